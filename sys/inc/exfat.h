@@ -0,0 +1,79 @@
+#ifndef EXFAT_H
+#define EXFAT_H
+
+/* The following is a subset of the exFAT file system specification */
+
+#define EXFAT_SIGN              "EXFAT   "
+#define EXFAT_REVISION          0x0100
+#define EXFAT_BOOT_SIGN         0xAA55
+#define EXFAT_EXT_BOOT_SIGN     0xAA550000
+
+#define EXFAT_BOOT_REGION_SECTORS   12
+#define EXFAT_CHECKSUM_SECTOR       11
+#define EXFAT_MIN_FAT_OFFSET        24
+#define EXFAT_FIRST_CLUSTER         2
+#define EXFAT_MAX_CLUSTERS          0xFFFFFFF5
+#define EXFAT_MAX_CLUSTER_SIZE      0x2000000
+
+#define EXFAT_FAT_MEDIA         0xFFFFFFF8
+#define EXFAT_FAT_EOC           0xFFFFFFFF
+
+#define EXFAT_TYPE_BITMAP       0x81
+#define EXFAT_TYPE_UPCASE       0x82
+#define EXFAT_TYPE_LABEL        0x83
+
+#define EXFAT_LABEL_LENGTH      11
+
+#pragma pack(push, 1)
+
+typedef struct _EXFAT_BOOT_SECTOR {
+    UCHAR       JumpBoot[3];
+    UCHAR       FileSystemName[8];
+    UCHAR       MustBeZero[53];
+    ULONGLONG   PartitionOffset;
+    ULONGLONG   VolumeLength;
+    ULONG       FatOffset;
+    ULONG       FatLength;
+    ULONG       ClusterHeapOffset;
+    ULONG       ClusterCount;
+    ULONG       FirstClusterOfRootDirectory;
+    ULONG       VolumeSerialNumber;
+    USHORT      FileSystemRevision;
+    USHORT      VolumeFlags;
+    UCHAR       BytesPerSectorShift;
+    UCHAR       SectorsPerClusterShift;
+    UCHAR       NumberOfFats;
+    UCHAR       DriveSelect;
+    UCHAR       PercentInUse;
+    UCHAR       Reserved[7];
+    UCHAR       BootCode[390];
+    USHORT      BootSignature;
+} EXFAT_BOOT_SECTOR, *PEXFAT_BOOT_SECTOR;
+
+typedef struct _EXFAT_LABEL_ENTRY {
+    UCHAR       EntryType;
+    UCHAR       CharacterCount;
+    WCHAR       VolumeLabel[EXFAT_LABEL_LENGTH];
+    UCHAR       Reserved[8];
+} EXFAT_LABEL_ENTRY, *PEXFAT_LABEL_ENTRY;
+
+typedef struct _EXFAT_BITMAP_ENTRY {
+    UCHAR       EntryType;
+    UCHAR       BitmapFlags;
+    UCHAR       Reserved[18];
+    ULONG       FirstCluster;
+    ULONGLONG   DataLength;
+} EXFAT_BITMAP_ENTRY, *PEXFAT_BITMAP_ENTRY;
+
+typedef struct _EXFAT_UPCASE_ENTRY {
+    UCHAR       EntryType;
+    UCHAR       Reserved1[3];
+    ULONG       TableChecksum;
+    UCHAR       Reserved2[12];
+    ULONG       FirstCluster;
+    ULONGLONG   DataLength;
+} EXFAT_UPCASE_ENTRY, *PEXFAT_UPCASE_ENTRY;
+
+#pragma pack(pop)
+
+#endif /* EXFAT_H */
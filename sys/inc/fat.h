@@ -66,8 +66,8 @@ struct msdos_boot_sector
   unsigned short fat_length;	/* sectors/FAT */
   unsigned short secs_track;	/* sectors per track */
   unsigned short heads;			/* number of heads */
-  unsigned long hidden;			/* hidden sectors (unused) */
-  unsigned long total_sect;		/* number of sectors (if sectors == 0) */
+  unsigned int hidden;				/* hidden sectors (unused) */
+  unsigned int total_sect;		/* number of sectors (if sectors == 0) */
   unsigned char drive_number;	/* BIOS drive number */
   unsigned char RESERVED;		/* Unused */
   unsigned char ext_boot_sign;	/* 0x29 if fields below exist (DOS 3.3+) */
@@ -84,7 +84,7 @@ struct msdos_dir_entry
     unsigned char attr;			/* attribute bits */
     char unused[10];
     unsigned short time, date, start;	/* time, date and first cluster */
-    unsigned long size;			/* file size (in bytes) */
+    unsigned int size;				/* file size (in bytes) */
   };
 
 #endif /* MKDOSFS_H */
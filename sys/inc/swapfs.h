@@ -20,23 +20,482 @@
 #ifndef SWAPFS_H
 #define SWAPFS_H
 
+#include "swapfsio.h"
+
 #define SWAPFS_POOL_TAG 'pawS'
 
+#define MAX_SWAP_DEVICES 10
+
+#define FORMAT_STATE_READY      0
+#define FORMAT_STATE_PENDING    1
+#define FORMAT_STATE_FAILED     2
+
+#define META_CACHE_FLUSH_INTERVAL   5000
+#define META_CACHE_FLUSH_BURST      0x10000
+
+#define FORMAT_PROFILE_DEFAULT          0
+#define FORMAT_PROFILE_LARGE_SEQUENTIAL 1
+#define FORMAT_PROFILE_MANY_SMALL_FILES 2
+
+#define FAT_TYPE_EXFAT                  64
+
+#define VOLUME_STAMP_SIGNATURE          "SwapFsV1"
+#define VOLUME_STAMP_OFFSET             0x200
+
+#define TRACE_BUFFER_MAXIMUM_SIZE       0x10000
+
+#define READ_AHEAD_MINIMUM_SIZE         0x40
+#define READ_AHEAD_MAXIMUM_SIZE         0x1000
+#define READ_AHEAD_STREAMS              4
+#define READ_AHEAD_BUFFERS              8
+#define READ_AHEAD_TRIGGER              2
+
+#define READ_AHEAD_FREE                 0
+#define READ_AHEAD_PENDING              1
+#define READ_AHEAD_VALID                2
+
+#define WRITE_COMBINE_MINIMUM_SIZE      0x40
+#define WRITE_COMBINE_MAXIMUM_SIZE      0x1000
+#define WRITE_COMBINE_SMALL_WRITE       0x10000
+#define WRITE_COMBINE_FLUSH_INTERVAL    20
+
+#define COMPRESS_MINIMUM_RATIO          100
+#define COMPRESS_MAXIMUM_RATIO          400
+#define COMPRESS_UNIT_SIZE              0x10000
+#define COMPRESS_BLOCK_SIZE             0x1000
+#define COMPRESS_CHUNK_SIZE             0x1000
+#define COMPRESS_FORMAT                 (COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD)
+
+/* the extent of a unit is the first block of it on the device and the number of blocks, 0 if not written */
+
+#define COMPRESS_EXTENT(Block, Count)   (((Block) << 5) | (Count))
+#define COMPRESS_EXTENT_BLOCK(Extent)   ((Extent) >> 5)
+#define COMPRESS_EXTENT_COUNT(Extent)   ((Extent) & 0x1f)
+#define COMPRESS_MAXIMUM_BLOCKS         0x8000000
+#define COMPRESS_MAXIMUM_UNITS          0x400000
+#define COMPRESS_THREADS                4
+
+#define RAM_TIER_MINIMUM_SIZE           0x400
+#define RAM_TIER_MAXIMUM_SIZE           0x400000
+#define RAM_TIER_BLOCK_SIZE             PAGE_SIZE
+#define RAM_TIER_MINIMUM_BLOCKS         0x100
+#define RAM_TIER_WRITE_BACK_BATCH       16
+#define RAM_TIER_INTERVAL               1000
+
+#define ZERO_ELISION_BLOCK_SIZE         0x1000
+
+#define DEDUP_MINIMUM_SIZE              0x40
+#define DEDUP_MAXIMUM_SIZE              0x4000
+#define DEDUP_BLOCK_SIZE                0x1000
+#define DEDUP_MAXIMUM_BLOCKS            0x400000
+#define DEDUP_ZERO_BLOCK                MAXULONG
+
+#define BLOCK_IO_QUEUE_DEPTH        16
+#define BLOCK_IO_DEFAULT_TRANSFER   0x10000
+#define BLOCK_IO_MAXIMUM_TRANSFER   0x100000
+#define BLOCK_IO_MAXIMUM_ALIGNMENT  0x100000
+#define STRIPE_MAXIMUM_SIZE         0x400
+
+typedef struct _BLOCK_IO_BATCH {
+    PDEVICE_OBJECT  DeviceObject;
+    KEVENT          Event;
+    KSEMAPHORE      Slots;
+    LONG            Outstanding;
+    NTSTATUS        Status;
+    ULONG           QueueDepth;
+    ULONG           MaximumTransferLength;
+    ULONG           AlignmentMask;
+} BLOCK_IO_BATCH, *PBLOCK_IO_BATCH;
+
+typedef struct _TRIM_INFORMATION {
+    ULONG           Granularity;
+    ULONG           AlignmentOffset;
+} TRIM_INFORMATION, *PTRIM_INFORMATION;
+
+typedef struct _ALIGNMENT_INFORMATION {
+    ULONG           Alignment;
+    ULONG           AlignmentOffset;
+} ALIGNMENT_INFORMATION, *PALIGNMENT_INFORMATION;
+
+typedef struct _FORMAT_LAYOUT {
+    ULONG           FatType;
+    ULONG           SectorSize;
+    ULONG           SectorsPerCluster;
+    ULONG           ReservedSectors;
+    ULONG           NumberOfFats;
+    ULONG           RootDirSectors;
+    ULONG           FatSectors;
+    ULONG           NumberOfClusters;
+} FORMAT_LAYOUT, *PFORMAT_LAYOUT;
+
+typedef struct _VOLUME_STAMP {
+    UCHAR           Signature[8];
+    ULONG           Generation;
+    ULONG           FileSystem;
+    ULONG           SectorSize;
+    ULONG           FatSector;
+    ULONG           MetaSectors;
+    ULONG           StripeSize;
+    ULONG           NumberOfMembers;
+    ULONG           FormatProfile;
+    ULONG           ClusterSize;
+    ULONG           Checksum;
+    LONGLONG        VolumeLength;
+} VOLUME_STAMP, *PVOLUME_STAMP;
+
+typedef struct _ZERO_FILL {
+    RTL_BITMAP      Bitmap;
+    KSPIN_LOCK      Lock;
+    ULONG           SectorSize;
+    LONGLONG        Length;
+} ZERO_FILL, *PZERO_FILL;
+
+typedef struct _META_CACHE {
+    PUCHAR          Buffer;
+    RTL_BITMAP      Dirty;
+    KSPIN_LOCK      Lock;
+    ULONG           SectorSize;
+    LONGLONG        Length;
+    FAST_MUTEX      FlushLock;
+    KTIMER          Timer;
+    KDPC            Dpc;
+    PIO_WORKITEM    FlushWorkItem;
+    LONG            FlushQueued;
+    BOOLEAN         ShutdownRegistered;
+} META_CACHE, *PMETA_CACHE;
+
+typedef struct _STRIPE {
+    ULONG           NumberOfMembers;
+    ULONG           StripeSize;
+    LONGLONG        MemberLength;
+    LONGLONG        Length;
+    PDEVICE_OBJECT  DeviceObject[MAX_SWAP_DEVICES];
+    PFILE_OBJECT    FileObject[MAX_SWAP_DEVICES];
+} STRIPE, *PSTRIPE;
+
+typedef struct _STRIPE_CONTEXT {
+    PIRP            Irp;
+    ULONG           Length;
+    LONG            Outstanding;
+    NTSTATUS        Status;
+} STRIPE_CONTEXT, *PSTRIPE_CONTEXT;
+
+typedef struct DECLSPEC_CACHEALIGN _IO_STATISTICS_SLOT {
+    LONG            InFlight;
+    LONGLONG        Requests[SWAPFS_OPERATIONS];
+    LONGLONG        Bytes[SWAPFS_OPERATIONS];
+    LONGLONG        Errors[SWAPFS_OPERATIONS];
+    LONGLONG        Latency[SWAPFS_OPERATIONS];
+    LONGLONG        Histogram[SWAPFS_OPERATIONS][SWAPFS_LATENCY_BUCKETS];
+} IO_STATISTICS_SLOT, *PIO_STATISTICS_SLOT;
+
+typedef struct _IO_STATISTICS {
+    PIO_STATISTICS_SLOT     Slots;
+    ULONG                   NumberOfSlots;
+    LONGLONG                Frequency;
+    LONGLONG                ResetTime;
+    NPAGED_LOOKASIDE_LIST   ContextList;
+} IO_STATISTICS, *PIO_STATISTICS;
+
+typedef struct _IO_STATISTICS_CONTEXT {
+    LONGLONG        StartTime;
+    LONG            Depth;
+} IO_STATISTICS_CONTEXT, *PIO_STATISTICS_CONTEXT;
+
+typedef struct _IO_TRACE {
+    PSWAPFS_TRACE_RECORD    Records;
+    LONGLONG                Mask;
+    LONGLONG                Head;
+    LONGLONG                Tail;
+    LONGLONG                Lost;
+    LONG                    InFlight;
+    LONGLONG                Frequency;
+    LONGLONG                StartCounter;
+    LONGLONG                StartTime;
+    FAST_MUTEX              Mutex;
+} IO_TRACE, *PIO_TRACE;
+
+typedef struct _READ_AHEAD_STREAM {
+    LONGLONG        NextOffset;
+    LONGLONG        AheadOffset;
+    ULONG           Sequential;
+    ULONG           Window;
+    ULONG           LastUse;
+} READ_AHEAD_STREAM, *PREAD_AHEAD_STREAM;
+
+typedef struct _READ_AHEAD_BUFFER {
+    struct _DEVICE_EXTENSION *DeviceExtension;
+    PUCHAR          Data;
+    ULONG           State;
+    ULONG           Generation;
+    ULONG           ReadGeneration;
+    ULONG           Stream;
+    LONGLONG        Offset;
+    ULONG           Length;
+    ULONG           Used;
+    ULONG           LastUse;
+} READ_AHEAD_BUFFER, *PREAD_AHEAD_BUFFER;
+
+typedef struct _READ_AHEAD {
+    KSPIN_LOCK          Lock;
+    ULONG               BufferSize;
+    ULONG               MaximumWindow;
+    ULONG               Clock;
+    READ_AHEAD_STREAM   Stream[READ_AHEAD_STREAMS];
+    READ_AHEAD_BUFFER   Buffer[READ_AHEAD_BUFFERS];
+    LONGLONG            Hits;
+    LONGLONG            Misses;
+    LONGLONG            Bytes;
+    LONGLONG            Wasted;
+} READ_AHEAD, *PREAD_AHEAD;
+
+typedef struct _WRITE_COMBINE {
+    KSPIN_LOCK      Lock;
+    PUCHAR          Buffer[2];
+    ULONG           Size;
+    ULONG           Staging;
+    LONGLONG        Offset;
+    ULONG           Length;
+    BOOLEAN         Flushing;
+    LONGLONG        FlushOffset;
+    ULONG           FlushLength;
+    NTSTATUS        Status;
+    LIST_ENTRY      WaitList;
+    KEVENT          FlushDone;
+    KTIMER          Timer;
+    KDPC            Dpc;
+} WRITE_COMBINE, *PWRITE_COMBINE;
+
+/* each thread has its own buffers for the unit it does */
+
+typedef struct _COMPRESS_WORKER {
+    struct _DEVICE_EXTENSION *DeviceExtension;
+    PUCHAR          Unit;
+    PUCHAR          Compressed;
+    PVOID           WorkSpace;
+    PVOID           Thread;
+} COMPRESS_WORKER, *PCOMPRESS_WORKER;
+
+typedef struct _COMPRESS {
+    LONGLONG        Length;
+    LONGLONG        Identity;
+    PULONG          Map;
+    RTL_BITMAP      Blocks;
+    RTL_BITMAP      Busy;
+    ULONG           Hint;
+    KSPIN_LOCK      UnitLock;
+    KEVENT          UnitDone;
+    KSPIN_LOCK      Lock;
+    LIST_ENTRY      Queue;
+    KSEMAPHORE      Queued;
+    COMPRESS_WORKER Worker[COMPRESS_THREADS];
+    BOOLEAN         Stop;
+} COMPRESS, *PCOMPRESS;
+
+typedef struct _RAM_TIER_BLOCK {
+    struct _DEVICE_EXTENSION *DeviceExtension;
+    LIST_ENTRY      HashEntry;
+    LIST_ENTRY      LruEntry;
+    LONGLONG        Offset;
+    PUCHAR          Data;
+    BOOLEAN         Dirty;
+    BOOLEAN         WriteBack;
+    NTSTATUS        Status;
+    ULONG           Pins;
+} RAM_TIER_BLOCK, *PRAM_TIER_BLOCK;
+
+/* the blocks a read sent down overlaps, pinned until it has copied them */
+
+typedef struct _RAM_TIER_READ {
+    struct _DEVICE_EXTENSION *DeviceExtension;
+    ULONG           NumberOfBlocks;
+    PRAM_TIER_BLOCK Block[1];
+} RAM_TIER_READ, *PRAM_TIER_READ;
+
+typedef struct _RAM_TIER {
+    KSPIN_LOCK      Lock;
+    PLIST_ENTRY     Hash;
+    ULONG           HashMask;
+    LIST_ENTRY      Lru;
+    ULONG           MaximumBlocks;
+    ULONG           Limit;
+    ULONG           NumberOfBlocks;
+    ULONG           DirtyBlocks;
+    NTSTATUS        Status;
+    FAST_MUTEX      WriteBackLock;
+    LONG            WriteBackPending;
+    KEVENT          WriteBackDone;
+    KEVENT          WakeEvent;
+    PKEVENT         LowMemory;
+    HANDLE          LowMemoryHandle;
+    PVOID           Thread;
+    BOOLEAN         Stop;
+    LONGLONG        Hits;
+    LONGLONG        Misses;
+    LONGLONG        Absorbed;
+    LONGLONG        WrittenBack;
+} RAM_TIER, *PRAM_TIER;
+
+typedef struct _ZERO_ELISION {
+    RTL_BITMAP      Bitmap;
+    RTL_BITMAP      Prefilling;
+    LIST_ENTRY      Waiting;
+    KSPIN_LOCK      Lock;
+    LONGLONG        Start;
+    PUCHAR          Zeros;
+    PMDL            ZerosMdl;
+    LONGLONG        Written;
+    LONGLONG        Elided;
+    LONGLONG        Read;
+} ZERO_ELISION, *PZERO_ELISION;
+
+typedef struct _ZERO_ELISION_CONTEXT {
+    LIST_ENTRY      ListEntry;
+    struct _DEVICE_EXTENSION *DeviceExtension;
+    PIRP            Irp;
+    UCHAR           MajorFunction;
+    LONGLONG        Offset;
+    ULONG           Length;
+    LONG            Pending;
+    NTSTATUS        Status;
+    ULONG           NumberOfBlocks;
+    ULONG           Block[2];
+} ZERO_ELISION_CONTEXT, *PZERO_ELISION_CONTEXT;
+
+/* the hash of a block written to the device and the block, it's checked against the block before it's used */
+
+typedef struct _DEDUP_INDEX_ENTRY {
+    ULONGLONG       Hash;
+    ULONG           Block;
+} DEDUP_INDEX_ENTRY, *PDEDUP_INDEX_ENTRY;
+
+typedef struct _DEDUP {
+    LONGLONG        Start;
+    ULONG           NumberOfBlocks;
+    PULONG          Map;
+    PULONG          References;
+    RTL_BITMAP      Used;
+    ULONG           Hint;
+    PDEDUP_INDEX_ENTRY Index;
+    ULONG           IndexMask;
+    PUCHAR          Block;
+    PUCHAR          Compare;
+    KSPIN_LOCK      Lock;
+    LIST_ENTRY      Queue;
+    KEVENT          QueueEvent;
+    PVOID           Thread;
+    BOOLEAN         Stop;
+    LONGLONG        Written;
+    LONGLONG        Duplicate;
+    LONGLONG        Collisions;
+} DEDUP, *PDEDUP;
+
+/* the time of the phases is counted in ticks of the performance counter */
+
+#define TIMELINE_PHASE_NONE     SWAPFS_PHASES
+
+typedef struct _BOOT_TIMELINE {
+    ULONG           DeviceNumber;
+    ULONG           Flags;
+    ULONG           Phase;
+    LONGLONG        Frequency;
+    LONGLONG        PhaseStart;
+    LONGLONG        Time[SWAPFS_PHASES];
+    LONGLONG        Requests[SWAPFS_PHASES];
+    LONGLONG        Bytes[SWAPFS_PHASES];
+    LONGLONG        SavedTime[SWAPFS_PHASES];
+    LONGLONG        SavedRequests[SWAPFS_PHASES];
+    LONGLONG        SavedBytes[SWAPFS_PHASES];
+} BOOT_TIMELINE, *PBOOT_TIMELINE;
+
 typedef struct _DEVICE_EXTENSION {
+    PDEVICE_OBJECT  DeviceObject;
     PDEVICE_OBJECT  TargetDeviceObject;
     KEVENT          PagingPathCountEvent;
     LONG            PagingPathCount;
+    ULONG           VirtualZeroFill;
+    ZERO_FILL       ZeroFill;
+    LONG            FormatState;
+    PIO_WORKITEM    FormatWorkItem;
+    KSPIN_LOCK      HeldIrpLock;
+    LIST_ENTRY      HeldIrpList;
+    ULONG           MetaCacheSize;
+    META_CACHE      MetaCache;
+    STRIPE          Stripe;
+    ULONG           FormatProfile;
+    ULONG           ClusterSize;
+    ULONG           ReuseVolume;
+    VOLUME_STAMP    Stamp;
+    LONG            ShutdownNotifications;
+    LONG            ShutdownCount;
+    IO_STATISTICS   Statistics;
+    IO_TRACE        Trace;
+    READ_AHEAD      ReadAhead;
+    WRITE_COMBINE   WriteCombine;
+    COMPRESS        Compress;
+    RAM_TIER        RamTier;
+    ZERO_ELISION    ZeroElision;
+    DEDUP           Dedup;
+    BOOT_TIMELINE   Timeline;
 } DEVICE_EXTENSION, *PDEVICE_EXTENSION;
 
+typedef struct _FIND_DEVICE_CONTEXT {
+    PDRIVER_OBJECT  DriverObject;
+    ULONG           DeviceNumber;
+    UNICODE_STRING  DeviceName;
+    ULONG           VirtualZeroFill;
+    ULONG           DeferredFormat;
+    ULONG           MetaCacheSize;
+    ULONG           StripeSize;
+    ULONG           FormatProfile;
+    ULONG           ClusterSize;
+    ULONG           ReuseVolume;
+    ULONG           TraceBufferSize;
+    ULONG           ReadAheadSize;
+    ULONG           WriteCombineSize;
+    ULONG           CompressionRatio;
+    ULONG           RamTierSize;
+    ULONG           ZeroBlockElision;
+    ULONG           DedupIndexSize;
+    ULONG           NumberOfMembers;
+    struct _FIND_DEVICE_CONTEXT *Members;
+    PVOID           Thread;
+    NTSTATUS        Status;
+    ULONGLONG       ElapsedTime;
+    LONGLONG        RegistryTime;
+} FIND_DEVICE_CONTEXT, *PFIND_DEVICE_CONTEXT;
+
 #ifdef _PREFAST_
 DRIVER_INITIALIZE DriverEntry;
-__drv_dispatchType(IRP_MJ_CREATE) __drv_dispatchType(IRP_MJ_CLOSE) __drv_dispatchType(IRP_MJ_FLUSH_BUFFERS) __drv_dispatchType(IRP_MJ_INTERNAL_DEVICE_CONTROL) __drv_dispatchType(IRP_MJ_SHUTDOWN) __drv_dispatchType(IRP_MJ_SYSTEM_CONTROL) DRIVER_DISPATCH SendIrpToNextDriver;
+KSTART_ROUTINE SwapFsAttachDeviceThread;
+RTL_QUERY_REGISTRY_ROUTINE SwapFsQueryFormatProfile;
+IO_WORKITEM_ROUTINE SwapFsFormatWorker;
+IO_WORKITEM_ROUTINE MetaCacheFlushWorker;
+KDEFERRED_ROUTINE MetaCacheTimerDpc;
+KDEFERRED_ROUTINE WriteCombineTimerDpc;
+KSTART_ROUTINE CompressThread;
+KSTART_ROUTINE RamTierThread;
+KSTART_ROUTINE DedupThread;
+__drv_dispatchType(IRP_MJ_CREATE) __drv_dispatchType(IRP_MJ_CLOSE) __drv_dispatchType(IRP_MJ_INTERNAL_DEVICE_CONTROL) __drv_dispatchType(IRP_MJ_SYSTEM_CONTROL) DRIVER_DISPATCH SendIrpToNextDriver;
 __drv_dispatchType(IRP_MJ_READ) __drv_dispatchType(IRP_MJ_WRITE) DRIVER_DISPATCH SwapFsReadWrite;
 __drv_dispatchType(IRP_MJ_DEVICE_CONTROL) DRIVER_DISPATCH SwapFsDeviceControl;
+__drv_dispatchType(IRP_MJ_FLUSH_BUFFERS) __drv_dispatchType(IRP_MJ_SHUTDOWN) DRIVER_DISPATCH SwapFsFlush;
 __drv_dispatchType(IRP_MJ_PNP) DRIVER_DISPATCH SwapFsPnp;
 __drv_dispatchType(IRP_MJ_POWER) DRIVER_DISPATCH SwapFsPower;
 IO_COMPLETION_ROUTINE DeviceControlCompletion;
 IO_COMPLETION_ROUTINE SynchronousCompletion;
+IO_COMPLETION_ROUTINE ZeroFillCompletion;
+IO_COMPLETION_ROUTINE MetaCacheCompletion;
+IO_COMPLETION_ROUTINE StripeCompletion;
+IO_COMPLETION_ROUTINE BlockIoBatchCompletion;
+IO_COMPLETION_ROUTINE StatsCompletion;
+IO_COMPLETION_ROUTINE ReadAheadCompletion;
+IO_COMPLETION_ROUTINE ReadAheadWriteCompletion;
+IO_COMPLETION_ROUTINE WriteCombineCompletion;
+IO_COMPLETION_ROUTINE RamTierReadCompletion;
+IO_COMPLETION_ROUTINE RamTierWriteBackCompletion;
+IO_COMPLETION_ROUTINE ZeroElisionPrefillCompletion;
+IO_COMPLETION_ROUTINE ZeroElisionCompletion;
 #endif // _PREFAST_
 
 NTSTATUS
@@ -47,9 +506,66 @@ DriverEntry (
 
 NTSTATUS
 SwapFsFindDevice (
-    IN PDRIVER_OBJECT   DriverObject,
-    IN PUNICODE_STRING  RegistryPath,
-    IN ULONG            DeviceNumber
+    IN PDRIVER_OBJECT           DriverObject,
+    IN PUNICODE_STRING          RegistryPath,
+    IN ULONG                    DeviceNumber,
+    OUT PFIND_DEVICE_CONTEXT    Context
+    );
+
+VOID
+SwapFsAttachDeviceThread (
+    IN PVOID Context
+    );
+
+NTSTATUS
+SwapFsQueryFormatProfile (
+    IN PWSTR    ValueName,
+    IN ULONG    ValueType,
+    IN PVOID    ValueData,
+    IN ULONG    ValueLength,
+    IN PVOID    Context,
+    IN PVOID    EntryContext
+    );
+
+VOID
+SwapFsLogError (
+    IN PVOID    IoObject,
+    IN NTSTATUS ErrorCode,
+    IN ULONG    UniqueValue,
+    IN PCWSTR   String
+    );
+
+NTSTATUS
+SwapFsAttachDevice (
+    IN PFIND_DEVICE_CONTEXT Context
+    );
+
+NTSTATUS
+SwapFsFormatDevice (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+SwapFsFormatWorker (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+SwapFsHoldIrp (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    );
+
+VOID
+SwapFsReleaseHeldIrps (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN NTSTATUS         FormatStatus
+    );
+
+BOOLEAN
+SwapFsIsQueryIoctl (
+    IN ULONG IoControlCode
     );
 
 NTSTATUS
@@ -71,6 +587,18 @@ DeviceControlCompletion (
     IN PVOID            Context
     );
 
+LONGLONG
+SwapFsVolumeLength (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             PartitionLength
+    );
+
+NTSTATUS
+SwapFsFlush (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    );
+
 NTSTATUS
 SwapFsDeviceControl (
     IN PDEVICE_OBJECT   DeviceObject,
@@ -109,12 +637,577 @@ IsDeviceLinuxSwap (
 
 NTSTATUS
 FormatDeviceToFat (
-    IN PDEVICE_OBJECT DeviceObject
+    IN PDEVICE_EXTENSION DeviceExtension
     );
 
 NTSTATUS
 FormatDeviceToFat32 (
-    IN PDEVICE_OBJECT DeviceObject
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+FormatDeviceToExFat (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+FormatLayoutPlan (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONGLONG            TotalSectors,
+    IN OUT PFORMAT_LAYOUT   Layout
+    );
+
+NTSTATUS
+ZeroFillInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                SectorSize,
+    IN ULONG                NumberOfSectors
+    );
+
+VOID
+ZeroFillRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+ZeroFillMarkWritten (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length
+    );
+
+VOID
+ZeroFillUpdate (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    );
+
+NTSTATUS
+ZeroFillCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+ZeroFillReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    );
+
+NTSTATUS
+MetaCacheInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                SectorSize,
+    IN ULONG                NumberOfSectors
+    );
+
+VOID
+MetaCacheRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+MetaCacheLoad (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                SectorSize,
+    IN ULONG                NumberOfSectors
+    );
+
+VOID
+MetaCacheUpdate (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length,
+    IN PVOID                Buffer
+    );
+
+NTSTATUS
+MetaCacheFlush (
+    IN PDEVICE_EXTENSION    DeviceExtension
+    );
+
+VOID
+MetaCacheTimerDpc (
+    IN PKDPC    Dpc,
+    IN PVOID    DeferredContext,
+    IN PVOID    SystemArgument1,
+    IN PVOID    SystemArgument2
+    );
+
+VOID
+MetaCacheFlushWorker (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+MetaCacheCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+MetaCacheReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    );
+
+NTSTATUS
+StripeInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PFIND_DEVICE_CONTEXT Context
+    );
+
+VOID
+StripeRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+ULONG
+StripeMapOffset (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length,
+    OUT PDEVICE_OBJECT*     DeviceObject,
+    OUT PLARGE_INTEGER      DeviceOffset
+    );
+
+NTSTATUS
+StripeRead (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length,
+    OUT PVOID               Buffer
+    );
+
+NTSTATUS
+StripeWrite (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length,
+    IN PVOID                Buffer
+    );
+
+NTSTATUS
+StripeFlush (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN UCHAR                MajorFunction
+    );
+
+VOID
+StripeDereference (
+    IN PSTRIPE_CONTEXT Context
+    );
+
+NTSTATUS
+StripeCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+StripeCallDriver (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    );
+
+NTSTATUS
+StripeCallDevice (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    );
+
+NTSTATUS
+StripeCallMembers (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    );
+
+VOID
+StampRecord (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                FileSystem,
+    IN ULONG                SectorSize,
+    IN ULONG                FatSector,
+    IN ULONG                MetaSectors,
+    IN LONGLONG             VolumeLength
+    );
+
+NTSTATUS
+StampCheck (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+StampVolume (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+StatsInitialize (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+StatsRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+BOOLEAN
+StatsStart (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    );
+
+NTSTATUS
+StatsCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+StatsQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    );
+
+NTSTATUS
+TraceInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                TraceBufferSize
+    );
+
+VOID
+TraceRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+TraceRecord (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp,
+    IN LONGLONG             StartTime,
+    IN LONGLONG             Latency,
+    IN LONG                 Depth
+    );
+
+NTSTATUS
+TraceDrain (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    );
+
+NTSTATUS
+ReadAheadInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                ReadAheadSize
+    );
+
+VOID
+ReadAheadRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+ReadAheadCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+ReadAheadWriteCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+ReadAheadReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    );
+
+VOID
+ReadAheadQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    OUT PSWAPFS_STATISTICS  Statistics,
+    IN BOOLEAN              Reset
+    );
+
+NTSTATUS
+WriteCombineInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                WriteCombineSize
+    );
+
+VOID
+WriteCombineRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+WriteCombineTimerDpc (
+    IN PKDPC    Dpc,
+    IN PVOID    DeferredContext,
+    IN PVOID    SystemArgument1,
+    IN PVOID    SystemArgument2
+    );
+
+NTSTATUS
+WriteCombineCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+WriteCombineReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    );
+
+NTSTATUS
+WriteCombineFlush (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN BOOLEAN              Wait
+    );
+
+NTSTATUS
+CompressInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                CompressionRatio
+    );
+
+VOID
+CompressRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+CompressStart (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+CompressCallDriver (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    );
+
+VOID
+CompressThread (
+    IN PVOID Context
+    );
+
+NTSTATUS
+RamTierInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                RamTierSize
+    );
+
+VOID
+RamTierRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+RamTierReadCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+RamTierWriteBackCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+RamTierReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    );
+
+NTSTATUS
+RamTierFlush (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+RamTierThread (
+    IN PVOID Context
+    );
+
+VOID
+RamTierQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    OUT PSWAPFS_STATISTICS  Statistics,
+    IN BOOLEAN              Reset
+    );
+
+NTSTATUS
+ZeroElisionInitialize (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+ZeroElisionRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+ZeroElisionStart (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+ZeroElisionPrefillCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+ZeroElisionCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+ZeroElisionCallDriver (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    );
+
+VOID
+ZeroElisionQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    OUT PSWAPFS_STATISTICS  Statistics,
+    IN BOOLEAN              Reset
+    );
+
+NTSTATUS
+DedupInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                DedupIndexSize
+    );
+
+VOID
+DedupRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+VOID
+DedupStart (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+NTSTATUS
+DedupCallDriver (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    );
+
+VOID
+DedupThread (
+    IN PVOID Context
+    );
+
+VOID
+DedupQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    OUT PSWAPFS_STATISTICS  Statistics,
+    IN BOOLEAN              Reset
+    );
+
+VOID
+TimelineInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                DeviceNumber,
+    IN LONGLONG             RegistryTime
+    );
+
+VOID
+TimelineBegin (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                Phase
+    );
+
+VOID
+TimelineTransfer (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Bytes
+    );
+
+VOID
+TimelineAttempt (
+    IN PDEVICE_EXTENSION    DeviceExtension
+    );
+
+VOID
+TimelineFallback (
+    IN PDEVICE_EXTENSION    DeviceExtension
+    );
+
+VOID
+TimelineSave (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN NTSTATUS             Status
+    );
+
+NTSTATUS
+EtwRegister (
+    VOID
+    );
+
+VOID
+EtwUnregister (
+    VOID
+    );
+
+VOID
+EtwReadWriteDispatch (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    );
+
+VOID
+EtwReadWriteComplete (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN LONGLONG         Latency
+    );
+
+VOID
+EtwLengthFixup (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            IoControlCode,
+    IN LONGLONG         PartitionLength,
+    IN LONGLONG         VolumeLength
+    );
+
+VOID
+EtwPagingPath (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN BOOLEAN          InPath,
+    IN LONG             PagingPathCount,
+    IN NTSTATUS         Status
+    );
+
+VOID
+EtwFormatPhase (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PCSTR                Phase,
+    IN ULONG                Sector,
+    IN ULONG                NumberOfSectors
     );
 
 NTSTATUS
@@ -133,6 +1226,12 @@ WriteBlockDevice (
     IN PVOID            Buffer
     );
 
+NTSTATUS
+FlushBlockDevice (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN UCHAR            MajorFunction
+    );
+
 NTSTATUS 
 BlockDeviceIoControl (
     IN PDEVICE_OBJECT   DeviceObject,
@@ -143,4 +1242,51 @@ BlockDeviceIoControl (
     IN OUT PULONG       OutputBufferSize
     );
 
+NTSTATUS
+BlockIoBatchInitialize (
+    OUT PBLOCK_IO_BATCH BlockIoBatch,
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            QueueDepth
+    );
+
+NTSTATUS
+BlockIoBatchCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+NTSTATUS
+BlockIoBatchWrite (
+    IN PBLOCK_IO_BATCH  BlockIoBatch,
+    IN PLARGE_INTEGER   Offset,
+    IN ULONG            Length,
+    IN PVOID            Buffer
+    );
+
+NTSTATUS
+BlockIoBatchWait (
+    IN PBLOCK_IO_BATCH  BlockIoBatch
+    );
+
+NTSTATUS
+BlockDeviceQueryTrim (
+    IN PDEVICE_OBJECT       DeviceObject,
+    OUT PTRIM_INFORMATION   TrimInformation
+    );
+
+NTSTATUS
+TrimBlockDevice (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PLARGE_INTEGER   Offset,
+    IN LONGLONG         Length,
+    IN ULONG            SectorSize
+    );
+
+NTSTATUS
+BlockDeviceQueryAlignment (
+    IN PDEVICE_OBJECT           DeviceObject,
+    OUT PALIGNMENT_INFORMATION  AlignmentInformation
+    );
+
 #endif /* SWAPFS_H */
@@ -0,0 +1,39 @@
+/*
+    This is a disk filter driver for Windows that uses a Linux swap partition
+    to provide a temporary storage area formated to the FAT file system.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SWAPFSETW_H
+#define SWAPFSETW_H
+
+#include <TraceLoggingProvider.h>
+
+/* The ETW provider is named SwapFs and has the GUID of the name, so it can be enabled as *SwapFs */
+
+#define SWAPFS_KEYWORD_READ_WRITE   0x0000000000000001
+#define SWAPFS_KEYWORD_IOCTL        0x0000000000000002
+#define SWAPFS_KEYWORD_PNP          0x0000000000000004
+#define SWAPFS_KEYWORD_FORMAT       0x0000000000000008
+
+TRACELOGGING_DECLARE_PROVIDER(SwapFsTraceProvider);
+
+/* checked where the events are written so the payload is not collected when no session wants it */
+
+#define SwapFsEtwEnabled(Level, Keyword) \
+    TraceLoggingProviderEnabled(SwapFsTraceProvider, Level, Keyword)
+
+#endif /* SWAPFSETW_H */
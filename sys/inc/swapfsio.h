@@ -0,0 +1,155 @@
+/*
+    This is a disk filter driver for Windows that uses a Linux swap partition
+    to provide a temporary storage area formated to the FAT file system.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SWAPFSIO_H
+#define SWAPFSIO_H
+
+/* Private device controls of the driver, sent to the swap partition or to the volume on it */
+
+#define IOCTL_SWAPFS_QUERY_STATISTICS   CTL_CODE(FILE_DEVICE_DISK, 0x0800, METHOD_BUFFERED, FILE_READ_ACCESS)
+#define IOCTL_SWAPFS_DRAIN_TRACE        CTL_CODE(FILE_DEVICE_DISK, 0x0801, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+#define SWAPFS_STATISTICS_VERSION       7
+
+/* set in the optional input buffer to reset the counters after they are returned */
+
+#define SWAPFS_STATISTICS_RESET         0x00000001
+
+#define SWAPFS_OPERATION_READ           0
+#define SWAPFS_OPERATION_WRITE          1
+#define SWAPFS_OPERATIONS               2
+
+/* bucket 0 counts requests done in less than one microsecond and bucket N
+   those done in 2^(N-1) to 2^N microseconds, the last bucket has the rest */
+
+#define SWAPFS_LATENCY_BUCKETS          32
+
+typedef struct _SWAPFS_OPERATION_STATISTICS {
+    ULONGLONG       Requests;
+    ULONGLONG       Bytes;
+    ULONGLONG       Errors;
+    ULONGLONG       TotalLatency;
+    ULONGLONG       Histogram[SWAPFS_LATENCY_BUCKETS];
+} SWAPFS_OPERATION_STATISTICS, *PSWAPFS_OPERATION_STATISTICS;
+
+/* with ReadAheadSize the reads completed from the read-ahead buffers are hits and
+   the other reads of the data region misses, the bytes read ahead that were never
+   read before their buffer was reused are wasted. With RamTierSize the reads completed
+   from the RAM tier are hits and the other reads of the data region misses, the bytes
+   of the writes kept in it are absorbed and the bytes written to the device written back.
+   With ZeroBlockElision the bytes of the writes of the data region sent to the device are
+   written, those of only zeros that were not are elided and those of the reads of only
+   zeros that were completed from memory are read. With DedupIndexSize the bytes of the
+   blocks written to the device are written, those of the blocks found to be the same as
+   a block on the device are duplicate and a hash that was the same for another block is
+   a collision */
+
+typedef struct _SWAPFS_STATISTICS {
+    ULONG           Version;
+    LONG            InFlight;
+    ULONGLONG       Interval;
+    SWAPFS_OPERATION_STATISTICS Operation[SWAPFS_OPERATIONS];
+    ULONGLONG       ReadAheadHits;
+    ULONGLONG       ReadAheadMisses;
+    ULONGLONG       ReadAheadBytes;
+    ULONGLONG       ReadAheadWasted;
+    ULONGLONG       RamTierHits;
+    ULONGLONG       RamTierMisses;
+    ULONGLONG       RamTierAbsorbed;
+    ULONGLONG       RamTierWrittenBack;
+    ULONGLONG       ZeroElisionWritten;
+    ULONGLONG       ZeroElisionElided;
+    ULONGLONG       ZeroElisionRead;
+    ULONGLONG       DedupWritten;
+    ULONGLONG       DedupDuplicate;
+    ULONGLONG       DedupCollisions;
+} SWAPFS_STATISTICS, *PSWAPFS_STATISTICS;
+
+typedef struct _SWAPFS_STATISTICS_REQUEST {
+    ULONG           Flags;
+} SWAPFS_STATISTICS_REQUEST, *PSWAPFS_STATISTICS_REQUEST;
+
+/* The time and the bytes of each phase of the boot are written to BootTimeline and
+   BootTimeline1 to BootTimelineN in the Parameters key, like SwapDevice and SwapDeviceN */
+
+#define SWAPFS_TIMELINE_VERSION         1
+
+#define SWAPFS_PHASE_REGISTRY           0
+#define SWAPFS_PHASE_ATTACH             1
+#define SWAPFS_PHASE_PROBE              2
+#define SWAPFS_PHASE_GEOMETRY           3
+#define SWAPFS_PHASE_ZERO               4
+#define SWAPFS_PHASE_METADATA           5
+#define SWAPFS_PHASE_FALLBACK           6
+#define SWAPFS_PHASES                   7
+
+#define SWAPFS_TIMELINE_DEFERRED        0x00000001
+#define SWAPFS_TIMELINE_REUSED          0x00000002
+
+/* the time is in microseconds, the fallback phase has the formats that failed, a
+   trim or a write of zeros is one request with the bytes it cleared */
+
+typedef struct _SWAPFS_TIMELINE_PHASE {
+    ULONGLONG       Time;
+    ULONGLONG       Requests;
+    ULONGLONG       Bytes;
+} SWAPFS_TIMELINE_PHASE, *PSWAPFS_TIMELINE_PHASE;
+
+typedef struct _SWAPFS_TIMELINE {
+    ULONG           Version;
+    LONG            Status;
+    ULONG           FileSystem;
+    ULONG           Flags;
+    SWAPFS_TIMELINE_PHASE Phase[SWAPFS_PHASES];
+} SWAPFS_TIMELINE, *PSWAPFS_TIMELINE;
+
+/* With TraceBufferSize the reads, writes, flushes and shutdowns are recorded in a ring
+   buffer that IOCTL_SWAPFS_DRAIN_TRACE returns as a SWAPFS_TRACE followed by the records
+   not returned before, as many as fits in the output buffer and oldest first */
+
+#define SWAPFS_TRACE_VERSION            1
+
+/* Operation is the major function of the request, Offset is the offset on the swap
+   partition after the swap header, the time is in microseconds from StartTime and
+   Depth is the number of traced requests in flight when it started, itself included,
+   so a replay can be paced and queued as the recorded requests were */
+
+typedef struct _SWAPFS_TRACE_RECORD {
+    LONGLONG        Sequence;
+    LONGLONG        Timestamp;
+    LONGLONG        Offset;
+    ULONG           Length;
+    LONG            Status;
+    ULONG           Latency;
+    UCHAR           Operation;
+    UCHAR           Reserved;
+    USHORT          Depth;
+} SWAPFS_TRACE_RECORD, *PSWAPFS_TRACE_RECORD;
+
+/* Lost counts the records overwritten before they were drained */
+
+typedef struct _SWAPFS_TRACE {
+    ULONG           Version;
+    ULONG           NumberOfRecords;
+    ULONGLONG       Lost;
+    LONGLONG        StartTime;
+    SWAPFS_TRACE_RECORD Record[1];
+} SWAPFS_TRACE, *PSWAPFS_TRACE;
+
+#endif /* SWAPFSIO_H */
@@ -1,5 +1,5 @@
 /*
-    Functions for synchronous read, write and ioctl on a device.
+    Functions for synchronous and batched read, write and ioctl on a device.
     Copyright (C) 1999-2015 Bo Brantn.
 
     This program is free software: you can redistribute it and/or modify
@@ -17,12 +17,19 @@
 */
 
 #include <ntddk.h>
+#include <ntdddisk.h>
 #include "swapfs.h"
 
+/* ReadBlockDevice and WriteBlockDevice are not pageable since they are used at last chance shutdown */
+
 #ifdef ALLOC_PRAGMA
-#pragma alloc_text("INIT", ReadBlockDevice)
-#pragma alloc_text("INIT", WriteBlockDevice)
-#pragma alloc_text("INIT", BlockDeviceIoControl)
+#pragma alloc_text("PAGE", BlockDeviceIoControl)
+#pragma alloc_text("PAGE", BlockIoBatchInitialize)
+#pragma alloc_text("PAGE", BlockIoBatchWrite)
+#pragma alloc_text("PAGE", BlockIoBatchWait)
+#pragma alloc_text("PAGE", BlockDeviceQueryTrim)
+#pragma alloc_text("PAGE", TrimBlockDevice)
+#pragma alloc_text("PAGE", BlockDeviceQueryAlignment)
 #endif // ALLOC_PRAGMA
 
 NTSTATUS
@@ -127,6 +134,55 @@ WriteBlockDevice (
     return Status;
 }
 
+/* MajorFunction is IRP_MJ_FLUSH_BUFFERS or IRP_MJ_SHUTDOWN */
+
+NTSTATUS
+FlushBlockDevice (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN UCHAR            MajorFunction
+    )
+{
+    KEVENT          Event;
+    PIRP            Irp;
+    IO_STATUS_BLOCK IoStatus;
+    NTSTATUS        Status;
+
+    ASSERT(DeviceObject != NULL);
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+
+    Irp = IoBuildSynchronousFsdRequest(
+        MajorFunction,
+        DeviceObject,
+        NULL,
+        0,
+        NULL,
+        &Event,
+        &IoStatus
+        );
+
+    if (!Irp)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Status = IoCallDriver(DeviceObject, Irp);
+
+    if (Status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(
+            &Event,
+            Executive,
+            KernelMode,
+            FALSE,
+            NULL
+            );
+        Status = IoStatus.Status;
+    }
+
+    return Status;
+}
+
 NTSTATUS 
 BlockDeviceIoControl (
     IN PDEVICE_OBJECT   DeviceObject,
@@ -190,3 +246,584 @@ BlockDeviceIoControl (
 
     return Status;
 }
+
+/*
+    A batch keeps up to QueueDepth asynchronous requests in flight to the
+    device, the transfer size is taken from what the storage adapter reports.
+    The buffers given to BlockIoBatchWrite must stay valid until
+    BlockIoBatchWait has returned and be aligned as the adapter requires,
+    since the transfers are split at multiples of the page size a buffer
+    that is aligned gives transfers that are aligned.
+*/
+
+NTSTATUS
+BlockIoBatchInitialize (
+    OUT PBLOCK_IO_BATCH BlockIoBatch,
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            QueueDepth
+    )
+{
+    STORAGE_PROPERTY_QUERY      Query;
+    STORAGE_ADAPTER_DESCRIPTOR  Adapter;
+    ULONG                       Size;
+    ULONG                       MaximumTransferLength;
+    NTSTATUS                    Status;
+
+    ASSERT(BlockIoBatch != NULL);
+    ASSERT(DeviceObject != NULL);
+    ASSERT(QueueDepth != 0);
+
+    RtlZeroMemory(BlockIoBatch, sizeof(BLOCK_IO_BATCH));
+
+    BlockIoBatch->DeviceObject = DeviceObject;
+    BlockIoBatch->QueueDepth = QueueDepth;
+    BlockIoBatch->Status = STATUS_SUCCESS;
+
+    /* the batch itself holds one reference until BlockIoBatchWait */
+
+    BlockIoBatch->Outstanding = 1;
+
+    KeInitializeEvent(&BlockIoBatch->Event, NotificationEvent, FALSE);
+
+    KeInitializeSemaphore(&BlockIoBatch->Slots, QueueDepth, QueueDepth);
+
+    MaximumTransferLength = BLOCK_IO_DEFAULT_TRANSFER;
+
+    RtlZeroMemory(&Query, sizeof(Query));
+
+    Query.PropertyId = StorageAdapterProperty;
+    Query.QueryType = PropertyStandardQuery;
+
+    Size = sizeof(Adapter);
+
+    Status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_STORAGE_QUERY_PROPERTY,
+        &Query,
+        sizeof(Query),
+        &Adapter,
+        &Size
+        );
+
+    if (NT_SUCCESS(Status) && Size >= sizeof(Adapter))
+    {
+        MaximumTransferLength = Adapter.MaximumTransferLength;
+
+        /* the first and last page of a transfer can be partial */
+
+        if (Adapter.MaximumPhysicalPages > 1 &&
+            Adapter.MaximumPhysicalPages - 1 < MaximumTransferLength / PAGE_SIZE)
+        {
+            MaximumTransferLength = (Adapter.MaximumPhysicalPages - 1) * PAGE_SIZE;
+        }
+
+        BlockIoBatch->AlignmentMask = Adapter.AlignmentMask;
+    }
+
+    MaximumTransferLength = min(MaximumTransferLength, BLOCK_IO_MAXIMUM_TRANSFER);
+
+    MaximumTransferLength &= ~(PAGE_SIZE - 1);
+
+    if (!MaximumTransferLength)
+    {
+        MaximumTransferLength = PAGE_SIZE;
+    }
+
+    BlockIoBatch->MaximumTransferLength = MaximumTransferLength;
+
+    KdPrint(("SwapFs: Block I/O batch of %u requests of %u bytes.\n",
+        QueueDepth, MaximumTransferLength));
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+BlockIoBatchCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PBLOCK_IO_BATCH BlockIoBatch;
+    PMDL            Mdl;
+    PMDL            NextMdl;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    BlockIoBatch = (PBLOCK_IO_BATCH) Context;
+
+    if (!NT_SUCCESS(Irp->IoStatus.Status))
+    {
+        InterlockedCompareExchange(&BlockIoBatch->Status, Irp->IoStatus.Status, STATUS_SUCCESS);
+    }
+
+    /* the IRP was built by IoBuildAsynchronousFsdRequest so we free it ourselves */
+
+    for (Mdl = Irp->MdlAddress; Mdl != NULL; Mdl = NextMdl)
+    {
+        NextMdl = Mdl->Next;
+        MmUnlockPages(Mdl);
+        IoFreeMdl(Mdl);
+    }
+
+    Irp->MdlAddress = NULL;
+
+    if (Irp->Flags & IRP_DEALLOCATE_BUFFER)
+    {
+        ExFreePool(Irp->AssociatedIrp.SystemBuffer);
+    }
+
+    IoFreeIrp(Irp);
+
+    KeReleaseSemaphore(&BlockIoBatch->Slots, IO_NO_INCREMENT, 1, FALSE);
+
+    if (InterlockedDecrement(&BlockIoBatch->Outstanding) == 0)
+    {
+        KeSetEvent(&BlockIoBatch->Event, IO_NO_INCREMENT, FALSE);
+    }
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+NTSTATUS
+BlockIoBatchWrite (
+    IN PBLOCK_IO_BATCH  BlockIoBatch,
+    IN PLARGE_INTEGER   Offset,
+    IN ULONG            Length,
+    IN PVOID            Buffer
+    )
+{
+    LARGE_INTEGER   TransferOffset;
+    ULONG           TransferLength;
+    PUCHAR          TransferBuffer;
+    PIRP            Irp;
+
+    ASSERT(BlockIoBatch != NULL);
+    ASSERT(Offset != NULL);
+    ASSERT(Buffer != NULL);
+
+    /* the adapter can't do a transfer from a buffer it isn't aligned for */
+
+    if ((ULONG_PTR) Buffer & BlockIoBatch->AlignmentMask)
+    {
+        KdPrint(("SwapFs: Buffer %p is not aligned to the adapter mask 0x%x.\n",
+            Buffer, BlockIoBatch->AlignmentMask));
+
+        return STATUS_DATATYPE_MISALIGNMENT;
+    }
+
+    TransferOffset.QuadPart = Offset->QuadPart;
+    TransferBuffer = (PUCHAR) Buffer;
+
+    while (Length)
+    {
+        /* stop issuing more requests once one has failed */
+
+        if (!NT_SUCCESS(BlockIoBatch->Status))
+        {
+            return BlockIoBatch->Status;
+        }
+
+        TransferLength = min(Length, BlockIoBatch->MaximumTransferLength);
+
+        KeWaitForSingleObject(
+            &BlockIoBatch->Slots,
+            Executive,
+            KernelMode,
+            FALSE,
+            NULL
+            );
+
+        Irp = IoBuildAsynchronousFsdRequest(
+            IRP_MJ_WRITE,
+            BlockIoBatch->DeviceObject,
+            TransferBuffer,
+            TransferLength,
+            &TransferOffset,
+            NULL
+            );
+
+        if (!Irp)
+        {
+            KeReleaseSemaphore(&BlockIoBatch->Slots, IO_NO_INCREMENT, 1, FALSE);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        IoSetCompletionRoutine(
+            Irp,
+            BlockIoBatchCompletion,
+            BlockIoBatch,
+            TRUE,
+            TRUE,
+            TRUE
+            );
+
+        InterlockedIncrement(&BlockIoBatch->Outstanding);
+
+        IoCallDriver(BlockIoBatch->DeviceObject, Irp);
+
+        TransferOffset.QuadPart += TransferLength;
+        TransferBuffer += TransferLength;
+        Length -= TransferLength;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+BlockIoBatchWait (
+    IN PBLOCK_IO_BATCH  BlockIoBatch
+    )
+{
+    ASSERT(BlockIoBatch != NULL);
+
+    if (InterlockedDecrement(&BlockIoBatch->Outstanding) != 0)
+    {
+        KeWaitForSingleObject(
+            &BlockIoBatch->Event,
+            Executive,
+            KernelMode,
+            FALSE,
+            NULL
+            );
+    }
+
+    return BlockIoBatch->Status;
+}
+
+/*
+    Zeroing by TRIM is only used on devices that reports that unmapped blocks
+    are read back as zeros, parts of the range that are not aligned to the
+    unmap granularity are written with zeros.
+*/
+
+NTSTATUS
+BlockDeviceQueryTrim (
+    IN PDEVICE_OBJECT       DeviceObject,
+    OUT PTRIM_INFORMATION   TrimInformation
+    )
+{
+    STORAGE_PROPERTY_QUERY              Query;
+    DEVICE_TRIM_DESCRIPTOR              Trim;
+    DEVICE_LB_PROVISIONING_DESCRIPTOR   Provisioning;
+    PARTITION_INFORMATION_EX            Partition;
+    ULONG                               Size;
+    NTSTATUS                            Status;
+
+    ASSERT(DeviceObject != NULL);
+    ASSERT(TrimInformation != NULL);
+
+    RtlZeroMemory(TrimInformation, sizeof(TRIM_INFORMATION));
+
+    RtlZeroMemory(&Query, sizeof(Query));
+
+    Query.PropertyId = StorageDeviceTrimProperty;
+    Query.QueryType = PropertyStandardQuery;
+
+    Size = sizeof(Trim);
+
+    Status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_STORAGE_QUERY_PROPERTY,
+        &Query,
+        sizeof(Query),
+        &Trim,
+        &Size
+        );
+
+    if (!NT_SUCCESS(Status) || Size < sizeof(Trim) || !Trim.TrimEnabled)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    Query.PropertyId = StorageDeviceLBProvisioningProperty;
+
+    Size = sizeof(Provisioning);
+
+    Status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_STORAGE_QUERY_PROPERTY,
+        &Query,
+        sizeof(Query),
+        &Provisioning,
+        &Size
+        );
+
+    if (!NT_SUCCESS(Status) ||
+        Size < FIELD_OFFSET(DEVICE_LB_PROVISIONING_DESCRIPTOR, MaxUnmapLbaCount) ||
+        !Provisioning.ThinProvisioningReadZeros)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (Provisioning.OptimalUnmapGranularity == 0 ||
+        Provisioning.OptimalUnmapGranularity > BLOCK_IO_MAXIMUM_TRANSFER)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    /* the unmap granularity alignment is relative to the start of the disk */
+
+    Size = sizeof(Partition);
+
+    Status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_GET_PARTITION_INFO_EX,
+        NULL,
+        0,
+        &Partition,
+        &Size
+        );
+
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    TrimInformation->Granularity = (ULONG) Provisioning.OptimalUnmapGranularity;
+
+    if (Provisioning.UnmapGranularityAlignmentValid)
+    {
+        TrimInformation->AlignmentOffset = (ULONG)
+            ((Provisioning.UnmapGranularityAlignment + TrimInformation->Granularity -
+              Partition.StartingOffset.QuadPart % TrimInformation->Granularity) %
+             TrimInformation->Granularity);
+    }
+    else
+    {
+        TrimInformation->AlignmentOffset = (ULONG)
+            ((TrimInformation->Granularity -
+              Partition.StartingOffset.QuadPart % TrimInformation->Granularity) %
+             TrimInformation->Granularity);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+TrimBlockDevice (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PLARGE_INTEGER   Offset,
+    IN LONGLONG         Length,
+    IN ULONG            SectorSize
+    )
+{
+    TRIM_INFORMATION    TrimInformation;
+    struct {
+        DEVICE_MANAGE_DATA_SET_ATTRIBUTES   Attributes;
+        DEVICE_DATA_SET_RANGE               Range;
+    }                   Dsm;
+    LONGLONG            Start;
+    LONGLONG            End;
+    LARGE_INTEGER       WriteOffset;
+    PUCHAR              Buffer;
+    ULONG               n;
+    NTSTATUS            Status;
+
+    ASSERT(DeviceObject != NULL);
+    ASSERT(Offset != NULL);
+    ASSERT(SectorSize != 0);
+
+    Status = BlockDeviceQueryTrim(DeviceObject, &TrimInformation);
+
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    Start = Offset->QuadPart - TrimInformation.AlignmentOffset;
+    Start = (Start + TrimInformation.Granularity - 1) / TrimInformation.Granularity *
+        TrimInformation.Granularity + TrimInformation.AlignmentOffset;
+
+    End = Offset->QuadPart + Length - TrimInformation.AlignmentOffset;
+    End = End / TrimInformation.Granularity *
+        TrimInformation.Granularity + TrimInformation.AlignmentOffset;
+
+    if (Start < Offset->QuadPart || End <= Start || (Start | End) % SectorSize)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    RtlZeroMemory(&Dsm, sizeof(Dsm));
+
+    Dsm.Attributes.Size = sizeof(DEVICE_MANAGE_DATA_SET_ATTRIBUTES);
+    Dsm.Attributes.Action = DeviceDsmAction_Trim;
+    Dsm.Attributes.DataSetRangesOffset = (ULONG) ((PUCHAR) &Dsm.Range - (PUCHAR) &Dsm);
+    Dsm.Attributes.DataSetRangesLength = sizeof(DEVICE_DATA_SET_RANGE);
+    Dsm.Range.StartingOffset = Start;
+    Dsm.Range.LengthInBytes = End - Start;
+
+    Status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES,
+        &Dsm,
+        sizeof(Dsm),
+        NULL,
+        NULL
+        );
+
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    Buffer = (PUCHAR) ExAllocatePoolWithTag(PagedPool, TrimInformation.Granularity, SWAPFS_POOL_TAG);
+
+    if (!Buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* a device is allowed to ignore an unmap so check that it reads back as zero */
+
+    WriteOffset.QuadPart = Start;
+
+    Status = ReadBlockDevice(DeviceObject, &WriteOffset, SectorSize, Buffer);
+
+    for (n = 0; NT_SUCCESS(Status) && n < SectorSize; n++)
+    {
+        if (Buffer[n])
+        {
+            Status = STATUS_NOT_SUPPORTED;
+        }
+    }
+
+    RtlZeroMemory(Buffer, TrimInformation.Granularity);
+
+    /* write zeros before and after the part that was trimmed */
+
+    if (NT_SUCCESS(Status) && Start > Offset->QuadPart)
+    {
+        WriteOffset.QuadPart = Offset->QuadPart;
+
+        Status = WriteBlockDevice(
+            DeviceObject,
+            &WriteOffset,
+            (ULONG) (Start - Offset->QuadPart),
+            Buffer
+            );
+    }
+
+    if (NT_SUCCESS(Status) && Offset->QuadPart + Length > End)
+    {
+        WriteOffset.QuadPart = End;
+
+        Status = WriteBlockDevice(
+            DeviceObject,
+            &WriteOffset,
+            (ULONG) (Offset->QuadPart + Length - End),
+            Buffer
+            );
+    }
+
+    ExFreePool(Buffer);
+
+    if (NT_SUCCESS(Status))
+    {
+        KdPrint(("SwapFs: Trimmed %I64d bytes.\n", End - Start));
+    }
+
+    return Status;
+}
+
+NTSTATUS
+BlockDeviceQueryAlignment (
+    IN PDEVICE_OBJECT           DeviceObject,
+    OUT PALIGNMENT_INFORMATION  AlignmentInformation
+    )
+{
+    STORAGE_PROPERTY_QUERY              Query;
+    STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR AccessAlignment;
+    DEVICE_LB_PROVISIONING_DESCRIPTOR   Provisioning;
+    PARTITION_INFORMATION_EX            Partition;
+    ULONG                               Alignment;
+    ULONG                               SectorOffset;
+    ULONG                               Size;
+    NTSTATUS                            Status;
+
+    ASSERT(DeviceObject != NULL);
+    ASSERT(AlignmentInformation != NULL);
+
+    RtlZeroMemory(AlignmentInformation, sizeof(ALIGNMENT_INFORMATION));
+
+    RtlZeroMemory(&Query, sizeof(Query));
+
+    Query.PropertyId = StorageAccessAlignmentProperty;
+    Query.QueryType = PropertyStandardQuery;
+
+    Size = sizeof(AccessAlignment);
+
+    Status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_STORAGE_QUERY_PROPERTY,
+        &Query,
+        sizeof(Query),
+        &AccessAlignment,
+        &Size
+        );
+
+    if (!NT_SUCCESS(Status) || Size < sizeof(AccessAlignment) || !AccessAlignment.BytesPerPhysicalSector)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    Alignment = AccessAlignment.BytesPerPhysicalSector;
+
+    SectorOffset = AccessAlignment.BytesOffsetForSectorAlignment;
+
+    /* an SSD or thin provisioned device may have larger erase blocks than its physical sectors */
+
+    Query.PropertyId = StorageDeviceLBProvisioningProperty;
+
+    Size = sizeof(Provisioning);
+
+    Status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_STORAGE_QUERY_PROPERTY,
+        &Query,
+        sizeof(Query),
+        &Provisioning,
+        &Size
+        );
+
+    if (NT_SUCCESS(Status) &&
+        Size >= FIELD_OFFSET(DEVICE_LB_PROVISIONING_DESCRIPTOR, MaxUnmapLbaCount) &&
+        Provisioning.OptimalUnmapGranularity > Alignment &&
+        Provisioning.OptimalUnmapGranularity <= BLOCK_IO_MAXIMUM_ALIGNMENT &&
+        Provisioning.OptimalUnmapGranularity % Alignment == 0)
+    {
+        Alignment = (ULONG) Provisioning.OptimalUnmapGranularity;
+    }
+
+    if (Alignment > BLOCK_IO_MAXIMUM_ALIGNMENT || (Alignment & (Alignment - 1)))
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    /* the alignment is relative to the start of the disk and the first physical sector */
+
+    Size = sizeof(Partition);
+
+    Status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_GET_PARTITION_INFO_EX,
+        NULL,
+        0,
+        &Partition,
+        &Size
+        );
+
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    AlignmentInformation->Alignment = Alignment;
+
+    AlignmentInformation->AlignmentOffset = (ULONG)
+        ((SectorOffset % Alignment + Alignment -
+          Partition.StartingOffset.QuadPart % Alignment) %
+         Alignment);
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,734 @@
+/*
+    Functions to compress the data region of the swap device.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With CompressionRatio the volume is reported as that many percent of
+    the swap partition and the data region is stored compressed. The
+    volume is split in units of COMPRESS_UNIT_SIZE that are compressed
+    with LZNT1 and stored in as few blocks of COMPRESS_BLOCK_SIZE as
+    they need, a unit that doesn't get smaller is stored as it is and a
+    unit of only zeros is not stored at all. A map in memory has the
+    extent of each unit on the device and a bitmap the blocks that are
+    used, a unit that is written again is stored in new blocks before
+    the old ones are freed, so a write that fails never loses the unit.
+    The map is at most COMPRESS_MAXIMUM_UNITS entries and a larger
+    volume is reported smaller. The start of the volume up to the end of
+    the metadata is not compressed since the formatter and the metadata
+    cache writes it on the device, so the requests there are sent down
+    as they are. The other requests are done by COMPRESS_THREADS threads
+    of the device, each with its own buffers so the units are compressed
+    in parallel, and a unit is locked by the thread that does it so a
+    write of a part of a unit reads the rest of it first without another
+    thread between. The map is only in memory so a compressed volume is
+    not reused at the next boot. When the data doesn't compress as well
+    as the ratio the writes fail with STATUS_DISK_FULL before the volume
+    is full.
+*/
+
+#include <ntifs.h>
+#include <ntdddisk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", CompressInitialize)
+#pragma alloc_text("INIT", CompressRelease)
+#pragma alloc_text("PAGE", CompressStart)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+CompressInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                CompressionRatio
+    )
+{
+    PCOMPRESS               compress;
+    GET_LENGTH_INFORMATION  length_information;
+    OBJECT_ATTRIBUTES       object_attributes;
+    HANDLE                  thread_handle;
+    LONGLONG                length;
+    ULONG                   nblock;
+    ULONG                   nunit;
+    ULONG                   workspace_size;
+    ULONG                   fragment_size;
+    PULONG                  bitmap;
+    PULONG                  busy;
+    PCOMPRESS_WORKER        worker;
+    BOOLEAN                 complete;
+    ULONG                   size;
+    ULONG                   n;
+    NTSTATUS                status;
+
+    compress = &DeviceExtension->Compress;
+
+    size = sizeof(length_information);
+
+    status = BlockDeviceIoControl(
+        DeviceExtension->TargetDeviceObject,
+        IOCTL_DISK_GET_LENGTH_INFO,
+        NULL,
+        0,
+        &length_information,
+        &size
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    /* the blocks are counted on the partition and the units on the volume it's reported as */
+
+    length = length_information.Length.QuadPart - sizeof(union swap_header);
+
+    if (length / COMPRESS_BLOCK_SIZE >= COMPRESS_MAXIMUM_BLOCKS)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    CompressionRatio = min(max(CompressionRatio, COMPRESS_MINIMUM_RATIO), COMPRESS_MAXIMUM_RATIO);
+
+    nblock = (ULONG) (length / COMPRESS_BLOCK_SIZE);
+
+    nunit = (ULONG) (length / 100 * CompressionRatio / COMPRESS_UNIT_SIZE);
+
+    /* the map is in nonpaged pool since the thread does the paging I/O of the page
+       file on the volume, a page fault on the map could wait for a read of the page
+       file by the same thread, the volume is reported smaller to bound it */
+
+    if (nunit > COMPRESS_MAXIMUM_UNITS)
+    {
+        KdPrint(("SwapFs: The compressed volume is limited to %u units.\n", COMPRESS_MAXIMUM_UNITS));
+
+        nunit = COMPRESS_MAXIMUM_UNITS;
+    }
+
+    status = RtlGetCompressionWorkSpaceSize(COMPRESS_FORMAT, &workspace_size, &fragment_size);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    RtlZeroMemory(compress, sizeof(COMPRESS));
+
+    compress->Map = (PULONG) ExAllocatePoolWithTag(NonPagedPool, nunit * sizeof(ULONG), SWAPFS_POOL_TAG);
+
+    bitmap = (PULONG) ExAllocatePoolWithTag(NonPagedPool, ((nblock + 31) / 32) * sizeof(ULONG), SWAPFS_POOL_TAG);
+
+    busy = (PULONG) ExAllocatePoolWithTag(NonPagedPool, ((nunit + 31) / 32) * sizeof(ULONG), SWAPFS_POOL_TAG);
+
+    complete = compress->Map && bitmap && busy;
+
+    for (n = 0; n < COMPRESS_THREADS; n++)
+    {
+        worker = &compress->Worker[n];
+
+        worker->DeviceExtension = DeviceExtension;
+
+        worker->Unit = (PUCHAR) ExAllocatePoolWithTag(NonPagedPool, COMPRESS_UNIT_SIZE * 2, SWAPFS_POOL_TAG);
+
+        worker->WorkSpace = ExAllocatePoolWithTag(NonPagedPool, workspace_size, SWAPFS_POOL_TAG);
+
+        worker->Compressed = worker->Unit ? worker->Unit + COMPRESS_UNIT_SIZE : NULL;
+
+        complete = complete && worker->Unit && worker->WorkSpace;
+    }
+
+    if (!complete)
+    {
+        if (compress->Map) { ExFreePool(compress->Map); }
+        if (bitmap) { ExFreePool(bitmap); }
+        if (busy) { ExFreePool(busy); }
+        for (n = 0; n < COMPRESS_THREADS; n++)
+        {
+            if (compress->Worker[n].Unit) { ExFreePool(compress->Worker[n].Unit); }
+            if (compress->Worker[n].WorkSpace) { ExFreePool(compress->Worker[n].WorkSpace); }
+        }
+        RtlZeroMemory(compress, sizeof(COMPRESS));
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(compress->Map, nunit * sizeof(ULONG));
+
+    RtlInitializeBitMap(&compress->Blocks, bitmap, nblock);
+
+    RtlClearAllBits(&compress->Blocks);
+
+    RtlInitializeBitMap(&compress->Busy, busy, nunit);
+
+    RtlClearAllBits(&compress->Busy);
+
+    KeInitializeSpinLock(&compress->UnitLock);
+
+    KeInitializeEvent(&compress->UnitDone, NotificationEvent, FALSE);
+
+    KeInitializeSpinLock(&compress->Lock);
+
+    InitializeListHead(&compress->Queue);
+
+    KeInitializeSemaphore(&compress->Queued, 0, MAXLONG);
+
+    /* the requests are done by a few threads so the units of them are compressed in parallel */
+
+    InitializeObjectAttributes(&object_attributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+
+    for (n = 0, status = STATUS_SUCCESS; n < COMPRESS_THREADS && NT_SUCCESS(status); n++)
+    {
+        worker = &compress->Worker[n];
+
+        status = PsCreateSystemThread(
+            &thread_handle,
+            THREAD_ALL_ACCESS,
+            &object_attributes,
+            NULL,
+            NULL,
+            CompressThread,
+            worker
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        status = ObReferenceObjectByHandle(
+            thread_handle,
+            THREAD_ALL_ACCESS,
+            NULL,
+            KernelMode,
+            &worker->Thread,
+            NULL
+            );
+
+        /* without a reference the thread is stopped and waited for on the handle */
+
+        if (!NT_SUCCESS(status))
+        {
+            worker->Thread = NULL;
+            compress->Stop = TRUE;
+            KeReleaseSemaphore(&compress->Queued, IO_NO_INCREMENT, n + 1, FALSE);
+            ZwWaitForSingleObject(thread_handle, FALSE, NULL);
+        }
+
+        ZwClose(thread_handle);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        CompressRelease(DeviceExtension);
+        return status;
+    }
+
+    /* the volume is reported as longer from here on, before it's formated */
+
+    compress->Length = (LONGLONG) nunit * COMPRESS_UNIT_SIZE;
+
+    KdPrint(("SwapFs: Compressing %u blocks to a volume of %I64u bytes.\n", nblock, compress->Length));
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+CompressRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PCOMPRESS           compress;
+    PCOMPRESS_WORKER    worker;
+    ULONG               n;
+
+    compress = &DeviceExtension->Compress;
+
+    if (!compress->Map)
+    {
+        return;
+    }
+
+    /* the semaphore is released once for each thread, unless a thread was stopped when it was created */
+
+    if (!compress->Stop)
+    {
+        compress->Stop = TRUE;
+
+        KeReleaseSemaphore(&compress->Queued, IO_NO_INCREMENT, COMPRESS_THREADS, FALSE);
+    }
+
+    for (n = 0; n < COMPRESS_THREADS; n++)
+    {
+        worker = &compress->Worker[n];
+
+        if (worker->Thread)
+        {
+            KeWaitForSingleObject(worker->Thread, Executive, KernelMode, FALSE, NULL);
+            ObDereferenceObject(worker->Thread);
+        }
+
+        ExFreePool(worker->Unit);
+        ExFreePool(worker->WorkSpace);
+    }
+
+    ExFreePool(compress->Map);
+    ExFreePool(compress->Blocks.Buffer);
+    ExFreePool(compress->Busy.Buffer);
+
+    RtlZeroMemory(compress, sizeof(COMPRESS));
+}
+
+VOID
+CompressStart (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PCOMPRESS   compress;
+    LONGLONG    identity;
+
+    PAGED_CODE();
+
+    compress = &DeviceExtension->Compress;
+
+    /* the metadata the formatter has written is at the same place on the device */
+
+    identity = (LONGLONG) DeviceExtension->Stamp.MetaSectors * DeviceExtension->Stamp.SectorSize;
+
+    identity = (identity + COMPRESS_UNIT_SIZE - 1) & ~((LONGLONG) COMPRESS_UNIT_SIZE - 1);
+
+    RtlSetBits(&compress->Blocks, 0, (ULONG) (identity / COMPRESS_BLOCK_SIZE));
+
+    compress->Hint = (ULONG) (identity / COMPRESS_BLOCK_SIZE);
+
+    compress->Identity = identity;
+
+    KdPrint(("SwapFs: Compressing the volume from %I64u.\n", identity));
+}
+
+/* not pageable since it's called from the dispatch routine */
+
+NTSTATUS
+CompressCallDriver (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    PCOMPRESS           compress;
+    PIO_STACK_LOCATION  io_stack;
+    LONGLONG            offset;
+    ULONG               length;
+    NTSTATUS            status;
+
+    compress = &DeviceExtension->Compress;
+
+    io_stack = IoGetNextIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart - sizeof(union swap_header);
+    length = io_stack->Parameters.Read.Length;
+
+    /* the metadata is not compressed */
+
+    if ((io_stack->MajorFunction != IRP_MJ_READ && io_stack->MajorFunction != IRP_MJ_WRITE) ||
+        offset + length <= compress->Identity)
+    {
+        return IoCallDriver(DeviceExtension->TargetDeviceObject, Irp);
+    }
+
+    /* the driver takes the place of the lower driver in the next stack location,
+       so a completion routine set there is called when the thread completes it */
+
+    IoSetNextIrpStackLocation(Irp);
+
+    if (offset < 0 || offset + length > compress->Length || !Irp->MdlAddress)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return status;
+    }
+
+    IoMarkIrpPending(Irp);
+
+    ExInterlockedInsertTailList(&compress->Queue, &Irp->Tail.Overlay.ListEntry, &compress->Lock);
+
+    KeReleaseSemaphore(&compress->Queued, IO_NO_INCREMENT, 1, FALSE);
+
+    return STATUS_PENDING;
+}
+
+/* not pageable since the threads do the requests to the volume, a unit is done by one thread at a time */
+
+static VOID
+compress_lock_unit (
+    IN PCOMPRESS    Compress,
+    IN ULONG        Unit
+    )
+{
+    KIRQL irql;
+
+    for (;;)
+    {
+        KeAcquireSpinLock(&Compress->UnitLock, &irql);
+
+        if (!RtlCheckBit(&Compress->Busy, Unit))
+        {
+            RtlSetBits(&Compress->Busy, Unit, 1);
+
+            KeReleaseSpinLock(&Compress->UnitLock, irql);
+
+            return;
+        }
+
+        /* the event is cleared under the lock so a unit done after the check sets it again */
+
+        KeClearEvent(&Compress->UnitDone);
+
+        KeReleaseSpinLock(&Compress->UnitLock, irql);
+
+        KeWaitForSingleObject(&Compress->UnitDone, Executive, KernelMode, FALSE, NULL);
+    }
+}
+
+/* not pageable since the threads do the requests to the volume */
+
+static VOID
+compress_unlock_unit (
+    IN PCOMPRESS    Compress,
+    IN ULONG        Unit
+    )
+{
+    KIRQL irql;
+
+    KeAcquireSpinLock(&Compress->UnitLock, &irql);
+
+    RtlClearBits(&Compress->Busy, Unit, 1);
+
+    KeSetEvent(&Compress->UnitDone, IO_NO_INCREMENT, FALSE);
+
+    KeReleaseSpinLock(&Compress->UnitLock, irql);
+}
+
+/* not pageable since the threads do the requests to the volume */
+
+static NTSTATUS
+compress_load (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PCOMPRESS_WORKER     Worker,
+    IN ULONG                Unit
+    )
+{
+    PCOMPRESS       compress;
+    LARGE_INTEGER   offset;
+    ULONG           extent;
+    ULONG           nblock;
+    ULONG           size;
+    NTSTATUS        status;
+
+    compress = &DeviceExtension->Compress;
+
+    extent = compress->Map[Unit];
+
+    nblock = COMPRESS_EXTENT_COUNT(extent);
+
+    if (!nblock)
+    {
+        RtlZeroMemory(Worker->Unit, COMPRESS_UNIT_SIZE);
+        return STATUS_SUCCESS;
+    }
+
+    offset.QuadPart = (LONGLONG) COMPRESS_EXTENT_BLOCK(extent) * COMPRESS_BLOCK_SIZE + sizeof(union swap_header);
+
+    /* a unit that didn't get smaller is stored as it is */
+
+    if (nblock == COMPRESS_UNIT_SIZE / COMPRESS_BLOCK_SIZE)
+    {
+        return ReadBlockDevice(DeviceExtension->TargetDeviceObject, &offset, COMPRESS_UNIT_SIZE, Worker->Unit);
+    }
+
+    status = ReadBlockDevice(DeviceExtension->TargetDeviceObject, &offset, nblock * COMPRESS_BLOCK_SIZE, Worker->Compressed);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    status = RtlDecompressBuffer(
+        COMPRESSION_FORMAT_LZNT1,
+        Worker->Unit,
+        COMPRESS_UNIT_SIZE,
+        Worker->Compressed,
+        nblock * COMPRESS_BLOCK_SIZE,
+        &size
+        );
+
+    if (NT_SUCCESS(status) && size < COMPRESS_UNIT_SIZE)
+    {
+        RtlZeroMemory(Worker->Unit + size, COMPRESS_UNIT_SIZE - size);
+    }
+
+    return status;
+}
+
+/* not pageable since the threads do the requests to the volume, the map
+   entry of the unit is only used by the thread that has the unit locked
+   while the bitmap of the blocks is shared under the lock of the units */
+
+static NTSTATUS
+compress_store (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PCOMPRESS_WORKER     Worker,
+    IN ULONG                Unit
+    )
+{
+    PCOMPRESS       compress;
+    LARGE_INTEGER   offset;
+    PUCHAR          data;
+    ULONG           extent;
+    ULONG           nblock;
+    ULONG           block;
+    ULONG           size;
+    NTSTATUS        status;
+    KIRQL           irql;
+
+    compress = &DeviceExtension->Compress;
+
+    extent = compress->Map[Unit];
+
+    status = RtlCompressBuffer(
+        COMPRESS_FORMAT,
+        Worker->Unit,
+        COMPRESS_UNIT_SIZE,
+        Worker->Compressed,
+        COMPRESS_UNIT_SIZE,
+        COMPRESS_CHUNK_SIZE,
+        &size,
+        Worker->WorkSpace
+        );
+
+    /* a unit of only zeros frees its blocks */
+
+    if (status == STATUS_BUFFER_ALL_ZEROS)
+    {
+        compress->Map[Unit] = 0;
+
+        if (COMPRESS_EXTENT_COUNT(extent))
+        {
+            KeAcquireSpinLock(&compress->UnitLock, &irql);
+            RtlClearBits(&compress->Blocks, COMPRESS_EXTENT_BLOCK(extent), COMPRESS_EXTENT_COUNT(extent));
+            KeReleaseSpinLock(&compress->UnitLock, irql);
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    nblock = (size + COMPRESS_BLOCK_SIZE - 1) / COMPRESS_BLOCK_SIZE;
+
+    if (NT_SUCCESS(status) && nblock < COMPRESS_UNIT_SIZE / COMPRESS_BLOCK_SIZE)
+    {
+        /* the end of the last block is zeroed so the decompression stops there */
+
+        RtlZeroMemory(Worker->Compressed + size, nblock * COMPRESS_BLOCK_SIZE - size);
+
+        data = Worker->Compressed;
+    }
+    else if (NT_SUCCESS(status) || status == STATUS_BUFFER_TOO_SMALL)
+    {
+        nblock = COMPRESS_UNIT_SIZE / COMPRESS_BLOCK_SIZE;
+
+        data = Worker->Unit;
+    }
+    else
+    {
+        return status;
+    }
+
+    /* the old blocks are freed only when the unit is written to the new ones, so
+       a write that fails keeps the unit as it was, even when the device is full */
+
+    KeAcquireSpinLock(&compress->UnitLock, &irql);
+
+    block = RtlFindClearBitsAndSet(&compress->Blocks, nblock, compress->Hint);
+
+    if (block != 0xFFFFFFFF)
+    {
+        compress->Hint = block + nblock;
+    }
+
+    KeReleaseSpinLock(&compress->UnitLock, irql);
+
+    if (block == 0xFFFFFFFF)
+    {
+        return STATUS_DISK_FULL;
+    }
+
+    offset.QuadPart = (LONGLONG) block * COMPRESS_BLOCK_SIZE + sizeof(union swap_header);
+
+    status = WriteBlockDevice(DeviceExtension->TargetDeviceObject, &offset, nblock * COMPRESS_BLOCK_SIZE, data);
+
+    KeAcquireSpinLock(&compress->UnitLock, &irql);
+
+    if (!NT_SUCCESS(status))
+    {
+        RtlClearBits(&compress->Blocks, block, nblock);
+    }
+    else if (COMPRESS_EXTENT_COUNT(extent))
+    {
+        RtlClearBits(&compress->Blocks, COMPRESS_EXTENT_BLOCK(extent), COMPRESS_EXTENT_COUNT(extent));
+    }
+
+    KeReleaseSpinLock(&compress->UnitLock, irql);
+
+    if (NT_SUCCESS(status))
+    {
+        compress->Map[Unit] = COMPRESS_EXTENT(block, nblock);
+    }
+
+    return status;
+}
+
+/* not pageable since the threads do the requests to the volume */
+
+static NTSTATUS
+compress_read_write (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PCOMPRESS_WORKER     Worker,
+    IN PIRP                 Irp
+    )
+{
+    PCOMPRESS           compress;
+    PIO_STACK_LOCATION  io_stack;
+    LARGE_INTEGER       device_offset;
+    LONGLONG            offset;
+    ULONG               length;
+    ULONG               done, count;
+    ULONG               unit, start;
+    PUCHAR              buffer;
+    NTSTATUS            status;
+
+    compress = &DeviceExtension->Compress;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart - sizeof(union swap_header);
+    length = io_stack->Parameters.Read.Length;
+
+    buffer = (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+
+    if (!buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (done = 0, status = STATUS_SUCCESS; done < length && NT_SUCCESS(status); done += count)
+    {
+        /* a request that starts in the metadata does that part on the device */
+
+        if (offset + done < compress->Identity)
+        {
+            count = (ULONG) min(length - done, compress->Identity - (offset + done));
+
+            device_offset.QuadPart = offset + done + sizeof(union swap_header);
+
+            if (io_stack->MajorFunction == IRP_MJ_READ)
+            {
+                status = ReadBlockDevice(DeviceExtension->TargetDeviceObject, &device_offset, count, buffer + done);
+            }
+            else
+            {
+                status = WriteBlockDevice(DeviceExtension->TargetDeviceObject, &device_offset, count, buffer + done);
+            }
+
+            continue;
+        }
+
+        unit = (ULONG) ((offset + done) / COMPRESS_UNIT_SIZE);
+        start = (ULONG) ((offset + done) % COMPRESS_UNIT_SIZE);
+        count = min(length - done, COMPRESS_UNIT_SIZE - start);
+
+        compress_lock_unit(compress, unit);
+
+        if (io_stack->MajorFunction == IRP_MJ_READ)
+        {
+            status = compress_load(DeviceExtension, Worker, unit);
+
+            if (NT_SUCCESS(status))
+            {
+                RtlCopyMemory(buffer + done, Worker->Unit + start, count);
+            }
+        }
+        else
+        {
+            /* a write of a part of a unit keeps the rest of it */
+
+            status = (count < COMPRESS_UNIT_SIZE) ? compress_load(DeviceExtension, Worker, unit) : STATUS_SUCCESS;
+
+            if (NT_SUCCESS(status))
+            {
+                RtlCopyMemory(Worker->Unit + start, buffer + done, count);
+
+                status = compress_store(DeviceExtension, Worker, unit);
+            }
+        }
+
+        compress_unlock_unit(compress, unit);
+    }
+
+    return status;
+}
+
+VOID
+CompressThread (
+    IN PVOID Context
+    )
+{
+    PCOMPRESS_WORKER    worker;
+    PDEVICE_EXTENSION   device_extension;
+    PCOMPRESS           compress;
+    PLIST_ENTRY         entry;
+    PIRP                irp;
+    NTSTATUS            status;
+
+    worker = (PCOMPRESS_WORKER) Context;
+
+    device_extension = worker->DeviceExtension;
+
+    compress = &device_extension->Compress;
+
+    /* the semaphore is released once for each request queued, each thread takes one at a time */
+
+    while (!compress->Stop)
+    {
+        KeWaitForSingleObject(&compress->Queued, Executive, KernelMode, FALSE, NULL);
+
+        entry = ExInterlockedRemoveHeadList(&compress->Queue, &compress->Lock);
+
+        if (!entry)
+        {
+            continue;
+        }
+
+        irp = CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry);
+
+        status = compress_read_write(device_extension, worker, irp);
+
+        irp->IoStatus.Status = status;
+        irp->IoStatus.Information = NT_SUCCESS(status) ? IoGetCurrentIrpStackLocation(irp)->Parameters.Read.Length : 0;
+
+        IoCompleteRequest(irp, IO_DISK_INCREMENT);
+    }
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
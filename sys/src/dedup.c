@@ -0,0 +1,764 @@
+/*
+    Functions to map the duplicate blocks of the data region to one block.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With DedupIndexSize the data region is split in blocks of
+    DEDUP_BLOCK_SIZE and a map has the block on the device each block of
+    the volume is stored in, at first the same block, and the number of
+    blocks of the volume that are stored in each block on the device. A
+    block that is written is hashed and looked up in an index of
+    DedupIndexSize KB with the hash of the blocks written last. When the
+    hash is found the block on the device is read and compared, and when
+    it's the same the block of the volume is mapped to it and nothing is
+    written. A block of only zeros is not stored at all. A block that is
+    not found is written where it's stored when no other block of the
+    volume is stored there, else it's written to a free block, the block
+    of the volume itself when it's free. There is always a free block
+    when a block of the volume shares a block on the device with another
+    one, so a write never fails for lack of space. The requests of the
+    data region are done by a thread of the device, in order, a write of
+    a part of a block reads the rest of it first. The map and the index
+    are only in memory so the volume is not reused at the next boot.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#define DEDUP_HASH_BASIS    0xcbf29ce484222325ULL
+#define DEDUP_HASH_PRIME    0x100000001b3ULL
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", DedupInitialize)
+#pragma alloc_text("INIT", DedupRelease)
+#pragma alloc_text("PAGE", DedupStart)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+DedupInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                DedupIndexSize
+    )
+{
+    PDEDUP              dedup;
+    OBJECT_ATTRIBUTES   object_attributes;
+    HANDLE              thread_handle;
+    ULONG               nentry;
+    NTSTATUS            status;
+
+    dedup = &DeviceExtension->Dedup;
+
+    RtlZeroMemory(dedup, sizeof(DEDUP));
+
+    /* DedupIndexSize is in KB and the number of entries is rounded down to a power of two */
+
+    DedupIndexSize = min(max(DedupIndexSize, DEDUP_MINIMUM_SIZE), DEDUP_MAXIMUM_SIZE);
+
+    nentry = 1 << RtlFindMostSignificantBit(DedupIndexSize * 1024 / sizeof(DEDUP_INDEX_ENTRY));
+
+    /* the thread does the paging I/O of the page file on the volume, so nothing
+       it uses can be paged or a fault could wait for a read queued behind it */
+
+    dedup->Index = (PDEDUP_INDEX_ENTRY) ExAllocatePoolWithTag(
+        NonPagedPool,
+        nentry * sizeof(DEDUP_INDEX_ENTRY),
+        SWAPFS_POOL_TAG
+        );
+
+    if (!dedup->Index)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(dedup->Index, nentry * sizeof(DEDUP_INDEX_ENTRY));
+
+    dedup->IndexMask = nentry - 1;
+
+    /* a block that is read before a part of it is written, and a block that is compared */
+
+    dedup->Block = (PUCHAR) ExAllocatePoolWithTag(
+        NonPagedPool,
+        2 * DEDUP_BLOCK_SIZE,
+        SWAPFS_POOL_TAG
+        );
+
+    if (!dedup->Block)
+    {
+        ExFreePool(dedup->Index);
+        dedup->Index = NULL;
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    dedup->Compare = dedup->Block + DEDUP_BLOCK_SIZE;
+
+    KeInitializeSpinLock(&dedup->Lock);
+
+    InitializeListHead(&dedup->Queue);
+
+    KeInitializeEvent(&dedup->QueueEvent, SynchronizationEvent, FALSE);
+
+    InitializeObjectAttributes(&object_attributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+
+    status = PsCreateSystemThread(
+        &thread_handle,
+        THREAD_ALL_ACCESS,
+        &object_attributes,
+        NULL,
+        NULL,
+        DedupThread,
+        DeviceExtension
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        ExFreePool(dedup->Index);
+        ExFreePool(dedup->Block);
+        RtlZeroMemory(dedup, sizeof(DEDUP));
+        return status;
+    }
+
+    status = ObReferenceObjectByHandle(
+        thread_handle,
+        THREAD_ALL_ACCESS,
+        NULL,
+        KernelMode,
+        &dedup->Thread,
+        NULL
+        );
+
+    /* without a reference the thread is stopped and waited for on the handle */
+
+    if (!NT_SUCCESS(status))
+    {
+        dedup->Stop = TRUE;
+        KeSetEvent(&dedup->QueueEvent, IO_NO_INCREMENT, FALSE);
+        ZwWaitForSingleObject(thread_handle, FALSE, NULL);
+        ZwClose(thread_handle);
+        ExFreePool(dedup->Index);
+        ExFreePool(dedup->Block);
+        RtlZeroMemory(dedup, sizeof(DEDUP));
+        return status;
+    }
+
+    ZwClose(thread_handle);
+
+    KdPrint(("SwapFs: Deduplicating with an index of %u blocks.\n", nentry));
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+DedupRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PDEDUP dedup;
+
+    dedup = &DeviceExtension->Dedup;
+
+    if (!dedup->Index)
+    {
+        return;
+    }
+
+    dedup->Stop = TRUE;
+
+    KeSetEvent(&dedup->QueueEvent, IO_NO_INCREMENT, FALSE);
+
+    if (dedup->Thread)
+    {
+        KeWaitForSingleObject(dedup->Thread, Executive, KernelMode, FALSE, NULL);
+        ObDereferenceObject(dedup->Thread);
+    }
+
+    if (dedup->Map)
+    {
+        ExFreePool(dedup->Map);
+        ExFreePool(dedup->References);
+        ExFreePool(dedup->Used.Buffer);
+    }
+
+    ExFreePool(dedup->Index);
+    ExFreePool(dedup->Block);
+
+    RtlZeroMemory(dedup, sizeof(DEDUP));
+}
+
+VOID
+DedupStart (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PDEDUP      dedup;
+    PULONG      bitmap;
+    ULONG       nblock;
+    ULONG       n;
+    LONGLONG    start;
+
+    PAGED_CODE();
+
+    dedup = &DeviceExtension->Dedup;
+
+    /* the map is in nonpaged pool like the index, so it's bounded and the blocks after it are not deduplicated */
+
+    nblock = (ULONG) min(DeviceExtension->Stamp.VolumeLength / DEDUP_BLOCK_SIZE, DEDUP_MAXIMUM_BLOCKS);
+
+    if (nblock < DeviceExtension->Stamp.VolumeLength / DEDUP_BLOCK_SIZE)
+    {
+        KdPrint(("SwapFs: Only the first %u blocks of the volume are deduplicated.\n", nblock));
+    }
+
+    dedup->Map = (PULONG) ExAllocatePoolWithTag(NonPagedPool, nblock * sizeof(ULONG), SWAPFS_POOL_TAG);
+
+    dedup->References = (PULONG) ExAllocatePoolWithTag(NonPagedPool, nblock * sizeof(ULONG), SWAPFS_POOL_TAG);
+
+    bitmap = (PULONG) ExAllocatePoolWithTag(NonPagedPool, ((nblock + 31) / 32) * sizeof(ULONG), SWAPFS_POOL_TAG);
+
+    if (!dedup->Map || !dedup->References || !bitmap)
+    {
+        if (dedup->Map) { ExFreePool(dedup->Map); }
+        if (dedup->References) { ExFreePool(dedup->References); }
+        if (bitmap) { ExFreePool(bitmap); }
+        dedup->Map = NULL;
+        dedup->References = NULL;
+        KdPrint(("SwapFs: No blocks are deduplicated for the device.\n"));
+        return;
+    }
+
+    /* each block of the volume is stored in the same block on the device */
+
+    for (n = 0; n < nblock; n++)
+    {
+        dedup->Map[n] = n;
+        dedup->References[n] = 1;
+    }
+
+    RtlInitializeBitMap(&dedup->Used, bitmap, nblock);
+
+    RtlSetAllBits(&dedup->Used);
+
+    dedup->NumberOfBlocks = nblock;
+
+    dedup->Hint = 0;
+
+    /* the metadata the formatter has written is not mapped */
+
+    start = (LONGLONG) DeviceExtension->Stamp.MetaSectors * DeviceExtension->Stamp.SectorSize;
+
+    start = (start + DEDUP_BLOCK_SIZE - 1) & ~((LONGLONG) DEDUP_BLOCK_SIZE - 1);
+
+    dedup->Start = max(start, DEDUP_BLOCK_SIZE);
+
+    KdPrint(("SwapFs: Deduplicating %u blocks of the volume from %I64u.\n", nblock, dedup->Start));
+}
+
+/* not pageable since it's called from StripeCallDevice */
+
+NTSTATUS
+DedupCallDriver (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    PDEDUP              dedup;
+    PIO_STACK_LOCATION  io_stack;
+    LONGLONG            offset;
+    ULONG               length;
+    NTSTATUS            status;
+
+    dedup = &DeviceExtension->Dedup;
+
+    io_stack = IoGetNextIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart - sizeof(union swap_header);
+    length = io_stack->Parameters.Read.Length;
+
+    /* the metadata is not mapped */
+
+    if ((io_stack->MajorFunction != IRP_MJ_READ && io_stack->MajorFunction != IRP_MJ_WRITE) ||
+        offset + length <= dedup->Start)
+    {
+        return StripeCallMembers(DeviceExtension, Irp);
+    }
+
+    /* the driver takes the place of the lower driver in the next stack location,
+       so a completion routine set there is called when the thread completes it */
+
+    IoSetNextIrpStackLocation(Irp);
+
+    if (offset < 0 || offset + length > DeviceExtension->Stamp.VolumeLength || !Irp->MdlAddress)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return status;
+    }
+
+    IoMarkIrpPending(Irp);
+
+    ExInterlockedInsertTailList(&dedup->Queue, &Irp->Tail.Overlay.ListEntry, &dedup->Lock);
+
+    KeSetEvent(&dedup->QueueEvent, IO_NO_INCREMENT, FALSE);
+
+    return STATUS_PENDING;
+}
+
+/* the hash is FNV-1a of the words of the block with the high half folded in, it's 0 for a block of only zeros */
+
+static ULONGLONG
+dedup_hash (
+    IN PUCHAR Data
+    )
+{
+    PULONGLONG  word;
+    ULONGLONG   hash;
+    ULONGLONG   bits;
+    ULONG       n;
+
+    word = (PULONGLONG) Data;
+
+    hash = DEDUP_HASH_BASIS;
+
+    bits = 0;
+
+    for (n = 0; n < DEDUP_BLOCK_SIZE / sizeof(ULONGLONG); n++)
+    {
+        bits |= word[n];
+
+        hash ^= word[n];
+        hash *= DEDUP_HASH_PRIME;
+        hash ^= hash >> 32;
+    }
+
+    return bits ? (hash ? hash : 1) : 0;
+}
+
+static VOID
+dedup_release (
+    IN PDEDUP   Dedup,
+    IN ULONG    Block
+    )
+{
+    if (Block == DEDUP_ZERO_BLOCK)
+    {
+        return;
+    }
+
+    if (--Dedup->References[Block] == 0)
+    {
+        RtlClearBits(&Dedup->Used, Block, 1);
+    }
+}
+
+/* the block of the volume itself is taken when it's free, so an undeduplicated volume is not fragmented */
+
+static ULONG
+dedup_allocate (
+    IN PDEDUP   Dedup,
+    IN ULONG    Block
+    )
+{
+    ULONG free_block;
+
+    if (!RtlCheckBit(&Dedup->Used, Block))
+    {
+        RtlSetBits(&Dedup->Used, Block, 1);
+        free_block = Block;
+    }
+    else
+    {
+        free_block = RtlFindClearBitsAndSet(&Dedup->Used, 1, Dedup->Hint);
+
+        if (free_block == 0xFFFFFFFF)
+        {
+            return DEDUP_ZERO_BLOCK;
+        }
+
+        Dedup->Hint = free_block + 1;
+    }
+
+    Dedup->References[free_block] = 1;
+
+    return free_block;
+}
+
+static NTSTATUS
+dedup_load (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                Block,
+    OUT PUCHAR              Buffer
+    )
+{
+    PDEDUP dedup;
+
+    dedup = &DeviceExtension->Dedup;
+
+    if (dedup->Map[Block] == DEDUP_ZERO_BLOCK)
+    {
+        RtlZeroMemory(Buffer, DEDUP_BLOCK_SIZE);
+        return STATUS_SUCCESS;
+    }
+
+    return StripeRead(DeviceExtension, (LONGLONG) dedup->Map[Block] * DEDUP_BLOCK_SIZE, DEDUP_BLOCK_SIZE, Buffer);
+}
+
+static NTSTATUS
+dedup_run (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN BOOLEAN              Write,
+    IN ULONG                Block,
+    IN ULONG                Count,
+    IN OUT PUCHAR           Buffer
+    )
+{
+    if (Write)
+    {
+        return StripeWrite(DeviceExtension, (LONGLONG) Block * DEDUP_BLOCK_SIZE, Count * DEDUP_BLOCK_SIZE, Buffer);
+    }
+
+    return StripeRead(DeviceExtension, (LONGLONG) Block * DEDUP_BLOCK_SIZE, Count * DEDUP_BLOCK_SIZE, Buffer);
+}
+
+static NTSTATUS
+dedup_read_write (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    PDEDUP              dedup;
+    PDEDUP_INDEX_ENTRY  entry;
+    PIO_STACK_LOCATION  io_stack;
+    LONGLONG            offset;
+    LONGLONG            end;
+    ULONG               length;
+    ULONG               done, count;
+    ULONG               block, start;
+    ULONG               stored;
+    ULONG               run_block;
+    ULONG               run_count;
+    PUCHAR              run_data;
+    PUCHAR              buffer;
+    PUCHAR              data;
+    ULONGLONG           hash;
+    LONGLONG            written;
+    LONGLONG            duplicate;
+    LONGLONG            collisions;
+    BOOLEAN             write;
+    NTSTATUS            status;
+    KIRQL               irql;
+
+    dedup = &DeviceExtension->Dedup;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart - sizeof(union swap_header);
+    length = io_stack->Parameters.Read.Length;
+
+    write = (BOOLEAN) (io_stack->MajorFunction == IRP_MJ_WRITE);
+
+    buffer = (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+
+    if (!buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    end = (LONGLONG) dedup->NumberOfBlocks * DEDUP_BLOCK_SIZE;
+
+    /* the blocks stored one after another on the device are read or written as one */
+
+    run_data = NULL;
+    run_block = 0;
+    run_count = 0;
+
+    written = 0;
+    duplicate = 0;
+    collisions = 0;
+
+    for (done = 0, status = STATUS_SUCCESS; done <= length && NT_SUCCESS(status); done += count)
+    {
+        block = (ULONG) ((offset + done) / DEDUP_BLOCK_SIZE);
+        start = (ULONG) ((offset + done) % DEDUP_BLOCK_SIZE);
+        count = min(length - done, DEDUP_BLOCK_SIZE - start);
+
+        data = buffer + done;
+
+        /* a read run ends where the next block is not after it on the device */
+
+        if (run_count &&
+            (done == length ||
+             offset + done < dedup->Start ||
+             offset + done >= end ||
+             count < DEDUP_BLOCK_SIZE ||
+             (!write && dedup->Map[block] != run_block + run_count)))
+        {
+            status = dedup_run(DeviceExtension, write, run_block, run_count, run_data);
+
+            run_count = 0;
+
+            if (!NT_SUCCESS(status))
+            {
+                break;
+            }
+        }
+
+        if (done == length)
+        {
+            break;
+        }
+
+        /* the metadata and the end of the volume after the last block are not mapped */
+
+        if (offset + done < dedup->Start || offset + done >= end)
+        {
+            count = (ULONG) min(length - done,
+                (offset + done < dedup->Start ? dedup->Start : offset + length) - (offset + done));
+
+            if (write)
+            {
+                status = StripeWrite(DeviceExtension, offset + done, count, data);
+            }
+            else
+            {
+                status = StripeRead(DeviceExtension, offset + done, count, data);
+            }
+
+            continue;
+        }
+
+        if (!write)
+        {
+            if (dedup->Map[block] == DEDUP_ZERO_BLOCK)
+            {
+                RtlZeroMemory(data, count);
+            }
+            else if (count < DEDUP_BLOCK_SIZE)
+            {
+                status = dedup_load(DeviceExtension, block, dedup->Block);
+
+                if (NT_SUCCESS(status))
+                {
+                    RtlCopyMemory(data, dedup->Block + start, count);
+                }
+            }
+            else if (run_count)
+            {
+                run_count++;
+            }
+            else
+            {
+                run_data = data;
+                run_block = dedup->Map[block];
+                run_count = 1;
+            }
+
+            continue;
+        }
+
+        /* a write of a part of a block keeps the rest of it */
+
+        if (count < DEDUP_BLOCK_SIZE)
+        {
+            status = dedup_load(DeviceExtension, block, dedup->Block);
+
+            if (!NT_SUCCESS(status))
+            {
+                continue;
+            }
+
+            RtlCopyMemory(dedup->Block + start, data, count);
+
+            data = dedup->Block;
+        }
+
+        hash = dedup_hash(data);
+
+        stored = dedup->Map[block];
+
+        /* a block of only zeros is not stored */
+
+        if (!hash)
+        {
+            dedup_release(dedup, stored);
+
+            dedup->Map[block] = DEDUP_ZERO_BLOCK;
+
+            duplicate += DEDUP_BLOCK_SIZE;
+
+            continue;
+        }
+
+        entry = &dedup->Index[hash & dedup->IndexMask];
+
+        /* the block on the device with the same hash is read to know that it's the same,
+           after the run is written since the block can be in it */
+
+        if (entry->Hash == hash && entry->Block != stored && dedup->References[entry->Block])
+        {
+            if (run_count)
+            {
+                status = dedup_run(DeviceExtension, write, run_block, run_count, run_data);
+
+                run_count = 0;
+            }
+
+            if (NT_SUCCESS(status))
+            {
+                status = StripeRead(DeviceExtension, (LONGLONG) entry->Block * DEDUP_BLOCK_SIZE, DEDUP_BLOCK_SIZE, dedup->Compare);
+            }
+
+            if (!NT_SUCCESS(status))
+            {
+                continue;
+            }
+
+            if (RtlCompareMemory(dedup->Compare, data, DEDUP_BLOCK_SIZE) == DEDUP_BLOCK_SIZE)
+            {
+                dedup->References[entry->Block]++;
+
+                dedup_release(dedup, stored);
+
+                dedup->Map[block] = entry->Block;
+
+                duplicate += DEDUP_BLOCK_SIZE;
+
+                continue;
+            }
+
+            collisions++;
+        }
+
+        /* a block that is shared, or not stored, is written to a free block */
+
+        if (stored == DEDUP_ZERO_BLOCK || dedup->References[stored] > 1)
+        {
+            dedup_release(dedup, stored);
+
+            stored = dedup_allocate(dedup, block);
+
+            if (stored == DEDUP_ZERO_BLOCK)
+            {
+                status = STATUS_DISK_FULL;
+                continue;
+            }
+
+            dedup->Map[block] = stored;
+        }
+
+        entry->Hash = hash;
+        entry->Block = stored;
+
+        written += DEDUP_BLOCK_SIZE;
+
+        if (data == dedup->Block)
+        {
+            status = StripeWrite(DeviceExtension, (LONGLONG) stored * DEDUP_BLOCK_SIZE, DEDUP_BLOCK_SIZE, data);
+        }
+        else if (run_count && run_block + run_count == stored && run_data + run_count * DEDUP_BLOCK_SIZE == data)
+        {
+            run_count++;
+        }
+        else
+        {
+            if (run_count)
+            {
+                status = dedup_run(DeviceExtension, write, run_block, run_count, run_data);
+            }
+
+            run_data = data;
+            run_block = stored;
+            run_count = 1;
+        }
+    }
+
+    KeAcquireSpinLock(&dedup->Lock, &irql);
+
+    dedup->Written += written;
+    dedup->Duplicate += duplicate;
+    dedup->Collisions += collisions;
+
+    KeReleaseSpinLock(&dedup->Lock, irql);
+
+    return status;
+}
+
+VOID
+DedupThread (
+    IN PVOID Context
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PDEDUP              dedup;
+    PLIST_ENTRY         entry;
+    PIRP                irp;
+    NTSTATUS            status;
+
+    device_extension = (PDEVICE_EXTENSION) Context;
+
+    dedup = &device_extension->Dedup;
+
+    while (!dedup->Stop)
+    {
+        KeWaitForSingleObject(&dedup->QueueEvent, Executive, KernelMode, FALSE, NULL);
+
+        while ((entry = ExInterlockedRemoveHeadList(&dedup->Queue, &dedup->Lock)) != NULL)
+        {
+            irp = CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry);
+
+            status = dedup_read_write(device_extension, irp);
+
+            irp->IoStatus.Status = status;
+            irp->IoStatus.Information = NT_SUCCESS(status) ? IoGetCurrentIrpStackLocation(irp)->Parameters.Read.Length : 0;
+
+            IoCompleteRequest(irp, IO_DISK_INCREMENT);
+        }
+    }
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+/* not pageable since it takes the spin lock */
+
+VOID
+DedupQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    OUT PSWAPFS_STATISTICS  Statistics,
+    IN BOOLEAN              Reset
+    )
+{
+    PDEDUP  dedup;
+    KIRQL   irql;
+
+    dedup = &DeviceExtension->Dedup;
+
+    KeAcquireSpinLock(&dedup->Lock, &irql);
+
+    Statistics->DedupWritten = dedup->Written;
+    Statistics->DedupDuplicate = dedup->Duplicate;
+    Statistics->DedupCollisions = dedup->Collisions;
+
+    if (Reset)
+    {
+        dedup->Written = 0;
+        dedup->Duplicate = 0;
+        dedup->Collisions = 0;
+    }
+
+    KeReleaseSpinLock(&dedup->Lock, irql);
+}
@@ -0,0 +1,167 @@
+/*
+    Functions to write ETW events of the driver.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The events are self-describing TraceLogging events, so WPR and WPA can
+    decode them without a manifest installed. The reads and writes are
+    traced at the verbose level, the length fixups of the device controls,
+    the paging path changes and the phases of the format at the info level,
+    each under a keyword of its own. The callers check that the provider is
+    enabled for the level and keyword before calling, so nothing more than
+    that check is done when no session is tracing the driver.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swapfsetw.h"
+
+/* b0b212b3-5db2-5d09-2ba3-120e5bd58f30 */
+
+TRACELOGGING_DEFINE_PROVIDER(
+    SwapFsTraceProvider,
+    "SwapFs",
+    (0xb0b212b3, 0x5db2, 0x5d09, 0x2b, 0xa3, 0x12, 0x0e, 0x5b, 0xd5, 0x8f, 0x30)
+    );
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", EtwRegister)
+#pragma alloc_text("INIT", EtwUnregister)
+#pragma alloc_text("PAGE", EtwFormatPhase)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+EtwRegister (
+    VOID
+    )
+{
+    return TraceLoggingRegister(SwapFsTraceProvider);
+}
+
+VOID
+EtwUnregister (
+    VOID
+    )
+{
+    TraceLoggingUnregister(SwapFsTraceProvider);
+}
+
+VOID
+EtwReadWriteDispatch (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PIO_STACK_LOCATION io_stack;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    TraceLoggingWrite(
+        SwapFsTraceProvider,
+        "ReadWriteDispatch",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+        TraceLoggingKeyword(SWAPFS_KEYWORD_READ_WRITE),
+        TraceLoggingPointer(DeviceObject, "DeviceObject"),
+        TraceLoggingPointer(Irp, "Irp"),
+        TraceLoggingUInt8(io_stack->MajorFunction, "MajorFunction"),
+        TraceLoggingInt64(io_stack->Parameters.Read.ByteOffset.QuadPart, "Offset"),
+        TraceLoggingUInt32(io_stack->Parameters.Read.Length, "Length")
+        );
+}
+
+VOID
+EtwReadWriteComplete (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN LONGLONG         Latency
+    )
+{
+    TraceLoggingWrite(
+        SwapFsTraceProvider,
+        "ReadWriteComplete",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+        TraceLoggingKeyword(SWAPFS_KEYWORD_READ_WRITE),
+        TraceLoggingPointer(DeviceObject, "DeviceObject"),
+        TraceLoggingPointer(Irp, "Irp"),
+        TraceLoggingUInt8(IoGetCurrentIrpStackLocation(Irp)->MajorFunction, "MajorFunction"),
+        TraceLoggingNTStatus(Irp->IoStatus.Status, "Status"),
+        TraceLoggingUInt64(Irp->IoStatus.Information, "Information"),
+        TraceLoggingInt64(Latency, "LatencyUs")
+        );
+}
+
+VOID
+EtwLengthFixup (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            IoControlCode,
+    IN LONGLONG         PartitionLength,
+    IN LONGLONG         VolumeLength
+    )
+{
+    TraceLoggingWrite(
+        SwapFsTraceProvider,
+        "LengthFixup",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(SWAPFS_KEYWORD_IOCTL),
+        TraceLoggingPointer(DeviceObject, "DeviceObject"),
+        TraceLoggingHexUInt32(IoControlCode, "IoControlCode"),
+        TraceLoggingInt64(PartitionLength, "PartitionLength"),
+        TraceLoggingInt64(VolumeLength, "VolumeLength")
+        );
+}
+
+VOID
+EtwPagingPath (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN BOOLEAN          InPath,
+    IN LONG             PagingPathCount,
+    IN NTSTATUS         Status
+    )
+{
+    TraceLoggingWrite(
+        SwapFsTraceProvider,
+        "PagingPath",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(SWAPFS_KEYWORD_PNP),
+        TraceLoggingPointer(DeviceObject, "DeviceObject"),
+        TraceLoggingBoolean(InPath, "InPath"),
+        TraceLoggingInt32(PagingPathCount, "PagingPathCount"),
+        TraceLoggingNTStatus(Status, "Status")
+        );
+}
+
+VOID
+EtwFormatPhase (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PCSTR                Phase,
+    IN ULONG                Sector,
+    IN ULONG                NumberOfSectors
+    )
+{
+    PAGED_CODE();
+
+    TraceLoggingWrite(
+        SwapFsTraceProvider,
+        "FormatPhase",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+        TraceLoggingKeyword(SWAPFS_KEYWORD_FORMAT),
+        TraceLoggingPointer(DeviceExtension->DeviceObject, "DeviceObject"),
+        TraceLoggingString(Phase, "Phase"),
+        TraceLoggingUInt32(Sector, "Sector"),
+        TraceLoggingUInt32(NumberOfSectors, "NumberOfSectors")
+        );
+}
@@ -0,0 +1,683 @@
+/*
+    Function to format a device to exFAT.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Large devices are formated to exFAT, which has no limit of 2^32 sectors
+    or 4 GB files and keeps track of the free clusters in an allocation
+    bitmap. The boot region is written twice, followed by the FAT and the
+    cluster heap, which starts with the allocation bitmap, the up-case
+    table and the root directory. Since the bitmap decides which clusters
+    are free the FAT is only read for clusters in a chain, so only its head
+    holding the chains of the three system files is written and formating
+    takes the same time on a volume of some GB as on one of many TB. The
+    up-case table is made from RtlUpcaseUnicodeChar and compressed.
+*/
+
+#include <ntddk.h>
+#include <ntdddisk.h>
+#include "swapfs.h"
+#include "swap.h"
+#include "exfat.h"
+
+#define EXFAT_PREFERRED_SIZE    0x800000000
+#define EXFAT_DEFAULT_CLUSTER_SIZE  0x20000
+#define UPCASE_TABLE_SIZE       0x20000
+#define WRITE_BURST_SIZE        0x10000
+
+static ULONG
+ExFatChecksum (
+    IN ULONG    Checksum,
+    IN PUCHAR   Buffer,
+    IN ULONG    Length,
+    IN BOOLEAN  BootSector
+    );
+
+static ULONG
+ExFatBuildUpcaseTable (
+    OUT PUSHORT Table
+    );
+
+static BOOLEAN
+ExFatCopyExtent (
+    IN PUCHAR       Region,
+    IN ULONGLONG    RegionOffset,
+    IN ULONG        RegionLength,
+    IN PVOID        Data,
+    IN ULONGLONG    DataOffset,
+    IN ULONG        DataLength
+    );
+
+static NTSTATUS
+ExFatWriteSectors (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                Sector,
+    IN ULONG                SectorSize,
+    IN ULONG                NumberOfSectors,
+    IN PVOID                Buffer
+    );
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("PAGE", FormatDeviceToExFat)
+#pragma alloc_text("PAGE", ExFatChecksum)
+#pragma alloc_text("PAGE", ExFatBuildUpcaseTable)
+#pragma alloc_text("PAGE", ExFatCopyExtent)
+#pragma alloc_text("PAGE", ExFatWriteSectors)
+#endif // ALLOC_PRAGMA
+
+static ULONG
+ExFatChecksum (
+    IN ULONG    Checksum,
+    IN PUCHAR   Buffer,
+    IN ULONG    Length,
+    IN BOOLEAN  BootSector
+    )
+{
+    ULONG n;
+
+    for (n = 0; n < Length; n++)
+    {
+        /* VolumeFlags and PercentInUse of the boot sector are not included */
+
+        if (BootSector && (n == 106 || n == 107 || n == 112))
+        {
+            continue;
+        }
+
+        Checksum = ((Checksum & 1) ? 0x80000000 : 0) + (Checksum >> 1) + Buffer[n];
+    }
+
+    return Checksum;
+}
+
+static ULONG
+ExFatBuildUpcaseTable (
+    OUT PUSHORT Table
+    )
+{
+    ULONG c;
+    ULONG run;
+    ULONG n;
+
+    n = 0;
+
+    for (c = 0; c < 0x10000; c += run)
+    {
+        for (run = 0; c + run < 0x10000 && run < 0xffff; run++)
+        {
+            if (RtlUpcaseUnicodeChar((WCHAR) (c + run)) != (WCHAR) (c + run))
+            {
+                break;
+            }
+        }
+
+        /* a run of characters that are their own upper case is stored as 0xffff
+           and the length of the run, which is also how 0xffff itself is stored */
+
+        if (run > 2 || (run && c + run == 0x10000))
+        {
+            Table[n++] = 0xffff;
+            Table[n++] = (USHORT) run;
+        }
+        else
+        {
+            Table[n++] = RtlUpcaseUnicodeChar((WCHAR) c);
+            run = 1;
+        }
+    }
+
+    return n * sizeof(USHORT);
+}
+
+static BOOLEAN
+ExFatCopyExtent (
+    IN PUCHAR       Region,
+    IN ULONGLONG    RegionOffset,
+    IN ULONG        RegionLength,
+    IN PVOID        Data,
+    IN ULONGLONG    DataOffset,
+    IN ULONG        DataLength
+    )
+{
+    ULONGLONG start;
+    ULONGLONG end;
+
+    start = max(RegionOffset, DataOffset);
+
+    end = min(RegionOffset + RegionLength, DataOffset + DataLength);
+
+    if (start >= end)
+    {
+        return FALSE;
+    }
+
+    RtlCopyMemory(
+        Region + (start - RegionOffset),
+        (PUCHAR) Data + (start - DataOffset),
+        (ULONG) (end - start)
+        );
+
+    return TRUE;
+}
+
+static NTSTATUS
+ExFatWriteSectors (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                Sector,
+    IN ULONG                SectorSize,
+    IN ULONG                NumberOfSectors,
+    IN PVOID                Buffer
+    )
+{
+    NTSTATUS status;
+
+    status = StripeWrite(
+        DeviceExtension,
+        (LONGLONG) Sector * SectorSize,
+        NumberOfSectors * SectorSize,
+        Buffer
+        );
+
+    if (NT_SUCCESS(status))
+    {
+        ZeroFillMarkWritten(DeviceExtension, (LONGLONG) Sector * SectorSize, NumberOfSectors * SectorSize);
+        MetaCacheUpdate(DeviceExtension, (LONGLONG) Sector * SectorSize, NumberOfSectors * SectorSize, Buffer);
+    }
+
+    return status;
+}
+
+NTSTATUS
+FormatDeviceToExFat (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PDEVICE_OBJECT              DeviceObject;
+    ULONG                       size;
+    NTSTATUS                    status;
+    DISK_GEOMETRY               disk_geometry;
+    PARTITION_INFORMATION       partition_information;
+    PARTITION_INFORMATION_EX    partition_information_ex;
+    ALIGNMENT_INFORMATION       alignment_information;
+    FORMAT_LAYOUT               layout;
+    ULONG                       sector_size;
+    ULONG                       sector_shift;
+    ULONG                       cluster_shift;
+    ULONG                       cluster_size;
+    ULONGLONG                   nsector;
+    ULONG                       align;
+    ULONG                       phase;
+    ULONG                       fat_offset;
+    ULONG                       fat_length;
+    ULONG                       fat_head;
+    ULONG                       heap_offset;
+    ULONG                       ncluster;
+    ULONG                       bitmap_length;
+    ULONG                       bitmap_head;
+    ULONG                       bitmap_clusters;
+    ULONG                       upcase_length;
+    ULONG                       upcase_clusters;
+    ULONG                       root_cluster;
+    ULONG                       nsystem;
+    ULONG                       nmeta;
+    ULONG                       checksum;
+    PUSHORT                     upcase_table;
+    PUCHAR                      buffer;
+    PUCHAR                      boot_region;
+    PEXFAT_BOOT_SECTOR          boot_sector;
+    PULONG                      fat;
+    PUCHAR                      bitmap;
+    PUCHAR                      region;
+    UCHAR                       root_dir[3 * 32];
+    PEXFAT_LABEL_ENTRY          label_entry;
+    PEXFAT_BITMAP_ENTRY         bitmap_entry;
+    PEXFAT_UPCASE_ENTRY         upcase_entry;
+    ULONG                       burst;
+    ULONG                       count;
+    ULONG                       n;
+    ULONG                       nirp;
+    BOOLEAN                     copied;
+    BOOLEAN                     zeroed;
+    LARGE_INTEGER               offset;
+    LARGE_INTEGER               frequency;
+    LARGE_INTEGER               start_time;
+    LARGE_INTEGER               end_time;
+
+    ASSERT(DeviceExtension != NULL);
+
+    DeviceObject = DeviceExtension->TargetDeviceObject;
+
+    size = sizeof(disk_geometry);
+
+    status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_GET_DRIVE_GEOMETRY,
+        NULL,
+        0,
+        &disk_geometry,
+        &size
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    size = sizeof(partition_information);
+
+    /* IOCTL_DISK_GET_PARTITION_INFO is only supported on disks with MBR,
+       retry IOCTL_DISK_GET_PARTITION_INFO_EX on disks with GPT. */
+
+    status = BlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_GET_PARTITION_INFO,
+        NULL,
+        0,
+        &partition_information,
+        &size
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        size = sizeof(partition_information_ex);
+
+        status = BlockDeviceIoControl(
+            DeviceObject,
+            IOCTL_DISK_GET_PARTITION_INFO_EX,
+            NULL,
+            0,
+            &partition_information_ex,
+            &size
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            return status;
+        }
+
+        partition_information.PartitionLength.QuadPart = partition_information_ex.PartitionLength.QuadPart;
+    }
+
+    partition_information.PartitionLength.QuadPart = SwapFsVolumeLength(
+        DeviceExtension,
+        partition_information.PartitionLength.QuadPart
+        );
+
+    /* smaller devices are formated to FAT32 as before */
+
+    if (partition_information.PartitionLength.QuadPart < EXFAT_PREFERRED_SIZE)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    sector_size = disk_geometry.BytesPerSector;
+
+    for (sector_shift = 9; sector_shift <= 12; sector_shift++)
+    {
+        if (sector_size == 1UL << sector_shift)
+        {
+            break;
+        }
+    }
+
+    if (sector_shift > 12)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    nsector = partition_information.PartitionLength.QuadPart / sector_size;
+
+    /* the FAT and the cluster heap starts at the alignment of the device,
+       which is found the same way as in fat32format.c */
+
+    if (DeviceExtension->Stripe.NumberOfMembers)
+    {
+        alignment_information.Alignment = DeviceExtension->Stripe.StripeSize;
+        alignment_information.AlignmentOffset = sizeof(union swap_header) % alignment_information.Alignment;
+    }
+    else if (!NT_SUCCESS(BlockDeviceQueryAlignment(DeviceObject, &alignment_information)))
+    {
+        alignment_information.Alignment = sector_size;
+        alignment_information.AlignmentOffset = 0;
+    }
+
+    align = 1;
+    phase = 0;
+
+    if (alignment_information.Alignment > sector_size &&
+        alignment_information.Alignment % sector_size == 0 &&
+        alignment_information.AlignmentOffset % sector_size == 0)
+    {
+        align = alignment_information.Alignment / sector_size;
+        phase = ((alignment_information.AlignmentOffset + alignment_information.Alignment -
+            sizeof(union swap_header) % alignment_information.Alignment) %
+            alignment_information.Alignment) / sector_size;
+    }
+
+    fat_offset = EXFAT_MIN_FAT_OFFSET + (phase + align - EXFAT_MIN_FAT_OFFSET % align) % align;
+
+    /* the default cluster size is the one Windows uses for exFAT on large volumes */
+
+    cluster_size = EXFAT_DEFAULT_CLUSTER_SIZE;
+
+    layout.FatType = FAT_TYPE_EXFAT;
+    layout.SectorSize = sector_size;
+    layout.SectorsPerCluster = max(1, cluster_size / sector_size);
+    layout.ReservedSectors = fat_offset;
+    layout.NumberOfFats = 1;
+    layout.RootDirSectors = 0;
+
+    status = FormatLayoutPlan(DeviceExtension, nsector, &layout);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    for (cluster_shift = 0; (1UL << cluster_shift) < layout.SectorsPerCluster; cluster_shift++)
+        ;
+
+    cluster_size = layout.SectorsPerCluster * sector_size;
+
+    fat_length = (layout.FatSectors + align - 1) / align * align;
+
+    heap_offset = fat_offset + fat_length;
+
+    ncluster = (ULONG) min((nsector - heap_offset) / layout.SectorsPerCluster, EXFAT_MAX_CLUSTERS);
+
+    if ((ULONGLONG) (ncluster + 2) * sizeof(ULONG) > (ULONGLONG) fat_length * sector_size)
+    {
+        KdPrint(("SwapFs: The FAT of %u sectors is too small for %u clusters.\n", fat_length, ncluster));
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    upcase_table = (PUSHORT) ExAllocatePoolWithTag(PagedPool, UPCASE_TABLE_SIZE, SWAPFS_POOL_TAG);
+
+    if (!upcase_table)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    upcase_length = ExFatBuildUpcaseTable(upcase_table);
+
+    /* the allocation bitmap, the up-case table and the root directory are
+       the first clusters of the heap */
+
+    bitmap_length = (ncluster + 7) / 8;
+
+    bitmap_clusters = (bitmap_length + cluster_size - 1) / cluster_size;
+
+    upcase_clusters = (upcase_length + cluster_size - 1) / cluster_size;
+
+    root_cluster = EXFAT_FIRST_CLUSTER + bitmap_clusters + upcase_clusters;
+
+    nsystem = bitmap_clusters + upcase_clusters + 1;
+
+    if (nsystem >= ncluster)
+    {
+        ExFreePool(upcase_table);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    nmeta = heap_offset + nsystem * layout.SectorsPerCluster;
+
+    fat_head = ((EXFAT_FIRST_CLUSTER + nsystem) * sizeof(ULONG) + sector_size - 1) / sector_size;
+
+    bitmap_head = (nsystem + 7) / 8;
+
+    burst = max(1, WRITE_BURST_SIZE / sector_size);
+
+    buffer = (PUCHAR) ExAllocatePoolWithTag(
+        PagedPool,
+        (EXFAT_BOOT_REGION_SECTORS + fat_head + burst) * sector_size + bitmap_head,
+        SWAPFS_POOL_TAG
+        );
+
+    if (!buffer)
+    {
+        ExFreePool(upcase_table);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(buffer, (EXFAT_BOOT_REGION_SECTORS + fat_head) * sector_size + bitmap_head);
+
+    boot_region = buffer;
+
+    fat = (PULONG) (boot_region + EXFAT_BOOT_REGION_SECTORS * sector_size);
+
+    region = (PUCHAR) fat + fat_head * sector_size;
+
+    bitmap = region + burst * sector_size;
+
+    /* the boot sector, eight extended boot sectors, the OEM parameters,
+       a reserved sector and a sector filled with the checksum of them */
+
+    boot_sector = (PEXFAT_BOOT_SECTOR) boot_region;
+
+    boot_sector->JumpBoot[0] = 0xeb;
+    boot_sector->JumpBoot[1] = 0x76;
+    boot_sector->JumpBoot[2] = 0x90;
+
+    RtlCopyMemory(boot_sector->FileSystemName, EXFAT_SIGN, 8);
+
+    boot_sector->PartitionOffset = 0;
+    boot_sector->VolumeLength = nsector;
+    boot_sector->FatOffset = fat_offset;
+    boot_sector->FatLength = fat_length;
+    boot_sector->ClusterHeapOffset = heap_offset;
+    boot_sector->ClusterCount = ncluster;
+    boot_sector->FirstClusterOfRootDirectory = root_cluster;
+    boot_sector->VolumeSerialNumber = 0x20261017;
+    boot_sector->FileSystemRevision = EXFAT_REVISION;
+    boot_sector->VolumeFlags = 0;
+    boot_sector->BytesPerSectorShift = (UCHAR) sector_shift;
+    boot_sector->SectorsPerClusterShift = (UCHAR) cluster_shift;
+    boot_sector->NumberOfFats = 1;
+    boot_sector->DriveSelect = 0x80;
+    boot_sector->PercentInUse = (UCHAR) ((ULONGLONG) nsystem * 100 / ncluster);
+
+    RtlFillMemory(boot_sector->BootCode, sizeof(boot_sector->BootCode), 0xf4);
+
+    boot_sector->BootSignature = EXFAT_BOOT_SIGN;
+
+    for (n = 1; n <= 8; n++)
+    {
+        *(PULONG) (boot_region + (n + 1) * sector_size - sizeof(ULONG)) = EXFAT_EXT_BOOT_SIGN;
+    }
+
+    checksum = ExFatChecksum(0, boot_region, sector_size, TRUE);
+
+    checksum = ExFatChecksum(checksum, boot_region + sector_size, (EXFAT_CHECKSUM_SECTOR - 1) * sector_size, FALSE);
+
+    for (n = 0; n < sector_size / sizeof(ULONG); n++)
+    {
+        ((PULONG) (boot_region + EXFAT_CHECKSUM_SECTOR * sector_size))[n] = checksum;
+    }
+
+    /* the head of the FAT with the chains of the system files */
+
+    fat[0] = EXFAT_FAT_MEDIA;
+    fat[1] = EXFAT_FAT_EOC;
+
+    for (n = EXFAT_FIRST_CLUSTER; n <= root_cluster; n++)
+    {
+        if (n == EXFAT_FIRST_CLUSTER + bitmap_clusters - 1 ||
+            n == EXFAT_FIRST_CLUSTER + bitmap_clusters + upcase_clusters - 1 ||
+            n == root_cluster)
+        {
+            fat[n] = EXFAT_FAT_EOC;
+        }
+        else
+        {
+            fat[n] = n + 1;
+        }
+    }
+
+    /* the system files are the only clusters in use */
+
+    for (n = 0; n < nsystem; n++)
+    {
+        bitmap[n / 8] |= 1 << (n % 8);
+    }
+
+    /* the root directory starts with the volume label, the allocation bitmap
+       and the up-case table */
+
+    RtlZeroMemory(root_dir, sizeof(root_dir));
+
+    label_entry = (PEXFAT_LABEL_ENTRY) &root_dir[0];
+    bitmap_entry = (PEXFAT_BITMAP_ENTRY) &root_dir[32];
+    upcase_entry = (PEXFAT_UPCASE_ENTRY) &root_dir[64];
+
+    label_entry->EntryType = EXFAT_TYPE_LABEL;
+    label_entry->CharacterCount = 4;
+    RtlCopyMemory(label_entry->VolumeLabel, L"Swap", 4 * sizeof(WCHAR));
+
+    bitmap_entry->EntryType = EXFAT_TYPE_BITMAP;
+    bitmap_entry->FirstCluster = EXFAT_FIRST_CLUSTER;
+    bitmap_entry->DataLength = bitmap_length;
+
+    upcase_entry->EntryType = EXFAT_TYPE_UPCASE;
+    upcase_entry->TableChecksum = ExFatChecksum(0, (PUCHAR) upcase_table, upcase_length, FALSE);
+    upcase_entry->FirstCluster = EXFAT_FIRST_CLUSTER + bitmap_clusters;
+    upcase_entry->DataLength = upcase_length;
+
+    /* with VirtualZeroFill or a device that can clear the sectors only those
+       that are not zero needs to be written */
+
+    offset.QuadPart = sizeof(union swap_header) + (LONGLONG) heap_offset * sector_size;
+
+    TimelineBegin(DeviceExtension, SWAPFS_PHASE_ZERO);
+
+    if (DeviceExtension->VirtualZeroFill && NT_SUCCESS(ZeroFillInitialize(DeviceExtension, sector_size, nmeta)))
+    {
+        zeroed = TRUE;
+    }
+    else
+    {
+        zeroed = !DeviceExtension->Stripe.NumberOfMembers &&
+            NT_SUCCESS(TrimBlockDevice(DeviceObject, &offset, (LONGLONG) nsystem * cluster_size, sector_size));
+
+        if (zeroed)
+        {
+            TimelineTransfer(DeviceExtension, (LONGLONG) nsystem * cluster_size);
+        }
+    }
+
+    /* the cache starts out as zero so it's prewarmed by the writes below, it's
+       released with the zero bitmap when one of them fails so the next
+       formatter can create them again */
+
+    if (DeviceExtension->MetaCacheSize)
+    {
+        MetaCacheInitialize(DeviceExtension, sector_size, nmeta);
+    }
+
+    TimelineBegin(DeviceExtension, SWAPFS_PHASE_METADATA);
+
+    nirp = 0;
+
+    start_time = KeQueryPerformanceCounter(&frequency);
+
+    for (n = 0; n < 2; n++)
+    {
+        status = ExFatWriteSectors(
+            DeviceExtension,
+            n * EXFAT_BOOT_REGION_SECTORS,
+            sector_size,
+            EXFAT_BOOT_REGION_SECTORS,
+            boot_region
+            );
+
+        nirp++;
+
+        if (!NT_SUCCESS(status))
+        {
+            ExFreePool(buffer);
+            ExFreePool(upcase_table);
+            MetaCacheRelease(DeviceExtension);
+            ZeroFillRelease(DeviceExtension);
+            return status;
+        }
+    }
+
+    status = ExFatWriteSectors(DeviceExtension, fat_offset, sector_size, fat_head, fat);
+
+    nirp++;
+
+    if (!NT_SUCCESS(status))
+    {
+        ExFreePool(buffer);
+        ExFreePool(upcase_table);
+        MetaCacheRelease(DeviceExtension);
+        ZeroFillRelease(DeviceExtension);
+        return status;
+    }
+
+    for (n = 0; n < nsystem * layout.SectorsPerCluster; n += count)
+    {
+        count = min(nsystem * layout.SectorsPerCluster - n, burst);
+
+        RtlZeroMemory(region, count * sector_size);
+
+        copied = ExFatCopyExtent(region, (ULONGLONG) n * sector_size, count * sector_size,
+            bitmap, 0, bitmap_head);
+
+        copied |= ExFatCopyExtent(region, (ULONGLONG) n * sector_size, count * sector_size,
+            upcase_table, (ULONGLONG) bitmap_clusters * cluster_size, upcase_length);
+
+        copied |= ExFatCopyExtent(region, (ULONGLONG) n * sector_size, count * sector_size,
+            root_dir, (ULONGLONG) (bitmap_clusters + upcase_clusters) * cluster_size, sizeof(root_dir));
+
+        if (zeroed && !copied)
+        {
+            continue;
+        }
+
+        status = ExFatWriteSectors(DeviceExtension, heap_offset + n, sector_size, count, region);
+
+        nirp++;
+
+        if (!NT_SUCCESS(status))
+        {
+            ExFreePool(buffer);
+            ExFreePool(upcase_table);
+            MetaCacheRelease(DeviceExtension);
+            ZeroFillRelease(DeviceExtension);
+            return status;
+        }
+    }
+
+    end_time = KeQueryPerformanceCounter(NULL);
+
+    ExFreePool(buffer);
+    ExFreePool(upcase_table);
+
+    KdPrint(("SwapFs: Wrote %u requests in %I64u ms.\n",
+        nirp, (end_time.QuadPart - start_time.QuadPart) * 1000 / frequency.QuadPart));
+
+    KdPrint(("SwapFs: FAT at sector %u and cluster heap at sector %u aligned to %u sectors, up-case table of %u bytes.\n",
+        fat_offset, heap_offset, align, upcase_length));
+
+    KdPrint(("SwapFs: Device size is %uMB having %I64u sectors of %u bytes formated to exFAT using %u clusters of %u sectors.\n",
+        (ULONG) (partition_information.PartitionLength.QuadPart / 0x100000),
+        nsector, sector_size, ncluster, layout.SectorsPerCluster));
+
+    StampRecord(DeviceExtension, FAT_TYPE_EXFAT, sector_size, fat_offset, nmeta, partition_information.PartitionLength.QuadPart);
+
+    return STATUS_SUCCESS;
+}
@@ -26,6 +26,7 @@
 #include <ntddk.h>
 #include <ntdddisk.h>
 #include "swapfs.h"
+#include "swapfsetw.h"
 #include "swap.h"
 #include "fat.h"
 #include "fat32.h"
@@ -36,7 +37,7 @@
 #define die(x) { return -1; }
 #endif // !DBG
 
-#pragma code_seg("INIT")
+#pragma code_seg("PAGE")
 
 static void *malloc(size_t size)
 {
@@ -80,36 +81,76 @@ static DWORD get_fat_size_sectors ( DWORD DskSize, DWORD ReservedSecCnt, DWORD S
     return( (DWORD) FatSz );
 }
 
-static int write_sect ( HANDLE hDevice, DWORD Sector, DWORD BytesPerSector, void *Data, DWORD NumSects )
+// Each phase starts with an event so the time of it can be seen in a trace
+static void trace_phase ( PDEVICE_EXTENSION pDevExt, PCSTR Phase, DWORD Sector, DWORD NumSects )
 {
-    LARGE_INTEGER offset;
+    if ( SwapFsEtwEnabled( WINEVENT_LEVEL_INFO, SWAPFS_KEYWORD_FORMAT ) )
+        EtwFormatPhase( pDevExt, Phase, Sector, NumSects );
+}
 
-    offset.QuadPart = Sector * BytesPerSector + sizeof(union swap_header);
+static int write_sect ( PDEVICE_EXTENSION pDevExt, DWORD Sector, DWORD BytesPerSector, void *Data, DWORD NumSects )
+{
+    NTSTATUS status;
 
-    return WriteBlockDevice(
-        hDevice,
-        &offset,
+    // The volume may be striped over several devices
+    status = StripeWrite(
+        pDevExt,
+        (LONGLONG) Sector * BytesPerSector,
         NumSects*BytesPerSector,
         Data
         );
+
+    // The sectors are no longer zero only in the bitmap, and the cache gets the same content
+    if ( NT_SUCCESS(status) )
+        {
+        ZeroFillMarkWritten( pDevExt, (LONGLONG) Sector * BytesPerSector, NumSects*BytesPerSector );
+        MetaCacheUpdate( pDevExt, (LONGLONG) Sector * BytesPerSector, NumSects*BytesPerSector, Data );
+        }
+
+    return status;
 }
 
-static int zero_sectors ( HANDLE hDevice, DWORD Sector, DWORD BytesPerSect, DWORD NumSects )
+static NTSTATUS zero_device_sectors ( PDEVICE_EXTENSION pDevExt, PDEVICE_OBJECT hDevice, LONGLONG qOffset, DWORD BytesPerSect, DWORD NumSects )
 {
+    BLOCK_IO_BATCH Batch;
     BYTE *pZeroSect;
     DWORD BurstSize;
     DWORD WriteSize;
+    LARGE_INTEGER offset;
 #if DBG
-    LONGLONG qBytesTotal=NumSects*BytesPerSect;
+    LONGLONG qBytesTotal=(LONGLONG)NumSects*BytesPerSect;
 #endif // DBG
     NTSTATUS status;
 
-    BurstSize = 128; // 64K
+    // Let the device clear the sectors if it reads back trimmed blocks as zeros
+    offset.QuadPart = qOffset;
+
+    if ( NT_SUCCESS(TrimBlockDevice( hDevice, &offset, (LONGLONG) NumSects * BytesPerSect, BytesPerSect )) )
+        {
+        TimelineTransfer( pDevExt, (LONGLONG) NumSects * BytesPerSect );
+        return STATUS_SUCCESS;
+        }
+
+    // Keep several writes in flight, each as big as the lower device accepts
+    BlockIoBatchInitialize( &Batch, hDevice, BLOCK_IO_QUEUE_DEPTH );
+
+    BurstSize = Batch.MaximumTransferLength / BytesPerSect;
+
+    if ( !BurstSize )
+        BurstSize = 1;
 
     pZeroSect = (BYTE*) malloc(BytesPerSect*BurstSize);
 
+    if ( !pZeroSect )
+        {
+        BlockIoBatchWait( &Batch );
+        return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
     memset(pZeroSect, 0, BytesPerSect*BurstSize);
 
+    status = STATUS_SUCCESS;
+
     while ( NumSects )
     {
         if ( NumSects > BurstSize )
@@ -117,23 +158,70 @@ static int zero_sectors ( HANDLE hDevice, DWORD Sector, DWORD BytesPerSect, DWOR
         else
             WriteSize = NumSects;
 
-        status = write_sect(hDevice, Sector, BytesPerSect, pZeroSect, WriteSize );
+        offset.QuadPart = qOffset;
 
-        Sector += WriteSize;
+        // All writes use the same zero buffer, it is only freed after the batch has completed
+        status = BlockIoBatchWrite( &Batch, &offset, WriteSize*BytesPerSect, pZeroSect );
 
-        if ( status ) {
-            free(pZeroSect);
-            die ( "Failed to write" );
-            }
+        if ( status )
+            break;
+
+        TimelineTransfer( pDevExt, (LONGLONG) WriteSize * BytesPerSect );
+
+        qOffset += (LONGLONG) WriteSize * BytesPerSect;
 
         NumSects -= WriteSize;
     }
 
+    if ( !status )
+        status = BlockIoBatchWait( &Batch );
+    else
+        BlockIoBatchWait( &Batch );
+
     free(pZeroSect);
 
+    if ( !NT_SUCCESS(status) )
+        {
+        KdPrint (( "SwapFs: Failed to write zeros, status 0x%08x.\n", status ));
+        return status;
+        }
+
     KdPrint (( "SwapFs: Wrote %I64d bytes.\n", qBytesTotal ));
 
-    return 0;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS zero_sectors ( PDEVICE_EXTENSION pDevExt, DWORD Sector, DWORD BytesPerSect, DWORD NumSects )
+{
+    PSTRIPE pStripe = &pDevExt->Stripe;
+    LONGLONG qRowSize;
+    LONGLONG qFirstRow;
+    LONGLONG qEndRow;
+    DWORD i;
+    NTSTATUS status;
+
+    if ( !pStripe->NumberOfMembers )
+        return zero_device_sectors( pDevExt, pDevExt->TargetDeviceObject, (LONGLONG) Sector * BytesPerSect + sizeof(union swap_header), BytesPerSect, NumSects );
+
+    // On a striped volume the whole rows of stripes holding the sectors are cleared on every member
+    qRowSize = (LONGLONG) pStripe->StripeSize * pStripe->NumberOfMembers;
+    qFirstRow = (LONGLONG) Sector * BytesPerSect / qRowSize;
+    qEndRow = ( (LONGLONG) ( Sector + NumSects ) * BytesPerSect + qRowSize - 1 ) / qRowSize;
+
+    if ( qEndRow > pStripe->MemberLength / pStripe->StripeSize )
+        qEndRow = pStripe->MemberLength / pStripe->StripeSize;
+
+    for ( i=0; i<pStripe->NumberOfMembers; i++ )
+        {
+        status = zero_device_sectors( pDevExt, pStripe->DeviceObject[i],
+                qFirstRow * pStripe->StripeSize + sizeof(union swap_header),
+                BytesPerSect,
+                (DWORD) ( ( qEndRow - qFirstRow ) * pStripe->StripeSize / BytesPerSect ) );
+        if ( !NT_SUCCESS(status) )
+            return status;
+        }
+
+    return STATUS_SUCCESS;
 }
 
 static BYTE get_spc ( DWORD ClusterSizeKB, DWORD BytesPerSect )
@@ -168,10 +256,11 @@ static BYTE get_sectors_per_cluster ( LONGLONG DiskSizeBytes, DWORD BytesPerSect
 
 NTSTATUS
 FormatDeviceToFat32 (
-    IN PDEVICE_OBJECT DeviceObject
+    IN PDEVICE_EXTENSION DeviceExtension
     )
 {
-    HANDLE hDevice = DeviceObject;
+    PDEVICE_EXTENSION pDevExt = DeviceExtension;
+    HANDLE hDevice = DeviceExtension->TargetDeviceObject;
     ULONG                       size;
     NTSTATUS                    status;
     // First open the device
@@ -201,12 +290,20 @@ FormatDeviceToFat32 (
 
     DWORD *pFirstSectOfFat;
 
+    // cluster size from the layout planner
+    FORMAT_LAYOUT flDrive;
+
+    // alignment of the FATs and the data region
+    ALIGNMENT_INFORMATION aiDrive;
+    DWORD AlignSects=1;
+    DWORD PhaseSects=0;
+
     BYTE VolId[12] = "Linux Swap ";
 
     // Debug temp vars
     ULONGLONG FatNeeded, ClusterCount;
 
-    ASSERT(DeviceObject != NULL);
+    ASSERT(DeviceExtension != NULL);
 
     VolumeId = 0x20100721;
 
@@ -264,7 +361,7 @@ FormatDeviceToFat32 (
         piDrive.HiddenSectors = 0;
     }
 
-    piDrive.PartitionLength.QuadPart -= sizeof(union swap_header);
+    piDrive.PartitionLength.QuadPart = SwapFsVolumeLength( pDevExt, piDrive.PartitionLength.QuadPart );
 
     // Only support hard disks at the moment
     //if ( dgDrive.BytesPerSector != 512 )
@@ -293,6 +390,8 @@ FormatDeviceToFat32 (
         die ( "This drive is too big for FAT32 - max 2TB supported\n" );
     }
 
+    trace_phase( pDevExt, "Geometry", 0, (DWORD) qTotalSectors );
+
     pFAT32BootSect = (FAT_BOOTSECTOR32*) malloc(BytesPerSect);
     memset(pFAT32BootSect, 0, BytesPerSect);
 
@@ -326,7 +425,58 @@ FormatDeviceToFat32 (
 
     SectorsPerCluster = get_sectors_per_cluster( piDrive.PartitionLength.QuadPart, BytesPerSect );
 
+    // Let the planner replace the cluster size with the one of the profile of the device
+    // and check the cluster count, the reserved sectors may still grow for the alignment
+    flDrive.FatType = 32;
+    flDrive.SectorSize = BytesPerSect;
+    flDrive.SectorsPerCluster = SectorsPerCluster;
+    flDrive.ReservedSectors = ReservedSectCount;
+    flDrive.NumberOfFats = NumFATs;
+    flDrive.RootDirSectors = 0;
+
+    if ( !NT_SUCCESS(FormatLayoutPlan( pDevExt, (DWORD) qTotalSectors, &flDrive )) )
+        {
+        free(pFAT32BootSect);
+        free(pFAT32FsInfo);
+        free(pFirstSectOfFat);
+        die ( "There is no cluster size that gives a valid FAT32 cluster count\n" );
+        }
+
+    SectorsPerCluster = flDrive.SectorsPerCluster;
+
     pFAT32BootSect->bSecPerClus = (BYTE) SectorsPerCluster ;
+
+    // Find the sector size of the alignment of the physical sectors, erase blocks or stripes of the device
+    // and the first sector of the volume that is aligned, the volume starts after the swap header
+    if ( pDevExt->Stripe.NumberOfMembers )
+        {
+        aiDrive.Alignment = pDevExt->Stripe.StripeSize;
+        aiDrive.AlignmentOffset = sizeof(union swap_header) % aiDrive.Alignment;
+        }
+    else if ( !NT_SUCCESS(BlockDeviceQueryAlignment( hDevice, &aiDrive )) )
+        {
+        aiDrive.Alignment = BytesPerSect;
+        aiDrive.AlignmentOffset = 0;
+        }
+
+    if ( aiDrive.Alignment > BytesPerSect && aiDrive.Alignment % BytesPerSect == 0 &&
+         aiDrive.AlignmentOffset % BytesPerSect == 0 )
+        {
+        AlignSects = aiDrive.Alignment / BytesPerSect;
+        PhaseSects = ( ( aiDrive.AlignmentOffset + aiDrive.Alignment - sizeof(union swap_header) % aiDrive.Alignment ) % aiDrive.Alignment ) / BytesPerSect;
+        }
+
+    // The reserved sectors are counted in a WORD, an alignment they can't be padded to is halved until they can
+    while ( AlignSects > 1 &&
+            ReservedSectCount + ( PhaseSects + AlignSects - ReservedSectCount % AlignSects ) % AlignSects > 0xFFFF )
+        {
+        AlignSects /= 2;
+        PhaseSects %= AlignSects;
+        }
+
+    // Pad the reserved sectors so the first FAT starts aligned
+    ReservedSectCount += ( PhaseSects + AlignSects - ReservedSectCount % AlignSects ) % AlignSects;
+
     pFAT32BootSect->wRsvdSecCnt = (WORD) ReservedSectCount;
     pFAT32BootSect->bNumFATs = (BYTE) NumFATs;
     pFAT32BootSect->wRootEntCnt = 0;
@@ -341,6 +491,15 @@ FormatDeviceToFat32 (
 
     FatSize = get_fat_size_sectors ( pFAT32BootSect->dTotSec32, pFAT32BootSect->wRsvdSecCnt, pFAT32BootSect->bSecPerClus, pFAT32BootSect->bNumFATs, BytesPerSect );
 
+    // Pad the FATs so the second FAT and the data region starts aligned too, a cluster is then
+    // aligned if it's at least as big as the alignment or else it's never split by it
+    FatSize = ( FatSize + AlignSects - 1 ) / AlignSects * AlignSects;
+
+    // The estimate leaves out the first two entries that are not clusters, grow the FAT until they fit too
+    while ( ( (ULONGLONG) ( TotalSectors - ReservedSectCount - NumFATs * FatSize ) / SectorsPerCluster + 2 ) * 4 >
+            (ULONGLONG) FatSize * BytesPerSect )
+        FatSize += AlignSects;
+
     pFAT32BootSect->dFATSz32 = FatSize;
     pFAT32BootSect->wExtFlags = 0;
     pFAT32BootSect->wFSVer = 0;
@@ -424,7 +583,7 @@ FormatDeviceToFat32 (
     // Sanity check, make sure the fat is big enough
     // Convert the cluster count into a Fat sector count, and check the fat size value we calculated
     // earlier is OK.
-    FatNeeded = ClusterCount * 4;
+    FatNeeded = ( ClusterCount + 2 ) * 4;
     FatNeeded += (BytesPerSect-1);
     FatNeeded /= BytesPerSect;
     if ( FatNeeded > FatSize )
@@ -435,11 +594,14 @@ FormatDeviceToFat32 (
         die ( "This drive is too big for this version of fat32format, check for an upgrade\n" );
         }
 
+    trace_phase( pDevExt, "Layout", ReservedSectCount + NumFATs * FatSize, UserAreaSize );
+
     // Now we're commited - print some info first
     //KdPrint (( "SwapFs: Size : %gGB %u sectors\n", (double) (piDrive.PartitionLength.QuadPart / (1000*1000*1000)), TotalSectors ));
     KdPrint (( "SwapFs: %d Bytes Per Sector, Cluster size %d bytes\n", BytesPerSect, SectorsPerCluster*BytesPerSect ));
     KdPrint (( "SwapFs: Volume ID is %x:%x\n", VolumeId>>16, VolumeId&0xffff ));
     KdPrint (( "SwapFs: %d Reserved Sectors, %d Sectors per FAT, %d fats\n", ReservedSectCount, FatSize, NumFATs ));
+    KdPrint (( "SwapFs: Data region aligned to %d sectors at sector %d\n", AlignSects, ReservedSectCount + NumFATs * FatSize ));
 
     KdPrint (( "SwapFs: %I64u Total clusters\n", ClusterCount ));
 
@@ -456,40 +618,74 @@ FormatDeviceToFat32 (
 
     // First zero out ReservedSect + FatSize * NumFats + SectorsPerCluster
     SystemAreaSize = (ReservedSectCount+(NumFATs*FatSize) + SectorsPerCluster);
-    KdPrint (( "SwapFs: Clearing out %d sectors for Reserved sectors, fats and root cluster...\n", SystemAreaSize ));
-    zero_sectors( hDevice, 0, BytesPerSect, SystemAreaSize);
+    trace_phase( pDevExt, "ClearSystemArea", 0, SystemAreaSize );
+    TimelineBegin( pDevExt, SWAPFS_PHASE_ZERO );
+    status = STATUS_SUCCESS;
+    // With VirtualZeroFill the sectors are only marked as zero, reads of them are completed with zeros until written
+    if ( pDevExt->VirtualZeroFill && NT_SUCCESS(ZeroFillInitialize( pDevExt, BytesPerSect, SystemAreaSize )) )
+        {
+        KdPrint (( "SwapFs: Marking %d sectors for Reserved sectors, fats and root cluster as zero...\n", SystemAreaSize ));
+        }
+    else
+        {
+        KdPrint (( "SwapFs: Clearing out %d sectors for Reserved sectors, fats and root cluster...\n", SystemAreaSize ));
+        // A volume is not written over FATs that are not cleared, the writes below are skipped and it fails
+        status = zero_sectors( pDevExt, 0, BytesPerSect, SystemAreaSize);
+        }
+    // The cache starts out as zero so it's prewarmed by the writes below
+    if ( pDevExt->MetaCacheSize && NT_SUCCESS(status) )
+        MetaCacheInitialize( pDevExt, BytesPerSect, SystemAreaSize );
     KdPrint (( "SwapFs: Initialising reserved sectors and FATs...\n" ));
+    trace_phase( pDevExt, "BootSectors", 0, BackupBootSect + 2 );
+    TimelineBegin( pDevExt, SWAPFS_PHASE_METADATA );
     // Now we should write the boot sector and fsinfo twice, once at 0 and once at the backup boot sect position
-    for ( i=0; i<2; i++ )
+    for ( i=0; i<2 && NT_SUCCESS(status); i++ )
         {
         int SectorStart = (i==0) ? 0 : BackupBootSect;
-        write_sect ( hDevice, SectorStart, BytesPerSect, pFAT32BootSect, 1 );
-        write_sect ( hDevice, SectorStart+1, BytesPerSect, pFAT32FsInfo, 1 );
+        status = write_sect ( pDevExt, SectorStart, BytesPerSect, pFAT32BootSect, 1 );
+        if ( NT_SUCCESS(status) )
+            status = write_sect ( pDevExt, SectorStart+1, BytesPerSect, pFAT32FsInfo, 1 );
         }
 
     // Write the first fat sector in the right places
-    for ( i=0; i<NumFATs; i++ )
+    trace_phase( pDevExt, "Fats", ReservedSectCount, NumFATs * FatSize );
+    for ( i=0; i<NumFATs && NT_SUCCESS(status); i++ )
         {
         int SectorStart = ReservedSectCount + (i * FatSize );
-        write_sect ( hDevice, SectorStart, BytesPerSect, pFirstSectOfFat, 1 );
+        status = write_sect ( pDevExt, SectorStart, BytesPerSect, pFirstSectOfFat, 1 );
         }
 
+    trace_phase( pDevExt, "RootDirectory", ReservedSectCount + (NumFATs * FatSize ), 1 );
     root_dir = (struct msdos_dir_entry*) pFirstSectOfFat;
     memset(root_dir, 0, BytesPerSect);
     memcpy(root_dir->name, "Swap    ", 8);
     memcpy(root_dir->ext, "   ", 3);
     root_dir->attr = ATTR_VOLUME;
-    write_sect ( hDevice, ReservedSectCount + (NumFATs * FatSize ), BytesPerSect, root_dir, 1 );
+    if ( NT_SUCCESS(status) )
+        status = write_sect ( pDevExt, ReservedSectCount + (NumFATs * FatSize ), BytesPerSect, root_dir, 1 );
 
     free(pFAT32BootSect);
     free(pFAT32FsInfo);
     free(pFirstSectOfFat);
 
+    // The next formatter creates the bitmap and the cache again
+    if ( !NT_SUCCESS(status) )
+        {
+        KdPrint (( "SwapFs: Failed to clear or write the reserved sectors, status 0x%08x.\n", status ));
+        MetaCacheRelease( pDevExt );
+        ZeroFillRelease( pDevExt );
+        return status;
+        }
+
     KdPrint(("SwapFs: Device size is %uMB having %I64u sectors of %u bytes formated to FAT%u using %I64u clusters of %u sectors.\n",
         (ULONG) (piDrive.PartitionLength.QuadPart / 0x100000),
         qTotalSectors, BytesPerSect, 32, ClusterCount, SectorsPerCluster));
 
+    StampRecord( pDevExt, 32, BytesPerSect, ReservedSectCount, SystemAreaSize, piDrive.PartitionLength.QuadPart );
+
+    trace_phase( pDevExt, "Done", 0, TotalSectors );
+
     return STATUS_SUCCESS;
 }
 
-#pragma code_seg() // end "INIT"
+#pragma code_seg() // end "PAGE"
@@ -23,16 +23,18 @@
 #include "fat.h"
 
 #define ROOT_DIR_ENTRYS 512
+#define WRITE_BURST_SIZE 0x10000
 
 #ifdef ALLOC_PRAGMA
-#pragma alloc_text("INIT", FormatDeviceToFat)
+#pragma alloc_text("PAGE", FormatDeviceToFat)
 #endif // ALLOC_PRAGMA
 
 NTSTATUS
 FormatDeviceToFat (
-    IN PDEVICE_OBJECT DeviceObject
+    IN PDEVICE_EXTENSION DeviceExtension
     )
 {
+    PDEVICE_OBJECT              DeviceObject;
     ULONG                       size;
     NTSTATUS                    status;
     DISK_GEOMETRY               disk_geometry;
@@ -46,11 +48,24 @@ FormatDeviceToFat (
     ULONG                       cluster_size;
     ULONG                       fat_type;
     ULONG                       fat_length;
+    FORMAT_LAYOUT               layout;
     LARGE_INTEGER               offset;
     ULONG                       n;
+    ULONG                       nmeta;
+    ULONG                       burst;
+    ULONG                       count;
+    ULONG                       nirp;
+    PUCHAR                      region;
+    PUCHAR                      fat;
+    BOOLEAN                     trimmed;
     struct msdos_dir_entry*     root_dir;
+    LARGE_INTEGER               frequency;
+    LARGE_INTEGER               start_time;
+    LARGE_INTEGER               end_time;
 
-    ASSERT(DeviceObject != NULL);
+    ASSERT(DeviceExtension != NULL);
+
+    DeviceObject = DeviceExtension->TargetDeviceObject;
 
     size = sizeof(disk_geometry);
 
@@ -103,6 +118,11 @@ FormatDeviceToFat (
         partition_information.PartitionLength.QuadPart = partition_information_ex.PartitionLength.QuadPart;
     }
 
+    partition_information.PartitionLength.QuadPart = SwapFsVolumeLength(
+        DeviceExtension,
+        partition_information.PartitionLength.QuadPart
+        );
+
     sector_size = (USHORT) disk_geometry.BytesPerSector;
 
     if (!sector_size)
@@ -135,8 +155,7 @@ FormatDeviceToFat (
 
     *(PUSHORT)boot_sector->dir_entries = ROOT_DIR_ENTRYS;
 
-    nsector = (ULONG) ((partition_information.PartitionLength.QuadPart -
-        sizeof(union swap_header)) / sector_size);
+    nsector = (ULONG) (partition_information.PartitionLength.QuadPart / sector_size);
 
     if (nsector <= 0xffff)
     {
@@ -147,39 +166,41 @@ FormatDeviceToFat (
         boot_sector->total_sect = nsector;
     }
 
-    boot_sector->cluster_size = 1;
-    ncluster = nsector;
+    /* the planner chooses the cluster size and between FAT12 and FAT16 */
+
+    layout.FatType = 16;
+    layout.SectorSize = sector_size;
+    layout.SectorsPerCluster = 1;
+    layout.ReservedSectors = 1;
+    layout.NumberOfFats = 1;
+    layout.RootDirSectors = sizeof(struct msdos_dir_entry) * ROOT_DIR_ENTRYS / sector_size;
+
+    status = FormatLayoutPlan(DeviceExtension, nsector, &layout);
 
-    while (ncluster > 0xffff && boot_sector->cluster_size <= 128)
+    if (!NT_SUCCESS(status))
     {
-        boot_sector->cluster_size <<= 1;
-        if (boot_sector->cluster_size == 0)
-        {
-            boot_sector->cluster_size = 128;
-            ncluster = 65517;
-            break;
-        }
-        ncluster = nsector / boot_sector->cluster_size;
+        ExFreePool(buffer);
+        return status;
     }
 
-    cluster_size = boot_sector->cluster_size;
+    boot_sector->cluster_size = (UCHAR) layout.SectorsPerCluster;
 
-    boot_sector->media = 0xf8;
+    cluster_size = layout.SectorsPerCluster;
 
-    if (ncluster > 4087)
-    {
-        fat_type = 16;
+    ncluster = layout.NumberOfClusters;
+
+    fat_type = layout.FatType;
 
-        fat_length = (ncluster * 2 + sector_size - 1) / sector_size;
+    fat_length = layout.FatSectors;
+
+    boot_sector->media = 0xf8;
 
+    if (fat_type == 16)
+    {
         RtlCopyMemory(boot_sector->fs_type, MSDOS_FAT16_SIGN, 8);
     }
     else
     {
-        fat_type = 12;
-
-        fat_length = (((ncluster * 3 + 1) / 2) + sector_size - 1) / sector_size;
-
         RtlCopyMemory(boot_sector->fs_type, MSDOS_FAT12_SIGN, 8);
     }
 
@@ -197,118 +218,134 @@ FormatDeviceToFat (
 
     boot_sector->boot_sign = BOOT_SIGN;
 
+    /* the boot sector, the FAT and the root directory are written in bursts,
+       as before the first sector after the root directory is cleared too */
+
+    nmeta = 1 + fat_length + 1 + (sizeof(struct msdos_dir_entry) * ROOT_DIR_ENTRYS / sector_size);
+
+    /* if the device can clear the sectors only those that are not zero needs to be written */
+
     offset.QuadPart = sizeof(union swap_header);
 
-    status = WriteBlockDevice(
-        DeviceObject,
-        &offset,
-        sector_size,
-        buffer
-        );
+    TimelineBegin(DeviceExtension, SWAPFS_PHASE_ZERO);
 
-    if (!NT_SUCCESS(status))
+    trimmed = !DeviceExtension->Stripe.NumberOfMembers &&
+        NT_SUCCESS(TrimBlockDevice(DeviceObject, &offset, (LONGLONG) nmeta * sector_size, sector_size));
+
+    if (trimmed)
     {
-        ExFreePool(buffer);
-        return status;
+        TimelineTransfer(DeviceExtension, (LONGLONG) nmeta * sector_size);
+        burst = 1;
     }
+    else
+    {
+        burst = min(nmeta, WRITE_BURST_SIZE / sector_size);
 
-    RtlZeroMemory(buffer, sector_size);
+        if (!burst)
+        {
+            burst = 1;
+        }
+    }
 
-    buffer[0] = 0xf8;
-    buffer[1] = 0xff;
-    buffer[2] = 0xff;
+    region = (PUCHAR) ExAllocatePoolWithTag(PagedPool, burst * sector_size, SWAPFS_POOL_TAG);
 
-    if (fat_type == 16)
+    if (!region)
     {
-        buffer[3] = 0xff;
+        ExFreePool(buffer);
+        return STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    offset.QuadPart += sector_size;
-
-    status = WriteBlockDevice(
-        DeviceObject,
-        &offset,
-        sector_size,
-        buffer
-        );
+    /* the cache starts out as zero so it's prewarmed by the writes below */
 
-    if (!NT_SUCCESS(status))
+    if (DeviceExtension->MetaCacheSize)
     {
-        ExFreePool(buffer);
-        return status;
+        MetaCacheInitialize(DeviceExtension, sector_size, nmeta);
     }
 
-    RtlZeroMemory(buffer, sector_size);
+    TimelineBegin(DeviceExtension, SWAPFS_PHASE_METADATA);
+
+    nirp = 0;
 
-    offset.QuadPart += sector_size;
+    start_time = KeQueryPerformanceCounter(&frequency);
 
-    for (n = 0;
-         n < fat_length - 1;
-         n++, offset.QuadPart += sector_size
-        )
+    for (n = 0; n < nmeta; n += count)
     {
-        status = WriteBlockDevice(
-            DeviceObject,
-            &offset,
-            sector_size,
-            buffer
-            );
+        count = min(nmeta - n, burst);
 
-        if (!NT_SUCCESS(status))
+        if (trimmed && n != 0 && n != 1 && n != 1 + fat_length)
         {
-            ExFreePool(buffer);
-            return status;
+            continue;
         }
-    }
 
-    root_dir = (struct msdos_dir_entry*) buffer;
+        RtlZeroMemory(region, count * sector_size);
 
-    RtlCopyMemory(root_dir->name, "Swap    ", 8);
-    RtlCopyMemory(root_dir->ext, "   ", 3);
-    root_dir->attr = ATTR_VOLUME;
+        /* sector 0 is the boot sector */
 
-    status = WriteBlockDevice(
-        DeviceObject,
-        &offset,
-        sector_size,
-        buffer
-        );
+        if (n == 0)
+        {
+            RtlCopyMemory(region, buffer, sector_size);
+        }
 
-    if (!NT_SUCCESS(status))
-    {
-        ExFreePool(buffer);
-        return status;
-    }
+        /* sector 1 is the first sector of the FAT */
 
-    RtlZeroMemory(buffer, sector_size);
+        if (n <= 1 && 1 < n + count)
+        {
+            fat = region + (1 - n) * sector_size;
 
-    offset.QuadPart += sector_size;
+            fat[0] = 0xf8;
+            fat[1] = 0xff;
+            fat[2] = 0xff;
 
-    for (n = 0;
-         n < (sizeof(struct msdos_dir_entry) * ROOT_DIR_ENTRYS / sector_size);
-         n++, offset.QuadPart += sector_size
-        )
-    {
-        status = WriteBlockDevice(
-            DeviceObject,
-            &offset,
-            sector_size,
-            buffer
+            if (fat_type == 16)
+            {
+                fat[3] = 0xff;
+            }
+        }
+
+        /* the root directory follows the FAT and starts with the volume label */
+
+        if (n <= 1 + fat_length && 1 + fat_length < n + count)
+        {
+            root_dir = (struct msdos_dir_entry*) (region + (1 + fat_length - n) * sector_size);
+
+            RtlCopyMemory(root_dir->name, "Swap    ", 8);
+            RtlCopyMemory(root_dir->ext, "   ", 3);
+            root_dir->attr = ATTR_VOLUME;
+        }
+
+        status = StripeWrite(
+            DeviceExtension,
+            (LONGLONG) n * sector_size,
+            count * sector_size,
+            region
             );
 
+        nirp++;
+
         if (!NT_SUCCESS(status))
         {
+            ExFreePool(region);
             ExFreePool(buffer);
+            MetaCacheRelease(DeviceExtension);
             return status;
         }
+
+        MetaCacheUpdate(DeviceExtension, (LONGLONG) n * sector_size, count * sector_size, region);
     }
 
+    end_time = KeQueryPerformanceCounter(NULL);
+
+    ExFreePool(region);
     ExFreePool(buffer);
 
+    KdPrint(("SwapFs: Wrote %u sectors in %u requests in %I64u ms.\n",
+        nmeta, nirp, (end_time.QuadPart - start_time.QuadPart) * 1000 / frequency.QuadPart));
+
     KdPrint(("SwapFs: Device size is %uMB having %u sectors of %u bytes formated to FAT%u using %u clusters of %u sectors.\n",
-        (ULONG) ((partition_information.PartitionLength.QuadPart -
-        sizeof(union swap_header)) / 0x100000),
+        (ULONG) (partition_information.PartitionLength.QuadPart / 0x100000),
         nsector, sector_size, fat_type, ncluster, cluster_size));
 
+    StampRecord(DeviceExtension, fat_type, sector_size, 1, nmeta, partition_information.PartitionLength.QuadPart);
+
     return STATUS_SUCCESS;
 }
@@ -0,0 +1,302 @@
+/*
+    Functions to plan the layout of the FAT file system on the swap device.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The formatters fill in the layout with the sector size, the reserved
+    sectors, the number of FATs, the root directory and the cluster size
+    they would use by default. The planner replaces the cluster size
+    with ClusterSize or the one of the FormatProfile of the device, then
+    moves it until the number of clusters is valid for the FAT type and
+    decides between FAT12 and FAT16. For exFAT only the upper limit of
+    the number of clusters is checked, and the clusters may be much
+    larger. Large sequential files wants large clusters so the FAT is
+    small and the files are less fragmented, many small files wants
+    small clusters so less space is wasted at their ends.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+
+#define FAT12_MAX_CLUSTERS      4084
+#define FAT16_MIN_CLUSTERS      4085
+#define FAT16_MAX_CLUSTERS      65524
+#define FAT32_MIN_CLUSTERS      65536
+#define FAT32_MAX_CLUSTERS      0x0FFFFFF5
+#define EXFAT_MAX_CLUSTERS      0xFFFFFFF5
+
+#define MAX_SECTORS_PER_CLUSTER 128
+#define MAX_CLUSTER_SIZE        0x10000
+#define EXFAT_MAX_CLUSTER_SIZE  0x2000000
+
+#define LARGE_SEQUENTIAL_CLUSTER_SIZE   0x8000
+#define MANY_SMALL_FILES_CLUSTER_SIZE   0x1000
+#define EXFAT_LARGE_SEQUENTIAL_CLUSTER_SIZE 0x100000
+
+static ULONG
+FormatLayoutFatSectors (
+    IN PFORMAT_LAYOUT   Layout,
+    IN ULONGLONG        TotalSectors
+    );
+
+static ULONG
+FormatLayoutClusters (
+    IN PFORMAT_LAYOUT   Layout,
+    IN ULONGLONG        TotalSectors
+    );
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("PAGE", FormatLayoutPlan)
+#pragma alloc_text("PAGE", FormatLayoutFatSectors)
+#pragma alloc_text("PAGE", FormatLayoutClusters)
+#endif // ALLOC_PRAGMA
+
+static ULONG
+FormatLayoutFatSectors (
+    IN PFORMAT_LAYOUT   Layout,
+    IN ULONGLONG        TotalSectors
+    )
+{
+    ULONGLONG   data_sectors;
+    ULONGLONG   entry_size;
+    ULONGLONG   numerator;
+    ULONGLONG   denominator;
+
+    /* the same estimate as in fat32format.c counted in half bytes for FAT12,
+       the entries of exFAT are 32 bits as in FAT32, with room for the first
+       two entries that are not clusters */
+
+    data_sectors = TotalSectors - Layout->ReservedSectors - Layout->RootDirSectors +
+        2 * Layout->SectorsPerCluster;
+
+    entry_size = (Layout->FatType == FAT_TYPE_EXFAT) ? 8 : Layout->FatType / 4;
+
+    numerator = entry_size * data_sectors;
+
+    denominator = 2 * Layout->SectorsPerCluster * Layout->SectorSize + entry_size * Layout->NumberOfFats;
+
+    return (ULONG) min(numerator / denominator + 1, MAXULONG);
+}
+
+static ULONG
+FormatLayoutClusters (
+    IN PFORMAT_LAYOUT   Layout,
+    IN ULONGLONG        TotalSectors
+    )
+{
+    ULONGLONG system_sectors;
+
+    system_sectors = (ULONGLONG) Layout->ReservedSectors + Layout->RootDirSectors +
+        (ULONGLONG) Layout->NumberOfFats * Layout->FatSectors;
+
+    if (system_sectors >= TotalSectors)
+    {
+        return 0;
+    }
+
+    return (ULONG) min((TotalSectors - system_sectors) / Layout->SectorsPerCluster, MAXULONG);
+}
+
+NTSTATUS
+FormatLayoutPlan (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONGLONG            TotalSectors,
+    IN OUT PFORMAT_LAYOUT   Layout
+    )
+{
+    ULONG   cluster_size;
+    ULONG   max_sectors_per_cluster;
+    ULONG   sectors_per_cluster;
+    PCHAR   file_system;
+
+    PAGED_CODE();
+
+    ASSERT(DeviceExtension != NULL);
+    ASSERT(Layout != NULL);
+    ASSERT(Layout->SectorSize != 0);
+
+    if (DeviceExtension->ClusterSize)
+    {
+        cluster_size = DeviceExtension->ClusterSize * 1024;
+    }
+    else if (DeviceExtension->FormatProfile == FORMAT_PROFILE_LARGE_SEQUENTIAL)
+    {
+        cluster_size = (Layout->FatType == FAT_TYPE_EXFAT) ?
+            EXFAT_LARGE_SEQUENTIAL_CLUSTER_SIZE : LARGE_SEQUENTIAL_CLUSTER_SIZE;
+    }
+    else if (DeviceExtension->FormatProfile == FORMAT_PROFILE_MANY_SMALL_FILES)
+    {
+        cluster_size = MANY_SMALL_FILES_CLUSTER_SIZE;
+    }
+    else
+    {
+        cluster_size = Layout->SectorsPerCluster * Layout->SectorSize;
+    }
+
+    /* the number of sectors per cluster must be a power of two */
+
+    if (Layout->FatType == FAT_TYPE_EXFAT)
+    {
+        max_sectors_per_cluster = max(1, EXFAT_MAX_CLUSTER_SIZE / Layout->SectorSize);
+    }
+    else
+    {
+        max_sectors_per_cluster = max(1, min(MAX_SECTORS_PER_CLUSTER, MAX_CLUSTER_SIZE / Layout->SectorSize));
+    }
+
+    sectors_per_cluster = 1;
+
+    while (sectors_per_cluster < max_sectors_per_cluster &&
+           sectors_per_cluster * 2 * Layout->SectorSize <= cluster_size)
+    {
+        sectors_per_cluster <<= 1;
+    }
+
+    Layout->SectorsPerCluster = sectors_per_cluster;
+
+    if (Layout->FatType == FAT_TYPE_EXFAT)
+    {
+        for (;;)
+        {
+            Layout->FatSectors = FormatLayoutFatSectors(Layout, TotalSectors);
+            Layout->NumberOfClusters = FormatLayoutClusters(Layout, TotalSectors);
+
+            if (Layout->NumberOfClusters > EXFAT_MAX_CLUSTERS &&
+                Layout->SectorsPerCluster < max_sectors_per_cluster)
+            {
+                Layout->SectorsPerCluster <<= 1;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (!Layout->NumberOfClusters || Layout->NumberOfClusters > EXFAT_MAX_CLUSTERS)
+        {
+            KdPrint(("SwapFs: %I64u sectors can not be formated to exFAT.\n", TotalSectors));
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+    else if (Layout->FatType == 32)
+    {
+        for (;;)
+        {
+            Layout->FatSectors = FormatLayoutFatSectors(Layout, TotalSectors);
+            Layout->NumberOfClusters = FormatLayoutClusters(Layout, TotalSectors);
+
+            if (Layout->NumberOfClusters > FAT32_MAX_CLUSTERS &&
+                Layout->SectorsPerCluster < max_sectors_per_cluster)
+            {
+                Layout->SectorsPerCluster <<= 1;
+            }
+            else if (Layout->NumberOfClusters < FAT32_MIN_CLUSTERS &&
+                     Layout->SectorsPerCluster > 1)
+            {
+                Layout->SectorsPerCluster >>= 1;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (Layout->NumberOfClusters < FAT32_MIN_CLUSTERS ||
+            Layout->NumberOfClusters > FAT32_MAX_CLUSTERS)
+        {
+            KdPrint(("SwapFs: %I64u sectors can not be formated to FAT32.\n", TotalSectors));
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+    else
+    {
+        Layout->FatType = 16;
+
+        for (;;)
+        {
+            Layout->FatSectors = FormatLayoutFatSectors(Layout, TotalSectors);
+            Layout->NumberOfClusters = FormatLayoutClusters(Layout, TotalSectors);
+
+            if (Layout->NumberOfClusters > FAT16_MAX_CLUSTERS &&
+                Layout->SectorsPerCluster < max_sectors_per_cluster)
+            {
+                Layout->SectorsPerCluster <<= 1;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (Layout->NumberOfClusters > FAT16_MAX_CLUSTERS)
+        {
+            KdPrint(("SwapFs: %I64u sectors can not be formated to FAT16.\n", TotalSectors));
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        /* too few clusters for FAT16 is FAT12, where the smaller FAT may
+           give a few clusters too many that a larger FAT takes back */
+
+        if (Layout->NumberOfClusters < FAT16_MIN_CLUSTERS)
+        {
+            Layout->FatType = 12;
+
+            Layout->FatSectors = FormatLayoutFatSectors(Layout, TotalSectors);
+            Layout->NumberOfClusters = FormatLayoutClusters(Layout, TotalSectors);
+
+            while (Layout->NumberOfClusters > FAT12_MAX_CLUSTERS)
+            {
+                Layout->FatSectors++;
+                Layout->NumberOfClusters = FormatLayoutClusters(Layout, TotalSectors);
+            }
+        }
+
+        if (!Layout->NumberOfClusters)
+        {
+            KdPrint(("SwapFs: %I64u sectors can not be formated to FAT12.\n", TotalSectors));
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    switch (Layout->FatType)
+    {
+    case FAT_TYPE_EXFAT:
+        file_system = "exFAT";
+        break;
+    case 32:
+        file_system = "FAT32";
+        break;
+    case 16:
+        file_system = "FAT16";
+        break;
+    default:
+        file_system = "FAT12";
+    }
+
+    if (Layout->SectorsPerCluster * Layout->SectorSize != cluster_size &&
+        (DeviceExtension->ClusterSize || DeviceExtension->FormatProfile != FORMAT_PROFILE_DEFAULT))
+    {
+        KdPrint(("SwapFs: Cluster size changed from %u to %u bytes to fit %s.\n",
+            cluster_size, Layout->SectorsPerCluster * Layout->SectorSize, file_system));
+    }
+
+    KdPrint(("SwapFs: Layout is %s with %u clusters of %u sectors, %u reserved sectors, %u FATs of %u sectors and %u root directory sectors.\n",
+        file_system, Layout->NumberOfClusters, Layout->SectorsPerCluster,
+        Layout->ReservedSectors, Layout->NumberOfFats, Layout->FatSectors, Layout->RootDirSectors));
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,600 @@
+/*
+    Functions to keep the FAT and the root directory in memory.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The reserved sectors, the FATs and the root directory are kept in a
+    nonpaged write-back cache created by the formatter. Since the formatter
+    knows the content of every sector in the region the cache starts out
+    complete, reads of it are always completed from memory and writes to
+    it only mark the sectors as dirty. Dirty sectors are written to the
+    device by a work item queued from a timer and on flush and shutdown.
+    The cache is limited to MetadataCacheSize KB from the start of the
+    volume, requests that extends past its end are sent to the device.
+    When a volume from the previous boot is reused the cache is instead
+    loaded from the device.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("PAGE", MetaCacheInitialize)
+#pragma alloc_text("PAGE", MetaCacheRelease)
+#pragma alloc_text("PAGE", MetaCacheLoad)
+#pragma alloc_text("PAGE", MetaCacheFlushWorker)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+MetaCacheInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                SectorSize,
+    IN ULONG                NumberOfSectors
+    )
+{
+    PMETA_CACHE     meta_cache;
+    PUCHAR          buffer;
+    PULONG          bitmap;
+    ULONG           nsector;
+    LARGE_INTEGER   due_time;
+
+    PAGED_CODE();
+
+    ASSERT(DeviceExtension != NULL);
+    ASSERT(SectorSize != 0);
+
+    meta_cache = &DeviceExtension->MetaCache;
+
+    /* a formatter that fails releases the cache before the next one creates it */
+
+    ASSERT(meta_cache->Buffer == NULL);
+
+    nsector = (ULONG) min(NumberOfSectors, (ULONGLONG) DeviceExtension->MetaCacheSize * 1024 / SectorSize);
+
+    if (!nsector)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    buffer = (PUCHAR) ExAllocatePoolWithTag(
+        NonPagedPool,
+        nsector * SectorSize,
+        SWAPFS_POOL_TAG
+        );
+
+    if (!buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    bitmap = (PULONG) ExAllocatePoolWithTag(
+        NonPagedPool,
+        ((nsector + 31) / 32) * sizeof(ULONG),
+        SWAPFS_POOL_TAG
+        );
+
+    if (!bitmap)
+    {
+        ExFreePool(buffer);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    meta_cache->FlushWorkItem = IoAllocateWorkItem(DeviceExtension->DeviceObject);
+
+    if (!meta_cache->FlushWorkItem)
+    {
+        ExFreePool(bitmap);
+        ExFreePool(buffer);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* the formatter writes what is not zero through MetaCacheUpdate */
+
+    RtlZeroMemory(buffer, nsector * SectorSize);
+
+    RtlInitializeBitMap(&meta_cache->Dirty, bitmap, nsector);
+
+    RtlClearAllBits(&meta_cache->Dirty);
+
+    KeInitializeSpinLock(&meta_cache->Lock);
+
+    ExInitializeFastMutex(&meta_cache->FlushLock);
+
+    meta_cache->SectorSize = SectorSize;
+
+    meta_cache->Length = (LONGLONG) nsector * SectorSize;
+
+    meta_cache->FlushQueued = FALSE;
+
+    meta_cache->Buffer = buffer;
+
+    KeInitializeDpc(&meta_cache->Dpc, MetaCacheTimerDpc, DeviceExtension);
+
+    KeInitializeTimer(&meta_cache->Timer);
+
+    due_time.QuadPart = (LONGLONG) META_CACHE_FLUSH_INTERVAL * -10000;
+
+    KeSetTimerEx(&meta_cache->Timer, due_time, META_CACHE_FLUSH_INTERVAL, &meta_cache->Dpc);
+
+    /* the device is registered once, a flush without a cache does nothing */
+
+    if (!meta_cache->ShutdownRegistered &&
+        NT_SUCCESS(IoRegisterShutdownNotification(DeviceExtension->DeviceObject)))
+    {
+        meta_cache->ShutdownRegistered = TRUE;
+        InterlockedIncrement(&DeviceExtension->ShutdownNotifications);
+    }
+
+    KdPrint(("SwapFs: Caching %u sectors of metadata in memory.\n", nsector));
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+MetaCacheRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PMETA_CACHE     meta_cache;
+    LARGE_INTEGER   interval;
+
+    PAGED_CODE();
+
+    meta_cache = &DeviceExtension->MetaCache;
+
+    if (!meta_cache->Buffer)
+    {
+        return;
+    }
+
+    KeCancelTimer(&meta_cache->Timer);
+
+    KeFlushQueuedDpcs();
+
+    /* a flush queued by the timer before it was canceled is waited for */
+
+    interval.QuadPart = -10 * 10000;
+
+    while (InterlockedCompareExchange(&meta_cache->FlushQueued, TRUE, TRUE))
+    {
+        KeDelayExecutionThread(KernelMode, FALSE, &interval);
+    }
+
+    IoFreeWorkItem(meta_cache->FlushWorkItem);
+
+    ExFreePool(meta_cache->Dirty.Buffer);
+
+    ExFreePool(meta_cache->Buffer);
+
+    /* the shutdown notification is kept since it can't be unregistered alone */
+
+    meta_cache->Buffer = NULL;
+    meta_cache->Dirty.Buffer = NULL;
+    meta_cache->Dirty.SizeOfBitMap = 0;
+    meta_cache->FlushWorkItem = NULL;
+    meta_cache->Length = 0;
+}
+
+NTSTATUS
+MetaCacheLoad (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                SectorSize,
+    IN ULONG                NumberOfSectors
+    )
+{
+    PUCHAR      buffer;
+    ULONG       nsector, burst;
+    ULONG       n, count;
+    NTSTATUS    status;
+
+    PAGED_CODE();
+
+    ASSERT(DeviceExtension != NULL);
+    ASSERT(SectorSize != 0);
+
+    nsector = (ULONG) min(NumberOfSectors, (ULONGLONG) DeviceExtension->MetaCacheSize * 1024 / SectorSize);
+
+    if (!nsector)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    buffer = (PUCHAR) ExAllocatePoolWithTag(PagedPool, nsector * SectorSize, SWAPFS_POOL_TAG);
+
+    if (!buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* the sectors are read before the cache is created so a failed read leaves no cache behind */
+
+    burst = max(META_CACHE_FLUSH_BURST / SectorSize, 1);
+
+    status = STATUS_SUCCESS;
+
+    for (n = 0; n < nsector; n += count)
+    {
+        count = min(nsector - n, burst);
+
+        status = StripeRead(
+            DeviceExtension,
+            (LONGLONG) n * SectorSize,
+            count * SectorSize,
+            buffer + (LONGLONG) n * SectorSize
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            KdPrint(("SwapFs: Failed to load metadata sector %u, status 0x%08x.\n", n, status));
+            ExFreePool(buffer);
+            return status;
+        }
+    }
+
+    status = MetaCacheInitialize(DeviceExtension, SectorSize, nsector);
+
+    if (NT_SUCCESS(status))
+    {
+        MetaCacheUpdate(DeviceExtension, 0, nsector * SectorSize, buffer);
+    }
+
+    ExFreePool(buffer);
+
+    return status;
+}
+
+VOID
+MetaCacheUpdate (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length,
+    IN PVOID                Buffer
+    )
+{
+    PMETA_CACHE meta_cache;
+    KIRQL       irql;
+
+    meta_cache = &DeviceExtension->MetaCache;
+
+    if (!meta_cache->Buffer || Offset >= meta_cache->Length || !Length)
+    {
+        return;
+    }
+
+    KeAcquireSpinLock(&meta_cache->Lock, &irql);
+
+    RtlCopyMemory(
+        meta_cache->Buffer + Offset,
+        Buffer,
+        (ULONG) min(Length, meta_cache->Length - Offset)
+        );
+
+    KeReleaseSpinLock(&meta_cache->Lock, irql);
+}
+
+/* not pageable since it's called for the last chance shutdown before the volume is stamped */
+
+NTSTATUS
+MetaCacheFlush (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PMETA_CACHE     meta_cache;
+    PUCHAR          buffer;
+    ULONG           nsector, burst;
+    ULONG           sector, first, count;
+    NTSTATUS        status;
+    KIRQL           irql;
+
+    meta_cache = &DeviceExtension->MetaCache;
+
+    if (!meta_cache->Buffer)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    nsector = (ULONG) (meta_cache->Length / meta_cache->SectorSize);
+
+    burst = max(META_CACHE_FLUSH_BURST / meta_cache->SectorSize, 1);
+
+    buffer = (PUCHAR) ExAllocatePoolWithTag(
+        NonPagedPool,
+        burst * meta_cache->SectorSize,
+        SWAPFS_POOL_TAG
+        );
+
+    if (!buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    status = STATUS_SUCCESS;
+
+    ExAcquireFastMutex(&meta_cache->FlushLock);
+
+    /* dirty sectors are copied and cleared under the lock so a write during the flush marks them dirty again */
+
+    for (sector = 0; sector < nsector; sector = first + count)
+    {
+        KeAcquireSpinLock(&meta_cache->Lock, &irql);
+
+        first = RtlFindSetBits(&meta_cache->Dirty, 1, sector);
+
+        /* the search wraps around to the start of the bitmap */
+
+        if (first == 0xFFFFFFFF || first < sector)
+        {
+            KeReleaseSpinLock(&meta_cache->Lock, irql);
+            break;
+        }
+
+        for (count = 1;
+             count < burst && first + count < nsector && RtlCheckBit(&meta_cache->Dirty, first + count);
+             count++
+            );
+
+        RtlCopyMemory(
+            buffer,
+            meta_cache->Buffer + (LONGLONG) first * meta_cache->SectorSize,
+            count * meta_cache->SectorSize
+            );
+
+        RtlClearBits(&meta_cache->Dirty, first, count);
+
+        KeReleaseSpinLock(&meta_cache->Lock, irql);
+
+        status = StripeWrite(
+            DeviceExtension,
+            (LONGLONG) first * meta_cache->SectorSize,
+            count * meta_cache->SectorSize,
+            buffer
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            KdPrint(("SwapFs: Failed to write back metadata sector %u, status 0x%08x.\n", first, status));
+
+            KeAcquireSpinLock(&meta_cache->Lock, &irql);
+
+            RtlSetBits(&meta_cache->Dirty, first, count);
+
+            KeReleaseSpinLock(&meta_cache->Lock, irql);
+
+            break;
+        }
+
+        ZeroFillMarkWritten(
+            DeviceExtension,
+            (LONGLONG) first * meta_cache->SectorSize,
+            count * meta_cache->SectorSize
+            );
+    }
+
+    ExReleaseFastMutex(&meta_cache->FlushLock);
+
+    ExFreePool(buffer);
+
+    return status;
+}
+
+VOID
+MetaCacheTimerDpc (
+    IN PKDPC    Dpc,
+    IN PVOID    DeferredContext,
+    IN PVOID    SystemArgument1,
+    IN PVOID    SystemArgument2
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PMETA_CACHE         meta_cache;
+    BOOLEAN             dirty;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    device_extension = (PDEVICE_EXTENSION) DeferredContext;
+
+    meta_cache = &device_extension->MetaCache;
+
+    KeAcquireSpinLockAtDpcLevel(&meta_cache->Lock);
+
+    dirty = !RtlAreBitsClear(&meta_cache->Dirty, 0, meta_cache->Dirty.SizeOfBitMap);
+
+    KeReleaseSpinLockFromDpcLevel(&meta_cache->Lock);
+
+    /* the work item is queued again only after the previous flush is done */
+
+    if (dirty && !InterlockedExchange(&meta_cache->FlushQueued, TRUE))
+    {
+        IoQueueWorkItem(
+            meta_cache->FlushWorkItem,
+            MetaCacheFlushWorker,
+            DelayedWorkQueue,
+            device_extension
+            );
+    }
+}
+
+VOID
+MetaCacheFlushWorker (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PVOID            Context
+    )
+{
+    PDEVICE_EXTENSION device_extension;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    PAGED_CODE();
+
+    device_extension = (PDEVICE_EXTENSION) Context;
+
+    MetaCacheFlush(device_extension);
+
+    InterlockedExchange(&device_extension->MetaCache.FlushQueued, FALSE);
+}
+
+NTSTATUS
+MetaCacheCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PMETA_CACHE         meta_cache;
+    PIO_STACK_LOCATION  io_stack;
+    LONGLONG            offset;
+    PUCHAR              buffer;
+    KIRQL               irql;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    device_extension = (PDEVICE_EXTENSION) Context;
+
+    meta_cache = &device_extension->MetaCache;
+
+    if (device_extension->ZeroFill.Bitmap.Buffer)
+    {
+        ZeroFillUpdate(device_extension, Irp);
+    }
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    /* the cached sectors may not be written back yet so they replace what was read from the device */
+
+    if (NT_SUCCESS(Irp->IoStatus.Status) && io_stack->MajorFunction == IRP_MJ_READ)
+    {
+        offset = io_stack->Parameters.Read.ByteOffset.QuadPart;
+
+        buffer = (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+
+        if (buffer)
+        {
+            KeAcquireSpinLock(&meta_cache->Lock, &irql);
+
+            RtlCopyMemory(buffer, meta_cache->Buffer + offset, (ULONG) (meta_cache->Length - offset));
+
+            KeReleaseSpinLock(&meta_cache->Lock, irql);
+        }
+        else
+        {
+            Irp->IoStatus.Status = STATUS_INSUFFICIENT_RESOURCES;
+            Irp->IoStatus.Information = 0;
+        }
+    }
+
+    if (Irp->PendingReturned)
+    {
+        IoMarkIrpPending(Irp);
+    }
+
+    return STATUS_CONTINUE_COMPLETION;
+}
+
+NTSTATUS
+MetaCacheReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PMETA_CACHE         meta_cache;
+    PIO_STACK_LOCATION  io_stack;
+    PIO_STACK_LOCATION  next_io_stack;
+    LONGLONG            offset;
+    ULONG               length;
+    ULONG               cached;
+    ULONG               first, last;
+    PUCHAR              buffer;
+    NTSTATUS            status;
+    KIRQL               irql;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    meta_cache = &device_extension->MetaCache;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart;
+    length = io_stack->Parameters.Read.Length;
+
+    ASSERT(offset < meta_cache->Length && length != 0);
+
+    cached = (ULONG) min(length, meta_cache->Length - offset);
+
+    buffer = (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+
+    if (!buffer)
+    {
+        Irp->IoStatus.Status = STATUS_INSUFFICIENT_RESOURCES;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    KeAcquireSpinLock(&meta_cache->Lock, &irql);
+
+    if (io_stack->MajorFunction == IRP_MJ_WRITE)
+    {
+        RtlCopyMemory(meta_cache->Buffer + offset, buffer, cached);
+
+        first = (ULONG) (offset / meta_cache->SectorSize);
+        last = (ULONG) ((offset + cached - 1) / meta_cache->SectorSize);
+
+        RtlSetBits(&meta_cache->Dirty, first, last - first + 1);
+    }
+    else if (cached == length)
+    {
+        RtlCopyMemory(buffer, meta_cache->Buffer + offset, length);
+    }
+
+    KeReleaseSpinLock(&meta_cache->Lock, irql);
+
+    if (cached == length)
+    {
+        status = STATUS_SUCCESS;
+
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = length;
+
+        IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+
+        return status;
+    }
+
+    /* a request that extends past the end of the cache is sent to the device */
+
+    IoCopyCurrentIrpStackLocationToNext(Irp);
+
+    next_io_stack = IoGetNextIrpStackLocation(Irp);
+
+    next_io_stack->Parameters.Read.ByteOffset.QuadPart += sizeof(union swap_header);
+
+    IoSetCompletionRoutine(
+        Irp,
+        MetaCacheCompletion,
+        device_extension,
+        TRUE,
+        FALSE,
+        FALSE
+        );
+
+    return StripeCallDriver(device_extension, Irp);
+}
@@ -18,6 +18,7 @@
 
 #include <ntddk.h>
 #include "swapfs.h"
+#include "swapfsetw.h"
 
 NTSTATUS
 SynchronousCompletion (
@@ -142,6 +143,11 @@ SwapFsPnp (
             DeviceObject->Flags &= ~DO_POWER_PAGABLE;
         }
 
+        if (SwapFsEtwEnabled(WINEVENT_LEVEL_INFO, SWAPFS_KEYWORD_PNP))
+        {
+            EtwPagingPath(DeviceObject, addPageFile, device_extension->PagingPathCount, status);
+        }
+
         KeSetEvent(
             &device_extension->PagingPathCountEvent,
             IO_NO_INCREMENT,
@@ -165,13 +171,41 @@ SwapFsPower (
     IN PIRP             Irp
     )
 {
-    PDEVICE_EXTENSION device_extension;
+    PDEVICE_EXTENSION   device_extension;
+    PIO_STACK_LOCATION  io_stack;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    /* the combined writes are written before the device is powered down */
+
+    if (device_extension->WriteCombine.Size &&
+        io_stack->MinorFunction == IRP_MN_SET_POWER &&
+        ((io_stack->Parameters.Power.Type == SystemPowerState &&
+          io_stack->Parameters.Power.State.SystemState > PowerSystemWorking) ||
+         (io_stack->Parameters.Power.Type == DevicePowerState &&
+          io_stack->Parameters.Power.State.DeviceState > PowerDeviceD0)))
+    {
+        WriteCombineFlush(device_extension, (BOOLEAN) (KeGetCurrentIrql() == PASSIVE_LEVEL));
+    }
+
+    /* the blocks kept in memory can only be written back at passive level */
+
+    if (device_extension->RamTier.Hash &&
+        KeGetCurrentIrql() == PASSIVE_LEVEL &&
+        io_stack->MinorFunction == IRP_MN_SET_POWER &&
+        ((io_stack->Parameters.Power.Type == SystemPowerState &&
+          io_stack->Parameters.Power.State.SystemState > PowerSystemWorking) ||
+         (io_stack->Parameters.Power.Type == DevicePowerState &&
+          io_stack->Parameters.Power.State.DeviceState > PowerDeviceD0)))
+    {
+        RamTierFlush(device_extension);
+    }
 
     PoStartNextPowerIrp(Irp);
 
     IoSkipCurrentIrpStackLocation(Irp);
 
-    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
-
     return PoCallDriver(device_extension->TargetDeviceObject, Irp);
 }
@@ -0,0 +1,1053 @@
+/*
+    Functions to keep the data region of the volume in a tier of memory.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With RamTierSize the data region is kept in blocks of nonpaged memory
+    of RAM_TIER_BLOCK_SIZE, up to RamTierSize KB, found by a hash of the
+    offset and kept in a list from the one used last to the one used
+    longest ago. A write of whole blocks is copied to the blocks and
+    completed without going to the device, any other write is sent down
+    and copies what it has to the blocks that are in memory. A read that
+    is all in memory is completed from it, any other read is sent down
+    and the blocks in memory are copied over what was read when it
+    completes. The blocks such a read overlaps are pinned until it has
+    copied them, so a pinned block is neither freed nor reused and the
+    read can't miss a block it should have been copied from. A thread
+    of the device writes back and frees the blocks used longest ago when
+    more than three quarters of the limit are used, and halves the limit
+    while the memory manager signals LowMemoryCondition, it's raised again
+    when the memory is no longer low. A block that is written while it's
+    written back is dirty again and is written back once more. A flush
+    writes back all the dirty blocks. Only the data region is kept since
+    the FAT and the root directory are in the metadata cache, so a file
+    that is deleted before its blocks are written back is never written
+    to the swap partition.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#define RAM_TIER_LOW_MEMORY     L"\\KernelObjects\\LowMemoryCondition"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", RamTierInitialize)
+#pragma alloc_text("INIT", RamTierRelease)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+RamTierInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                RamTierSize
+    )
+{
+    PRAM_TIER           ram_tier;
+    OBJECT_ATTRIBUTES   object_attributes;
+    UNICODE_STRING      event_name;
+    HANDLE              thread_handle;
+    ULONG               nblock;
+    ULONG               nbucket;
+    ULONG               n;
+    NTSTATUS            status;
+
+    ram_tier = &DeviceExtension->RamTier;
+
+    /* RamTierSize is in KB and there is a bucket of the hash for every two blocks */
+
+    RamTierSize = min(max(RamTierSize, RAM_TIER_MINIMUM_SIZE), RAM_TIER_MAXIMUM_SIZE);
+
+    nblock = RamTierSize / (RAM_TIER_BLOCK_SIZE / 1024);
+
+    nbucket = 1 << RtlFindMostSignificantBit(max(nblock / 2, 1));
+
+    RtlZeroMemory(ram_tier, sizeof(RAM_TIER));
+
+    ram_tier->Hash = (PLIST_ENTRY) ExAllocatePoolWithTag(
+        NonPagedPool,
+        nbucket * sizeof(LIST_ENTRY),
+        SWAPFS_POOL_TAG
+        );
+
+    if (!ram_tier->Hash)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (n = 0; n < nbucket; n++)
+    {
+        InitializeListHead(&ram_tier->Hash[n]);
+    }
+
+    ram_tier->HashMask = nbucket - 1;
+
+    InitializeListHead(&ram_tier->Lru);
+
+    KeInitializeSpinLock(&ram_tier->Lock);
+
+    ExInitializeFastMutex(&ram_tier->WriteBackLock);
+
+    KeInitializeEvent(&ram_tier->WriteBackDone, NotificationEvent, FALSE);
+
+    KeInitializeEvent(&ram_tier->WakeEvent, SynchronizationEvent, FALSE);
+
+    ram_tier->MaximumBlocks = nblock;
+
+    ram_tier->Limit = nblock;
+
+    ram_tier->Status = STATUS_SUCCESS;
+
+    /* the tier is not shrunk when the memory manager has no event to signal low memory */
+
+    RtlInitUnicodeString(&event_name, RAM_TIER_LOW_MEMORY);
+
+    ram_tier->LowMemory = IoCreateNotificationEvent(&event_name, &ram_tier->LowMemoryHandle);
+
+    InitializeObjectAttributes(&object_attributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+
+    status = PsCreateSystemThread(
+        &thread_handle,
+        THREAD_ALL_ACCESS,
+        &object_attributes,
+        NULL,
+        NULL,
+        RamTierThread,
+        DeviceExtension
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        if (ram_tier->LowMemory)
+        {
+            ZwClose(ram_tier->LowMemoryHandle);
+        }
+
+        ExFreePool(ram_tier->Hash);
+        RtlZeroMemory(ram_tier, sizeof(RAM_TIER));
+        return status;
+    }
+
+    status = ObReferenceObjectByHandle(
+        thread_handle,
+        THREAD_ALL_ACCESS,
+        NULL,
+        KernelMode,
+        &ram_tier->Thread,
+        NULL
+        );
+
+    /* without a reference the thread is stopped and waited for on the handle */
+
+    if (!NT_SUCCESS(status))
+    {
+        ram_tier->Stop = TRUE;
+        KeSetEvent(&ram_tier->WakeEvent, IO_NO_INCREMENT, FALSE);
+        ZwWaitForSingleObject(thread_handle, FALSE, NULL);
+        ZwClose(thread_handle);
+
+        if (ram_tier->LowMemory)
+        {
+            ZwClose(ram_tier->LowMemoryHandle);
+        }
+
+        ExFreePool(ram_tier->Hash);
+        RtlZeroMemory(ram_tier, sizeof(RAM_TIER));
+        return status;
+    }
+
+    ZwClose(thread_handle);
+
+    KdPrint(("SwapFs: Keeping up to %u blocks of the data region in memory.\n", nblock));
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+RamTierRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PRAM_TIER       ram_tier;
+    PRAM_TIER_BLOCK block;
+    PLIST_ENTRY     entry;
+
+    ram_tier = &DeviceExtension->RamTier;
+
+    if (!ram_tier->Hash)
+    {
+        return;
+    }
+
+    ram_tier->Stop = TRUE;
+
+    KeSetEvent(&ram_tier->WakeEvent, IO_NO_INCREMENT, FALSE);
+
+    if (ram_tier->Thread)
+    {
+        KeWaitForSingleObject(ram_tier->Thread, Executive, KernelMode, FALSE, NULL);
+        ObDereferenceObject(ram_tier->Thread);
+    }
+
+    /* it's only released before the device is formated so nothing is dirty */
+
+    while (!IsListEmpty(&ram_tier->Lru))
+    {
+        entry = RemoveHeadList(&ram_tier->Lru);
+
+        block = CONTAINING_RECORD(entry, RAM_TIER_BLOCK, LruEntry);
+
+        ExFreePool(block->Data);
+        ExFreePool(block);
+    }
+
+    if (ram_tier->LowMemory)
+    {
+        ZwClose(ram_tier->LowMemoryHandle);
+    }
+
+    ExFreePool(ram_tier->Hash);
+
+    RtlZeroMemory(ram_tier, sizeof(RAM_TIER));
+}
+
+/* not pageable since it's called with the spin lock held */
+
+static PRAM_TIER_BLOCK
+ram_tier_find (
+    IN PRAM_TIER    RamTier,
+    IN LONGLONG     Offset
+    )
+{
+    PLIST_ENTRY     bucket;
+    PLIST_ENTRY     entry;
+    PRAM_TIER_BLOCK block;
+
+    bucket = &RamTier->Hash[(ULONG) (Offset / RAM_TIER_BLOCK_SIZE) & RamTier->HashMask];
+
+    for (entry = bucket->Flink; entry != bucket; entry = entry->Flink)
+    {
+        block = CONTAINING_RECORD(entry, RAM_TIER_BLOCK, HashEntry);
+
+        if (block->Offset == Offset)
+        {
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+/* not pageable since it's called with the spin lock held */
+
+static VOID
+ram_tier_touch (
+    IN PRAM_TIER        RamTier,
+    IN PRAM_TIER_BLOCK  Block
+    )
+{
+    RemoveEntryList(&Block->LruEntry);
+
+    InsertHeadList(&RamTier->Lru, &Block->LruEntry);
+}
+
+/* not pageable since it's called with the spin lock held */
+
+static PRAM_TIER_BLOCK
+ram_tier_allocate (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset
+    )
+{
+    PRAM_TIER       ram_tier;
+    PRAM_TIER_BLOCK block;
+    PLIST_ENTRY     entry;
+
+    ram_tier = &DeviceExtension->RamTier;
+
+    block = NULL;
+
+    /* at the limit the clean block used longest ago is taken, if no read could still copy from it
+       and it's not being written back from */
+
+    if (ram_tier->NumberOfBlocks >= ram_tier->Limit)
+    {
+        for (entry = ram_tier->Lru.Blink; entry != &ram_tier->Lru; entry = entry->Blink)
+        {
+            block = CONTAINING_RECORD(entry, RAM_TIER_BLOCK, LruEntry);
+
+            if (!block->Dirty && !block->WriteBack && !block->Pins)
+            {
+                break;
+            }
+        }
+
+        if (entry == &ram_tier->Lru)
+        {
+            return NULL;
+        }
+
+        RemoveEntryList(&block->HashEntry);
+        RemoveEntryList(&block->LruEntry);
+    }
+    else
+    {
+        block = (PRAM_TIER_BLOCK) ExAllocatePoolWithTag(NonPagedPool, sizeof(RAM_TIER_BLOCK), SWAPFS_POOL_TAG);
+
+        if (!block)
+        {
+            return NULL;
+        }
+
+        block->Data = (PUCHAR) ExAllocatePoolWithTag(NonPagedPool, RAM_TIER_BLOCK_SIZE, SWAPFS_POOL_TAG);
+
+        if (!block->Data)
+        {
+            ExFreePool(block);
+            return NULL;
+        }
+
+        block->DeviceExtension = DeviceExtension;
+
+        ram_tier->NumberOfBlocks++;
+    }
+
+    block->Offset = Offset;
+    block->Dirty = FALSE;
+    block->WriteBack = FALSE;
+    block->Status = STATUS_SUCCESS;
+    block->Pins = 0;
+
+    InsertHeadList(&ram_tier->Hash[(ULONG) (Offset / RAM_TIER_BLOCK_SIZE) & ram_tier->HashMask], &block->HashEntry);
+
+    InsertHeadList(&ram_tier->Lru, &block->LruEntry);
+
+    return block;
+}
+
+/* not pageable since it's called with the spin lock held */
+
+static VOID
+ram_tier_dirty (
+    IN PRAM_TIER        RamTier,
+    IN PRAM_TIER_BLOCK  Block
+    )
+{
+    if (!Block->Dirty)
+    {
+        Block->Dirty = TRUE;
+        RamTier->DirtyBlocks++;
+    }
+}
+
+/* not pageable since it's called with the spin lock held, the part of the request in the block is copied */
+
+static VOID
+ram_tier_copy (
+    IN PRAM_TIER_BLOCK  Block,
+    IN PUCHAR           Data,
+    IN LONGLONG         Offset,
+    IN ULONG            Length,
+    IN BOOLEAN          Write
+    )
+{
+    LONGLONG    start;
+    LONGLONG    end;
+
+    start = max(Offset, Block->Offset);
+
+    end = min(Offset + Length, Block->Offset + RAM_TIER_BLOCK_SIZE);
+
+    if (Write)
+    {
+        RtlCopyMemory(Block->Data + (ULONG) (start - Block->Offset), Data + (ULONG) (start - Offset), (ULONG) (end - start));
+    }
+    else
+    {
+        RtlCopyMemory(Data + (ULONG) (start - Offset), Block->Data + (ULONG) (start - Block->Offset), (ULONG) (end - start));
+    }
+}
+
+/* not pageable since it's called from the completion routine */
+
+NTSTATUS
+RamTierReadCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PRAM_TIER_READ      read;
+    PRAM_TIER           ram_tier;
+    PRAM_TIER_BLOCK     block;
+    PIO_STACK_LOCATION  io_stack;
+    LONGLONG            offset;
+    ULONG               length;
+    ULONG               n;
+    PUCHAR              data;
+    KIRQL               irql;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    read = (PRAM_TIER_READ) Context;
+
+    ram_tier = &read->DeviceExtension->RamTier;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart;
+    length = io_stack->Parameters.Read.Length;
+
+    data = NT_SUCCESS(Irp->IoStatus.Status) ?
+        (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority) : NULL;
+
+    /* the blocks in memory are newer than what was read from the device */
+
+    KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+    for (n = 0; n < read->NumberOfBlocks; n++)
+    {
+        block = read->Block[n];
+
+        if (data)
+        {
+            ram_tier_copy(block, data, offset, length, FALSE);
+        }
+
+        block->Pins--;
+    }
+
+    KeReleaseSpinLock(&ram_tier->Lock, irql);
+
+    ExFreePool(read);
+
+    if (NT_SUCCESS(Irp->IoStatus.Status) && !data)
+    {
+        Irp->IoStatus.Status = STATUS_INSUFFICIENT_RESOURCES;
+        Irp->IoStatus.Information = 0;
+    }
+
+    if (Irp->PendingReturned)
+    {
+        IoMarkIrpPending(Irp);
+    }
+
+    return STATUS_CONTINUE_COMPLETION;
+}
+
+NTSTATUS
+RamTierReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PRAM_TIER           ram_tier;
+    PRAM_TIER_BLOCK     block;
+    PRAM_TIER_READ      read;
+    PIO_STACK_LOCATION  io_stack;
+    PIO_STACK_LOCATION  next_io_stack;
+    LONGLONG            offset;
+    LONGLONG            block_offset;
+    ULONG               length;
+    ULONG               nblock;
+    PUCHAR              data;
+    BOOLEAN             write;
+    BOOLEAN             done;
+    BOOLEAN             overlay;
+    BOOLEAN             wake;
+    NTSTATUS            status;
+    KIRQL               irql;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    ram_tier = &device_extension->RamTier;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart;
+    length = io_stack->Parameters.Read.Length;
+
+    write = (BOOLEAN) (io_stack->MajorFunction == IRP_MJ_WRITE);
+
+    data = length ? (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority) : NULL;
+
+    /* a write can't be sent down without copying it to the blocks it overlaps */
+
+    if (length && !data)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+        return status;
+    }
+
+    done = (BOOLEAN) (length != 0);
+
+    overlay = FALSE;
+
+    read = NULL;
+
+    nblock = 0;
+
+    KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+    if (write)
+    {
+        /* only a write of whole blocks is kept in memory, the others update the blocks that are */
+
+        if ((offset | length) & (RAM_TIER_BLOCK_SIZE - 1))
+        {
+            done = FALSE;
+        }
+
+        for (block_offset = offset & ~((LONGLONG) RAM_TIER_BLOCK_SIZE - 1);
+             block_offset < offset + length;
+             block_offset += RAM_TIER_BLOCK_SIZE)
+        {
+            block = ram_tier_find(ram_tier, block_offset);
+
+            if (block)
+            {
+                ram_tier_touch(ram_tier, block);
+            }
+            else if (done)
+            {
+                block = ram_tier_allocate(device_extension, block_offset);
+            }
+
+            if (!block)
+            {
+                done = FALSE;
+                continue;
+            }
+
+            ram_tier_copy(block, data, offset, length, TRUE);
+
+            ram_tier_dirty(ram_tier, block);
+        }
+
+        if (done)
+        {
+            ram_tier->Absorbed += length;
+        }
+    }
+    else
+    {
+        for (block_offset = offset & ~((LONGLONG) RAM_TIER_BLOCK_SIZE - 1);
+             block_offset < offset + length;
+             block_offset += RAM_TIER_BLOCK_SIZE)
+        {
+            if (ram_tier_find(ram_tier, block_offset))
+            {
+                overlay = TRUE;
+                nblock++;
+            }
+            else
+            {
+                done = FALSE;
+            }
+        }
+
+        if (done)
+        {
+            for (block_offset = offset & ~((LONGLONG) RAM_TIER_BLOCK_SIZE - 1);
+                 block_offset < offset + length;
+                 block_offset += RAM_TIER_BLOCK_SIZE)
+            {
+                block = ram_tier_find(ram_tier, block_offset);
+
+                ram_tier_copy(block, data, offset, length, FALSE);
+
+                ram_tier_touch(ram_tier, block);
+            }
+
+            ram_tier->Hits++;
+        }
+        else
+        {
+            ram_tier->Misses++;
+        }
+
+        /* the blocks a read sent down overlaps are pinned until it has copied them */
+
+        if (!done && overlay)
+        {
+            read = (PRAM_TIER_READ) ExAllocatePoolWithTag(
+                NonPagedPool,
+                FIELD_OFFSET(RAM_TIER_READ, Block) + nblock * sizeof(PRAM_TIER_BLOCK),
+                SWAPFS_POOL_TAG
+                );
+        }
+
+        if (read)
+        {
+            read->DeviceExtension = device_extension;
+            read->NumberOfBlocks = 0;
+
+            for (block_offset = offset & ~((LONGLONG) RAM_TIER_BLOCK_SIZE - 1);
+                 block_offset < offset + length;
+                 block_offset += RAM_TIER_BLOCK_SIZE)
+            {
+                block = ram_tier_find(ram_tier, block_offset);
+
+                if (block)
+                {
+                    block->Pins++;
+                    read->Block[read->NumberOfBlocks++] = block;
+                }
+            }
+        }
+    }
+
+    wake = (BOOLEAN) (ram_tier->NumberOfBlocks > ram_tier->Limit / 4 * 3);
+
+    KeReleaseSpinLock(&ram_tier->Lock, irql);
+
+    if (wake)
+    {
+        KeSetEvent(&ram_tier->WakeEvent, IO_NO_INCREMENT, FALSE);
+    }
+
+    if (done)
+    {
+        status = STATUS_SUCCESS;
+
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = length;
+
+        IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+
+        return status;
+    }
+
+    /* a read that can't pin the blocks it overlaps could miss them, so it fails */
+
+    if (!write && overlay && !read)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+        return status;
+    }
+
+    IoCopyCurrentIrpStackLocationToNext(Irp);
+
+    next_io_stack = IoGetNextIrpStackLocation(Irp);
+
+    next_io_stack->Parameters.Read.ByteOffset.QuadPart += sizeof(union swap_header);
+
+    if (read)
+    {
+        IoSetCompletionRoutine(
+            Irp,
+            RamTierReadCompletion,
+            read,
+            TRUE,
+            TRUE,
+            TRUE
+            );
+    }
+
+    return StripeCallDriver(device_extension, Irp);
+}
+
+/* not pageable since it's called from the completion routine */
+
+NTSTATUS
+RamTierWriteBackCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PRAM_TIER_BLOCK block;
+    PRAM_TIER       ram_tier;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    block = (PRAM_TIER_BLOCK) Context;
+
+    ram_tier = &block->DeviceExtension->RamTier;
+
+    block->Status = Irp->IoStatus.Status;
+
+    IoFreeMdl(Irp->MdlAddress);
+
+    IoFreeIrp(Irp);
+
+    if (InterlockedDecrement(&ram_tier->WriteBackPending) == 0)
+    {
+        KeSetEvent(&ram_tier->WriteBackDone, IO_NO_INCREMENT, FALSE);
+    }
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+/* not pageable since it's called at the last chance shutdown, the write back lock must be held */
+
+static NTSTATUS
+ram_tier_write_back (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PRAM_TIER_BLOCK      Block[],
+    IN ULONG                NumberOfBlocks
+    )
+{
+    PRAM_TIER           ram_tier;
+    PIO_STACK_LOCATION  next_io_stack;
+    PIRP                irp;
+    PMDL                mdl;
+    ULONG               n;
+    NTSTATUS            status;
+    KIRQL               irql;
+
+    ram_tier = &DeviceExtension->RamTier;
+
+    KeClearEvent(&ram_tier->WriteBackDone);
+
+    ram_tier->WriteBackPending = 1;
+
+    for (n = 0; n < NumberOfBlocks; n++)
+    {
+        irp = IoAllocateIrp(DeviceExtension->DeviceObject->StackSize, FALSE);
+
+        mdl = irp ? IoAllocateMdl(Block[n]->Data, RAM_TIER_BLOCK_SIZE, FALSE, FALSE, irp) : NULL;
+
+        if (!mdl)
+        {
+            if (irp)
+            {
+                IoFreeIrp(irp);
+            }
+
+            Block[n]->Status = STATUS_INSUFFICIENT_RESOURCES;
+
+            continue;
+        }
+
+        MmBuildMdlForNonPagedPool(mdl);
+
+        next_io_stack = IoGetNextIrpStackLocation(irp);
+
+        next_io_stack->MajorFunction = IRP_MJ_WRITE;
+        next_io_stack->Parameters.Write.ByteOffset.QuadPart = Block[n]->Offset + sizeof(union swap_header);
+        next_io_stack->Parameters.Write.Length = RAM_TIER_BLOCK_SIZE;
+
+        IoSetCompletionRoutine(
+            irp,
+            RamTierWriteBackCompletion,
+            Block[n],
+            TRUE,
+            TRUE,
+            TRUE
+            );
+
+        InterlockedIncrement(&ram_tier->WriteBackPending);
+
+        StripeCallDriver(DeviceExtension, irp);
+    }
+
+    if (InterlockedDecrement(&ram_tier->WriteBackPending) != 0)
+    {
+        KeWaitForSingleObject(&ram_tier->WriteBackDone, Executive, KernelMode, FALSE, NULL);
+    }
+
+    /* a block that failed is dirty again, the first error is returned by the next flush */
+
+    status = STATUS_SUCCESS;
+
+    KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+    for (n = 0; n < NumberOfBlocks; n++)
+    {
+        Block[n]->WriteBack = FALSE;
+
+        if (NT_SUCCESS(Block[n]->Status))
+        {
+            ram_tier->WrittenBack += RAM_TIER_BLOCK_SIZE;
+            continue;
+        }
+
+        ram_tier_dirty(ram_tier, Block[n]);
+
+        if (NT_SUCCESS(status))
+        {
+            status = Block[n]->Status;
+        }
+    }
+
+    if (!NT_SUCCESS(status) && NT_SUCCESS(ram_tier->Status))
+    {
+        ram_tier->Status = status;
+    }
+
+    KeReleaseSpinLock(&ram_tier->Lock, irql);
+
+    return status;
+}
+
+/* not pageable since it's called with the spin lock held, the dirty blocks are taken from the one used longest ago */
+
+static ULONG
+ram_tier_take_dirty (
+    IN PRAM_TIER        RamTier,
+    OUT PRAM_TIER_BLOCK Block[],
+    IN ULONG            Keep
+    )
+{
+    PLIST_ENTRY     entry;
+    PRAM_TIER_BLOCK block;
+    ULONG           nblock;
+    ULONG           position;
+
+    nblock = 0;
+
+    position = RamTier->NumberOfBlocks;
+
+    for (entry = RamTier->Lru.Blink;
+         entry != &RamTier->Lru && position > Keep && nblock < RAM_TIER_WRITE_BACK_BATCH;
+         entry = entry->Blink, position--)
+    {
+        block = CONTAINING_RECORD(entry, RAM_TIER_BLOCK, LruEntry);
+
+        if (!block->Dirty)
+        {
+            continue;
+        }
+
+        /* a write while it's written back makes it dirty again */
+
+        block->Dirty = FALSE;
+        block->WriteBack = TRUE;
+        RamTier->DirtyBlocks--;
+
+        Block[nblock++] = block;
+    }
+
+    return nblock;
+}
+
+/* not pageable since it's called at the last chance shutdown */
+
+NTSTATUS
+RamTierFlush (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PRAM_TIER       ram_tier;
+    PRAM_TIER_BLOCK block[RAM_TIER_WRITE_BACK_BATCH];
+    ULONG           nblock;
+    ULONG           ndirty;
+    NTSTATUS        status;
+    KIRQL           irql;
+
+    ram_tier = &DeviceExtension->RamTier;
+
+    ExAcquireFastMutex(&ram_tier->WriteBackLock);
+
+    /* the blocks written after the flush started are not waited for */
+
+    KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+    ndirty = ram_tier->DirtyBlocks;
+
+    KeReleaseSpinLock(&ram_tier->Lock, irql);
+
+    while (ndirty)
+    {
+        KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+        nblock = ram_tier_take_dirty(ram_tier, block, 0);
+
+        KeReleaseSpinLock(&ram_tier->Lock, irql);
+
+        if (!nblock)
+        {
+            break;
+        }
+
+        ram_tier_write_back(DeviceExtension, block, nblock);
+
+        ndirty -= min(nblock, ndirty);
+    }
+
+    /* a write back that failed is returned once */
+
+    KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+    status = ram_tier->Status;
+
+    ram_tier->Status = STATUS_SUCCESS;
+
+    KeReleaseSpinLock(&ram_tier->Lock, irql);
+
+    ExReleaseFastMutex(&ram_tier->WriteBackLock);
+
+    return status;
+}
+
+/* not pageable since it's called at the last chance shutdown */
+
+VOID
+RamTierThread (
+    IN PVOID Context
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PRAM_TIER           ram_tier;
+    PRAM_TIER_BLOCK     block[RAM_TIER_WRITE_BACK_BATCH];
+    PRAM_TIER_BLOCK     victim;
+    PLIST_ENTRY         entry;
+    LIST_ENTRY          free_list;
+    LARGE_INTEGER       interval;
+    ULONG               keep;
+    ULONG               nblock;
+    KIRQL               irql;
+
+    device_extension = (PDEVICE_EXTENSION) Context;
+
+    ram_tier = &device_extension->RamTier;
+
+    interval.QuadPart = (LONGLONG) RAM_TIER_INTERVAL * -10000;
+
+    while (!ram_tier->Stop)
+    {
+        KeWaitForSingleObject(&ram_tier->WakeEvent, Executive, KernelMode, FALSE, &interval);
+
+        if (ram_tier->Stop)
+        {
+            break;
+        }
+
+        KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+        /* the limit is halved every interval the memory is low and raised by an eighth when it's not */
+
+        if (ram_tier->LowMemory && KeReadStateEvent(ram_tier->LowMemory))
+        {
+            ram_tier->Limit = max(ram_tier->Limit / 2, min(RAM_TIER_MINIMUM_BLOCKS, ram_tier->MaximumBlocks));
+        }
+        else
+        {
+            ram_tier->Limit = min(ram_tier->Limit + ram_tier->MaximumBlocks / 8, ram_tier->MaximumBlocks);
+        }
+
+        keep = ram_tier->Limit / 4 * 3;
+
+        KeReleaseSpinLock(&ram_tier->Lock, irql);
+
+        ExAcquireFastMutex(&ram_tier->WriteBackLock);
+
+        /* the dirty blocks past what is kept are written back before they can be freed */
+
+        for (;;)
+        {
+            KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+            nblock = ram_tier_take_dirty(ram_tier, block, keep);
+
+            KeReleaseSpinLock(&ram_tier->Lock, irql);
+
+            if (!nblock || !NT_SUCCESS(ram_tier_write_back(device_extension, block, nblock)))
+            {
+                break;
+            }
+        }
+
+        /* the clean blocks used longest ago are freed, but not those a read sent down has pinned */
+
+        InitializeListHead(&free_list);
+
+        KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+        entry = ram_tier->Lru.Blink;
+
+        while (ram_tier->NumberOfBlocks > keep && entry != &ram_tier->Lru)
+        {
+            victim = CONTAINING_RECORD(entry, RAM_TIER_BLOCK, LruEntry);
+
+            entry = entry->Blink;
+
+            if (victim->Dirty || victim->Pins)
+            {
+                continue;
+            }
+
+            RemoveEntryList(&victim->HashEntry);
+            RemoveEntryList(&victim->LruEntry);
+
+            InsertTailList(&free_list, &victim->LruEntry);
+
+            ram_tier->NumberOfBlocks--;
+        }
+
+        KeReleaseSpinLock(&ram_tier->Lock, irql);
+
+        ExReleaseFastMutex(&ram_tier->WriteBackLock);
+
+        while (!IsListEmpty(&free_list))
+        {
+            entry = RemoveHeadList(&free_list);
+
+            victim = CONTAINING_RECORD(entry, RAM_TIER_BLOCK, LruEntry);
+
+            ExFreePool(victim->Data);
+            ExFreePool(victim);
+        }
+    }
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+/* not pageable since it takes the spin lock */
+
+VOID
+RamTierQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    OUT PSWAPFS_STATISTICS  Statistics,
+    IN BOOLEAN              Reset
+    )
+{
+    PRAM_TIER   ram_tier;
+    KIRQL       irql;
+
+    ram_tier = &DeviceExtension->RamTier;
+
+    KeAcquireSpinLock(&ram_tier->Lock, &irql);
+
+    Statistics->RamTierHits = ram_tier->Hits;
+    Statistics->RamTierMisses = ram_tier->Misses;
+    Statistics->RamTierAbsorbed = ram_tier->Absorbed;
+    Statistics->RamTierWrittenBack = ram_tier->WrittenBack;
+
+    if (Reset)
+    {
+        ram_tier->Hits = 0;
+        ram_tier->Misses = 0;
+        ram_tier->Absorbed = 0;
+        ram_tier->WrittenBack = 0;
+    }
+
+    KeReleaseSpinLock(&ram_tier->Lock, irql);
+}
@@ -0,0 +1,583 @@
+/*
+    Functions to read ahead of sequential reads from the swap device.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With ReadAheadSize a few streams of reads are followed, a read that
+    starts where the read before it in a stream ended continues it and
+    any other read replaces the stream used longest ago. When a stream
+    has continued READ_AHEAD_TRIGGER times the data after it is read into
+    nonpaged buffers of ReadAheadSize KB split in READ_AHEAD_BUFFERS, so
+    much that the window of the stream is read ahead of the last read.
+    A read that is all in a buffer that has been read is completed from
+    it. The window starts at the size of one buffer, it's doubled when a
+    buffer is read to its end and halved when a buffer of the stream is
+    reused before it was read. A write throws away the buffers it
+    overlaps, both when it's sent down and when it completes, and bumps
+    the generation of each of them. A buffer is only valid when its read
+    completes if the generation is the one it was read at, so a buffer
+    being read at the same time as a write is not used. Only the data
+    region is read ahead since the FAT and the root directory are in the
+    metadata cache, and the sectors not written since format are read as
+    zeros by the virtual zero fill.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", ReadAheadInitialize)
+#pragma alloc_text("INIT", ReadAheadRelease)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+ReadAheadInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                ReadAheadSize
+    )
+{
+    PREAD_AHEAD     read_ahead;
+    PUCHAR          pool;
+    ULONG           buffer_size;
+    ULONG           n;
+
+    read_ahead = &DeviceExtension->ReadAhead;
+
+    /* ReadAheadSize is in KB and each buffer is a number of pages */
+
+    ReadAheadSize = min(max(ReadAheadSize, READ_AHEAD_MINIMUM_SIZE), READ_AHEAD_MAXIMUM_SIZE);
+
+    buffer_size = (ReadAheadSize * 1024 / READ_AHEAD_BUFFERS) & ~(PAGE_SIZE - 1);
+
+    pool = (PUCHAR) ExAllocatePoolWithTag(
+        NonPagedPool,
+        buffer_size * READ_AHEAD_BUFFERS,
+        SWAPFS_POOL_TAG
+        );
+
+    if (!pool)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(read_ahead, sizeof(READ_AHEAD));
+
+    KeInitializeSpinLock(&read_ahead->Lock);
+
+    read_ahead->BufferSize = buffer_size;
+
+    read_ahead->MaximumWindow = buffer_size * READ_AHEAD_BUFFERS;
+
+    for (n = 0; n < READ_AHEAD_BUFFERS; n++)
+    {
+        read_ahead->Buffer[n].DeviceExtension = DeviceExtension;
+        read_ahead->Buffer[n].Data = pool + n * buffer_size;
+        read_ahead->Buffer[n].State = READ_AHEAD_FREE;
+    }
+
+    KdPrint(("SwapFs: Reading ahead with %u buffers of %u bytes.\n", READ_AHEAD_BUFFERS, buffer_size));
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+ReadAheadRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PREAD_AHEAD read_ahead;
+
+    read_ahead = &DeviceExtension->ReadAhead;
+
+    if (!read_ahead->MaximumWindow)
+    {
+        return;
+    }
+
+    ExFreePool(read_ahead->Buffer[0].Data);
+
+    RtlZeroMemory(read_ahead, sizeof(READ_AHEAD));
+}
+
+/* not pageable since it's called with the spin lock held */
+
+static VOID
+read_ahead_invalidate (
+    IN PREAD_AHEAD  ReadAhead,
+    IN LONGLONG     Offset,
+    IN ULONG        Length
+    )
+{
+    PREAD_AHEAD_BUFFER  buffer;
+    ULONG               n;
+
+    for (n = 0; n < READ_AHEAD_BUFFERS; n++)
+    {
+        buffer = &ReadAhead->Buffer[n];
+
+        if (buffer->State == READ_AHEAD_FREE ||
+            buffer->Offset >= Offset + Length ||
+            buffer->Offset + buffer->Length <= Offset)
+        {
+            continue;
+        }
+
+        /* a buffer still being read is thrown away by its completion since the generation has changed */
+
+        buffer->Generation++;
+
+        if (buffer->State == READ_AHEAD_VALID)
+        {
+            buffer->State = READ_AHEAD_FREE;
+        }
+    }
+}
+
+/* not pageable since it's called with the spin lock held */
+
+static PREAD_AHEAD_BUFFER
+read_ahead_take_buffer (
+    IN PREAD_AHEAD  ReadAhead
+    )
+{
+    PREAD_AHEAD_BUFFER  buffer;
+    PREAD_AHEAD_STREAM  stream;
+    ULONG               n;
+
+    buffer = NULL;
+
+    /* a free buffer is taken first, else the one that was used longest ago if not by this read */
+
+    for (n = 0; n < READ_AHEAD_BUFFERS; n++)
+    {
+        if (ReadAhead->Buffer[n].State == READ_AHEAD_FREE)
+        {
+            return &ReadAhead->Buffer[n];
+        }
+
+        if (ReadAhead->Buffer[n].State == READ_AHEAD_VALID &&
+            ReadAhead->Buffer[n].LastUse != ReadAhead->Clock &&
+            (!buffer || ReadAhead->Buffer[n].LastUse < buffer->LastUse))
+        {
+            buffer = &ReadAhead->Buffer[n];
+        }
+    }
+
+    if (!buffer)
+    {
+        return NULL;
+    }
+
+    /* the stream that never read what was read ahead for it reads less ahead */
+
+    if (buffer->Used < buffer->Length)
+    {
+        ReadAhead->Wasted += buffer->Length - buffer->Used;
+
+        stream = &ReadAhead->Stream[buffer->Stream];
+
+        stream->Window = max(stream->Window / 2, ReadAhead->BufferSize);
+    }
+
+    buffer->State = READ_AHEAD_FREE;
+
+    return buffer;
+}
+
+NTSTATUS
+ReadAheadCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PREAD_AHEAD_BUFFER  buffer;
+    PREAD_AHEAD         read_ahead;
+    KIRQL               irql;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    buffer = (PREAD_AHEAD_BUFFER) Context;
+
+    read_ahead = &buffer->DeviceExtension->ReadAhead;
+
+    KeAcquireSpinLock(&read_ahead->Lock, &irql);
+
+    if (NT_SUCCESS(Irp->IoStatus.Status) &&
+        Irp->IoStatus.Information == buffer->Length &&
+        buffer->Generation == buffer->ReadGeneration)
+    {
+        buffer->State = READ_AHEAD_VALID;
+    }
+    else
+    {
+        buffer->State = READ_AHEAD_FREE;
+    }
+
+    KeReleaseSpinLock(&read_ahead->Lock, irql);
+
+    IoFreeMdl(Irp->MdlAddress);
+
+    IoFreeIrp(Irp);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+NTSTATUS
+ReadAheadWriteCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PREAD_AHEAD         read_ahead;
+    PIO_STACK_LOCATION  io_stack;
+    KIRQL               irql;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    device_extension = (PDEVICE_EXTENSION) Context;
+
+    read_ahead = &device_extension->ReadAhead;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    /* what was read ahead while the write was on its way down may be older than it */
+
+    KeAcquireSpinLock(&read_ahead->Lock, &irql);
+
+    read_ahead_invalidate(
+        read_ahead,
+        io_stack->Parameters.Write.ByteOffset.QuadPart,
+        io_stack->Parameters.Write.Length
+        );
+
+    KeReleaseSpinLock(&read_ahead->Lock, irql);
+
+    if (Irp->PendingReturned)
+    {
+        IoMarkIrpPending(Irp);
+    }
+
+    return STATUS_CONTINUE_COMPLETION;
+}
+
+/* not pageable since it's called from the dispatch routine */
+
+static VOID
+read_ahead_start (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PREAD_AHEAD_BUFFER   Buffer
+    )
+{
+    PREAD_AHEAD         read_ahead;
+    PIO_STACK_LOCATION  next_io_stack;
+    PIRP                irp;
+    PMDL                mdl;
+    KIRQL               irql;
+
+    read_ahead = &DeviceExtension->ReadAhead;
+
+    irp = IoAllocateIrp(DeviceExtension->DeviceObject->StackSize, FALSE);
+
+    mdl = irp ? IoAllocateMdl(Buffer->Data, Buffer->Length, FALSE, FALSE, irp) : NULL;
+
+    if (!mdl)
+    {
+        if (irp)
+        {
+            IoFreeIrp(irp);
+        }
+
+        KeAcquireSpinLock(&read_ahead->Lock, &irql);
+
+        Buffer->State = READ_AHEAD_FREE;
+
+        KeReleaseSpinLock(&read_ahead->Lock, irql);
+
+        return;
+    }
+
+    MmBuildMdlForNonPagedPool(mdl);
+
+    next_io_stack = IoGetNextIrpStackLocation(irp);
+
+    next_io_stack->MajorFunction = IRP_MJ_READ;
+    next_io_stack->Parameters.Read.ByteOffset.QuadPart = Buffer->Offset + sizeof(union swap_header);
+    next_io_stack->Parameters.Read.Length = Buffer->Length;
+
+    IoSetCompletionRoutine(
+        irp,
+        ReadAheadCompletion,
+        Buffer,
+        TRUE,
+        TRUE,
+        TRUE
+        );
+
+    StripeCallDriver(DeviceExtension, irp);
+}
+
+NTSTATUS
+ReadAheadReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PREAD_AHEAD         read_ahead;
+    PREAD_AHEAD_STREAM  stream;
+    PREAD_AHEAD_BUFFER  buffer;
+    PREAD_AHEAD_BUFFER  start[READ_AHEAD_BUFFERS];
+    PIO_STACK_LOCATION  io_stack;
+    PIO_STACK_LOCATION  next_io_stack;
+    LONGLONG            offset;
+    LONGLONG            end;
+    ULONG               length;
+    ULONG               nstart;
+    ULONG               n;
+    BOOLEAN             hit;
+    PUCHAR              data;
+    NTSTATUS            status;
+    KIRQL               irql;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    read_ahead = &device_extension->ReadAhead;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart;
+    length = io_stack->Parameters.Read.Length;
+    end = offset + length;
+
+    if (io_stack->MajorFunction == IRP_MJ_WRITE)
+    {
+        KeAcquireSpinLock(&read_ahead->Lock, &irql);
+
+        read_ahead_invalidate(read_ahead, offset, length);
+
+        KeReleaseSpinLock(&read_ahead->Lock, irql);
+
+        IoCopyCurrentIrpStackLocationToNext(Irp);
+
+        next_io_stack = IoGetNextIrpStackLocation(Irp);
+
+        next_io_stack->Parameters.Write.ByteOffset.QuadPart += sizeof(union swap_header);
+
+        IoSetCompletionRoutine(
+            Irp,
+            ReadAheadWriteCompletion,
+            device_extension,
+            TRUE,
+            TRUE,
+            TRUE
+            );
+
+        return StripeCallDriver(device_extension, Irp);
+    }
+
+    data = length ? (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority) : NULL;
+
+    hit = FALSE;
+
+    nstart = 0;
+
+    KeAcquireSpinLock(&read_ahead->Lock, &irql);
+
+    read_ahead->Clock++;
+
+    /* the read continues the stream that ended where it starts, or replaces the one used longest ago */
+
+    for (n = 0, stream = &read_ahead->Stream[0]; n < READ_AHEAD_STREAMS; n++)
+    {
+        if (read_ahead->Stream[n].NextOffset == offset && read_ahead->Stream[n].Sequential)
+        {
+            stream = &read_ahead->Stream[n];
+            break;
+        }
+
+        if (read_ahead->Stream[n].LastUse < stream->LastUse)
+        {
+            stream = &read_ahead->Stream[n];
+        }
+    }
+
+    if (n < READ_AHEAD_STREAMS)
+    {
+        stream->Sequential++;
+    }
+    else
+    {
+        stream->Sequential = 1;
+        stream->AheadOffset = end;
+        stream->Window = read_ahead->BufferSize;
+    }
+
+    stream->NextOffset = end;
+
+    stream->LastUse = read_ahead->Clock;
+
+    for (n = 0; n < READ_AHEAD_BUFFERS && data; n++)
+    {
+        buffer = &read_ahead->Buffer[n];
+
+        if (buffer->State != READ_AHEAD_VALID || buffer->Offset > offset || buffer->Offset + buffer->Length < end)
+        {
+            continue;
+        }
+
+        RtlCopyMemory(data, buffer->Data + (ULONG) (offset - buffer->Offset), length);
+
+        buffer->Used = min(buffer->Used + length, buffer->Length);
+
+        buffer->LastUse = read_ahead->Clock;
+
+        hit = TRUE;
+
+        break;
+    }
+
+    if (hit)
+    {
+        read_ahead->Hits++;
+    }
+    else
+    {
+        read_ahead->Misses++;
+    }
+
+    /* the buffers the stream has read past are done, it reads more ahead when one was all used */
+
+    for (n = 0; n < READ_AHEAD_BUFFERS; n++)
+    {
+        buffer = &read_ahead->Buffer[n];
+
+        if (buffer->State != READ_AHEAD_VALID ||
+            &read_ahead->Stream[buffer->Stream] != stream ||
+            buffer->Offset + buffer->Length > end ||
+            buffer->Offset + buffer->Length <= offset)
+        {
+            continue;
+        }
+
+        if (buffer->Used == buffer->Length)
+        {
+            stream->Window = min(stream->Window * 2, read_ahead->MaximumWindow);
+        }
+        else
+        {
+            read_ahead->Wasted += buffer->Length - buffer->Used;
+        }
+
+        buffer->State = READ_AHEAD_FREE;
+    }
+
+    /* read ahead until the window of the stream is in buffers or being read */
+
+    if (stream->Sequential >= READ_AHEAD_TRIGGER)
+    {
+        stream->AheadOffset = max(stream->AheadOffset, end);
+
+        while (stream->AheadOffset < end + stream->Window &&
+               stream->AheadOffset < device_extension->Stamp.VolumeLength &&
+               nstart < READ_AHEAD_BUFFERS)
+        {
+            buffer = read_ahead_take_buffer(read_ahead);
+
+            if (!buffer)
+            {
+                break;
+            }
+
+            buffer->State = READ_AHEAD_PENDING;
+            buffer->ReadGeneration = buffer->Generation;
+            buffer->Stream = (ULONG) (stream - read_ahead->Stream);
+            buffer->Offset = stream->AheadOffset;
+            buffer->Length = (ULONG) min(read_ahead->BufferSize, device_extension->Stamp.VolumeLength - buffer->Offset);
+            buffer->Used = 0;
+            buffer->LastUse = read_ahead->Clock;
+
+            stream->AheadOffset += buffer->Length;
+
+            read_ahead->Bytes += buffer->Length;
+
+            start[nstart++] = buffer;
+        }
+    }
+
+    KeReleaseSpinLock(&read_ahead->Lock, irql);
+
+    for (n = 0; n < nstart; n++)
+    {
+        read_ahead_start(device_extension, start[n]);
+    }
+
+    if (hit)
+    {
+        status = STATUS_SUCCESS;
+
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = length;
+
+        IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+
+        return status;
+    }
+
+    IoCopyCurrentIrpStackLocationToNext(Irp);
+
+    next_io_stack = IoGetNextIrpStackLocation(Irp);
+
+    next_io_stack->Parameters.Read.ByteOffset.QuadPart += sizeof(union swap_header);
+
+    return StripeCallDriver(device_extension, Irp);
+}
+
+/* not pageable since it takes the spin lock */
+
+VOID
+ReadAheadQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    OUT PSWAPFS_STATISTICS  Statistics,
+    IN BOOLEAN              Reset
+    )
+{
+    PREAD_AHEAD read_ahead;
+    KIRQL       irql;
+
+    read_ahead = &DeviceExtension->ReadAhead;
+
+    KeAcquireSpinLock(&read_ahead->Lock, &irql);
+
+    Statistics->ReadAheadHits = read_ahead->Hits;
+    Statistics->ReadAheadMisses = read_ahead->Misses;
+    Statistics->ReadAheadBytes = read_ahead->Bytes;
+    Statistics->ReadAheadWasted = read_ahead->Wasted;
+
+    if (Reset)
+    {
+        read_ahead->Hits = 0;
+        read_ahead->Misses = 0;
+        read_ahead->Bytes = 0;
+        read_ahead->Wasted = 0;
+    }
+
+    KeReleaseSpinLock(&read_ahead->Lock, irql);
+}
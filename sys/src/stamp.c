@@ -0,0 +1,368 @@
+/*
+    Functions to reuse the volume formated at the previous boot.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The formatter records where the boot sector, the sector after it and
+    the first sector of the FAT are, and at last chance shutdown, when the
+    file systems are gone and the FAT is written back, a stamp with the
+    generation of the format, the configuration of the device and a
+    checksum of the swap header and of these sectors is written to the boot
+    bits of the swap header. At the next boot the stamp is always removed
+    so a crash before the next clean shutdown formats the device again,
+    and with ReuseVolume a stamp that is still valid skips the format. A
+    mkswap in Linux changes the swap header and a use of the partition as
+    swap the boot sector, so both makes the checksum fail. A volume with
+    VirtualZeroFill is never stamped since the sectors it reads as zeros
+    are not cleared on the device.
+*/
+
+#include <ntddk.h>
+#include <ntdddisk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+static ULONG
+StampSum (
+    IN ULONG    Checksum,
+    IN PUCHAR   Buffer,
+    IN ULONG    Length
+    );
+
+static NTSTATUS
+StampChecksum (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN union swap_header*   SwapHeader,
+    OUT PULONG              Checksum
+    );
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("PAGE", StampRecord)
+#pragma alloc_text("PAGE", StampCheck)
+#endif // ALLOC_PRAGMA
+
+static ULONG
+StampSum (
+    IN ULONG    Checksum,
+    IN PUCHAR   Buffer,
+    IN ULONG    Length
+    )
+{
+    ULONG n;
+
+    for (n = 0; n < Length; n++)
+    {
+        Checksum = ((Checksum << 31) | (Checksum >> 1)) + Buffer[n];
+    }
+
+    return Checksum;
+}
+
+static NTSTATUS
+StampChecksum (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN union swap_header*   SwapHeader,
+    OUT PULONG              Checksum
+    )
+{
+    PVOLUME_STAMP   stamp;
+    PUCHAR          buffer;
+    ULONG           sector[3];
+    ULONG           saved_checksum;
+    ULONG           checksum;
+    ULONG           n;
+    NTSTATUS        status;
+
+    stamp = (PVOLUME_STAMP) (SwapHeader->info.bootbits + VOLUME_STAMP_OFFSET);
+
+    /* the swap header is summed with the checksum of the stamp as zero */
+
+    saved_checksum = stamp->Checksum;
+
+    stamp->Checksum = 0;
+
+    checksum = StampSum(0, (PUCHAR) SwapHeader, sizeof(union swap_header));
+
+    stamp->Checksum = saved_checksum;
+
+    buffer = (PUCHAR) ExAllocatePoolWithTag(NonPagedPool, stamp->SectorSize, SWAPFS_POOL_TAG);
+
+    if (!buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* the boot sector, the FSInfo or first FAT sector and the first FAT sector of the volume */
+
+    sector[0] = 0;
+    sector[1] = 1;
+    sector[2] = stamp->FatSector;
+
+    status = STATUS_SUCCESS;
+
+    for (n = 0; n < 3; n++)
+    {
+        status = StripeRead(
+            DeviceExtension,
+            (LONGLONG) sector[n] * stamp->SectorSize,
+            stamp->SectorSize,
+            buffer
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        checksum = StampSum(checksum, buffer, stamp->SectorSize);
+    }
+
+    ExFreePool(buffer);
+
+    *Checksum = checksum;
+
+    return status;
+}
+
+VOID
+StampRecord (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                FileSystem,
+    IN ULONG                SectorSize,
+    IN ULONG                FatSector,
+    IN ULONG                MetaSectors,
+    IN LONGLONG             VolumeLength
+    )
+{
+    PVOLUME_STAMP stamp;
+
+    PAGED_CODE();
+
+    stamp = &DeviceExtension->Stamp;
+
+    /* the generation counts the formats since the stamp was first written */
+
+    RtlCopyMemory(stamp->Signature, VOLUME_STAMP_SIGNATURE, sizeof(stamp->Signature));
+    stamp->Generation++;
+    stamp->FileSystem = FileSystem;
+    stamp->SectorSize = SectorSize;
+    stamp->FatSector = FatSector;
+    stamp->MetaSectors = MetaSectors;
+    stamp->StripeSize = DeviceExtension->Stripe.StripeSize;
+    stamp->NumberOfMembers = DeviceExtension->Stripe.NumberOfMembers;
+    stamp->FormatProfile = DeviceExtension->FormatProfile;
+    stamp->ClusterSize = DeviceExtension->ClusterSize;
+    stamp->Checksum = 0;
+    stamp->VolumeLength = VolumeLength;
+}
+
+NTSTATUS
+StampCheck (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    union swap_header*      swap_header;
+    PVOLUME_STAMP           stamp;
+    VOLUME_STAMP            old_stamp;
+    GET_LENGTH_INFORMATION  length_information;
+    LARGE_INTEGER           offset;
+    ULONG                   checksum;
+    ULONG                   size;
+    NTSTATUS                status;
+
+    PAGED_CODE();
+
+    swap_header = (union swap_header*) ExAllocatePoolWithTag(PagedPool, sizeof(union swap_header), SWAPFS_POOL_TAG);
+
+    if (!swap_header)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    offset.QuadPart = SWAP_HEADER_OFFSET;
+
+    status = ReadBlockDevice(
+        DeviceExtension->TargetDeviceObject,
+        &offset,
+        sizeof(union swap_header),
+        swap_header
+        );
+
+    stamp = (PVOLUME_STAMP) (swap_header->info.bootbits + VOLUME_STAMP_OFFSET);
+
+    if (!NT_SUCCESS(status) ||
+        RtlCompareMemory(stamp->Signature, VOLUME_STAMP_SIGNATURE, sizeof(stamp->Signature)) != sizeof(stamp->Signature))
+    {
+        ExFreePool(swap_header);
+        return STATUS_UNRECOGNIZED_VOLUME;
+    }
+
+    old_stamp = *stamp;
+
+    /* the next format continues the generations of the stamp */
+
+    DeviceExtension->Stamp.Generation = old_stamp.Generation;
+
+    status = STATUS_UNRECOGNIZED_VOLUME;
+
+    if (DeviceExtension->ReuseVolume &&
+        old_stamp.SectorSize >= 512 &&
+        old_stamp.SectorSize <= PAGE_SIZE &&
+        old_stamp.FatSector < old_stamp.MetaSectors &&
+        old_stamp.StripeSize == DeviceExtension->Stripe.StripeSize &&
+        old_stamp.NumberOfMembers == DeviceExtension->Stripe.NumberOfMembers &&
+        old_stamp.FormatProfile == DeviceExtension->FormatProfile &&
+        old_stamp.ClusterSize == DeviceExtension->ClusterSize)
+    {
+        size = sizeof(length_information);
+
+        status = BlockDeviceIoControl(
+            DeviceExtension->TargetDeviceObject,
+            IOCTL_DISK_GET_LENGTH_INFO,
+            NULL,
+            0,
+            &length_information,
+            &size
+            );
+
+        if (NT_SUCCESS(status) &&
+            old_stamp.VolumeLength != SwapFsVolumeLength(DeviceExtension, length_information.Length.QuadPart))
+        {
+            status = STATUS_UNRECOGNIZED_VOLUME;
+        }
+
+        if (NT_SUCCESS(status))
+        {
+            status = StampChecksum(DeviceExtension, swap_header, &checksum);
+        }
+
+        if (NT_SUCCESS(status) && checksum != old_stamp.Checksum)
+        {
+            KdPrint(("SwapFs: The volume has changed since the last shutdown.\n"));
+            status = STATUS_UNRECOGNIZED_VOLUME;
+        }
+    }
+    else if (DeviceExtension->ReuseVolume)
+    {
+        KdPrint(("SwapFs: The device has been reconfigured since the last shutdown.\n"));
+    }
+
+    /* the stamp is written again at the next clean shutdown */
+
+    RtlZeroMemory(stamp, sizeof(VOLUME_STAMP));
+
+    if (!NT_SUCCESS(WriteBlockDevice(
+            DeviceExtension->TargetDeviceObject,
+            &offset,
+            sizeof(union swap_header),
+            swap_header
+            )))
+    {
+        KdPrint(("SwapFs: Failed to remove the stamp from the swap header.\n"));
+        status = STATUS_UNRECOGNIZED_VOLUME;
+    }
+
+    ExFreePool(swap_header);
+
+    if (NT_SUCCESS(status))
+    {
+        DeviceExtension->Stamp = old_stamp;
+    }
+
+    return status;
+}
+
+/* not pageable since it's called at last chance shutdown */
+
+NTSTATUS
+StampVolume (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    union swap_header*  swap_header;
+    PVOLUME_STAMP       stamp;
+    LARGE_INTEGER       offset;
+    BOOLEAN             dirty;
+    NTSTATUS            status;
+    KIRQL               irql;
+
+    if (!DeviceExtension->Stamp.SectorSize ||
+        DeviceExtension->FormatState != FORMAT_STATE_READY ||
+        DeviceExtension->ZeroFill.Bitmap.Buffer)
+    {
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    /* a FAT that is not written back can't be reused */
+
+    if (DeviceExtension->MetaCache.Buffer)
+    {
+        KeAcquireSpinLock(&DeviceExtension->MetaCache.Lock, &irql);
+
+        dirty = !RtlAreBitsClear(&DeviceExtension->MetaCache.Dirty, 0, DeviceExtension->MetaCache.Dirty.SizeOfBitMap);
+
+        KeReleaseSpinLock(&DeviceExtension->MetaCache.Lock, irql);
+
+        if (dirty)
+        {
+            KdPrint(("SwapFs: Metadata not written back, the volume is not stamped.\n"));
+            return STATUS_UNSUCCESSFUL;
+        }
+    }
+
+    swap_header = (union swap_header*) ExAllocatePoolWithTag(NonPagedPool, sizeof(union swap_header), SWAPFS_POOL_TAG);
+
+    if (!swap_header)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    offset.QuadPart = SWAP_HEADER_OFFSET;
+
+    status = ReadBlockDevice(
+        DeviceExtension->TargetDeviceObject,
+        &offset,
+        sizeof(union swap_header),
+        swap_header
+        );
+
+    if (NT_SUCCESS(status))
+    {
+        stamp = (PVOLUME_STAMP) (swap_header->info.bootbits + VOLUME_STAMP_OFFSET);
+
+        *stamp = DeviceExtension->Stamp;
+
+        status = StampChecksum(DeviceExtension, swap_header, &stamp->Checksum);
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        status = WriteBlockDevice(
+            DeviceExtension->TargetDeviceObject,
+            &offset,
+            sizeof(union swap_header),
+            swap_header
+            );
+    }
+
+    ExFreePool(swap_header);
+
+    KdPrint(("SwapFs: Stamped volume of generation %u, status 0x%08x.\n",
+        DeviceExtension->Stamp.Generation, status));
+
+    return status;
+}
@@ -0,0 +1,367 @@
+/*
+    Functions to count the reads and writes of the swap device.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Each read and write is counted from when it reaches the driver to when
+    it is completed, whether it is completed from the metadata cache, read
+    as zeros or sent to the device. The driver has one more stack location
+    than the device below it, so the request can be given a completion
+    routine in the stack location of the driver and then be moved down to
+    the next one where it is handled as before. The flushes and shutdowns
+    gets the completion routine too so they can be traced, but they are
+    only counted as in flight. The counters are kept in
+    one slot per processor, each on cache lines of its own, that are only
+    summed when they are queried with IOCTL_SWAPFS_QUERY_STATISTICS. They
+    are updated with interlocked operations since a thread may be preempted
+    by another on the same processor, but no lock is taken and no cache
+    line is shared between processors.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swapfsetw.h"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", StatsInitialize)
+#pragma alloc_text("INIT", StatsRelease)
+#pragma alloc_text("PAGE", StatsQuery)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+StatsInitialize (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PIO_STATISTICS      stats;
+    PIO_STATISTICS_SLOT slots;
+    ULONG               nslot;
+    LARGE_INTEGER       frequency;
+
+    stats = &DeviceExtension->Statistics;
+
+    nslot = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    slots = (PIO_STATISTICS_SLOT) ExAllocatePoolWithTag(
+        NonPagedPoolCacheAligned,
+        nslot * sizeof(IO_STATISTICS_SLOT),
+        SWAPFS_POOL_TAG
+        );
+
+    if (!slots)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(slots, nslot * sizeof(IO_STATISTICS_SLOT));
+
+    ExInitializeNPagedLookasideList(
+        &stats->ContextList,
+        NULL,
+        NULL,
+        0,
+        sizeof(IO_STATISTICS_CONTEXT),
+        SWAPFS_POOL_TAG,
+        0
+        );
+
+    stats->ResetTime = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+    stats->Frequency = frequency.QuadPart;
+
+    stats->NumberOfSlots = nslot;
+
+    stats->Slots = slots;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+StatsRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PIO_STATISTICS stats;
+
+    stats = &DeviceExtension->Statistics;
+
+    if (!stats->Slots)
+    {
+        return;
+    }
+
+    ExDeleteNPagedLookasideList(&stats->ContextList);
+
+    ExFreePool(stats->Slots);
+
+    stats->Slots = NULL;
+}
+
+BOOLEAN
+StatsStart (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PDEVICE_EXTENSION       device_extension;
+    PIO_STATISTICS          stats;
+    PIO_STATISTICS_CONTEXT  context;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    stats = &device_extension->Statistics;
+
+    /* the request must have room for the extra stack location and the one of the device below */
+
+    if (!stats->Slots || Irp->CurrentLocation < 3)
+    {
+        return FALSE;
+    }
+
+    context = (PIO_STATISTICS_CONTEXT) ExAllocateFromNPagedLookasideList(&stats->ContextList);
+
+    if (!context)
+    {
+        return FALSE;
+    }
+
+    context->StartTime = KeQueryPerformanceCounter(NULL).QuadPart;
+
+    /* the traced requests share one counter so the depth of each is known when it starts */
+
+    context->Depth = device_extension->Trace.Records ?
+        InterlockedIncrement(&device_extension->Trace.InFlight) : 0;
+
+    InterlockedIncrement(&stats->Slots[KeGetCurrentProcessorNumberEx(NULL) % stats->NumberOfSlots].InFlight);
+
+    IoCopyCurrentIrpStackLocationToNext(Irp);
+
+    IoSetCompletionRoutine(
+        Irp,
+        StatsCompletion,
+        context,
+        TRUE,
+        TRUE,
+        TRUE
+        );
+
+    IoSetNextIrpStackLocation(Irp);
+
+    return TRUE;
+}
+
+NTSTATUS
+StatsCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PDEVICE_EXTENSION       device_extension;
+    PIO_STATISTICS          stats;
+    PIO_STATISTICS_SLOT     slot;
+    PIO_STATISTICS_CONTEXT  context;
+    LONGLONG                start_time;
+    LONGLONG                latency;
+    LONG                    depth;
+    UCHAR                   major_function;
+    ULONG                   operation;
+    ULONG                   bucket;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    stats = &device_extension->Statistics;
+
+    context = (PIO_STATISTICS_CONTEXT) Context;
+
+    start_time = context->StartTime;
+
+    depth = context->Depth;
+
+    latency = (KeQueryPerformanceCounter(NULL).QuadPart - start_time) * 1000000 / stats->Frequency;
+
+    ExFreeToNPagedLookasideList(&stats->ContextList, context);
+
+    if (depth)
+    {
+        TraceRecord(device_extension, Irp, start_time, latency, depth);
+    }
+
+    slot = &stats->Slots[KeGetCurrentProcessorNumberEx(NULL) % stats->NumberOfSlots];
+
+    major_function = IoGetCurrentIrpStackLocation(Irp)->MajorFunction;
+
+    if (major_function == IRP_MJ_READ || major_function == IRP_MJ_WRITE)
+    {
+        operation = (major_function == IRP_MJ_WRITE) ?
+            SWAPFS_OPERATION_WRITE : SWAPFS_OPERATION_READ;
+
+        /* the most significant bit is -1 for a latency of zero */
+
+        bucket = (ULONG) min(RtlFindMostSignificantBit((ULONGLONG) latency) + 1, SWAPFS_LATENCY_BUCKETS - 1);
+
+        InterlockedIncrement64(&slot->Requests[operation]);
+
+        InterlockedExchangeAdd64(&slot->Bytes[operation], (LONGLONG) Irp->IoStatus.Information);
+
+        if (!NT_SUCCESS(Irp->IoStatus.Status))
+        {
+            InterlockedIncrement64(&slot->Errors[operation]);
+        }
+
+        InterlockedExchangeAdd64(&slot->Latency[operation], latency);
+
+        InterlockedIncrement64(&slot->Histogram[operation][bucket]);
+
+        if (SwapFsEtwEnabled(WINEVENT_LEVEL_VERBOSE, SWAPFS_KEYWORD_READ_WRITE))
+        {
+            EtwReadWriteComplete(DeviceObject, Irp, latency);
+        }
+    }
+
+    /* the request may complete on another processor than it started on, only the sum is the depth */
+
+    InterlockedDecrement(&slot->InFlight);
+
+    if (Irp->PendingReturned)
+    {
+        IoMarkIrpPending(Irp);
+    }
+
+    return STATUS_CONTINUE_COMPLETION;
+}
+
+NTSTATUS
+StatsQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    PIO_STACK_LOCATION  io_stack;
+    PIO_STATISTICS      stats;
+    PIO_STATISTICS_SLOT slot;
+    PSWAPFS_STATISTICS  statistics;
+    LONGLONG            now;
+    ULONG               flags;
+    ULONG               n, operation, bucket;
+
+    PAGED_CODE();
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    stats = &DeviceExtension->Statistics;
+
+    Irp->IoStatus.Information = 0;
+
+    if (!stats->Slots)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    if (io_stack->Parameters.DeviceIoControl.OutputBufferLength < sizeof(SWAPFS_STATISTICS))
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    /* the input and the output share the system buffer */
+
+    flags = 0;
+
+    if (io_stack->Parameters.DeviceIoControl.InputBufferLength >= sizeof(SWAPFS_STATISTICS_REQUEST))
+    {
+        flags = ((PSWAPFS_STATISTICS_REQUEST) Irp->AssociatedIrp.SystemBuffer)->Flags;
+    }
+
+    statistics = (PSWAPFS_STATISTICS) Irp->AssociatedIrp.SystemBuffer;
+
+    RtlZeroMemory(statistics, sizeof(SWAPFS_STATISTICS));
+
+    statistics->Version = SWAPFS_STATISTICS_VERSION;
+
+    now = KeQueryPerformanceCounter(NULL).QuadPart;
+
+    statistics->Interval = (now - stats->ResetTime) * 1000000 / stats->Frequency;
+
+    for (n = 0; n < stats->NumberOfSlots; n++)
+    {
+        slot = &stats->Slots[n];
+
+        statistics->InFlight += slot->InFlight;
+
+        for (operation = 0; operation < SWAPFS_OPERATIONS; operation++)
+        {
+            statistics->Operation[operation].Requests += slot->Requests[operation];
+            statistics->Operation[operation].Bytes += slot->Bytes[operation];
+            statistics->Operation[operation].Errors += slot->Errors[operation];
+            statistics->Operation[operation].TotalLatency += slot->Latency[operation];
+
+            for (bucket = 0; bucket < SWAPFS_LATENCY_BUCKETS; bucket++)
+            {
+                statistics->Operation[operation].Histogram[bucket] += slot->Histogram[operation][bucket];
+            }
+        }
+    }
+
+    if (DeviceExtension->ReadAhead.MaximumWindow)
+    {
+        ReadAheadQuery(DeviceExtension, statistics, (BOOLEAN) ((flags & SWAPFS_STATISTICS_RESET) != 0));
+    }
+
+    if (DeviceExtension->RamTier.Hash)
+    {
+        RamTierQuery(DeviceExtension, statistics, (BOOLEAN) ((flags & SWAPFS_STATISTICS_RESET) != 0));
+    }
+
+    if (DeviceExtension->ZeroElision.Start)
+    {
+        ZeroElisionQuery(DeviceExtension, statistics, (BOOLEAN) ((flags & SWAPFS_STATISTICS_RESET) != 0));
+    }
+
+    if (DeviceExtension->Dedup.Start)
+    {
+        DedupQuery(DeviceExtension, statistics, (BOOLEAN) ((flags & SWAPFS_STATISTICS_RESET) != 0));
+    }
+
+    /* the requests in flight are not reset since they are still to be completed */
+
+    if (flags & SWAPFS_STATISTICS_RESET)
+    {
+        for (n = 0; n < stats->NumberOfSlots; n++)
+        {
+            slot = &stats->Slots[n];
+
+            for (operation = 0; operation < SWAPFS_OPERATIONS; operation++)
+            {
+                InterlockedExchange64(&slot->Requests[operation], 0);
+                InterlockedExchange64(&slot->Bytes[operation], 0);
+                InterlockedExchange64(&slot->Errors[operation], 0);
+                InterlockedExchange64(&slot->Latency[operation], 0);
+
+                for (bucket = 0; bucket < SWAPFS_LATENCY_BUCKETS; bucket++)
+                {
+                    InterlockedExchange64(&slot->Histogram[operation][bucket], 0);
+                }
+            }
+        }
+
+        stats->ResetTime = now;
+    }
+
+    Irp->IoStatus.Information = sizeof(SWAPFS_STATISTICS);
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,570 @@
+/*
+    Functions to stripe a volume over several Linux swap partitions.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    When StripeSize is set all the listed swap partitions are joined to one
+    RAID-0 volume on the first of them. The volume is divided in stripes of
+    StripeSize KB that are placed on the members in turn, each member holds
+    as many stripes as fits on the smallest of them after its swap header.
+    Reads and writes are split at the stripe boundaries and sent to the
+    members in parallel, the request is completed when all parts are done.
+*/
+
+#include <ntddk.h>
+#include <ntdddisk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", StripeInitialize)
+#pragma alloc_text("INIT", StripeRelease)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+StripeInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PFIND_DEVICE_CONTEXT Context
+    )
+{
+    PSTRIPE                 stripe;
+    DISK_GEOMETRY           disk_geometry;
+    GET_LENGTH_INFORMATION  length_information;
+    ULONG                   sector_size;
+    ULONG                   size;
+    ULONG                   n;
+    NTSTATUS                status;
+
+    ASSERT(Context->NumberOfMembers > 1 && Context->NumberOfMembers <= MAX_SWAP_DEVICES);
+
+    stripe = &DeviceExtension->Stripe;
+
+    /* the stripes must keep the members page aligned after the swap header,
+       and are at most 1 MB like the alignment of the formatter */
+
+    if (!Context->StripeSize || Context->StripeSize > STRIPE_MAXIMUM_SIZE)
+    {
+        KdPrint(("SwapFs: Stripe size %u KB is not 4 KB to %u KB.\n", Context->StripeSize, STRIPE_MAXIMUM_SIZE));
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if ((Context->StripeSize * 1024) % PAGE_SIZE)
+    {
+        KdPrint(("SwapFs: Stripe size %u KB is not a multiple of the page size.\n", Context->StripeSize));
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stripe->StripeSize = Context->StripeSize * 1024;
+
+    stripe->DeviceObject[0] = DeviceExtension->TargetDeviceObject;
+
+    status = STATUS_SUCCESS;
+
+    for (n = 1; n < Context->NumberOfMembers; n++)
+    {
+        status = IoGetDeviceObjectPointer(
+            &Context->Members[n].DeviceName,
+            FILE_READ_DATA | FILE_WRITE_DATA,
+            &stripe->FileObject[n],
+            &stripe->DeviceObject[n]
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            KdPrint(("SwapFs: Failed to open stripe member %wZ.\n", &Context->Members[n].DeviceName));
+            break;
+        }
+
+        status = IsDeviceLinuxSwap(stripe->DeviceObject[n]);
+
+        if (!NT_SUCCESS(status))
+        {
+            KdPrint(("SwapFs: Stripe member %wZ is not a Linux swap device.\n", &Context->Members[n].DeviceName));
+            ObDereferenceObject(stripe->FileObject[n]);
+            stripe->FileObject[n] = NULL;
+            break;
+        }
+    }
+
+    /* all members must have the same sector size, the smallest decides the length of them all */
+
+    sector_size = 0;
+
+    stripe->MemberLength = MAXLONGLONG;
+
+    for (n = 0; NT_SUCCESS(status) && n < Context->NumberOfMembers; n++)
+    {
+        size = sizeof(disk_geometry);
+
+        status = BlockDeviceIoControl(
+            stripe->DeviceObject[n],
+            IOCTL_DISK_GET_DRIVE_GEOMETRY,
+            NULL,
+            0,
+            &disk_geometry,
+            &size
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        if (n == 0)
+        {
+            sector_size = disk_geometry.BytesPerSector;
+        }
+        else if (disk_geometry.BytesPerSector != sector_size)
+        {
+            KdPrint(("SwapFs: Stripe member %wZ has %u bytes per sector, not %u.\n",
+                &Context->Members[n].DeviceName, disk_geometry.BytesPerSector, sector_size));
+            status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        size = sizeof(length_information);
+
+        status = BlockDeviceIoControl(
+            stripe->DeviceObject[n],
+            IOCTL_DISK_GET_LENGTH_INFO,
+            NULL,
+            0,
+            &length_information,
+            &size
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        stripe->MemberLength = min(
+            stripe->MemberLength,
+            length_information.Length.QuadPart - sizeof(union swap_header)
+            );
+    }
+
+    if (NT_SUCCESS(status) && (!sector_size || stripe->StripeSize % sector_size))
+    {
+        status = STATUS_INVALID_PARAMETER;
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        StripeRelease(DeviceExtension);
+        return status;
+    }
+
+    stripe->MemberLength -= stripe->MemberLength % stripe->StripeSize;
+
+    stripe->Length = stripe->MemberLength * Context->NumberOfMembers;
+
+    /* the filter must meet the alignment requirement of all members */
+
+    for (n = 1; n < Context->NumberOfMembers; n++)
+    {
+        if (DeviceExtension->DeviceObject->AlignmentRequirement < stripe->DeviceObject[n]->AlignmentRequirement)
+        {
+            DeviceExtension->DeviceObject->AlignmentRequirement = stripe->DeviceObject[n]->AlignmentRequirement;
+        }
+    }
+
+    stripe->NumberOfMembers = Context->NumberOfMembers;
+
+    KdPrint(("SwapFs: Striping %u devices in stripes of %u KB to a volume of %I64u MB.\n",
+        stripe->NumberOfMembers, stripe->StripeSize / 1024, stripe->Length / 0x100000));
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+StripeRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PSTRIPE stripe;
+    ULONG   n;
+
+    stripe = &DeviceExtension->Stripe;
+
+    for (n = 1; n < MAX_SWAP_DEVICES; n++)
+    {
+        if (stripe->FileObject[n])
+        {
+            ObDereferenceObject(stripe->FileObject[n]);
+        }
+    }
+
+    RtlZeroMemory(stripe, sizeof(STRIPE));
+}
+
+ULONG
+StripeMapOffset (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length,
+    OUT PDEVICE_OBJECT*     DeviceObject,
+    OUT PLARGE_INTEGER      DeviceOffset
+    )
+{
+    PSTRIPE     stripe;
+    LONGLONG    stripe_number;
+    ULONG       stripe_offset;
+
+    stripe = &DeviceExtension->Stripe;
+
+    if (!stripe->NumberOfMembers)
+    {
+        *DeviceObject = DeviceExtension->TargetDeviceObject;
+        DeviceOffset->QuadPart = Offset + sizeof(union swap_header);
+        return Length;
+    }
+
+    stripe_number = Offset / stripe->StripeSize;
+    stripe_offset = (ULONG) (Offset % stripe->StripeSize);
+
+    *DeviceObject = stripe->DeviceObject[stripe_number % stripe->NumberOfMembers];
+
+    DeviceOffset->QuadPart = (stripe_number / stripe->NumberOfMembers) * stripe->StripeSize +
+        stripe_offset + sizeof(union swap_header);
+
+    return min(Length, stripe->StripeSize - stripe_offset);
+}
+
+/* not pageable since the volume is stamped at last chance shutdown */
+
+NTSTATUS
+StripeRead (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length,
+    OUT PVOID               Buffer
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    LARGE_INTEGER   device_offset;
+    ULONG           done, count;
+    NTSTATUS        status;
+
+    status = STATUS_SUCCESS;
+
+    for (done = 0; done < Length; done += count)
+    {
+        count = StripeMapOffset(DeviceExtension, Offset + done, Length - done, &device_object, &device_offset);
+
+        status = ReadBlockDevice(device_object, &device_offset, count, (PUCHAR) Buffer + done);
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        TimelineTransfer(DeviceExtension, count);
+    }
+
+    return status;
+}
+
+/* not pageable since the metadata cache is written back at last chance shutdown */
+
+NTSTATUS
+StripeWrite (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length,
+    IN PVOID                Buffer
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    LARGE_INTEGER   device_offset;
+    ULONG           done, count;
+    NTSTATUS        status;
+
+    status = STATUS_SUCCESS;
+
+    for (done = 0; done < Length; done += count)
+    {
+        count = StripeMapOffset(DeviceExtension, Offset + done, Length - done, &device_object, &device_offset);
+
+        status = WriteBlockDevice(device_object, &device_offset, count, (PUCHAR) Buffer + done);
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        TimelineTransfer(DeviceExtension, count);
+    }
+
+    return status;
+}
+
+/* the first member is flushed by the request sent down to it, the others are flushed here,
+   not pageable since it's called at last chance shutdown */
+
+NTSTATUS
+StripeFlush (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN UCHAR                MajorFunction
+    )
+{
+    PSTRIPE     stripe;
+    ULONG       n;
+    NTSTATUS    status;
+    NTSTATUS    member_status;
+
+    stripe = &DeviceExtension->Stripe;
+
+    status = STATUS_SUCCESS;
+
+    /* all the members are flushed even when one of them fails */
+
+    for (n = 1; n < stripe->NumberOfMembers; n++)
+    {
+        member_status = FlushBlockDevice(stripe->DeviceObject[n], MajorFunction);
+
+        if (!NT_SUCCESS(member_status) && NT_SUCCESS(status))
+        {
+            status = member_status;
+        }
+    }
+
+    return status;
+}
+
+VOID
+StripeDereference (
+    IN PSTRIPE_CONTEXT Context
+    )
+{
+    PIRP irp;
+
+    if (InterlockedDecrement(&Context->Outstanding))
+    {
+        return;
+    }
+
+    irp = Context->Irp;
+
+    irp->IoStatus.Status = Context->Status;
+    irp->IoStatus.Information = NT_SUCCESS(Context->Status) ? Context->Length : 0;
+
+    ExFreePool(Context);
+
+    IoCompleteRequest(irp, IO_DISK_INCREMENT);
+}
+
+NTSTATUS
+StripeCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PSTRIPE_CONTEXT stripe_context;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    stripe_context = (PSTRIPE_CONTEXT) Context;
+
+    /* the first error is returned for the whole request */
+
+    if (!NT_SUCCESS(Irp->IoStatus.Status))
+    {
+        InterlockedCompareExchange(&stripe_context->Status, Irp->IoStatus.Status, STATUS_SUCCESS);
+    }
+
+    IoFreeMdl(Irp->MdlAddress);
+
+    IoFreeIrp(Irp);
+
+    StripeDereference(stripe_context);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+NTSTATUS
+StripeCallDriver (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    /* the zero blocks of the data region are kept in a bitmap before the request is mapped */
+
+    if (DeviceExtension->ZeroElision.Start)
+    {
+        return ZeroElisionCallDriver(DeviceExtension, Irp);
+    }
+
+    return StripeCallDevice(DeviceExtension, Irp);
+}
+
+NTSTATUS
+StripeCallDevice (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    /* a compressed volume is not striped, the data region of it is mapped by the compression */
+
+    if (DeviceExtension->Compress.Identity)
+    {
+        return CompressCallDriver(DeviceExtension, Irp);
+    }
+
+    /* the duplicate blocks of the data region are mapped to one block before the request is striped */
+
+    if (DeviceExtension->Dedup.Start)
+    {
+        return DedupCallDriver(DeviceExtension, Irp);
+    }
+
+    return StripeCallMembers(DeviceExtension, Irp);
+}
+
+NTSTATUS
+StripeCallMembers (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    PSTRIPE             stripe;
+    PSTRIPE_CONTEXT     stripe_context;
+    PIO_STACK_LOCATION  io_stack;
+    PIO_STACK_LOCATION  member_io_stack;
+    PIRP                member_irp;
+    PDEVICE_OBJECT      device_object;
+    LARGE_INTEGER       device_offset;
+    LONGLONG            offset;
+    ULONG               length;
+    ULONG               done, count;
+    PUCHAR              va;
+    NTSTATUS            status;
+
+    stripe = &DeviceExtension->Stripe;
+
+    if (!stripe->NumberOfMembers)
+    {
+        return IoCallDriver(DeviceExtension->TargetDeviceObject, Irp);
+    }
+
+    /* the driver takes the place of the lower driver in the next stack location,
+       so a completion routine set there is called when the request is completed */
+
+    IoSetNextIrpStackLocation(Irp);
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart - sizeof(union swap_header);
+    length = io_stack->Parameters.Read.Length;
+
+    if (offset < 0 || offset + length > stripe->Length || (length && !Irp->MdlAddress))
+    {
+        status = STATUS_INVALID_PARAMETER;
+    }
+    else if (!length)
+    {
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        status = STATUS_PENDING;
+    }
+
+    if (status != STATUS_PENDING)
+    {
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return status;
+    }
+
+    stripe_context = (PSTRIPE_CONTEXT) ExAllocatePoolWithTag(
+        NonPagedPool,
+        sizeof(STRIPE_CONTEXT),
+        SWAPFS_POOL_TAG
+        );
+
+    if (!stripe_context)
+    {
+        Irp->IoStatus.Status = STATUS_INSUFFICIENT_RESOURCES;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    stripe_context->Irp = Irp;
+    stripe_context->Length = length;
+    stripe_context->Outstanding = 1;
+    stripe_context->Status = STATUS_SUCCESS;
+
+    IoMarkIrpPending(Irp);
+
+    va = (PUCHAR) MmGetMdlVirtualAddress(Irp->MdlAddress);
+
+    for (done = 0; done < length; done += count)
+    {
+        count = StripeMapOffset(DeviceExtension, offset + done, length - done, &device_object, &device_offset);
+
+        member_irp = IoAllocateIrp(device_object->StackSize, FALSE);
+
+        if (member_irp)
+        {
+            member_irp->MdlAddress = IoAllocateMdl(va + done, count, FALSE, FALSE, NULL);
+
+            if (!member_irp->MdlAddress)
+            {
+                IoFreeIrp(member_irp);
+                member_irp = NULL;
+            }
+        }
+
+        if (!member_irp)
+        {
+            InterlockedCompareExchange(&stripe_context->Status, STATUS_INSUFFICIENT_RESOURCES, STATUS_SUCCESS);
+            break;
+        }
+
+        IoBuildPartialMdl(Irp->MdlAddress, member_irp->MdlAddress, va + done, count);
+
+        member_irp->Tail.Overlay.Thread = Irp->Tail.Overlay.Thread;
+
+        member_io_stack = IoGetNextIrpStackLocation(member_irp);
+
+        member_io_stack->MajorFunction = io_stack->MajorFunction;
+        member_io_stack->Flags = io_stack->Flags;
+        member_io_stack->Parameters.Read.Length = count;
+        member_io_stack->Parameters.Read.ByteOffset = device_offset;
+
+        IoSetCompletionRoutine(
+            member_irp,
+            StripeCompletion,
+            stripe_context,
+            TRUE,
+            TRUE,
+            TRUE
+            );
+
+        InterlockedIncrement(&stripe_context->Outstanding);
+
+        IoCallDriver(device_object, member_irp);
+    }
+
+    StripeDereference(stripe_context);
+
+    return STATUS_PENDING;
+}
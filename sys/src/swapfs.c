@@ -19,16 +19,44 @@
 
 #include <ntddk.h>
 #include <ntdddisk.h>
+#include <ntddvol.h>
+#include <mountdev.h>
 #include <ntstrsafe.h>
 #include "swapfs.h"
+#include "swapfsetw.h"
 #include "swap.h"
 
 #define PARAMETER_KEY       L"\\Parameters"
 #define SWAPDEVICE_VALUE    L"SwapDevice"
+#define ZEROFILL_VALUE      L"VirtualZeroFill"
+#define DEFERRED_VALUE      L"DeferredFormat"
+#define METACACHE_VALUE     L"MetadataCacheSize"
+#define STRIPESIZE_VALUE    L"StripeSize"
+#define PROFILE_VALUE       L"FormatProfile"
+#define CLUSTERSIZE_VALUE   L"ClusterSize"
+#define REUSE_VALUE         L"ReuseVolume"
+#define TRACEBUFFER_VALUE   L"TraceBufferSize"
+#define READAHEAD_VALUE     L"ReadAheadSize"
+#define WRITECOMBINE_VALUE  L"WriteCombineSize"
+#define COMPRESSION_VALUE   L"CompressionRatio"
+#define RAMTIER_VALUE       L"RamTierSize"
+#define ZEROELISION_VALUE   L"ZeroBlockElision"
+#define DEDUP_VALUE         L"DedupIndexSize"
+
+/* a value of another type than REG_DWORD would be copied over the ULONG it's read to */
+
+#define QUERY_DWORD         (RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK | \
+                             (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT))
 
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text("INIT", DriverEntry)
 #pragma alloc_text("INIT", SwapFsFindDevice)
+#pragma alloc_text("INIT", SwapFsQueryFormatProfile)
+#pragma alloc_text("INIT", SwapFsLogError)
+#pragma alloc_text("INIT", SwapFsAttachDeviceThread)
+#pragma alloc_text("INIT", SwapFsAttachDevice)
+#pragma alloc_text("PAGE", SwapFsFormatDevice)
+#pragma alloc_text("PAGE", SwapFsFormatWorker)
 #endif // ALLOC_PRAGMA
 
 NTSTATUS
@@ -37,8 +65,14 @@ DriverEntry (
     IN PUNICODE_STRING  RegistryPath
     )
 {
-    ULONG       n, n_found_devices;
-    NTSTATUS    status;
+    PFIND_DEVICE_CONTEXT    context;
+    OBJECT_ATTRIBUTES       object_attributes;
+    HANDLE                  thread_handle;
+    LARGE_INTEGER           frequency;
+    LARGE_INTEGER           start_time;
+    LARGE_INTEGER           end_time;
+    ULONG                   n, n_listed_devices, n_volumes, n_found_devices;
+    NTSTATUS                status;
 
     DriverObject->MajorFunction[IRP_MJ_READ]                    = SwapFsReadWrite;
     DriverObject->MajorFunction[IRP_MJ_WRITE]                   = SwapFsReadWrite;
@@ -47,31 +81,142 @@ DriverEntry (
     DriverObject->MajorFunction[IRP_MJ_POWER]                   = SwapFsPower;
     DriverObject->MajorFunction[IRP_MJ_CREATE]                  = SendIrpToNextDriver;
     DriverObject->MajorFunction[IRP_MJ_CLOSE]                   = SendIrpToNextDriver;
-    DriverObject->MajorFunction[IRP_MJ_FLUSH_BUFFERS]           = SendIrpToNextDriver;
+    DriverObject->MajorFunction[IRP_MJ_FLUSH_BUFFERS]           = SwapFsFlush;
     DriverObject->MajorFunction[IRP_MJ_INTERNAL_DEVICE_CONTROL] = SendIrpToNextDriver;
-    DriverObject->MajorFunction[IRP_MJ_SHUTDOWN]                = SendIrpToNextDriver;
+    DriverObject->MajorFunction[IRP_MJ_SHUTDOWN]                = SwapFsFlush;
     DriverObject->MajorFunction[IRP_MJ_SYSTEM_CONTROL]          = SendIrpToNextDriver;
 
+    if (!NT_SUCCESS(EtwRegister()))
+    {
+        KdPrint(("SwapFs: Failed to register the ETW provider.\n"));
+    }
+
+    context = (PFIND_DEVICE_CONTEXT) ExAllocatePoolWithTag(
+        PagedPool,
+        sizeof(FIND_DEVICE_CONTEXT) * MAX_SWAP_DEVICES,
+        SWAPFS_POOL_TAG
+        );
+
+    if (!context)
+    {
+        EtwUnregister();
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(context, sizeof(FIND_DEVICE_CONTEXT) * MAX_SWAP_DEVICES);
+
     /* search for the swap partitions the user has listed */
 
-    for (n = 0, n_found_devices = 0; n < 10; n++)
+    for (n = 0, n_listed_devices = 0; n < MAX_SWAP_DEVICES; n++)
     {
-        status = SwapFsFindDevice(DriverObject, RegistryPath, n);
+        status = SwapFsFindDevice(DriverObject, RegistryPath, n, &context[n_listed_devices]);
 
         if (NT_SUCCESS(status))
         {
-            n_found_devices++;
+            n_listed_devices++;
         }
-        /* skip an unrecognized partition but break if the user has not listed any more to search */
-        else if(n && status != STATUS_UNRECOGNIZED_VOLUME)
+        /* break if the user has not listed any more to search */
+        else if (n)
         {
             break;
         }
     }
 
+    /* with StripeSize all the swap partitions are joined to one volume on the first of them */
+
+    n_volumes = n_listed_devices;
+
+    if (n_listed_devices > 1 && context[0].StripeSize)
+    {
+        context[0].NumberOfMembers = n_listed_devices;
+        context[0].Members = context;
+        n_volumes = 1;
+    }
+
+    /* probe and format the swap partitions in parallel, each on its own thread */
+
+    InitializeObjectAttributes(&object_attributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+
+    for (n = 0; n < n_volumes; n++)
+    {
+        status = PsCreateSystemThread(
+            &thread_handle,
+            THREAD_ALL_ACCESS,
+            &object_attributes,
+            NULL,
+            NULL,
+            SwapFsAttachDeviceThread,
+            &context[n]
+            );
+
+        if (NT_SUCCESS(status))
+        {
+            status = ObReferenceObjectByHandle(
+                thread_handle,
+                THREAD_ALL_ACCESS,
+                NULL,
+                KernelMode,
+                &context[n].Thread,
+                NULL
+                );
+
+            /* the thread uses the context so without a reference it's waited for on the handle */
+
+            if (!NT_SUCCESS(status))
+            {
+                context[n].Thread = NULL;
+                ZwWaitForSingleObject(thread_handle, FALSE, NULL);
+            }
+
+            ZwClose(thread_handle);
+        }
+        else
+        {
+            start_time = KeQueryPerformanceCounter(&frequency);
+            context[n].Status = SwapFsAttachDevice(&context[n]);
+            end_time = KeQueryPerformanceCounter(NULL);
+            context[n].ElapsedTime = (end_time.QuadPart - start_time.QuadPart) * 1000 / frequency.QuadPart;
+        }
+    }
+
+    for (n = 0, n_found_devices = 0; n < n_volumes; n++)
+    {
+        if (context[n].Thread)
+        {
+            KeWaitForSingleObject(
+                context[n].Thread,
+                Executive,
+                KernelMode,
+                FALSE,
+                NULL
+                );
+
+            ObDereferenceObject(context[n].Thread);
+        }
+
+        KdPrint(("SwapFs: %wZ %s in %I64u ms, status 0x%08x.\n",
+            &context[n].DeviceName,
+            NT_SUCCESS(context[n].Status) ? "attached" : "not attached",
+            context[n].ElapsedTime,
+            context[n].Status));
+
+        if (NT_SUCCESS(context[n].Status))
+        {
+            n_found_devices++;
+        }
+    }
+
+    for (n = 0; n < n_listed_devices; n++)
+    {
+        ExFreePool(context[n].DeviceName.Buffer);
+    }
+
+    ExFreePool(context);
+
     if (n_found_devices == 0)
     {
         KdPrint(("SwapFs: No Linux swap device found, driver not loaded.\n"));
+        EtwUnregister();
         return STATUS_UNRECOGNIZED_VOLUME;
     }
 
@@ -80,18 +225,38 @@ DriverEntry (
 
 NTSTATUS
 SwapFsFindDevice (
-    IN PDRIVER_OBJECT   DriverObject,
-    IN PUNICODE_STRING  RegistryPath,
-    IN ULONG            DeviceNumber
+    IN PDRIVER_OBJECT           DriverObject,
+    IN PUNICODE_STRING          RegistryPath,
+    IN ULONG                    DeviceNumber,
+    OUT PFIND_DEVICE_CONTEXT    Context
     )
 {
     UNICODE_STRING              parameter_path;
     UNICODE_STRING              parameter_name;
     UNICODE_STRING              device_name;
-    RTL_QUERY_REGISTRY_TABLE    query_table[2];
+    UNICODE_STRING              profile_name;
+    UNICODE_STRING              cluster_size_name;
+    WCHAR                       profile_buffer[32];
+    WCHAR                       cluster_size_buffer[32];
+    RTL_QUERY_REGISTRY_TABLE    query_table[18];
+    ULONG                       virtual_zero_fill = 0;
+    ULONG                       deferred_format = 0;
+    ULONG                       meta_cache_size = 0;
+    ULONG                       stripe_size = 0;
+    ULONG                       format_profile = FORMAT_PROFILE_DEFAULT;
+    ULONG                       cluster_size = 0;
+    ULONG                       reuse_volume = 0;
+    ULONG                       trace_buffer_size = 0;
+    ULONG                       read_ahead_size = 0;
+    ULONG                       write_combine_size = 0;
+    ULONG                       compression_ratio = 0;
+    ULONG                       ram_tier_size = 0;
+    ULONG                       zero_block_elision = 0;
+    ULONG                       dedup_index_size = 0;
+    LARGE_INTEGER               start_time;
     NTSTATUS                    status;
-    PDEVICE_OBJECT              device_object;
-    PDEVICE_EXTENSION           device_extension;
+
+    start_time = KeQueryPerformanceCounter(NULL);
 
     /* read SwapDevice and SwapDevice1 to SwapDeviceN in [HKEY_LOCAL_MACHINE\SYSTEM\CurrentControlSet\Services\SwapFs\Parameters] */
 
@@ -143,6 +308,148 @@ SwapFsFindDevice (
     query_table[0].Name = parameter_name.Buffer;
     query_table[0].EntryContext = &device_name;
 
+    /* VirtualZeroFill=1 tells the formatter to not clear the FATs on disk */
+
+    query_table[1].Flags = QUERY_DWORD;
+    query_table[1].Name = ZEROFILL_VALUE;
+    query_table[1].EntryContext = &virtual_zero_fill;
+    query_table[1].DefaultType = REG_DWORD;
+    query_table[1].DefaultData = &virtual_zero_fill;
+    query_table[1].DefaultLength = sizeof(ULONG);
+
+    /* DeferredFormat=1 formats the device after the driver has loaded */
+
+    query_table[2].Flags = QUERY_DWORD;
+    query_table[2].Name = DEFERRED_VALUE;
+    query_table[2].EntryContext = &deferred_format;
+    query_table[2].DefaultType = REG_DWORD;
+    query_table[2].DefaultData = &deferred_format;
+    query_table[2].DefaultLength = sizeof(ULONG);
+
+    /* MetadataCacheSize is the size in KB of the cache for the FAT and the root directory */
+
+    query_table[3].Flags = QUERY_DWORD;
+    query_table[3].Name = METACACHE_VALUE;
+    query_table[3].EntryContext = &meta_cache_size;
+    query_table[3].DefaultType = REG_DWORD;
+    query_table[3].DefaultData = &meta_cache_size;
+    query_table[3].DefaultLength = sizeof(ULONG);
+
+    /* StripeSize is the size in KB of the stripes when the devices are joined to one volume */
+
+    query_table[4].Flags = QUERY_DWORD;
+    query_table[4].Name = STRIPESIZE_VALUE;
+    query_table[4].EntryContext = &stripe_size;
+    query_table[4].DefaultType = REG_DWORD;
+    query_table[4].DefaultData = &stripe_size;
+    query_table[4].DefaultLength = sizeof(ULONG);
+
+    /* FormatProfile names the workload the formatter plans the cluster size for */
+
+    query_table[5].QueryRoutine = SwapFsQueryFormatProfile;
+    query_table[5].Name = PROFILE_VALUE;
+    query_table[5].EntryContext = &format_profile;
+
+    /* ClusterSize is the size in KB of the clusters and overrides the profile */
+
+    query_table[6].Flags = QUERY_DWORD;
+    query_table[6].Name = CLUSTERSIZE_VALUE;
+    query_table[6].EntryContext = &cluster_size;
+    query_table[6].DefaultType = REG_DWORD;
+    query_table[6].DefaultData = &cluster_size;
+    query_table[6].DefaultLength = sizeof(ULONG);
+
+    /* ReuseVolume=1 skips the format when the volume from the previous boot is intact */
+
+    query_table[7].Flags = QUERY_DWORD;
+    query_table[7].Name = REUSE_VALUE;
+    query_table[7].EntryContext = &reuse_volume;
+    query_table[7].DefaultType = REG_DWORD;
+    query_table[7].DefaultData = &reuse_volume;
+    query_table[7].DefaultLength = sizeof(ULONG);
+
+    /* TraceBufferSize is the size in KB of the buffer the reads and writes are traced to */
+
+    query_table[8].Flags = QUERY_DWORD;
+    query_table[8].Name = TRACEBUFFER_VALUE;
+    query_table[8].EntryContext = &trace_buffer_size;
+    query_table[8].DefaultType = REG_DWORD;
+    query_table[8].DefaultData = &trace_buffer_size;
+    query_table[8].DefaultLength = sizeof(ULONG);
+
+    /* ReadAheadSize is the size in KB of the buffers sequential reads are read ahead to */
+
+    query_table[9].Flags = QUERY_DWORD;
+    query_table[9].Name = READAHEAD_VALUE;
+    query_table[9].EntryContext = &read_ahead_size;
+    query_table[9].DefaultType = REG_DWORD;
+    query_table[9].DefaultData = &read_ahead_size;
+    query_table[9].DefaultLength = sizeof(ULONG);
+
+    /* WriteCombineSize is the size in KB of the buffers small writes are combined in */
+
+    query_table[10].Flags = QUERY_DWORD;
+    query_table[10].Name = WRITECOMBINE_VALUE;
+    query_table[10].EntryContext = &write_combine_size;
+    query_table[10].DefaultType = REG_DWORD;
+    query_table[10].DefaultData = &write_combine_size;
+    query_table[10].DefaultLength = sizeof(ULONG);
+
+    /* CompressionRatio is the size in percent of the swap partition the compressed volume is reported as */
+
+    query_table[11].Flags = QUERY_DWORD;
+    query_table[11].Name = COMPRESSION_VALUE;
+    query_table[11].EntryContext = &compression_ratio;
+    query_table[11].DefaultType = REG_DWORD;
+    query_table[11].DefaultData = &compression_ratio;
+    query_table[11].DefaultLength = sizeof(ULONG);
+
+    /* RamTierSize is the size in KB of the memory the data region is kept in */
+
+    query_table[12].Flags = QUERY_DWORD;
+    query_table[12].Name = RAMTIER_VALUE;
+    query_table[12].EntryContext = &ram_tier_size;
+    query_table[12].DefaultType = REG_DWORD;
+    query_table[12].DefaultData = &ram_tier_size;
+    query_table[12].DefaultLength = sizeof(ULONG);
+
+    /* ZeroBlockElision keeps the blocks of only zeros in the data region in a bitmap */
+
+    query_table[13].Flags = QUERY_DWORD;
+    query_table[13].Name = ZEROELISION_VALUE;
+    query_table[13].EntryContext = &zero_block_elision;
+    query_table[13].DefaultType = REG_DWORD;
+    query_table[13].DefaultData = &zero_block_elision;
+    query_table[13].DefaultLength = sizeof(ULONG);
+
+    /* DedupIndexSize maps the duplicate blocks of the data region to one block */
+
+    query_table[14].Flags = QUERY_DWORD;
+    query_table[14].Name = DEDUP_VALUE;
+    query_table[14].EntryContext = &dedup_index_size;
+    query_table[14].DefaultType = REG_DWORD;
+    query_table[14].DefaultData = &dedup_index_size;
+    query_table[14].DefaultLength = sizeof(ULONG);
+
+    /* FormatProfileN and ClusterSizeN overrides them for SwapDeviceN */
+
+    if (DeviceNumber)
+    {
+        RtlInitEmptyUnicodeString(&profile_name, profile_buffer, sizeof(profile_buffer));
+        RtlUnicodeStringPrintf(&profile_name, PROFILE_VALUE L"%u", DeviceNumber);
+
+        RtlInitEmptyUnicodeString(&cluster_size_name, cluster_size_buffer, sizeof(cluster_size_buffer));
+        RtlUnicodeStringPrintf(&cluster_size_name, CLUSTERSIZE_VALUE L"%u", DeviceNumber);
+
+        query_table[15].QueryRoutine = SwapFsQueryFormatProfile;
+        query_table[15].Name = profile_name.Buffer;
+        query_table[15].EntryContext = &format_profile;
+
+        query_table[16].Flags = QUERY_DWORD;
+        query_table[16].Name = cluster_size_name.Buffer;
+        query_table[16].EntryContext = &cluster_size;
+    }
+
     status = RtlQueryRegistryValues(
         RTL_REGISTRY_ABSOLUTE,
         parameter_path.Buffer,
@@ -154,16 +461,177 @@ SwapFsFindDevice (
     ExFreePool(parameter_path.Buffer);
     ExFreePool(parameter_name.Buffer);
 
+    if (status == STATUS_OBJECT_TYPE_MISMATCH)
+    {
+        KdPrint(("SwapFs: A parameter for swap device %u is not a REG_DWORD.\n", DeviceNumber));
+        SwapFsLogError(DriverObject, IO_ERR_CONFIGURATION_ERROR, DeviceNumber, PARAMETER_KEY + 1);
+
+        /* the swap device was read before the value that failed the query */
+
+        if (device_name.Buffer)
+        {
+            ExFreePool(device_name.Buffer);
+            device_name.Buffer = NULL;
+        }
+    }
+
     if (!NT_SUCCESS(status) || !device_name.Buffer)
     {
         if (DeviceNumber) { KdPrint(("SwapFs: No more swap devices to search.\n")); }
         return STATUS_UNSUCCESSFUL;
     }
 
+    /* the map of the duplicate blocks is only in memory, so a volume that is reused is not deduplicated */
+
+    if (reuse_volume && dedup_index_size)
+    {
+        KdPrint(("SwapFs: %wZ is not deduplicated since it's reused.\n", &device_name));
+        SwapFsLogError(DriverObject, IO_ERR_CONFIGURATION_ERROR, DeviceNumber, DEDUP_VALUE);
+        dedup_index_size = 0;
+    }
+
+    Context->DriverObject = DriverObject;
+    Context->DeviceNumber = DeviceNumber;
+    Context->DeviceName = device_name;
+    Context->VirtualZeroFill = virtual_zero_fill;
+    Context->DeferredFormat = deferred_format;
+    Context->MetaCacheSize = meta_cache_size;
+    Context->StripeSize = stripe_size;
+    Context->FormatProfile = format_profile;
+    Context->ClusterSize = cluster_size;
+    Context->ReuseVolume = reuse_volume;
+    Context->TraceBufferSize = trace_buffer_size;
+    Context->ReadAheadSize = read_ahead_size;
+    Context->WriteCombineSize = write_combine_size;
+    Context->CompressionRatio = compression_ratio;
+    Context->RamTierSize = ram_tier_size;
+    Context->ZeroBlockElision = zero_block_elision;
+    Context->DedupIndexSize = dedup_index_size;
+    Context->RegistryTime = KeQueryPerformanceCounter(NULL).QuadPart - start_time.QuadPart;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+SwapFsQueryFormatProfile (
+    IN PWSTR    ValueName,
+    IN ULONG    ValueType,
+    IN PVOID    ValueData,
+    IN ULONG    ValueLength,
+    IN PVOID    Context,
+    IN PVOID    EntryContext
+    )
+{
+    PWSTR   name;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (ValueType != REG_SZ || ValueLength < sizeof(WCHAR))
+    {
+        KdPrint(("SwapFs: %ws is not a string.\n", ValueName));
+        return STATUS_SUCCESS;
+    }
+
+    name = (PWSTR) ValueData;
+
+    /* an unknown profile is only logged so the device is still found */
+
+    if (!_wcsicmp(name, L"default"))
+    {
+        *(PULONG)EntryContext = FORMAT_PROFILE_DEFAULT;
+    }
+    else if (!_wcsicmp(name, L"large-sequential"))
+    {
+        *(PULONG)EntryContext = FORMAT_PROFILE_LARGE_SEQUENTIAL;
+    }
+    else if (!_wcsicmp(name, L"many-small-files"))
+    {
+        *(PULONG)EntryContext = FORMAT_PROFILE_MANY_SMALL_FILES;
+    }
+    else
+    {
+        KdPrint(("SwapFs: Unknown %ws %ws.\n", ValueName, name));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+SwapFsLogError (
+    IN PVOID    IoObject,
+    IN NTSTATUS ErrorCode,
+    IN ULONG    UniqueValue,
+    IN PCWSTR   String
+    )
+{
+    PIO_ERROR_LOG_PACKET    packet;
+    ULONG                   length;
+
+    /* the string is the parameter that is wrong, it's inserted after the name of the driver */
+
+    length = (ULONG) (wcslen(String) + 1) * sizeof(WCHAR);
+
+    if (sizeof(IO_ERROR_LOG_PACKET) + length > ERROR_LOG_MAXIMUM_SIZE)
+    {
+        return;
+    }
+
+    packet = (PIO_ERROR_LOG_PACKET) IoAllocateErrorLogEntry(IoObject, (UCHAR) (sizeof(IO_ERROR_LOG_PACKET) + length));
+
+    if (!packet)
+    {
+        return;
+    }
+
+    RtlZeroMemory(packet, sizeof(IO_ERROR_LOG_PACKET));
+
+    packet->ErrorCode = ErrorCode;
+    packet->UniqueErrorValue = UniqueValue;
+    packet->FinalStatus = STATUS_INVALID_PARAMETER;
+    packet->NumberOfStrings = 1;
+    packet->StringOffset = sizeof(IO_ERROR_LOG_PACKET);
+
+    RtlCopyMemory((PUCHAR) packet + sizeof(IO_ERROR_LOG_PACKET), String, length);
+
+    IoWriteErrorLogEntry(packet);
+}
+
+VOID
+SwapFsAttachDeviceThread (
+    IN PVOID Context
+    )
+{
+    PFIND_DEVICE_CONTEXT    context;
+    LARGE_INTEGER           frequency;
+    LARGE_INTEGER           start_time;
+    LARGE_INTEGER           end_time;
+
+    context = (PFIND_DEVICE_CONTEXT) Context;
+
+    start_time = KeQueryPerformanceCounter(&frequency);
+
+    context->Status = SwapFsAttachDevice(context);
+
+    end_time = KeQueryPerformanceCounter(NULL);
+
+    context->ElapsedTime = (end_time.QuadPart - start_time.QuadPart) * 1000 / frequency.QuadPart;
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+NTSTATUS
+SwapFsAttachDevice (
+    IN PFIND_DEVICE_CONTEXT Context
+    )
+{
+    NTSTATUS            status;
+    PDEVICE_OBJECT      device_object;
+    PDEVICE_EXTENSION   device_extension;
+
     /* create a device object and attach to the target partition */
 
     status = IoCreateDevice(
-        DriverObject,
+        Context->DriverObject,
         sizeof(DEVICE_EXTENSION),
         NULL,
         FILE_DEVICE_DISK,
@@ -175,24 +643,35 @@ SwapFsFindDevice (
     if (!NT_SUCCESS(status))
     {
         KdPrint(("SwapFs: Create device failed.\n"));
-        ExFreePool(device_name.Buffer);
         return status;
     }
 
     device_extension = (PDEVICE_EXTENSION) device_object->DeviceExtension;
 
+    device_extension->DeviceObject = device_object;
+
+    TimelineInitialize(device_extension, Context->DeviceNumber, Context->RegistryTime);
+
     KeInitializeEvent(&device_extension->PagingPathCountEvent, NotificationEvent, TRUE);
 
     device_extension->PagingPathCount = 0;
 
+    device_extension->VirtualZeroFill = Context->VirtualZeroFill;
+
+    device_extension->MetaCacheSize = Context->MetaCacheSize;
+
+    device_extension->FormatProfile = Context->FormatProfile;
+
+    device_extension->ClusterSize = Context->ClusterSize;
+
+    device_extension->ReuseVolume = Context->ReuseVolume;
+
     status = IoAttachDevice(
         device_object,
-        &device_name,
+        &Context->DeviceName,
         &device_extension->TargetDeviceObject
         );
 
-    ExFreePool(device_name.Buffer);
-
     if (!NT_SUCCESS(status))
     {
         KdPrint(("SwapFs: Attach device failed.\n"));
@@ -200,6 +679,10 @@ SwapFsFindDevice (
         return status;
     }
 
+    /* one more stack location lets the requests be counted in a stack location of their own */
+
+    device_object->StackSize++;
+
     device_object->Flags |= (device_extension->TargetDeviceObject->Flags &
         (DO_BUFFERED_IO | DO_DIRECT_IO | DO_POWER_PAGABLE));
 
@@ -209,27 +692,172 @@ SwapFsFindDevice (
 
     /* check that it is a Linux swap partition and preformat it to FAT */
 
+    TimelineBegin(device_extension, SWAPFS_PHASE_PROBE);
+
     status = IsDeviceLinuxSwap(device_extension->TargetDeviceObject);
 
     if (!NT_SUCCESS(status))
     {
         KdPrint(("SwapFs: Not a Linux swap device.\n"));
+        TimelineSave(device_extension, status);
         IoDetachDevice(device_extension->TargetDeviceObject);
         IoDeleteDevice(device_object);
         return status;
     }
 
-    status = FormatDeviceToFat32(device_extension->TargetDeviceObject);
+    TimelineTransfer(device_extension, sizeof(union swap_header));
 
-    if (!NT_SUCCESS(status))
+    /* the other listed devices are members of a volume striped from this device */
+
+    if (Context->NumberOfMembers > 1)
     {
-        KdPrint(("SwapFs: FormatDeviceToFat32 failed, trying FormatDeviceToFat...\n"));
-        status = FormatDeviceToFat(device_extension->TargetDeviceObject);
+        status = StripeInitialize(device_extension, Context);
+
+        if (!NT_SUCCESS(status))
+        {
+            TimelineSave(device_extension, status);
+            IoDetachDevice(device_extension->TargetDeviceObject);
+            IoDeleteDevice(device_object);
+            return status;
+        }
+    }
+
+    /* the map of a compressed volume is only in memory, so it's formated at every boot */
+
+    if (Context->CompressionRatio && Context->NumberOfMembers > 1)
+    {
+        KdPrint(("SwapFs: A striped volume is not compressed.\n"));
+    }
+    else if (Context->CompressionRatio && !NT_SUCCESS(CompressInitialize(device_extension, Context->CompressionRatio)))
+    {
+        KdPrint(("SwapFs: The volume is not compressed.\n"));
+    }
+    else if (Context->CompressionRatio)
+    {
+        device_extension->ReuseVolume = FALSE;
+    }
+
+    /* the bitmap of the zero blocks is only in memory, so the volume is formated at every boot */
+
+    if (Context->ZeroBlockElision && !NT_SUCCESS(ZeroElisionInitialize(device_extension)))
+    {
+        KdPrint(("SwapFs: No zero blocks are elided for the device.\n"));
+    }
+    else if (Context->ZeroBlockElision)
+    {
+        device_extension->ReuseVolume = FALSE;
+    }
+
+    /* ReuseVolume was rejected with DedupIndexSize when the parameters were read */
+
+    if (Context->DedupIndexSize && device_extension->Compress.Length)
+    {
+        KdPrint(("SwapFs: A compressed volume is not deduplicated.\n"));
+    }
+    else if (Context->DedupIndexSize && !NT_SUCCESS(DedupInitialize(device_extension, Context->DedupIndexSize)))
+    {
+        KdPrint(("SwapFs: No blocks are deduplicated for the device.\n"));
+    }
+
+    if (!NT_SUCCESS(StatsInitialize(device_extension)))
+    {
+        KdPrint(("SwapFs: No statistics are kept for the device.\n"));
+    }
+    /* the trace is recorded by the completion routine of the statistics */
+    else if (Context->TraceBufferSize && !NT_SUCCESS(TraceInitialize(device_extension, Context->TraceBufferSize)))
+    {
+        KdPrint(("SwapFs: No trace is recorded for the device.\n"));
+    }
+
+    if (Context->RamTierSize && !NT_SUCCESS(RamTierInitialize(device_extension, Context->RamTierSize)))
+    {
+        KdPrint(("SwapFs: The data region is not kept in memory.\n"));
     }
 
+    /* the RAM tier takes the reads and writes of the data region before they could be combined or read ahead */
+
+    if (Context->WriteCombineSize && device_extension->RamTier.Hash)
+    {
+        KdPrint(("SwapFs: No writes are combined when the data region is kept in memory.\n"));
+    }
+    else if (Context->WriteCombineSize && !NT_SUCCESS(WriteCombineInitialize(device_extension, Context->WriteCombineSize)))
+    {
+        KdPrint(("SwapFs: No writes are combined for the device.\n"));
+    }
+
+    /* what is read ahead could be older than the combined writes not yet on the device */
+
+    if (Context->ReadAheadSize && device_extension->RamTier.Hash)
+    {
+        KdPrint(("SwapFs: No read ahead is done when the data region is kept in memory.\n"));
+    }
+    else if (Context->ReadAheadSize && device_extension->WriteCombine.Size)
+    {
+        KdPrint(("SwapFs: No read ahead is done when writes are combined.\n"));
+    }
+    else if (Context->ReadAheadSize && !NT_SUCCESS(ReadAheadInitialize(device_extension, Context->ReadAheadSize)))
+    {
+        KdPrint(("SwapFs: No read ahead is done for the device.\n"));
+    }
+
+    /* the volume is stamped for reuse when the file systems are shut down */
+
+    if (device_extension->ReuseVolume)
+    {
+        if (NT_SUCCESS(IoRegisterLastChanceShutdownNotification(device_object)))
+        {
+            InterlockedIncrement(&device_extension->ShutdownNotifications);
+        }
+        else
+        {
+            device_extension->ReuseVolume = FALSE;
+        }
+    }
+
+    /* with DeferredFormat the device is formated by a work item while I/O to it is held */
+
+    if (Context->DeferredFormat)
+    {
+        device_extension->FormatWorkItem = IoAllocateWorkItem(device_object);
+    }
+
+    if (device_extension->FormatWorkItem)
+    {
+        KeInitializeSpinLock(&device_extension->HeldIrpLock);
+
+        InitializeListHead(&device_extension->HeldIrpList);
+
+        device_extension->FormatState = FORMAT_STATE_PENDING;
+
+        /* the time the format waits for the work item is not a phase of it */
+
+        device_extension->Timeline.Flags |= SWAPFS_TIMELINE_DEFERRED;
+
+        TimelineBegin(device_extension, TIMELINE_PHASE_NONE);
+
+        IoQueueWorkItem(
+            device_extension->FormatWorkItem,
+            SwapFsFormatWorker,
+            DelayedWorkQueue,
+            NULL
+            );
+
+        return STATUS_SUCCESS;
+    }
+
+    status = SwapFsFormatDevice(device_extension);
+
     if (!NT_SUCCESS(status))
     {
-        KdPrint(("SwapFs: FormatDeviceToFat failed.\n"));
+        ReadAheadRelease(device_extension);
+        WriteCombineRelease(device_extension);
+        RamTierRelease(device_extension);
+        TraceRelease(device_extension);
+        StatsRelease(device_extension);
+        DedupRelease(device_extension);
+        ZeroElisionRelease(device_extension);
+        CompressRelease(device_extension);
+        StripeRelease(device_extension);
         IoDetachDevice(device_extension->TargetDeviceObject);
         IoDeleteDevice(device_object);
         return status;
@@ -238,6 +866,214 @@ SwapFsFindDevice (
     return STATUS_SUCCESS;
 }
 
+NTSTATUS
+SwapFsFormatDevice (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    NTSTATUS status;
+
+    /* a stamp left by the previous shutdown is removed even when it is not used */
+
+    TimelineBegin(DeviceExtension, SWAPFS_PHASE_PROBE);
+
+    status = StampCheck(DeviceExtension);
+
+    if (NT_SUCCESS(status) && DeviceExtension->MetaCacheSize)
+    {
+        status = MetaCacheLoad(DeviceExtension, DeviceExtension->Stamp.SectorSize, DeviceExtension->Stamp.MetaSectors);
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        KdPrint(("SwapFs: Reusing the volume of generation %u from the previous boot.\n",
+            DeviceExtension->Stamp.Generation));
+        DeviceExtension->Timeline.Flags |= SWAPFS_TIMELINE_REUSED;
+        TimelineSave(DeviceExtension, status);
+        return status;
+    }
+
+    TimelineAttempt(DeviceExtension);
+
+    status = FormatDeviceToExFat(DeviceExtension);
+
+    if (!NT_SUCCESS(status))
+    {
+        KdPrint(("SwapFs: FormatDeviceToExFat failed, trying FormatDeviceToFat32...\n"));
+        TimelineFallback(DeviceExtension);
+        TimelineAttempt(DeviceExtension);
+        status = FormatDeviceToFat32(DeviceExtension);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        KdPrint(("SwapFs: FormatDeviceToFat32 failed, trying FormatDeviceToFat...\n"));
+        TimelineFallback(DeviceExtension);
+        TimelineAttempt(DeviceExtension);
+        status = FormatDeviceToFat(DeviceExtension);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        KdPrint(("SwapFs: FormatDeviceToFat failed.\n"));
+        TimelineFallback(DeviceExtension);
+    }
+
+    /* the data region is compressed after the metadata the formatter wrote */
+
+    if (NT_SUCCESS(status) && DeviceExtension->Compress.Length)
+    {
+        CompressStart(DeviceExtension);
+    }
+
+    /* the zero blocks are elided after the metadata the formatter wrote */
+
+    if (NT_SUCCESS(status) && DeviceExtension->ZeroElision.Zeros)
+    {
+        ZeroElisionStart(DeviceExtension);
+    }
+
+    /* the duplicate blocks are mapped after the metadata the formatter wrote */
+
+    if (NT_SUCCESS(status) && DeviceExtension->Dedup.Index)
+    {
+        DedupStart(DeviceExtension);
+    }
+
+    TimelineSave(DeviceExtension, status);
+
+    return status;
+}
+
+VOID
+SwapFsFormatWorker (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PVOID            Context
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    LARGE_INTEGER       frequency;
+    LARGE_INTEGER       start_time;
+    LARGE_INTEGER       end_time;
+    NTSTATUS            status;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    start_time = KeQueryPerformanceCounter(&frequency);
+
+    status = SwapFsFormatDevice(device_extension);
+
+    end_time = KeQueryPerformanceCounter(NULL);
+
+    KdPrint(("SwapFs: Deferred format done in %I64u ms, status 0x%08x.\n",
+        (end_time.QuadPart - start_time.QuadPart) * 1000 / frequency.QuadPart,
+        status));
+
+    IoFreeWorkItem(device_extension->FormatWorkItem);
+
+    device_extension->FormatWorkItem = NULL;
+
+    SwapFsReleaseHeldIrps(DeviceObject, status);
+}
+
+NTSTATUS
+SwapFsHoldIrp (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    NTSTATUS            status;
+    KIRQL               irql;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    KeAcquireSpinLock(&device_extension->HeldIrpLock, &irql);
+
+    if (device_extension->FormatState == FORMAT_STATE_PENDING)
+    {
+        IoMarkIrpPending(Irp);
+        InsertTailList(&device_extension->HeldIrpList, &Irp->Tail.Overlay.ListEntry);
+        status = STATUS_PENDING;
+    }
+    else if (device_extension->FormatState == FORMAT_STATE_FAILED)
+    {
+        status = STATUS_UNRECOGNIZED_VOLUME;
+    }
+    else
+    {
+        status = STATUS_SUCCESS;
+    }
+
+    KeReleaseSpinLock(&device_extension->HeldIrpLock, irql);
+
+    if (status == STATUS_UNRECOGNIZED_VOLUME)
+    {
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    }
+
+    return status;
+}
+
+VOID
+SwapFsReleaseHeldIrps (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN NTSTATUS         FormatStatus
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    LIST_ENTRY          held_irps;
+    PLIST_ENTRY         entry;
+    PIRP                irp;
+    PIO_STACK_LOCATION  io_stack;
+    KIRQL               irql;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    /* the state is changed before the held requests are dispatched again, else they are held again */
+
+    InitializeListHead(&held_irps);
+
+    KeAcquireSpinLock(&device_extension->HeldIrpLock, &irql);
+
+    device_extension->FormatState = NT_SUCCESS(FormatStatus) ?
+        FORMAT_STATE_READY : FORMAT_STATE_FAILED;
+
+    while (!IsListEmpty(&device_extension->HeldIrpList))
+    {
+        entry = RemoveHeadList(&device_extension->HeldIrpList);
+        InsertTailList(&held_irps, entry);
+    }
+
+    KeReleaseSpinLock(&device_extension->HeldIrpLock, irql);
+
+    /* the held requests are dispatched in the order they came */
+
+    while (!IsListEmpty(&held_irps))
+    {
+        entry = RemoveHeadList(&held_irps);
+
+        irp = CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry);
+
+        if (NT_SUCCESS(FormatStatus))
+        {
+            io_stack = IoGetCurrentIrpStackLocation(irp);
+
+            DeviceObject->DriverObject->MajorFunction[io_stack->MajorFunction](DeviceObject, irp);
+        }
+        else
+        {
+            irp->IoStatus.Status = STATUS_UNRECOGNIZED_VOLUME;
+            irp->IoStatus.Information = 0;
+            IoCompleteRequest(irp, IO_NO_INCREMENT);
+        }
+    }
+}
+
 NTSTATUS
 SendIrpToNextDriver (
     IN PDEVICE_OBJECT   DeviceObject,
@@ -253,14 +1089,180 @@ SendIrpToNextDriver (
     return IoCallDriver(device_extension->TargetDeviceObject, Irp);
 }
 
+NTSTATUS
+SwapFsFlush (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    UCHAR               major_function;
+    LONG                shutdown_count;
+    BOOLEAN             last_chance;
+    NTSTATUS            status;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    major_function = IoGetCurrentIrpStackLocation(Irp)->MajorFunction;
+
+    /* with ReuseVolume the last shutdown is the last chance one where pageable code can't be called */
+
+    shutdown_count = (major_function == IRP_MJ_SHUTDOWN) ?
+        InterlockedIncrement(&device_extension->ShutdownCount) : 0;
+
+    last_chance = device_extension->ReuseVolume &&
+        shutdown_count == device_extension->ShutdownNotifications;
+
+    /* the combined writes are not pageable so they are written even at the last chance */
+
+    if (device_extension->WriteCombine.Size)
+    {
+        status = WriteCombineFlush(device_extension, TRUE);
+
+        if (!NT_SUCCESS(status) && major_function == IRP_MJ_FLUSH_BUFFERS)
+        {
+            Irp->IoStatus.Status = status;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest(Irp, IO_NO_INCREMENT);
+            return status;
+        }
+    }
+
+    /* the blocks kept in memory are not pageable either */
+
+    if (device_extension->RamTier.Hash)
+    {
+        status = RamTierFlush(device_extension);
+
+        if (!NT_SUCCESS(status) && major_function == IRP_MJ_FLUSH_BUFFERS)
+        {
+            Irp->IoStatus.Status = status;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest(Irp, IO_NO_INCREMENT);
+            return status;
+        }
+    }
+
+    /* write back the FAT and the root directory before the flush is sent down,
+       at the last chance it's not pageable and is done before the volume is stamped */
+
+    if (device_extension->MetaCache.Buffer)
+    {
+        status = MetaCacheFlush(device_extension);
+
+        if (!NT_SUCCESS(status) && major_function == IRP_MJ_FLUSH_BUFFERS)
+        {
+            Irp->IoStatus.Status = status;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest(Irp, IO_NO_INCREMENT);
+            return status;
+        }
+    }
+
+    if (last_chance)
+    {
+        StampVolume(device_extension);
+    }
+
+    /* the other members of a striped volume are flushed before the request is sent down to the first,
+       when one of them fails the first is flushed here too and the request fails */
+
+    if (device_extension->Stripe.NumberOfMembers)
+    {
+        status = StripeFlush(device_extension, major_function);
+
+        if (!NT_SUCCESS(status) && major_function == IRP_MJ_FLUSH_BUFFERS)
+        {
+            FlushBlockDevice(device_extension->TargetDeviceObject, major_function);
+            Irp->IoStatus.Status = status;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest(Irp, IO_NO_INCREMENT);
+            return status;
+        }
+    }
+
+    /* the flushes are only timed to be traced, the stack location is skipped below */
+
+    StatsStart(DeviceObject, Irp);
+
+    return SendIrpToNextDriver(DeviceObject, Irp);
+}
+
 NTSTATUS
 SwapFsReadWrite (
     IN PDEVICE_OBJECT   DeviceObject,
     IN PIRP             Irp
     )
 {
+    PIO_STACK_LOCATION  io_stack;
     PIO_STACK_LOCATION  next_io_stack;
     PDEVICE_EXTENSION   device_extension;
+    NTSTATUS            status;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    /* hold requests until a deferred format is done */
+
+    if (device_extension->FormatState != FORMAT_STATE_READY)
+    {
+        status = SwapFsHoldIrp(DeviceObject, Irp);
+
+        if (status != STATUS_SUCCESS)
+        {
+            return status;
+        }
+    }
+
+    if (SwapFsEtwEnabled(WINEVENT_LEVEL_VERBOSE, SWAPFS_KEYWORD_READ_WRITE))
+    {
+        EtwReadWriteDispatch(DeviceObject, Irp);
+    }
+
+    if (StatsStart(DeviceObject, Irp))
+    {
+        io_stack = IoGetCurrentIrpStackLocation(Irp);
+    }
+
+    /* the FAT and the root directory are read and written in memory */
+
+    if (device_extension->MetaCache.Buffer &&
+        io_stack->Parameters.Read.ByteOffset.QuadPart < device_extension->MetaCache.Length &&
+        io_stack->Parameters.Read.Length)
+    {
+        return MetaCacheReadWrite(DeviceObject, Irp);
+    }
+
+    /* sectors not written since format must be read as zeros */
+
+    if (device_extension->ZeroFill.Bitmap.Buffer &&
+        io_stack->Parameters.Read.ByteOffset.QuadPart < device_extension->ZeroFill.Length &&
+        io_stack->Parameters.Read.Length)
+    {
+        return ZeroFillReadWrite(DeviceObject, Irp);
+    }
+
+    /* the data region is read and written in memory as far as it fits */
+
+    if (device_extension->RamTier.Hash)
+    {
+        return RamTierReadWrite(DeviceObject, Irp);
+    }
+
+    /* small writes to the data region are combined */
+
+    if (device_extension->WriteCombine.Size)
+    {
+        return WriteCombineReadWrite(DeviceObject, Irp);
+    }
+
+    /* sequential reads of the data region are read ahead */
+
+    if (device_extension->ReadAhead.MaximumWindow)
+    {
+        return ReadAheadReadWrite(DeviceObject, Irp);
+    }
 
     IoCopyCurrentIrpStackLocationToNext(Irp);
 
@@ -268,9 +1270,62 @@ SwapFsReadWrite (
 
     next_io_stack->Parameters.Read.ByteOffset.QuadPart += sizeof(union swap_header);
 
-    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+    return StripeCallDriver(device_extension, Irp);
+}
 
-    return IoCallDriver(device_extension->TargetDeviceObject, Irp);
+LONGLONG
+SwapFsVolumeLength (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             PartitionLength
+    )
+{
+    /* a compressed volume is as long as the units in its map */
+
+    if (DeviceExtension->Compress.Length)
+    {
+        return DeviceExtension->Compress.Length;
+    }
+
+    /* a striped volume is as long as the stripes on all its members */
+
+    if (DeviceExtension->Stripe.NumberOfMembers)
+    {
+        return DeviceExtension->Stripe.Length;
+    }
+
+    return PartitionLength - sizeof(union swap_header);
+}
+
+BOOLEAN
+SwapFsIsQueryIoctl (
+    IN ULONG IoControlCode
+    )
+{
+    switch (DEVICE_TYPE_FROM_CTL_CODE(IoControlCode))
+    {
+    case MOUNTDEVCONTROLTYPE:
+    case IOCTL_VOLUME_BASE:
+        return TRUE;
+    }
+
+    switch (IoControlCode)
+    {
+    case IOCTL_DISK_GET_DRIVE_GEOMETRY:
+    case IOCTL_DISK_GET_DRIVE_GEOMETRY_EX:
+    case IOCTL_DISK_GET_PARTITION_INFO:
+    case IOCTL_DISK_GET_PARTITION_INFO_EX:
+    case IOCTL_DISK_GET_LENGTH_INFO:
+    case IOCTL_DISK_IS_WRITABLE:
+    case IOCTL_DISK_CHECK_VERIFY:
+    case IOCTL_STORAGE_CHECK_VERIFY:
+    case IOCTL_STORAGE_CHECK_VERIFY2:
+    case IOCTL_STORAGE_GET_DEVICE_NUMBER:
+    case IOCTL_STORAGE_GET_HOTPLUG_INFO:
+    case IOCTL_STORAGE_QUERY_PROPERTY:
+        return TRUE;
+    }
+
+    return FALSE;
 }
 
 NTSTATUS
@@ -280,13 +1335,19 @@ DeviceControlCompletion (
     IN PVOID            Context
     )
 {
-    PIO_STACK_LOCATION io_stack;
+    PIO_STACK_LOCATION  io_stack;
+    PDEVICE_EXTENSION   device_extension;
+    PLARGE_INTEGER      length;
+    LONGLONG            partition_length;
 
-    UNREFERENCED_PARAMETER(DeviceObject);
     UNREFERENCED_PARAMETER(Context);
 
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
     io_stack = IoGetCurrentIrpStackLocation(Irp);
 
+    length = NULL;
+
     switch (io_stack->Parameters.DeviceIoControl.IoControlCode)
     {
     case IOCTL_DISK_GET_PARTITION_INFO:
@@ -294,7 +1355,7 @@ DeviceControlCompletion (
         PPARTITION_INFORMATION p;
         p = (PPARTITION_INFORMATION) Irp->AssociatedIrp.SystemBuffer;
         ASSERT(p != NULL);
-        p->PartitionLength.QuadPart -= sizeof(union swap_header);
+        length = &p->PartitionLength;
         break;
         }
     case IOCTL_DISK_GET_PARTITION_INFO_EX:
@@ -302,7 +1363,7 @@ DeviceControlCompletion (
         PPARTITION_INFORMATION_EX p;
         p = (PPARTITION_INFORMATION_EX) Irp->AssociatedIrp.SystemBuffer;
         ASSERT(p != NULL);
-        p->PartitionLength.QuadPart -= sizeof(union swap_header);
+        length = &p->PartitionLength;
         break;
         }
     case IOCTL_DISK_GET_LENGTH_INFO:
@@ -310,11 +1371,28 @@ DeviceControlCompletion (
         PGET_LENGTH_INFORMATION p;
         p = (PGET_LENGTH_INFORMATION) Irp->AssociatedIrp.SystemBuffer;
         ASSERT(p != NULL);
-        p->Length.QuadPart -= sizeof(union swap_header);
+        length = &p->Length;
         break;
         }
     }
 
+    if (length)
+    {
+        partition_length = length->QuadPart;
+
+        length->QuadPart = SwapFsVolumeLength(device_extension, partition_length);
+
+        if (SwapFsEtwEnabled(WINEVENT_LEVEL_INFO, SWAPFS_KEYWORD_IOCTL))
+        {
+            EtwLengthFixup(
+                DeviceObject,
+                io_stack->Parameters.DeviceIoControl.IoControlCode,
+                partition_length,
+                length->QuadPart
+                );
+        }
+    }
+
     if (Irp->PendingReturned)
     {
         IoMarkIrpPending(Irp);
@@ -331,9 +1409,28 @@ SwapFsDeviceControl (
 {
     PIO_STACK_LOCATION  io_stack;
     PDEVICE_EXTENSION   device_extension;
+    NTSTATUS            status;
 
     io_stack = IoGetCurrentIrpStackLocation(Irp);
 
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    if (io_stack->Parameters.DeviceIoControl.IoControlCode == IOCTL_SWAPFS_QUERY_STATISTICS)
+    {
+        status = StatsQuery(device_extension, Irp);
+        Irp->IoStatus.Status = status;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return status;
+    }
+
+    if (io_stack->Parameters.DeviceIoControl.IoControlCode == IOCTL_SWAPFS_DRAIN_TRACE)
+    {
+        status = TraceDrain(device_extension, Irp);
+        Irp->IoStatus.Status = status;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return status;
+    }
+
     if (io_stack->Parameters.DeviceIoControl.IoControlCode ==
         IOCTL_DISK_SET_PARTITION_INFO
         ||
@@ -347,6 +1444,33 @@ SwapFsDeviceControl (
         return STATUS_SUCCESS;
     }
 
+    /* requests with ranges of the partition can't be passed on to the members of a striped volume,
+       nor on a compressed or deduplicated volume where the ranges are not where the data is stored */
+
+    if ((device_extension->Stripe.NumberOfMembers || device_extension->Compress.Length ||
+         device_extension->Dedup.Index) &&
+        (io_stack->Parameters.DeviceIoControl.IoControlCode == IOCTL_DISK_VERIFY ||
+         io_stack->Parameters.DeviceIoControl.IoControlCode == IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES))
+    {
+        Irp->IoStatus.Status = STATUS_INVALID_DEVICE_REQUEST;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    /* queries of the geometry and from the mount manager are not held by a deferred format */
+
+    if (device_extension->FormatState != FORMAT_STATE_READY &&
+        !SwapFsIsQueryIoctl(io_stack->Parameters.DeviceIoControl.IoControlCode))
+    {
+        status = SwapFsHoldIrp(DeviceObject, Irp);
+
+        if (status != STATUS_SUCCESS)
+        {
+            return status;
+        }
+    }
+
     IoCopyCurrentIrpStackLocationToNext(Irp);
 
     IoSetCompletionRoutine(
@@ -358,7 +1482,5 @@ SwapFsDeviceControl (
         FALSE
         );
 
-    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
-
     return IoCallDriver(device_extension->TargetDeviceObject, Irp);
 }
@@ -0,0 +1,247 @@
+/*
+    Functions to keep the timeline of the boot of a swap device.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The time from the registry is read until the device is formated is
+    split in phases, each started by TimelineBegin where the one before it
+    ends, and the requests that read, write or clear the device and their
+    bytes are counted to the phase that is running. A format that fails is moved to the fallback phase so
+    the other phases only has the format that was used. When the device is
+    formated, or found not to be usable, the timeline is written as a
+    SWAPFS_TIMELINE to BootTimeline or BootTimelineN in the Parameters key
+    of the service where a tool can read it after the boot. The timeline
+    is only used by the thread that attaches or formats the device, and
+    after it is written no phase is running so the reads and writes made
+    later are not counted.
+*/
+
+#include <ntddk.h>
+#include <ntstrsafe.h>
+#include "swapfs.h"
+
+#define TIMELINE_KEY        L"\\Parameters"
+#define TIMELINE_VALUE      L"BootTimeline"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", TimelineInitialize)
+#pragma alloc_text("PAGE", TimelineBegin)
+#pragma alloc_text("PAGE", TimelineAttempt)
+#pragma alloc_text("PAGE", TimelineFallback)
+#pragma alloc_text("PAGE", TimelineSave)
+#endif // ALLOC_PRAGMA
+
+VOID
+TimelineInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                DeviceNumber,
+    IN LONGLONG             RegistryTime
+    )
+{
+    PBOOT_TIMELINE  timeline;
+    LARGE_INTEGER   frequency;
+
+    timeline = &DeviceExtension->Timeline;
+
+    RtlZeroMemory(timeline, sizeof(BOOT_TIMELINE));
+
+    timeline->DeviceNumber = DeviceNumber;
+
+    timeline->Time[SWAPFS_PHASE_REGISTRY] = RegistryTime;
+
+    timeline->PhaseStart = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+    timeline->Frequency = frequency.QuadPart;
+
+    timeline->Phase = SWAPFS_PHASE_ATTACH;
+}
+
+VOID
+TimelineBegin (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                Phase
+    )
+{
+    PBOOT_TIMELINE  timeline;
+    LONGLONG        now;
+
+    PAGED_CODE();
+
+    timeline = &DeviceExtension->Timeline;
+
+    now = KeQueryPerformanceCounter(NULL).QuadPart;
+
+    if (timeline->Phase != TIMELINE_PHASE_NONE)
+    {
+        timeline->Time[timeline->Phase] += now - timeline->PhaseStart;
+    }
+
+    timeline->PhaseStart = now;
+
+    timeline->Phase = Phase;
+}
+
+/* not pageable since it's called from StripeRead */
+
+VOID
+TimelineTransfer (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Bytes
+    )
+{
+    PBOOT_TIMELINE timeline;
+
+    timeline = &DeviceExtension->Timeline;
+
+    if (timeline->Phase != TIMELINE_PHASE_NONE)
+    {
+        timeline->Requests[timeline->Phase]++;
+        timeline->Bytes[timeline->Phase] += Bytes;
+    }
+}
+
+VOID
+TimelineAttempt (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PBOOT_TIMELINE timeline;
+
+    PAGED_CODE();
+
+    timeline = &DeviceExtension->Timeline;
+
+    /* each format starts with the geometry of the device */
+
+    TimelineBegin(DeviceExtension, SWAPFS_PHASE_GEOMETRY);
+
+    RtlCopyMemory(timeline->SavedTime, timeline->Time, sizeof(timeline->Time));
+
+    RtlCopyMemory(timeline->SavedRequests, timeline->Requests, sizeof(timeline->Requests));
+
+    RtlCopyMemory(timeline->SavedBytes, timeline->Bytes, sizeof(timeline->Bytes));
+}
+
+VOID
+TimelineFallback (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PBOOT_TIMELINE  timeline;
+    ULONG           phase;
+
+    PAGED_CODE();
+
+    timeline = &DeviceExtension->Timeline;
+
+    TimelineBegin(DeviceExtension, SWAPFS_PHASE_FALLBACK);
+
+    /* what the format that failed added to the phases is moved to the fallback */
+
+    for (phase = SWAPFS_PHASE_GEOMETRY; phase < SWAPFS_PHASE_FALLBACK; phase++)
+    {
+        timeline->Time[SWAPFS_PHASE_FALLBACK] += timeline->Time[phase] - timeline->SavedTime[phase];
+        timeline->Requests[SWAPFS_PHASE_FALLBACK] += timeline->Requests[phase] - timeline->SavedRequests[phase];
+        timeline->Bytes[SWAPFS_PHASE_FALLBACK] += timeline->Bytes[phase] - timeline->SavedBytes[phase];
+
+        timeline->Time[phase] = timeline->SavedTime[phase];
+        timeline->Requests[phase] = timeline->SavedRequests[phase];
+        timeline->Bytes[phase] = timeline->SavedBytes[phase];
+    }
+}
+
+VOID
+TimelineSave (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN NTSTATUS             Status
+    )
+{
+    PBOOT_TIMELINE  timeline;
+    SWAPFS_TIMELINE record;
+    PUNICODE_STRING service_name;
+    UNICODE_STRING  key_name;
+    WCHAR           value_name[32];
+    ULONG           phase;
+    NTSTATUS        status;
+
+    PAGED_CODE();
+
+    timeline = &DeviceExtension->Timeline;
+
+    TimelineBegin(DeviceExtension, TIMELINE_PHASE_NONE);
+
+    RtlZeroMemory(&record, sizeof(record));
+
+    record.Version = SWAPFS_TIMELINE_VERSION;
+    record.Status = Status;
+    record.FileSystem = NT_SUCCESS(Status) ? DeviceExtension->Stamp.FileSystem : 0;
+    record.Flags = timeline->Flags;
+
+    for (phase = 0; phase < SWAPFS_PHASES; phase++)
+    {
+        record.Phase[phase].Time = timeline->Time[phase] * 1000000 / timeline->Frequency;
+        record.Phase[phase].Requests = timeline->Requests[phase];
+        record.Phase[phase].Bytes = timeline->Bytes[phase];
+
+        KdPrint(("SwapFs: Phase %u took %I64u us for %I64u requests of %I64u bytes.\n",
+            phase, record.Phase[phase].Time, record.Phase[phase].Requests, record.Phase[phase].Bytes));
+    }
+
+    /* the Parameters key is relative to the key of the service */
+
+    service_name = &DeviceExtension->DeviceObject->DriverObject->DriverExtension->ServiceKeyName;
+
+    key_name.Length = 0;
+
+    key_name.MaximumLength = service_name->Length + sizeof(TIMELINE_KEY);
+
+    key_name.Buffer = (PWSTR) ExAllocatePoolWithTag(PagedPool, key_name.MaximumLength, SWAPFS_POOL_TAG);
+
+    if (!key_name.Buffer)
+    {
+        return;
+    }
+
+    RtlCopyUnicodeString(&key_name, service_name);
+
+    RtlAppendUnicodeToString(&key_name, TIMELINE_KEY);
+
+    if (timeline->DeviceNumber)
+    {
+        RtlStringCbPrintfW(value_name, sizeof(value_name), TIMELINE_VALUE L"%u", timeline->DeviceNumber);
+    }
+    else
+    {
+        RtlStringCbPrintfW(value_name, sizeof(value_name), TIMELINE_VALUE);
+    }
+
+    status = RtlWriteRegistryValue(
+        RTL_REGISTRY_SERVICES,
+        key_name.Buffer,
+        value_name,
+        REG_BINARY,
+        &record,
+        sizeof(record)
+        );
+
+    ExFreePool(key_name.Buffer);
+
+    if (!NT_SUCCESS(status))
+    {
+        KdPrint(("SwapFs: Failed to write %ws, status 0x%08x.\n", value_name, status));
+    }
+}
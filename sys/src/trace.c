@@ -0,0 +1,266 @@
+/*
+    Functions to record a trace of the requests to the swap device.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With TraceBufferSize each read, write, flush and shutdown is recorded
+    when it completes, from the completion routine of the statistics, in
+    a ring buffer of a power of two records. A request takes the next
+    sequence number with an interlocked increment and writes the record
+    of it in the slot of the number, first marking the slot as being
+    written and last setting the sequence number of the record, so no
+    lock is taken. When the buffer is full the oldest records are
+    overwritten. IOCTL_SWAPFS_DRAIN_TRACE copies the records that are
+    complete from the oldest not drained and counts those that were
+    overwritten before they were drained as lost. A record that changes
+    while it is copied is also counted as lost.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", TraceInitialize)
+#pragma alloc_text("INIT", TraceRelease)
+#pragma alloc_text("PAGE", TraceDrain)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+TraceInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                TraceBufferSize
+    )
+{
+    PIO_TRACE       trace;
+    ULONG           nrecord;
+    LARGE_INTEGER   frequency;
+    LARGE_INTEGER   start_time;
+
+    trace = &DeviceExtension->Trace;
+
+    /* TraceBufferSize is in KB and the number of records is rounded down to a power of two */
+
+    nrecord = min(TraceBufferSize, TRACE_BUFFER_MAXIMUM_SIZE) * 1024 / sizeof(SWAPFS_TRACE_RECORD);
+
+    if (!nrecord)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    nrecord = 1 << RtlFindMostSignificantBit(nrecord);
+
+    trace->Records = (PSWAPFS_TRACE_RECORD) ExAllocatePoolWithTag(
+        NonPagedPool,
+        nrecord * sizeof(SWAPFS_TRACE_RECORD),
+        SWAPFS_POOL_TAG
+        );
+
+    if (!trace->Records)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(trace->Records, nrecord * sizeof(SWAPFS_TRACE_RECORD));
+
+    ExInitializeFastMutex(&trace->Mutex);
+
+    trace->Mask = nrecord - 1;
+
+    trace->Head = 0;
+
+    trace->Tail = 0;
+
+    trace->Lost = 0;
+
+    trace->InFlight = 0;
+
+    KeQuerySystemTime(&start_time);
+
+    trace->StartCounter = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+    trace->StartTime = start_time.QuadPart;
+
+    trace->Frequency = frequency.QuadPart;
+
+    KdPrint(("SwapFs: Tracing to a buffer of %u records.\n", nrecord));
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+TraceRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PIO_TRACE trace;
+
+    trace = &DeviceExtension->Trace;
+
+    if (!trace->Records)
+    {
+        return;
+    }
+
+    ExFreePool(trace->Records);
+
+    trace->Records = NULL;
+}
+
+/* not pageable since it's called from the completion routine */
+
+VOID
+TraceRecord (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp,
+    IN LONGLONG             StartTime,
+    IN LONGLONG             Latency,
+    IN LONG                 Depth
+    )
+{
+    PIO_TRACE           trace;
+    PIO_STACK_LOCATION  io_stack;
+    PSWAPFS_TRACE_RECORD record;
+    LONGLONG            sequence;
+
+    trace = &DeviceExtension->Trace;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    InterlockedDecrement(&trace->InFlight);
+
+    sequence = InterlockedIncrement64(&trace->Head) - 1;
+
+    record = &trace->Records[sequence & trace->Mask];
+
+    /* a sequence number of zero tells the drain that the record is being written */
+
+    InterlockedExchange64(&record->Sequence, 0);
+
+    record->Timestamp = (StartTime - trace->StartCounter) * 1000000 / trace->Frequency;
+    record->Status = Irp->IoStatus.Status;
+    record->Latency = (ULONG) min(Latency, MAXULONG);
+    record->Operation = io_stack->MajorFunction;
+    record->Depth = (USHORT) min(Depth, MAXUSHORT);
+
+    if (io_stack->MajorFunction == IRP_MJ_READ || io_stack->MajorFunction == IRP_MJ_WRITE)
+    {
+        record->Offset = io_stack->Parameters.Read.ByteOffset.QuadPart + sizeof(union swap_header);
+        record->Length = io_stack->Parameters.Read.Length;
+    }
+    else
+    {
+        record->Offset = 0;
+        record->Length = 0;
+    }
+
+    InterlockedExchange64(&record->Sequence, sequence + 1);
+}
+
+NTSTATUS
+TraceDrain (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    PIO_STACK_LOCATION      io_stack;
+    PIO_TRACE               trace;
+    PSWAPFS_TRACE           output;
+    PSWAPFS_TRACE_RECORD    record;
+    LONGLONG                head;
+    LONGLONG                sequence;
+    LONGLONG                written;
+    ULONG                   nrecord;
+    ULONG                   n;
+
+    PAGED_CODE();
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    trace = &DeviceExtension->Trace;
+
+    Irp->IoStatus.Information = 0;
+
+    if (!trace->Records)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    if (io_stack->Parameters.DeviceIoControl.OutputBufferLength < FIELD_OFFSET(SWAPFS_TRACE, Record))
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    output = (PSWAPFS_TRACE) Irp->AssociatedIrp.SystemBuffer;
+
+    nrecord = (io_stack->Parameters.DeviceIoControl.OutputBufferLength - FIELD_OFFSET(SWAPFS_TRACE, Record)) /
+        sizeof(SWAPFS_TRACE_RECORD);
+
+    ExAcquireFastMutex(&trace->Mutex);
+
+    head = InterlockedCompareExchange64(&trace->Head, 0, 0);
+
+    /* the records older than the size of the buffer are overwritten */
+
+    if (head - trace->Tail > trace->Mask + 1)
+    {
+        trace->Lost += head - trace->Tail - (trace->Mask + 1);
+        trace->Tail = head - (trace->Mask + 1);
+    }
+
+    for (n = 0, sequence = trace->Tail; sequence < head && n < nrecord; sequence++)
+    {
+        record = &trace->Records[sequence & trace->Mask];
+
+        written = InterlockedCompareExchange64(&record->Sequence, 0, 0);
+
+        /* stop at a record that is still being written, it's returned by the next drain */
+
+        if (written == 0 || written < sequence + 1)
+        {
+            break;
+        }
+
+        if (written == sequence + 1)
+        {
+            output->Record[n] = *record;
+
+            KeMemoryBarrier();
+
+            if (InterlockedCompareExchange64(&record->Sequence, 0, 0) == sequence + 1)
+            {
+                n++;
+                continue;
+            }
+        }
+
+        trace->Lost++;
+    }
+
+    trace->Tail = sequence;
+
+    output->Version = SWAPFS_TRACE_VERSION;
+    output->NumberOfRecords = n;
+    output->Lost = trace->Lost;
+    output->StartTime = trace->StartTime;
+
+    ExReleaseFastMutex(&trace->Mutex);
+
+    Irp->IoStatus.Information = FIELD_OFFSET(SWAPFS_TRACE, Record) + n * sizeof(SWAPFS_TRACE_RECORD);
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,663 @@
+/*
+    Functions to combine small writes to the swap device.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With WriteCombineSize the small writes to the data region are copied
+    to a nonpaged staging buffer of that many KB and completed at once.
+    A write that is next to or overlaps the staged range is merged into
+    it while the range fits in the buffer. The staged range is written
+    to the device as one request when the buffer is full, when a small
+    write that can't be merged comes, when a read needs what is on the
+    device, when a timer set as a new range is staged expires and on
+    flush, shutdown and power down. There are two buffers so the staging goes on while the other
+    one is written, but only one write of them is in flight at a time.
+    A read that is all in the staged or the written range is copied from
+    it and a read that is partly in them waits for the write, as does a
+    write sent to the device that overlaps the range being written, so
+    the newest data always reaches the device last. A write with
+    SL_WRITE_THROUGH or SL_FORCE_UNIT_ACCESS is never staged but waits
+    for the staged data it overlaps to be written and is then sent to
+    the device, so it completes only when it is there. A write of the
+    staged data that fails is returned by the next flush.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", WriteCombineInitialize)
+#pragma alloc_text("INIT", WriteCombineRelease)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+WriteCombineInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                WriteCombineSize
+    )
+{
+    PWRITE_COMBINE  write_combine;
+    PUCHAR          buffer;
+    ULONG           size;
+
+    write_combine = &DeviceExtension->WriteCombine;
+
+    /* WriteCombineSize is in KB and each of the two buffers is that size */
+
+    size = min(max(WriteCombineSize, WRITE_COMBINE_MINIMUM_SIZE), WRITE_COMBINE_MAXIMUM_SIZE) * 1024;
+
+    buffer = (PUCHAR) ExAllocatePoolWithTag(
+        NonPagedPool,
+        size * 2,
+        SWAPFS_POOL_TAG
+        );
+
+    if (!buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(write_combine, sizeof(WRITE_COMBINE));
+
+    KeInitializeSpinLock(&write_combine->Lock);
+
+    InitializeListHead(&write_combine->WaitList);
+
+    KeInitializeEvent(&write_combine->FlushDone, NotificationEvent, TRUE);
+
+    write_combine->Buffer[0] = buffer;
+
+    write_combine->Buffer[1] = buffer + size;
+
+    write_combine->Size = size;
+
+    write_combine->Status = STATUS_SUCCESS;
+
+    KeInitializeDpc(&write_combine->Dpc, WriteCombineTimerDpc, DeviceExtension);
+
+    KeInitializeTimer(&write_combine->Timer);
+
+    KdPrint(("SwapFs: Combining small writes in buffers of %u bytes.\n", size));
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+WriteCombineRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PWRITE_COMBINE write_combine;
+
+    write_combine = &DeviceExtension->WriteCombine;
+
+    if (!write_combine->Size)
+    {
+        return;
+    }
+
+    KeCancelTimer(&write_combine->Timer);
+
+    KeFlushQueuedDpcs();
+
+    ExFreePool(write_combine->Buffer[0]);
+
+    RtlZeroMemory(write_combine, sizeof(WRITE_COMBINE));
+}
+
+/* not pageable since it's called with the spin lock held */
+
+static VOID
+write_combine_set_timer (
+    IN PWRITE_COMBINE WriteCombine
+    )
+{
+    LARGE_INTEGER due_time;
+
+    /* the timer is set only while there is staged data so an idle device has no ticks */
+
+    due_time.QuadPart = (LONGLONG) WRITE_COMBINE_FLUSH_INTERVAL * -10000;
+
+    KeSetTimer(&WriteCombine->Timer, due_time, &WriteCombine->Dpc);
+}
+
+/* not pageable since it's called with the spin lock held */
+
+static VOID
+write_combine_swap (
+    IN PWRITE_COMBINE WriteCombine
+    )
+{
+    ASSERT(!WriteCombine->Flushing && WriteCombine->Length);
+
+    /* the staged range is written from its buffer and the staging goes on in the other */
+
+    WriteCombine->FlushOffset = WriteCombine->Offset;
+    WriteCombine->FlushLength = WriteCombine->Length;
+    WriteCombine->Flushing = TRUE;
+
+    WriteCombine->Staging ^= 1;
+    WriteCombine->Length = 0;
+
+    KeClearEvent(&WriteCombine->FlushDone);
+}
+
+static VOID
+write_combine_start (
+    IN PDEVICE_EXTENSION DeviceExtension
+    );
+
+/* not pageable since it's called from the completion routine */
+
+static VOID
+write_combine_done (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN NTSTATUS             Status
+    )
+{
+    PWRITE_COMBINE  write_combine;
+    LIST_ENTRY      wait_list;
+    PLIST_ENTRY     entry;
+    BOOLEAN         flush;
+    KIRQL           irql;
+
+    write_combine = &DeviceExtension->WriteCombine;
+
+    InitializeListHead(&wait_list);
+
+    KeAcquireSpinLock(&write_combine->Lock, &irql);
+
+    if (!NT_SUCCESS(Status))
+    {
+        KdPrint(("SwapFs: Failed to write %u combined bytes at %I64u, status 0x%08x.\n",
+            write_combine->FlushLength, write_combine->FlushOffset, Status));
+
+        if (NT_SUCCESS(write_combine->Status))
+        {
+            write_combine->Status = Status;
+        }
+    }
+
+    write_combine->Flushing = FALSE;
+
+    /* the requests that waited for the write are sent again in the order they came */
+
+    while (!IsListEmpty(&write_combine->WaitList))
+    {
+        entry = RemoveHeadList(&write_combine->WaitList);
+        InsertTailList(&wait_list, entry);
+    }
+
+    flush = (write_combine->Length == write_combine->Size);
+
+    if (flush)
+    {
+        write_combine_swap(write_combine);
+    }
+    else
+    {
+        KeSetEvent(&write_combine->FlushDone, IO_NO_INCREMENT, FALSE);
+    }
+
+    KeReleaseSpinLock(&write_combine->Lock, irql);
+
+    if (flush)
+    {
+        write_combine_start(DeviceExtension);
+    }
+
+    while (!IsListEmpty(&wait_list))
+    {
+        entry = RemoveHeadList(&wait_list);
+
+        WriteCombineReadWrite(
+            DeviceExtension->DeviceObject,
+            CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry)
+            );
+    }
+}
+
+NTSTATUS
+WriteCombineCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    NTSTATUS status;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    status = Irp->IoStatus.Status;
+
+    IoFreeMdl(Irp->MdlAddress);
+
+    IoFreeIrp(Irp);
+
+    write_combine_done((PDEVICE_EXTENSION) Context, status);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+/* not pageable since it's called from the dispatch routine and the timer */
+
+static VOID
+write_combine_start (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PWRITE_COMBINE      write_combine;
+    PIO_STACK_LOCATION  next_io_stack;
+    PIRP                irp;
+    PMDL                mdl;
+
+    write_combine = &DeviceExtension->WriteCombine;
+
+    /* the buffer being written doesn't change until the write is done */
+
+    irp = IoAllocateIrp(DeviceExtension->DeviceObject->StackSize, FALSE);
+
+    mdl = irp ? IoAllocateMdl(
+        write_combine->Buffer[write_combine->Staging ^ 1],
+        write_combine->FlushLength,
+        FALSE,
+        FALSE,
+        irp
+        ) : NULL;
+
+    if (!mdl)
+    {
+        if (irp)
+        {
+            IoFreeIrp(irp);
+        }
+
+        write_combine_done(DeviceExtension, STATUS_INSUFFICIENT_RESOURCES);
+
+        return;
+    }
+
+    MmBuildMdlForNonPagedPool(mdl);
+
+    next_io_stack = IoGetNextIrpStackLocation(irp);
+
+    next_io_stack->MajorFunction = IRP_MJ_WRITE;
+    next_io_stack->Parameters.Write.ByteOffset.QuadPart = write_combine->FlushOffset + sizeof(union swap_header);
+    next_io_stack->Parameters.Write.Length = write_combine->FlushLength;
+
+    IoSetCompletionRoutine(
+        irp,
+        WriteCombineCompletion,
+        DeviceExtension,
+        TRUE,
+        TRUE,
+        TRUE
+        );
+
+    StripeCallDriver(DeviceExtension, irp);
+}
+
+VOID
+WriteCombineTimerDpc (
+    IN PKDPC    Dpc,
+    IN PVOID    DeferredContext,
+    IN PVOID    SystemArgument1,
+    IN PVOID    SystemArgument2
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PWRITE_COMBINE      write_combine;
+    BOOLEAN             flush;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    device_extension = (PDEVICE_EXTENSION) DeferredContext;
+
+    write_combine = &device_extension->WriteCombine;
+
+    KeAcquireSpinLockAtDpcLevel(&write_combine->Lock);
+
+    flush = (write_combine->Length && !write_combine->Flushing);
+
+    if (flush)
+    {
+        write_combine_swap(write_combine);
+    }
+
+    /* the staged range can't be written while the other is so the timer is set again */
+
+    else if (write_combine->Length)
+    {
+        write_combine_set_timer(write_combine);
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&write_combine->Lock);
+
+    if (flush)
+    {
+        write_combine_start(device_extension);
+    }
+}
+
+NTSTATUS
+WriteCombineReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PWRITE_COMBINE      write_combine;
+    PIO_STACK_LOCATION  io_stack;
+    PIO_STACK_LOCATION  next_io_stack;
+    LONGLONG            offset;
+    LONGLONG            end;
+    LONGLONG            staged_end;
+    LONGLONG            flush_end;
+    LONGLONG            first, last;
+    ULONG               length;
+    PUCHAR              staging;
+    PUCHAR              data;
+    BOOLEAN             write_through;
+    BOOLEAN             complete;
+    BOOLEAN             wait;
+    BOOLEAN             flush;
+    NTSTATUS            status;
+    KIRQL               irql;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    write_combine = &device_extension->WriteCombine;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart;
+    length = io_stack->Parameters.Read.Length;
+    end = offset + length;
+
+    data = length ? (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority) : NULL;
+
+    if (!data)
+    {
+        /* a request of no length has nothing to combine */
+
+        if (!length)
+        {
+            IoCopyCurrentIrpStackLocationToNext(Irp);
+
+            next_io_stack = IoGetNextIrpStackLocation(Irp);
+
+            next_io_stack->Parameters.Read.ByteOffset.QuadPart += sizeof(union swap_header);
+
+            return StripeCallDriver(device_extension, Irp);
+        }
+
+
+        Irp->IoStatus.Status = STATUS_INSUFFICIENT_RESOURCES;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    write_through = (io_stack->MajorFunction == IRP_MJ_WRITE &&
+        (io_stack->Flags & (SL_WRITE_THROUGH | SL_FORCE_UNIT_ACCESS)));
+
+    complete = FALSE;
+    wait = FALSE;
+    flush = FALSE;
+
+    KeAcquireSpinLock(&write_combine->Lock, &irql);
+
+    staging = write_combine->Buffer[write_combine->Staging];
+
+    staged_end = write_combine->Offset + write_combine->Length;
+
+    flush_end = write_combine->FlushOffset + write_combine->FlushLength;
+
+    /* the staged range is newer than the one being written so it's looked at first */
+
+    if (io_stack->MajorFunction == IRP_MJ_READ)
+    {
+        if (write_combine->Length && offset < staged_end && end > write_combine->Offset)
+        {
+            if (offset >= write_combine->Offset && end <= staged_end)
+            {
+                RtlCopyMemory(data, staging + (ULONG) (offset - write_combine->Offset), length);
+                complete = TRUE;
+            }
+            else
+            {
+                if (!write_combine->Flushing)
+                {
+                    write_combine_swap(write_combine);
+
+                    flush = TRUE;
+                }
+
+                wait = TRUE;
+            }
+        }
+        else if (write_combine->Flushing && offset < flush_end && end > write_combine->FlushOffset)
+        {
+            if (offset >= write_combine->FlushOffset && end <= flush_end)
+            {
+                RtlCopyMemory(
+                    data,
+                    write_combine->Buffer[write_combine->Staging ^ 1] + (ULONG) (offset - write_combine->FlushOffset),
+                    length
+                    );
+                complete = TRUE;
+            }
+            else
+            {
+                wait = TRUE;
+            }
+        }
+    }
+    /* a write through is sent to the device after the staged data it overlaps */
+
+    else if (write_through)
+    {
+        if (write_combine->Length && offset < staged_end && end > write_combine->Offset)
+        {
+            if (!write_combine->Flushing)
+            {
+                write_combine_swap(write_combine);
+
+                flush = TRUE;
+            }
+
+            wait = TRUE;
+        }
+        else if (write_combine->Flushing && offset < flush_end && end > write_combine->FlushOffset)
+        {
+            wait = TRUE;
+        }
+    }
+    else if (length <= min(WRITE_COMBINE_SMALL_WRITE, write_combine->Size))
+    {
+        first = min(offset, write_combine->Offset);
+        last = max(end, staged_end);
+
+        /* a small write next to or in the staged range is merged into it */
+
+        if (write_combine->Length && offset <= staged_end && end >= write_combine->Offset &&
+            last - first <= write_combine->Size)
+        {
+            if (first < write_combine->Offset)
+            {
+                RtlMoveMemory(staging + (ULONG) (write_combine->Offset - first), staging, write_combine->Length);
+                write_combine->Offset = first;
+            }
+
+            RtlCopyMemory(staging + (ULONG) (offset - first), data, length);
+
+            write_combine->Length = (ULONG) (last - first);
+
+            complete = TRUE;
+
+            if (write_combine->Length == write_combine->Size && !write_combine->Flushing)
+            {
+                write_combine_swap(write_combine);
+
+                flush = TRUE;
+            }
+        }
+
+        /* else the staged range is written and the write starts a new one */
+
+        else if (!write_combine->Flushing || !write_combine->Length)
+        {
+            if (write_combine->Length)
+            {
+                write_combine_swap(write_combine);
+
+                flush = TRUE;
+            }
+
+            staging = write_combine->Buffer[write_combine->Staging];
+
+            RtlCopyMemory(staging, data, length);
+
+            write_combine->Offset = offset;
+            write_combine->Length = length;
+
+            write_combine_set_timer(write_combine);
+
+            complete = TRUE;
+        }
+        else if (offset < flush_end && end > write_combine->FlushOffset)
+        {
+            wait = TRUE;
+        }
+    }
+    else if (write_combine->Flushing && offset < flush_end && end > write_combine->FlushOffset)
+    {
+        wait = TRUE;
+    }
+
+    /* a write sent down over the staged range replaces it there too */
+
+    if (!complete && !wait && io_stack->MajorFunction == IRP_MJ_WRITE &&
+        write_combine->Length && offset < staged_end && end > write_combine->Offset)
+    {
+        first = max(offset, write_combine->Offset);
+        last = min(end, staged_end);
+
+        RtlCopyMemory(
+            staging + (ULONG) (first - write_combine->Offset),
+            data + (ULONG) (first - offset),
+            (ULONG) (last - first)
+            );
+    }
+
+    if (wait)
+    {
+        IoMarkIrpPending(Irp);
+        InsertTailList(&write_combine->WaitList, &Irp->Tail.Overlay.ListEntry);
+    }
+
+    KeReleaseSpinLock(&write_combine->Lock, irql);
+
+    if (flush)
+    {
+        write_combine_start(device_extension);
+    }
+
+    if (wait)
+    {
+        return STATUS_PENDING;
+    }
+
+    if (complete)
+    {
+        status = STATUS_SUCCESS;
+
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = length;
+
+        IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+
+        return status;
+    }
+
+    IoCopyCurrentIrpStackLocationToNext(Irp);
+
+    next_io_stack = IoGetNextIrpStackLocation(Irp);
+
+    next_io_stack->Parameters.Read.ByteOffset.QuadPart += sizeof(union swap_header);
+
+    return StripeCallDriver(device_extension, Irp);
+}
+
+/* not pageable since it's called for the last chance shutdown and power down */
+
+NTSTATUS
+WriteCombineFlush (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN BOOLEAN              Wait
+    )
+{
+    PWRITE_COMBINE  write_combine;
+    BOOLEAN         flush;
+    BOOLEAN         done;
+    NTSTATUS        status;
+    KIRQL           irql;
+
+    write_combine = &DeviceExtension->WriteCombine;
+
+    do
+    {
+        KeAcquireSpinLock(&write_combine->Lock, &irql);
+
+        done = (!write_combine->Length && !write_combine->Flushing);
+
+        flush = (write_combine->Length && !write_combine->Flushing);
+
+        if (flush)
+        {
+            write_combine_swap(write_combine);
+        }
+
+        KeReleaseSpinLock(&write_combine->Lock, irql);
+
+        if (flush)
+        {
+            write_combine_start(DeviceExtension);
+        }
+
+        if (!done && Wait)
+        {
+            KeWaitForSingleObject(&write_combine->FlushDone, Executive, KernelMode, FALSE, NULL);
+        }
+
+    } while (!done && Wait);
+
+    /* a write of the staged data that failed is returned once */
+
+    KeAcquireSpinLock(&write_combine->Lock, &irql);
+
+    status = write_combine->Status;
+
+    write_combine->Status = STATUS_SUCCESS;
+
+    KeReleaseSpinLock(&write_combine->Lock, irql);
+
+    return status;
+}
@@ -0,0 +1,1005 @@
+/*
+    Functions to keep the blocks of only zeros in the data region in memory.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With ZeroBlockElision the data region is split in blocks of
+    ZERO_ELISION_BLOCK_SIZE and a bit in a bitmap is set when a block has
+    been written with only zeros. The requests are checked where they
+    are sent to the device, so the requests of the RAM tier, the combined
+    writes and the read ahead are checked as well as the others. A write
+    of only zeros to the blocks that are set, or to whole blocks, is
+    completed without going to the device, any other write clears the
+    blocks it writes with data and sets the whole blocks it writes with
+    zeros. A write of data to a part of a block that is set first writes
+    zeros to the block, so the rest of it is still zero, and clears it.
+    The block is marked as prefilling while the zeros are written and a
+    later write of the block waits until they are, so the zeros can not
+    be written over the data of an earlier write to another part of it.
+    A read of blocks that are all set is completed with zeros, a read of
+    some blocks that are set is sent down and the blocks that are set are
+    cleared to zeros when it completes. The bitmap is only in memory so
+    the volume is not reused at the next boot. Only the data region is
+    checked since the formatter and the metadata cache writes the start
+    of the volume on the device.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#if defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("INIT", ZeroElisionInitialize)
+#pragma alloc_text("INIT", ZeroElisionRelease)
+#pragma alloc_text("PAGE", ZeroElisionStart)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+ZeroElisionInitialize (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PZERO_ELISION zero_elision;
+
+    zero_elision = &DeviceExtension->ZeroElision;
+
+    RtlZeroMemory(zero_elision, sizeof(ZERO_ELISION));
+
+    InitializeListHead(&zero_elision->Waiting);
+
+    /* a block of zeros is written before a part of a block that is set */
+
+    zero_elision->Zeros = (PUCHAR) ExAllocatePoolWithTag(
+        NonPagedPool,
+        ZERO_ELISION_BLOCK_SIZE,
+        SWAPFS_POOL_TAG
+        );
+
+    if (!zero_elision->Zeros)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(zero_elision->Zeros, ZERO_ELISION_BLOCK_SIZE);
+
+    zero_elision->ZerosMdl = IoAllocateMdl(zero_elision->Zeros, ZERO_ELISION_BLOCK_SIZE, FALSE, FALSE, NULL);
+
+    if (!zero_elision->ZerosMdl)
+    {
+        ExFreePool(zero_elision->Zeros);
+        zero_elision->Zeros = NULL;
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    MmBuildMdlForNonPagedPool(zero_elision->ZerosMdl);
+
+    KeInitializeSpinLock(&zero_elision->Lock);
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+ZeroElisionRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PZERO_ELISION zero_elision;
+
+    zero_elision = &DeviceExtension->ZeroElision;
+
+    if (!zero_elision->Zeros)
+    {
+        return;
+    }
+
+    if (zero_elision->Bitmap.Buffer)
+    {
+        ExFreePool(zero_elision->Bitmap.Buffer);
+    }
+
+    IoFreeMdl(zero_elision->ZerosMdl);
+
+    ExFreePool(zero_elision->Zeros);
+
+    RtlZeroMemory(zero_elision, sizeof(ZERO_ELISION));
+}
+
+VOID
+ZeroElisionStart (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PZERO_ELISION   zero_elision;
+    PULONG          buffer;
+    ULONG           nblock;
+    ULONG           nword;
+    LONGLONG        start;
+
+    PAGED_CODE();
+
+    zero_elision = &DeviceExtension->ZeroElision;
+
+    nblock = (ULONG) (DeviceExtension->Stamp.VolumeLength / ZERO_ELISION_BLOCK_SIZE);
+
+    nword = (nblock + 31) / 32;
+
+    /* the bitmap of the blocks that are prefilling follows the one of the blocks that are zero */
+
+    buffer = (PULONG) ExAllocatePoolWithTag(
+        NonPagedPool,
+        2 * nword * sizeof(ULONG),
+        SWAPFS_POOL_TAG
+        );
+
+    if (!buffer)
+    {
+        KdPrint(("SwapFs: No zero blocks are elided for the device.\n"));
+        return;
+    }
+
+    RtlInitializeBitMap(&zero_elision->Bitmap, buffer, nblock);
+
+    RtlClearAllBits(&zero_elision->Bitmap);
+
+    RtlInitializeBitMap(&zero_elision->Prefilling, buffer + nword, nblock);
+
+    RtlClearAllBits(&zero_elision->Prefilling);
+
+    /* the metadata the formatter has written is not checked */
+
+    start = (LONGLONG) DeviceExtension->Stamp.MetaSectors * DeviceExtension->Stamp.SectorSize;
+
+    start = (start + ZERO_ELISION_BLOCK_SIZE - 1) & ~((LONGLONG) ZERO_ELISION_BLOCK_SIZE - 1);
+
+    zero_elision->Start = max(start, ZERO_ELISION_BLOCK_SIZE);
+
+    KdPrint(("SwapFs: Eliding the zero blocks of the volume from %I64u.\n", zero_elision->Start));
+}
+
+/* not pageable since it's called from the dispatch routine, the SSE2 and NEON
+   registers are used without being saved since the kernel saves them on x64
+   and ARM64, AVX is not used since the YMM registers would have to be saved
+   with KeSaveExtendedProcessorState for each block */
+
+static BOOLEAN
+zero_elision_is_zero (
+    IN PUCHAR   Data,
+    IN ULONG    Length
+    )
+{
+    PULONG_PTR  word;
+    ULONG_PTR   bits;
+    ULONG       nword;
+    ULONG       n;
+#if defined(_M_X64)
+    __m128i     vector;
+#elif defined(_M_ARM64)
+    uint8x16_t  vector;
+#endif
+
+    while (Length && ((ULONG_PTR) Data & 15))
+    {
+        if (*Data)
+        {
+            return FALSE;
+        }
+
+        Data++;
+        Length--;
+    }
+
+    /* four vectors, a cache line, are or'ed before they are tested */
+
+#if defined(_M_X64)
+    for (; Length >= 64; Data += 64, Length -= 64)
+    {
+        vector = _mm_or_si128(
+            _mm_or_si128(_mm_load_si128((__m128i*) Data), _mm_load_si128((__m128i*) (Data + 16))),
+            _mm_or_si128(_mm_load_si128((__m128i*) (Data + 32)), _mm_load_si128((__m128i*) (Data + 48)))
+            );
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(vector, _mm_setzero_si128())) != 0xffff)
+        {
+            return FALSE;
+        }
+    }
+#elif defined(_M_ARM64)
+    for (; Length >= 64; Data += 64, Length -= 64)
+    {
+        vector = vorrq_u8(
+            vorrq_u8(vld1q_u8(Data), vld1q_u8(Data + 16)),
+            vorrq_u8(vld1q_u8(Data + 32), vld1q_u8(Data + 48))
+            );
+
+        if (vmaxvq_u8(vector))
+        {
+            return FALSE;
+        }
+    }
+#endif
+
+    word = (PULONG_PTR) Data;
+
+    nword = Length / sizeof(ULONG_PTR);
+
+    /* the rest, or all of it on x86, is tested eight words at a time */
+
+    for (n = 0; n + 8 <= nword; n += 8)
+    {
+        bits = word[n] | word[n + 1] | word[n + 2] | word[n + 3] |
+            word[n + 4] | word[n + 5] | word[n + 6] | word[n + 7];
+
+        if (bits)
+        {
+            return FALSE;
+        }
+    }
+
+    for (; n < nword; n++)
+    {
+        if (word[n])
+        {
+            return FALSE;
+        }
+    }
+
+    Data += nword * sizeof(ULONG_PTR);
+
+    Length -= nword * sizeof(ULONG_PTR);
+
+    while (Length--)
+    {
+        if (*Data++)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* not pageable since it's called from the completion routine */
+
+static VOID
+zero_elision_finish (
+    IN PZERO_ELISION_CONTEXT    Context,
+    IN NTSTATUS                 Status,
+    IN ULONG_PTR                Information
+    )
+{
+    PIRP irp;
+
+    irp = Context->Irp;
+
+    ExFreePool(Context);
+
+    irp->IoStatus.Status = Status;
+    irp->IoStatus.Information = NT_SUCCESS(Status) ? Information : 0;
+
+    IoCompleteRequest(irp, IO_DISK_INCREMENT);
+}
+
+/* not pageable since it's called from the completion routine, the request is sent below the zero elision */
+
+static BOOLEAN
+zero_elision_send (
+    IN PDEVICE_EXTENSION        DeviceExtension,
+    IN UCHAR                    MajorFunction,
+    IN LONGLONG                 Offset,
+    IN ULONG                    Length,
+    IN PMDL                     Mdl,
+    IN PIO_COMPLETION_ROUTINE   CompletionRoutine,
+    IN PZERO_ELISION_CONTEXT    Context
+    )
+{
+    PIO_STACK_LOCATION  next_io_stack;
+    PIRP                irp;
+
+    irp = IoAllocateIrp(DeviceExtension->DeviceObject->StackSize, FALSE);
+
+    if (!irp)
+    {
+        return FALSE;
+    }
+
+    irp->MdlAddress = Mdl;
+
+    irp->Tail.Overlay.Thread = Context->Irp->Tail.Overlay.Thread;
+
+    next_io_stack = IoGetNextIrpStackLocation(irp);
+
+    next_io_stack->MajorFunction = MajorFunction;
+    next_io_stack->Parameters.Read.ByteOffset.QuadPart = Offset + sizeof(union swap_header);
+    next_io_stack->Parameters.Read.Length = Length;
+
+    IoSetCompletionRoutine(
+        irp,
+        CompletionRoutine,
+        Context,
+        TRUE,
+        TRUE,
+        TRUE
+        );
+
+    StripeCallDevice(DeviceExtension, irp);
+
+    return TRUE;
+}
+
+static VOID
+zero_elision_resume (
+    IN PZERO_ELISION_CONTEXT Context
+    );
+
+/* not pageable since it's called from the completion routine, the writes that waited for the blocks are checked again */
+
+static VOID
+zero_elision_prefilled (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PULONG               Block,
+    IN ULONG                NumberOfBlocks,
+    IN BOOLEAN              Zeroed
+    )
+{
+    PZERO_ELISION           zero_elision;
+    PZERO_ELISION_CONTEXT   context;
+    LIST_ENTRY              waiting;
+    ULONG                   n;
+    KIRQL                   irql;
+
+    zero_elision = &DeviceExtension->ZeroElision;
+
+    InitializeListHead(&waiting);
+
+    KeAcquireSpinLock(&zero_elision->Lock, &irql);
+
+    for (n = 0; n < NumberOfBlocks; n++)
+    {
+        if (Zeroed)
+        {
+            RtlClearBits(&zero_elision->Bitmap, Block[n], 1);
+        }
+
+        RtlClearBits(&zero_elision->Prefilling, Block[n], 1);
+    }
+
+    while (!IsListEmpty(&zero_elision->Waiting))
+    {
+        InsertTailList(&waiting, RemoveHeadList(&zero_elision->Waiting));
+    }
+
+    KeReleaseSpinLock(&zero_elision->Lock, irql);
+
+    while (!IsListEmpty(&waiting))
+    {
+        context = CONTAINING_RECORD(RemoveHeadList(&waiting), ZERO_ELISION_CONTEXT, ListEntry);
+
+        zero_elision_resume(context);
+    }
+}
+
+/* not pageable since it's called from the completion routine */
+
+static VOID
+zero_elision_prefill_done (
+    IN PZERO_ELISION_CONTEXT    Context,
+    IN NTSTATUS                 Status
+    )
+{
+    if (!NT_SUCCESS(Status))
+    {
+        InterlockedCompareExchange(&Context->Status, Status, STATUS_SUCCESS);
+    }
+
+    if (InterlockedDecrement(&Context->Pending) != 0)
+    {
+        return;
+    }
+
+    /* the blocks are zero on the device now unless a prefill failed, they are
+       released before the write is sent down since it may free the context */
+
+    zero_elision_prefilled(
+        Context->DeviceExtension,
+        Context->Block,
+        Context->NumberOfBlocks,
+        (BOOLEAN) NT_SUCCESS(Context->Status)
+        );
+
+    if (!NT_SUCCESS(Context->Status))
+    {
+        zero_elision_finish(Context, Context->Status, 0);
+        return;
+    }
+
+    if (!zero_elision_send(
+            Context->DeviceExtension,
+            Context->MajorFunction,
+            Context->Offset,
+            Context->Length,
+            Context->Irp->MdlAddress,
+            ZeroElisionCompletion,
+            Context
+            ))
+    {
+        zero_elision_finish(Context, STATUS_INSUFFICIENT_RESOURCES, 0);
+    }
+}
+
+/* not pageable since it's called from the completion routine, returns FALSE
+   without changing the bitmaps if a block of the write is prefilling, the
+   write is then queued until the prefill is done if it has a context */
+
+static BOOLEAN
+zero_elision_check_write (
+    IN PDEVICE_EXTENSION        DeviceExtension,
+    IN LONGLONG                 Offset,
+    IN ULONG                    Length,
+    IN PUCHAR                   Data,
+    IN PZERO_ELISION_CONTEXT    Context OPTIONAL,
+    OUT PBOOLEAN                Elided,
+    OUT PULONG                  Prefill,
+    OUT PULONG                  NumberOfPrefills
+    )
+{
+    PZERO_ELISION   zero_elision;
+    LONGLONG        start;
+    LONGLONG        end;
+    ULONG           first;
+    ULONG           last;
+    ULONG           block;
+    ULONG           part[2];
+    BOOLEAN         part_zero[2];
+    ULONG           npart;
+    ULONG           nprefill;
+    ULONG           n;
+    BOOLEAN         elided;
+    BOOLEAN         zero;
+    KIRQL           irql;
+
+    zero_elision = &DeviceExtension->ZeroElision;
+
+    *Elided = FALSE;
+    *NumberOfPrefills = 0;
+
+    first = (ULONG) (max(Offset, zero_elision->Start) / ZERO_ELISION_BLOCK_SIZE);
+
+    last = (ULONG) ((Offset + Length - 1) / ZERO_ELISION_BLOCK_SIZE);
+
+    /* only the first and the last block can be written in part */
+
+    npart = 0;
+
+    for (n = 0; n < 2 && first + n <= last; n++)
+    {
+        block = n ? last : first;
+
+        start = max(Offset, (LONGLONG) block * ZERO_ELISION_BLOCK_SIZE);
+
+        end = min(Offset + Length, (LONGLONG) (block + 1) * ZERO_ELISION_BLOCK_SIZE);
+
+        if (end - start != ZERO_ELISION_BLOCK_SIZE)
+        {
+            part[npart] = block;
+            part_zero[npart] = zero_elision_is_zero(Data + (ULONG) (start - Offset), (ULONG) (end - start));
+            npart++;
+        }
+    }
+
+    /* a write that starts before the data region is always sent down */
+
+    elided = (BOOLEAN) (Offset >= zero_elision->Start);
+
+    nprefill = 0;
+
+    KeAcquireSpinLock(&zero_elision->Lock, &irql);
+
+    if (!RtlAreBitsClear(&zero_elision->Prefilling, first, last - first + 1))
+    {
+        if (Context)
+        {
+            InsertTailList(&zero_elision->Waiting, &Context->ListEntry);
+        }
+
+        KeReleaseSpinLock(&zero_elision->Lock, irql);
+
+        return FALSE;
+    }
+
+    /* a part of a block that is set is prefilled if it has data, the block is
+       marked as prefilling under the same lock it was checked under */
+
+    for (n = 0; n < npart; n++)
+    {
+        if (!RtlCheckBit(&zero_elision->Bitmap, part[n]))
+        {
+            elided = FALSE;
+        }
+        else if (!part_zero[n])
+        {
+            RtlSetBits(&zero_elision->Prefilling, part[n], 1);
+
+            Prefill[nprefill++] = part[n];
+        }
+
+        if (!part_zero[n])
+        {
+            elided = FALSE;
+        }
+    }
+
+    KeReleaseSpinLock(&zero_elision->Lock, irql);
+
+    /* the whole blocks are set when they are written with zeros and cleared when they are written with data */
+
+    for (block = first; block <= last; block++)
+    {
+        start = max(Offset, (LONGLONG) block * ZERO_ELISION_BLOCK_SIZE);
+
+        end = min(Offset + Length, (LONGLONG) (block + 1) * ZERO_ELISION_BLOCK_SIZE);
+
+        if (end - start != ZERO_ELISION_BLOCK_SIZE)
+        {
+            continue;
+        }
+
+        zero = zero_elision_is_zero(Data + (ULONG) (start - Offset), ZERO_ELISION_BLOCK_SIZE);
+
+        KeAcquireSpinLock(&zero_elision->Lock, &irql);
+
+        if (zero)
+        {
+            RtlSetBits(&zero_elision->Bitmap, block, 1);
+        }
+        else
+        {
+            RtlClearBits(&zero_elision->Bitmap, block, 1);
+        }
+
+        KeReleaseSpinLock(&zero_elision->Lock, irql);
+
+        if (!zero)
+        {
+            elided = FALSE;
+        }
+    }
+
+    KeAcquireSpinLock(&zero_elision->Lock, &irql);
+
+    if (elided)
+    {
+        zero_elision->Elided += Length;
+    }
+    else
+    {
+        zero_elision->Written += Length;
+    }
+
+    KeReleaseSpinLock(&zero_elision->Lock, irql);
+
+    *Elided = elided;
+    *NumberOfPrefills = nprefill;
+
+    return TRUE;
+}
+
+/* not pageable since it's called from the completion routine, the blocks are prefilled before the request is sent down */
+
+static VOID
+zero_elision_start (
+    IN PZERO_ELISION_CONTEXT    Context,
+    IN PULONG                   Prefill,
+    IN ULONG                    NumberOfPrefills
+    )
+{
+    ULONG n;
+
+    Context->Pending = NumberOfPrefills;
+    Context->Status = STATUS_SUCCESS;
+    Context->NumberOfBlocks = NumberOfPrefills;
+
+    if (!NumberOfPrefills)
+    {
+        if (!zero_elision_send(
+                Context->DeviceExtension,
+                Context->MajorFunction,
+                Context->Offset,
+                Context->Length,
+                Context->Irp->MdlAddress,
+                ZeroElisionCompletion,
+                Context
+                ))
+        {
+            zero_elision_finish(Context, STATUS_INSUFFICIENT_RESOURCES, 0);
+        }
+
+        return;
+    }
+
+    for (n = 0; n < NumberOfPrefills; n++)
+    {
+        Context->Block[n] = Prefill[n];
+    }
+
+    for (n = 0; n < NumberOfPrefills; n++)
+    {
+        if (!zero_elision_send(
+                Context->DeviceExtension,
+                IRP_MJ_WRITE,
+                (LONGLONG) Prefill[n] * ZERO_ELISION_BLOCK_SIZE,
+                ZERO_ELISION_BLOCK_SIZE,
+                Context->DeviceExtension->ZeroElision.ZerosMdl,
+                ZeroElisionPrefillCompletion,
+                Context
+                ))
+        {
+            zero_elision_prefill_done(Context, STATUS_INSUFFICIENT_RESOURCES);
+        }
+    }
+}
+
+/* not pageable since it's called from the completion routine, a write that waited for a prefill is checked again */
+
+static VOID
+zero_elision_resume (
+    IN PZERO_ELISION_CONTEXT Context
+    )
+{
+    PUCHAR  data;
+    ULONG   prefill[2];
+    ULONG   nprefill;
+    BOOLEAN elided;
+
+    data = (PUCHAR) MmGetSystemAddressForMdlSafe(Context->Irp->MdlAddress, NormalPagePriority);
+
+    if (!data)
+    {
+        zero_elision_finish(Context, STATUS_INSUFFICIENT_RESOURCES, 0);
+        return;
+    }
+
+    if (!zero_elision_check_write(
+            Context->DeviceExtension,
+            Context->Offset,
+            Context->Length,
+            data,
+            Context,
+            &elided,
+            prefill,
+            &nprefill
+            ))
+    {
+        return;
+    }
+
+    if (elided)
+    {
+        zero_elision_finish(Context, STATUS_SUCCESS, Context->Length);
+        return;
+    }
+
+    zero_elision_start(Context, prefill, nprefill);
+}
+
+/* not pageable since it's called from the completion routine */
+
+NTSTATUS
+ZeroElisionPrefillCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    NTSTATUS status;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    status = Irp->IoStatus.Status;
+
+    /* the block of zeros is shared by the requests */
+
+    Irp->MdlAddress = NULL;
+
+    IoFreeIrp(Irp);
+
+    zero_elision_prefill_done((PZERO_ELISION_CONTEXT) Context, status);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+/* not pageable since it's called from the completion routine */
+
+NTSTATUS
+ZeroElisionCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PZERO_ELISION_CONTEXT   context;
+    PZERO_ELISION           zero_elision;
+    PUCHAR                  data;
+    LONGLONG                start;
+    LONGLONG                end;
+    ULONG                   block;
+    NTSTATUS                status;
+    ULONG_PTR               information;
+    KIRQL                   irql;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    context = (PZERO_ELISION_CONTEXT) Context;
+
+    zero_elision = &context->DeviceExtension->ZeroElision;
+
+    status = Irp->IoStatus.Status;
+
+    information = Irp->IoStatus.Information;
+
+    /* the MDL is the one of the request it was sent for */
+
+    Irp->MdlAddress = NULL;
+
+    IoFreeIrp(Irp);
+
+    /* what was read of the blocks that are set may be older than the zeros written to them */
+
+    data = (context->MajorFunction == IRP_MJ_READ && NT_SUCCESS(status)) ?
+        (PUCHAR) MmGetSystemAddressForMdlSafe(context->Irp->MdlAddress, NormalPagePriority) : NULL;
+
+    if (data)
+    {
+        KeAcquireSpinLock(&zero_elision->Lock, &irql);
+
+        for (block = (ULONG) (max(context->Offset, zero_elision->Start) / ZERO_ELISION_BLOCK_SIZE);
+             (LONGLONG) block * ZERO_ELISION_BLOCK_SIZE < context->Offset + context->Length;
+             block++)
+        {
+            if (!RtlCheckBit(&zero_elision->Bitmap, block))
+            {
+                continue;
+            }
+
+            start = max(context->Offset, (LONGLONG) block * ZERO_ELISION_BLOCK_SIZE);
+
+            end = min(context->Offset + context->Length, (LONGLONG) (block + 1) * ZERO_ELISION_BLOCK_SIZE);
+
+            RtlZeroMemory(data + (ULONG) (start - context->Offset), (ULONG) (end - start));
+        }
+
+        KeReleaseSpinLock(&zero_elision->Lock, irql);
+    }
+
+    zero_elision_finish(context, status, information);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+/* not pageable since it's called from StripeCallDriver */
+
+NTSTATUS
+ZeroElisionCallDriver (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    PZERO_ELISION           zero_elision;
+    PZERO_ELISION_CONTEXT   context;
+    PIO_STACK_LOCATION      io_stack;
+    LONGLONG                offset;
+    ULONG                   length;
+    ULONG                   first;
+    ULONG                   last;
+    ULONG                   nprefill;
+    ULONG                   prefill[2];
+    PUCHAR                  data;
+    BOOLEAN                 elided;
+    BOOLEAN                 wait;
+    BOOLEAN                 all;
+    BOOLEAN                 none;
+    NTSTATUS                status;
+    KIRQL                   irql;
+
+    zero_elision = &DeviceExtension->ZeroElision;
+
+    io_stack = IoGetNextIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart - sizeof(union swap_header);
+    length = io_stack->Parameters.Read.Length;
+
+    /* the metadata and the requests outside the volume are sent down as they are */
+
+    if ((io_stack->MajorFunction != IRP_MJ_READ && io_stack->MajorFunction != IRP_MJ_WRITE) ||
+        !length ||
+        offset + length <= zero_elision->Start ||
+        offset + length > (LONGLONG) zero_elision->Bitmap.SizeOfBitMap * ZERO_ELISION_BLOCK_SIZE)
+    {
+        return StripeCallDevice(DeviceExtension, Irp);
+    }
+
+    first = (ULONG) (max(offset, zero_elision->Start) / ZERO_ELISION_BLOCK_SIZE);
+
+    last = (ULONG) ((offset + length - 1) / ZERO_ELISION_BLOCK_SIZE);
+
+    data = Irp->MdlAddress ? (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority) : NULL;
+
+    /* the driver takes the place of the lower driver in the next stack location when it completes the request */
+
+    if (!data)
+    {
+        IoSetNextIrpStackLocation(Irp);
+
+        status = STATUS_INSUFFICIENT_RESOURCES;
+
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+        return status;
+    }
+
+    nprefill = 0;
+
+    wait = FALSE;
+
+    if (io_stack->MajorFunction == IRP_MJ_READ)
+    {
+        KeAcquireSpinLock(&zero_elision->Lock, &irql);
+
+        all = (offset >= zero_elision->Start) && RtlAreBitsSet(&zero_elision->Bitmap, first, last - first + 1);
+
+        none = RtlAreBitsClear(&zero_elision->Bitmap, first, last - first + 1);
+
+        if (all)
+        {
+            zero_elision->Read += length;
+        }
+
+        KeReleaseSpinLock(&zero_elision->Lock, irql);
+
+        if (none)
+        {
+            return StripeCallDevice(DeviceExtension, Irp);
+        }
+
+        if (all)
+        {
+            RtlZeroMemory(data, length);
+
+            IoSetNextIrpStackLocation(Irp);
+
+            status = STATUS_SUCCESS;
+
+            Irp->IoStatus.Status = status;
+            Irp->IoStatus.Information = length;
+
+            IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+
+            return status;
+        }
+    }
+    else
+    {
+        /* a write of a block that is prefilling waits for it in a context */
+
+        wait = !zero_elision_check_write(DeviceExtension, offset, length, data, NULL, &elided, prefill, &nprefill);
+
+        if (!wait && elided)
+        {
+            IoSetNextIrpStackLocation(Irp);
+
+            status = STATUS_SUCCESS;
+
+            Irp->IoStatus.Status = status;
+            Irp->IoStatus.Information = length;
+
+            IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+
+            return status;
+        }
+
+        if (!wait && !nprefill)
+        {
+            return StripeCallDevice(DeviceExtension, Irp);
+        }
+    }
+
+    /* the request is done by new requests and completed when they are */
+
+    IoSetNextIrpStackLocation(Irp);
+
+    context = (PZERO_ELISION_CONTEXT) ExAllocatePoolWithTag(
+        NonPagedPool,
+        sizeof(ZERO_ELISION_CONTEXT),
+        SWAPFS_POOL_TAG
+        );
+
+    if (!context)
+    {
+        /* the blocks marked as prefilling are released for the writes that wait for them */
+
+        if (nprefill)
+        {
+            zero_elision_prefilled(DeviceExtension, prefill, nprefill, FALSE);
+        }
+
+        status = STATUS_INSUFFICIENT_RESOURCES;
+
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+        return status;
+    }
+
+    context->DeviceExtension = DeviceExtension;
+    context->Irp = Irp;
+    context->MajorFunction = io_stack->MajorFunction;
+    context->Offset = offset;
+    context->Length = length;
+
+    IoMarkIrpPending(Irp);
+
+    if (wait)
+    {
+        zero_elision_resume(context);
+    }
+    else
+    {
+        zero_elision_start(context, prefill, nprefill);
+    }
+
+    return STATUS_PENDING;
+}
+
+/* not pageable since it takes the spin lock */
+
+VOID
+ZeroElisionQuery (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    OUT PSWAPFS_STATISTICS  Statistics,
+    IN BOOLEAN              Reset
+    )
+{
+    PZERO_ELISION   zero_elision;
+    KIRQL           irql;
+
+    zero_elision = &DeviceExtension->ZeroElision;
+
+    KeAcquireSpinLock(&zero_elision->Lock, &irql);
+
+    Statistics->ZeroElisionWritten = zero_elision->Written;
+    Statistics->ZeroElisionElided = zero_elision->Elided;
+    Statistics->ZeroElisionRead = zero_elision->Read;
+
+    if (Reset)
+    {
+        zero_elision->Written = 0;
+        zero_elision->Elided = 0;
+        zero_elision->Read = 0;
+    }
+
+    KeReleaseSpinLock(&zero_elision->Lock, irql);
+}
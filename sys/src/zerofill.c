@@ -0,0 +1,305 @@
+/*
+    Functions to keep track of sectors that has not been written since format.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Instead of clearing the reserved sectors, the FATs and the root directory
+    cluster at boot the formatter can mark them in a bitmap as zero. A set bit
+    means that the sector has not been written since format so reads of it is
+    completed with zeros from memory, a bit is cleared when a write of the
+    sector has completed successfully.
+*/
+
+#include <ntddk.h>
+#include "swapfs.h"
+#include "swap.h"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text("PAGE", ZeroFillInitialize)
+#pragma alloc_text("PAGE", ZeroFillRelease)
+#endif // ALLOC_PRAGMA
+
+NTSTATUS
+ZeroFillInitialize (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN ULONG                SectorSize,
+    IN ULONG                NumberOfSectors
+    )
+{
+    PZERO_FILL  zero_fill;
+    PULONG      buffer;
+
+    PAGED_CODE();
+
+    ASSERT(DeviceExtension != NULL);
+    ASSERT(SectorSize != 0);
+
+    zero_fill = &DeviceExtension->ZeroFill;
+
+    /* a formatter that fails releases the bitmap before the next one creates it */
+
+    ASSERT(zero_fill->Bitmap.Buffer == NULL);
+
+    buffer = (PULONG) ExAllocatePoolWithTag(
+        NonPagedPool,
+        ((NumberOfSectors + 31) / 32) * sizeof(ULONG),
+        SWAPFS_POOL_TAG
+        );
+
+    if (!buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    KeInitializeSpinLock(&zero_fill->Lock);
+
+    RtlInitializeBitMap(&zero_fill->Bitmap, buffer, NumberOfSectors);
+
+    RtlSetAllBits(&zero_fill->Bitmap);
+
+    zero_fill->SectorSize = SectorSize;
+
+    zero_fill->Length = (LONGLONG) NumberOfSectors * SectorSize;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+ZeroFillRelease (
+    IN PDEVICE_EXTENSION DeviceExtension
+    )
+{
+    PZERO_FILL zero_fill;
+
+    PAGED_CODE();
+
+    zero_fill = &DeviceExtension->ZeroFill;
+
+    if (!zero_fill->Bitmap.Buffer)
+    {
+        return;
+    }
+
+    ExFreePool(zero_fill->Bitmap.Buffer);
+
+    RtlZeroMemory(zero_fill, sizeof(ZERO_FILL));
+}
+
+VOID
+ZeroFillMarkWritten (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN LONGLONG             Offset,
+    IN ULONG                Length
+    )
+{
+    PZERO_FILL  zero_fill;
+    LONGLONG    end;
+    ULONG       first, last;
+    KIRQL       irql;
+
+    zero_fill = &DeviceExtension->ZeroFill;
+
+    if (!zero_fill->Bitmap.Buffer || Offset >= zero_fill->Length || !Length)
+    {
+        return;
+    }
+
+    end = min(Offset + Length, zero_fill->Length);
+
+    first = (ULONG) (Offset / zero_fill->SectorSize);
+    last = (ULONG) ((end - 1) / zero_fill->SectorSize);
+
+    KeAcquireSpinLock(&zero_fill->Lock, &irql);
+
+    RtlClearBits(&zero_fill->Bitmap, first, last - first + 1);
+
+    KeReleaseSpinLock(&zero_fill->Lock, irql);
+}
+
+VOID
+ZeroFillUpdate (
+    IN PDEVICE_EXTENSION    DeviceExtension,
+    IN PIRP                 Irp
+    )
+{
+    PZERO_FILL          zero_fill;
+    PIO_STACK_LOCATION  io_stack;
+    LONGLONG            offset;
+    LONGLONG            end;
+    ULONG               sector;
+    PUCHAR              buffer;
+    KIRQL               irql;
+
+    zero_fill = &DeviceExtension->ZeroFill;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart;
+
+    if (!NT_SUCCESS(Irp->IoStatus.Status))
+    {
+        return;
+    }
+
+    if (io_stack->MajorFunction == IRP_MJ_WRITE)
+    {
+        ZeroFillMarkWritten(DeviceExtension, offset, io_stack->Parameters.Write.Length);
+        return;
+    }
+
+    if (offset >= zero_fill->Length)
+    {
+        return;
+    }
+
+    /* the read went to the device, replace sectors not yet written with zeros */
+
+    buffer = (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+
+    if (!buffer)
+    {
+        Irp->IoStatus.Status = STATUS_INSUFFICIENT_RESOURCES;
+        Irp->IoStatus.Information = 0;
+        return;
+    }
+
+    end = min(offset + io_stack->Parameters.Read.Length, zero_fill->Length);
+
+    KeAcquireSpinLock(&zero_fill->Lock, &irql);
+
+    for (sector = (ULONG) (offset / zero_fill->SectorSize);
+         (LONGLONG) sector * zero_fill->SectorSize < end;
+         sector++
+        )
+    {
+        if (RtlCheckBit(&zero_fill->Bitmap, sector))
+        {
+            RtlZeroMemory(
+                buffer + ((LONGLONG) sector * zero_fill->SectorSize - offset),
+                zero_fill->SectorSize
+                );
+        }
+    }
+
+    KeReleaseSpinLock(&zero_fill->Lock, irql);
+}
+
+NTSTATUS
+ZeroFillCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    ZeroFillUpdate((PDEVICE_EXTENSION) Context, Irp);
+
+    if (Irp->PendingReturned)
+    {
+        IoMarkIrpPending(Irp);
+    }
+
+    return STATUS_CONTINUE_COMPLETION;
+}
+
+NTSTATUS
+ZeroFillReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PDEVICE_EXTENSION   device_extension;
+    PZERO_FILL          zero_fill;
+    PIO_STACK_LOCATION  io_stack;
+    PIO_STACK_LOCATION  next_io_stack;
+    LONGLONG            offset;
+    ULONG               length;
+    ULONG               first, last;
+    BOOLEAN             all_zero, any_zero;
+    PUCHAR              buffer;
+    NTSTATUS            status;
+    KIRQL               irql;
+
+    device_extension = (PDEVICE_EXTENSION) DeviceObject->DeviceExtension;
+
+    zero_fill = &device_extension->ZeroFill;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart;
+    length = io_stack->Parameters.Read.Length;
+
+    ASSERT(offset < zero_fill->Length && length != 0);
+
+    first = (ULONG) (offset / zero_fill->SectorSize);
+    last = (ULONG) ((min(offset + length, zero_fill->Length) - 1) / zero_fill->SectorSize);
+
+    KeAcquireSpinLock(&zero_fill->Lock, &irql);
+
+    all_zero = offset + length <= zero_fill->Length &&
+        RtlAreBitsSet(&zero_fill->Bitmap, first, last - first + 1);
+
+    any_zero = !RtlAreBitsClear(&zero_fill->Bitmap, first, last - first + 1);
+
+    KeReleaseSpinLock(&zero_fill->Lock, irql);
+
+    /* a read of sectors that all are zero can be completed without going to the device */
+
+    if (io_stack->MajorFunction == IRP_MJ_READ && all_zero)
+    {
+        buffer = (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+
+        if (buffer)
+        {
+            RtlZeroMemory(buffer, length);
+            status = STATUS_SUCCESS;
+        }
+        else
+        {
+            length = 0;
+            status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = length;
+
+        IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+
+        return status;
+    }
+
+    IoCopyCurrentIrpStackLocationToNext(Irp);
+
+    next_io_stack = IoGetNextIrpStackLocation(Irp);
+
+    next_io_stack->Parameters.Read.ByteOffset.QuadPart += sizeof(union swap_header);
+
+    if (any_zero)
+    {
+        IoSetCompletionRoutine(
+            Irp,
+            ZeroFillCompletion,
+            device_extension,
+            TRUE,
+            FALSE,
+            FALSE
+            );
+    }
+
+    return StripeCallDriver(device_extension, Irp);
+}
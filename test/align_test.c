@@ -0,0 +1,247 @@
+/*
+    Tests of the alignment of the FAT32 layout to the physical sectors.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The FAT32 formatter pads the reserved sectors and the FATs so the FATs
+    and the data region start on the physical sectors, the erase blocks
+    or the stripes of the device. The tests format partitions with 512
+    and 4096 byte sectors, at sector 63 and at 1 MB, on devices that
+    report 4 KB physical sectors, 64 KB or 1 MB unmap granularity, and
+    check where the volume the checker finds puts them on the disk. A
+    striped volume with the largest stripes puts them on the stripes,
+    with the reserved sectors still counted in a WORD. A partition of
+    16 GB must get a FAT with room for the two entries before the first
+    cluster, the size where the estimate of fat32format came out short.
+*/
+
+#include <stdlib.h>
+#include <ntstrsafe.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swap.h"
+
+#define TEST_DISK_LENGTH    (512 * 1024 * 1024)
+
+typedef struct _TEST_CASE {
+    ULONG       SectorSize;
+    ULONG       PhysicalSectorSize;
+    ULONG       PhysicalSectorOffset;
+    ULONG       UnmapGranularity;
+    ULONG       StartingSector;
+} TEST_CASE;
+
+static const TEST_CASE test_cases[] = {
+    {  512, 4096,    0,           0,   63 },
+    {  512, 4096, 3584,           0,   63 },
+    {  512, 4096,    0,  64 * 1024,    63 },
+    {  512, 4096,    0, 1024 * 1024,   63 },
+    {  512, 4096,    0,           0, 2048 },
+    {  512,  512,    0, 1024 * 1024, 2048 },
+    { 4096, 4096,    0,  64 * 1024,    63 },
+    { 4096, 4096,    0, 1024 * 1024,  256 },
+};
+
+static ULONG test_number;
+
+static PTEST_DISK
+test_format (
+    IN const TEST_CASE  *Case,
+    IN LONGLONG         Length,
+    OUT PFATCHECK       Check
+    )
+{
+    PTEST_DISK      disk;
+    PDEVICE_OBJECT  device_object;
+    WCHAR           name[64];
+    NTSTATUS        status;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk3\\Partition%u", ++test_number);
+
+    disk = TestDiskCreate(name, Length, Case->SectorSize, NULL);
+
+    disk->StartingOffset = (LONGLONG) Case->StartingSector * Case->SectorSize;
+    disk->PhysicalSectorSize = Case->PhysicalSectorSize;
+    disk->PhysicalSectorOffset = Case->PhysicalSectorOffset;
+    disk->UnmapGranularity = Case->UnmapGranularity;
+
+    TestDiskSetSwapHeader(disk);
+
+    WdkClearRegistry();
+
+    device_object = TestLoadDriver(disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    if (!device_object || !FatCheckVolume(TestReadVolume, device_object, Length - sizeof(union swap_header), Check))
+    {
+        fprintf(stderr, "fatcheck: %s\n", device_object ? Check->Error : "not loaded");
+        CHECK(FALSE);
+        return NULL;
+    }
+
+    CHECK(Check->FileSystem == FATCHECK_FAT32);
+
+    return disk;
+}
+
+/* the offset from the first physical sector on the disk */
+
+static ULONG
+test_misalignment (
+    IN PTEST_DISK   Disk,
+    IN ULONG        Alignment,
+    IN ULONGLONG    Offset
+    )
+{
+    return (ULONG) ((Disk->StartingOffset + sizeof(union swap_header) + Offset +
+        Alignment - Disk->PhysicalSectorOffset) % Alignment);
+}
+
+static void
+test_aligned (void)
+{
+    PTEST_DISK  disk;
+    FATCHECK    check;
+    ULONG       alignment;
+    ULONG       n;
+
+    for (n = 0; n < RTL_NUMBER_OF(test_cases); n++)
+    {
+        disk = test_format(&test_cases[n], TEST_DISK_LENGTH, &check);
+
+        if (!disk)
+        {
+            continue;
+        }
+
+        alignment = max(test_cases[n].PhysicalSectorSize, test_cases[n].UnmapGranularity);
+
+        CHECK(test_misalignment(disk, alignment, check.FatOffset) == 0);
+        CHECK(test_misalignment(disk, alignment, check.FatOffset + (ULONGLONG) check.FatSectors * check.SectorSize) == 0);
+        CHECK(test_misalignment(disk, alignment, check.DataOffset) == 0);
+
+        printf("    %4u/%4u at %4u, %7u aligned: %5u reserved sectors, FAT of %4u sectors, data at %8llu\n",
+            test_cases[n].SectorSize, test_cases[n].PhysicalSectorSize, test_cases[n].StartingSector,
+            alignment, check.ReservedSectors, check.FatSectors, check.DataOffset);
+    }
+}
+
+/* the members of a striped volume with the largest stripes, the FATs and the data region start on a stripe */
+
+static void
+test_striped (void)
+{
+    PTEST_DISK          disk[3];
+    PDEVICE_OBJECT      device_object;
+    PDEVICE_EXTENSION   device_extension;
+    FATCHECK            check;
+    WCHAR               name[64];
+    char                value[64];
+    char                member[16];
+    NTSTATUS            status;
+    ULONG               stripe;
+    ULONG               n;
+
+    WdkClearRegistry();
+
+    for (n = 0; n < RTL_NUMBER_OF(disk); n++)
+    {
+        RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk3\\Partition%u", ++test_number);
+
+        disk[n] = TestDiskCreate(name, TEST_DISK_LENGTH, 512, NULL);
+
+        TestDiskSetSwapHeader(disk[n]);
+
+        if (n)
+        {
+            snprintf(value, sizeof(value), "\\Device\\Harddisk3\\Partition%u", test_number);
+            snprintf(member, sizeof(member), "SwapDevice%u", n);
+            WdkSetRegistryString(TEST_PARAMETERS_KEY, member, value);
+        }
+    }
+
+    TestSetParameter("StripeSize", STRIPE_MAXIMUM_SIZE);
+
+    device_object = TestLoadDriver(disk[0], &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    if (!device_object)
+    {
+        return;
+    }
+
+    device_extension = (PDEVICE_EXTENSION) device_object->DeviceExtension;
+
+    stripe = device_extension->Stripe.StripeSize;
+
+    if (!FatCheckVolume(TestReadVolume, device_object, device_extension->Stripe.Length, &check))
+    {
+        fprintf(stderr, "fatcheck: %s\n", check.Error);
+        CHECK(FALSE);
+        return;
+    }
+
+    CHECK(check.FileSystem == FATCHECK_FAT32);
+    CHECK(check.ReservedSectors <= 0xFFFF);
+    CHECK(check.FatOffset % stripe == 0);
+    CHECK((check.FatOffset + (ULONGLONG) check.FatSectors * check.SectorSize) % stripe == 0);
+    CHECK(check.DataOffset % stripe == 0);
+
+    printf("    %u KB stripes: %5u reserved sectors, FAT of %4u sectors, data at %8llu\n",
+        stripe / 1024, check.ReservedSectors, check.FatSectors, check.DataOffset);
+}
+
+static void
+test_unaligned_as_before (void)
+{
+    static const TEST_CASE unaligned = { 512, 512, 0, 0, 63 };
+    FATCHECK check;
+
+    /* without a physical sector larger than the logical one the layout is as before */
+
+    if (test_format(&unaligned, TEST_DISK_LENGTH, &check))
+    {
+        CHECK(check.ReservedSectors == 32);
+    }
+}
+
+static void
+test_fat_size (void)
+{
+    static const TEST_CASE unaligned = { 512, 512, 0, 0, 63 };
+    FATCHECK check;
+
+    /* the checker fails a FAT too small for the clusters and the two entries before them */
+
+    if (test_format(&unaligned, 16384LL * 1024 * 1024, &check))
+    {
+        CHECK((ULONGLONG) (check.NumberOfClusters + 2) * 4 <= (ULONGLONG) check.FatSectors * check.SectorSize);
+    }
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_aligned);
+    TEST_RUN(test_striped);
+    TEST_RUN(test_unaligned_as_before);
+    TEST_RUN(test_fat_size);
+
+    return TestFailures != 0;
+}
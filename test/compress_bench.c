@@ -0,0 +1,321 @@
+/*
+    A benchmark of the codec of the compressed volume.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Compresses samples in units of 64 KB with LZNT1 as the driver stores
+    them on a compressed volume and reports the throughput of the
+    compression and the decompression, the ratio of the codec and the
+    ratio when each unit is stored in whole blocks of 4 KB, which is what
+    CompressionRatio should be set from. The samples are lines of a log,
+    the sources of the driver, this program as a build object, random
+    data and zeros, or the files given. LZNT1 is the one of the harness,
+    which writes the format of the kernel's standard engine, so the ratio
+    is that of the driver while the throughput only tells the samples and
+    the changes of the harness apart.
+
+        compress_bench [-r MB] [file...]
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <glob.h>
+#include <unistd.h>
+#include <ntifs.h>
+#include "test.h"
+#include "swapfs.h"
+
+static ULONG bench_megabytes = 64;
+
+typedef struct _BENCH_SAMPLE {
+    const char  *Name;
+    PUCHAR      Data;
+    ULONG       Length;
+} BENCH_SAMPLE;
+
+static BOOLEAN
+bench_read_file (
+    IN const char   *Path,
+    IN OUT PUCHAR   *Data,
+    IN OUT ULONG    *Length
+    )
+{
+    FILE    *file;
+    long    size;
+    PUCHAR  data;
+
+    file = fopen(Path, "rb");
+
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    rewind(file);
+
+    data = (PUCHAR) realloc(*Data, *Length + size);
+
+    if (data && fread(data + *Length, 1, size, file) == (size_t) size)
+    {
+        *Data = data;
+        *Length += size;
+    }
+
+    fclose(file);
+
+    return data != NULL;
+}
+
+/* a sample is made whole units by repeating it */
+
+static void
+bench_units (
+    IN OUT BENCH_SAMPLE *Sample
+    )
+{
+    ULONG length;
+
+    length = (Sample->Length + COMPRESS_UNIT_SIZE - 1) / COMPRESS_UNIT_SIZE * COMPRESS_UNIT_SIZE;
+
+    Sample->Data = (PUCHAR) realloc(Sample->Data, length);
+
+    for (; Sample->Length < length; Sample->Length++)
+    {
+        Sample->Data[Sample->Length] = Sample->Data[Sample->Length % max(Sample->Length, 1)];
+    }
+}
+
+static void
+bench_sample (
+    IN BENCH_SAMPLE *Sample
+    )
+{
+    static UCHAR    compressed[COMPRESS_UNIT_SIZE];
+    static UCHAR    unit[COMPRESS_UNIT_SIZE];
+    PVOID           workspace;
+    ULONG           workspace_size, fragment_size;
+    ULONGLONG       bytes, compressed_bytes, stored_bytes;
+    LONGLONG        compress_time, decompress_time, time;
+    ULONG           size, nblock, offset, round, rounds;
+    NTSTATUS        status;
+
+    RtlGetCompressionWorkSpaceSize(COMPRESS_FORMAT, &workspace_size, &fragment_size);
+
+    workspace = malloc(workspace_size);
+
+    rounds = max(1, (ULONG) (((ULONGLONG) bench_megabytes << 20) / Sample->Length));
+
+    bytes = compressed_bytes = stored_bytes = 0;
+    compress_time = decompress_time = 0;
+
+    for (round = 0; round < rounds; round++)
+    {
+        for (offset = 0; offset < Sample->Length; offset += COMPRESS_UNIT_SIZE)
+        {
+            time = TestTime();
+
+            status = RtlCompressBuffer(COMPRESS_FORMAT, Sample->Data + offset, COMPRESS_UNIT_SIZE,
+                compressed, sizeof(compressed), COMPRESS_CHUNK_SIZE, &size, workspace);
+
+            compress_time += TestTime() - time;
+
+            bytes += COMPRESS_UNIT_SIZE;
+
+            /* as compress_store stores a unit */
+
+            if (status == STATUS_BUFFER_ALL_ZEROS)
+            {
+                continue;
+            }
+
+            nblock = (size + COMPRESS_BLOCK_SIZE - 1) / COMPRESS_BLOCK_SIZE;
+
+            if (!NT_SUCCESS(status) || nblock >= COMPRESS_UNIT_SIZE / COMPRESS_BLOCK_SIZE)
+            {
+                compressed_bytes += COMPRESS_UNIT_SIZE;
+                stored_bytes += COMPRESS_UNIT_SIZE;
+                continue;
+            }
+
+            compressed_bytes += size;
+            stored_bytes += nblock * COMPRESS_BLOCK_SIZE;
+
+            time = TestTime();
+
+            status = RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1, unit, sizeof(unit), compressed, size, &size);
+
+            decompress_time += TestTime() - time;
+
+            if (!NT_SUCCESS(status) || memcmp(unit, Sample->Data + offset, size))
+            {
+                fprintf(stderr, "%s: the unit at %u is not decompressed as it was\n", Sample->Name, offset);
+                exit(1);
+            }
+        }
+    }
+
+    printf("%-10s %8.1f %12.1f", Sample->Name, bytes / 1048576.0, bytes / 1048576.0 / (compress_time / 1e9));
+
+    /* units stored as they are aren't decompressed and units of zeros aren't stored */
+
+    if (decompress_time)
+    {
+        printf(" %12.1f", bytes / 1048576.0 / (decompress_time / 1e9));
+    }
+    else
+    {
+        printf(" %12s", "-");
+    }
+
+    if (stored_bytes)
+    {
+        printf(" %8.2f %8.2f\n", (double) bytes / compressed_bytes, (double) bytes / stored_bytes);
+    }
+    else
+    {
+        printf(" %8s %8s\n", "-", "-");
+    }
+
+    free(workspace);
+}
+
+int
+main (
+    int     argc,
+    char    **argv
+    )
+{
+    BENCH_SAMPLE    sample;
+    glob_t          sources;
+    unsigned int    seed;
+    ULONG           n, line;
+    int             c;
+
+    while ((c = getopt(argc, argv, "r:")) != -1)
+    {
+        switch (c)
+        {
+        case 'r':
+            bench_megabytes = (ULONG) strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: compress_bench [-r MB] [file...]\n");
+            return 2;
+        }
+    }
+
+    printf("sample           MB compress MB/s decompr MB/s    ratio   stored\n");
+
+    if (optind < argc)
+    {
+        for (; optind < argc; optind++)
+        {
+            RtlZeroMemory(&sample, sizeof(sample));
+
+            sample.Name = strrchr(argv[optind], '/') ? strrchr(argv[optind], '/') + 1 : argv[optind];
+
+            if (!bench_read_file(argv[optind], &sample.Data, &sample.Length) || !sample.Length)
+            {
+                perror(argv[optind]);
+                return 1;
+            }
+
+            bench_units(&sample);
+            bench_sample(&sample);
+            free(sample.Data);
+        }
+
+        return 0;
+    }
+
+    /* lines of a log */
+
+    sample.Name = "log";
+    sample.Length = 4 * 1024 * 1024;
+    sample.Data = (PUCHAR) malloc(sample.Length);
+
+    for (n = 0, line = 0; n < sample.Length; line++)
+    {
+        n += snprintf((char *) sample.Data + n, sample.Length - n,
+            "2026-10-17 12:%02u:%02u.%03u worker %u: request %u done in %u us, status %s\n",
+            line / 60 % 60, line % 60, line * 7 % 1000, line % 16, line * 31, line * 13 % 5000,
+            line % 5 ? "ok" : "retry");
+        n = min(n, sample.Length);
+    }
+
+    bench_sample(&sample);
+    free(sample.Data);
+
+    /* the sources of the driver */
+
+    RtlZeroMemory(&sample, sizeof(sample));
+    sample.Name = "source";
+
+    if (glob("../sys/src/*.c", 0, NULL, &sources) == 0)
+    {
+        for (n = 0; n < sources.gl_pathc; n++)
+        {
+            bench_read_file(sources.gl_pathv[n], &sample.Data, &sample.Length);
+        }
+
+        globfree(&sources);
+    }
+
+    if (sample.Length)
+    {
+        bench_units(&sample);
+        bench_sample(&sample);
+    }
+
+    free(sample.Data);
+
+    /* a build object */
+
+    RtlZeroMemory(&sample, sizeof(sample));
+    sample.Name = "object";
+
+    if (bench_read_file("/proc/self/exe", &sample.Data, &sample.Length) && sample.Length)
+    {
+        bench_units(&sample);
+        bench_sample(&sample);
+    }
+
+    free(sample.Data);
+
+    /* random data is stored as it is and zeros are not stored */
+
+    sample.Name = "random";
+    sample.Length = 4 * 1024 * 1024;
+    sample.Data = (PUCHAR) malloc(sample.Length);
+
+    for (seed = 1, n = 0; n < sample.Length; n++)
+    {
+        sample.Data[n] = (UCHAR) rand_r(&seed);
+    }
+
+    bench_sample(&sample);
+
+    sample.Name = "zeros";
+    RtlZeroMemory(sample.Data, sample.Length);
+
+    bench_sample(&sample);
+    free(sample.Data);
+
+    return 0;
+}
@@ -0,0 +1,499 @@
+/*
+    Tests of the compression of the data region of the volume.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With CompressionRatio the volume is reported larger than the swap
+    partition and the units of 64 KB of its data region are stored
+    compressed in blocks of 4 KB through a map in memory. The tests check
+    the length that is reported and the volume formatted to it, units of
+    text that are read back as written in fewer blocks, a write of part
+    of a unit, a unit of zeros that frees its blocks, a full device that
+    fails a write with the unit kept as it was, a TRIM and a verify of
+    ranges of the volume that are refused, and threads that write parts
+    of the same units at once.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ntstrsafe.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swap.h"
+
+#define TEST_DISK_LENGTH    (32 * 1024 * 1024)
+#define TEST_RATIO          200
+#define TEST_THREADS        4
+
+static ULONG test_number;
+
+static PDEVICE_OBJECT
+test_load (
+    IN ULONG        DiskLength,
+    IN ULONG        Ratio,
+    OUT PTEST_DISK  *Disk
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    WCHAR           name[64];
+    NTSTATUS        status;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk10\\Partition%u", ++test_number);
+
+    *Disk = TestDiskCreate(name, DiskLength, 512, NULL);
+
+    TestDiskSetSwapHeader(*Disk);
+
+    WdkClearRegistry();
+
+    TestSetParameter("CompressionRatio", Ratio);
+
+    device_object = TestLoadDriver(*Disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    return device_object;
+}
+
+static PCOMPRESS
+test_compress (
+    IN PDEVICE_OBJECT DeviceObject
+    )
+{
+    return &((PDEVICE_EXTENSION) DeviceObject->DeviceExtension)->Compress;
+}
+
+/* lines of a log, as the data that is compressed 2 to 4 times */
+
+static void
+test_text (
+    OUT PUCHAR  Buffer,
+    IN ULONG    Length,
+    IN ULONG    Seed
+    )
+{
+    ULONG n, line;
+
+    for (n = 0, line = Seed; n < Length; line++)
+    {
+        n += snprintf((char *) Buffer + n, Length - n,
+            "2026-10-17 12:%02u:%02u.%03u worker %u: request %u done in %u us, status %s\n",
+            line / 60 % 60, line % 60, line * 7 % 1000, line % 16, line * 31, line * 13 % 5000,
+            line % 5 ? "ok" : "retry");
+
+        n = min(n, Length);
+    }
+}
+
+static void
+test_random (
+    OUT PUCHAR  Buffer,
+    IN ULONG    Length,
+    IN ULONG    Seed
+    )
+{
+    unsigned int    seed = Seed;
+    ULONG           n;
+
+    for (n = 0; n < Length; n++)
+    {
+        Buffer[n] = (UCHAR) rand_r(&seed);
+    }
+}
+
+static void
+test_volume (void)
+{
+    PDEVICE_OBJECT          device_object;
+    PTEST_DISK              disk;
+    PCOMPRESS               compress;
+    GET_LENGTH_INFORMATION  length;
+    ULONG_PTR               information;
+    FATCHECK                check;
+
+    device_object = test_load(TEST_DISK_LENGTH, TEST_RATIO, &disk);
+
+    compress = test_compress(device_object);
+
+    CHECK(compress->Length == (TEST_DISK_LENGTH - (LONGLONG) sizeof(union swap_header)) / 100 * TEST_RATIO /
+        COMPRESS_UNIT_SIZE * COMPRESS_UNIT_SIZE);
+
+    /* the metadata is stored as it is, up to a unit */
+
+    CHECK(compress->Identity > 0 && compress->Identity % COMPRESS_UNIT_SIZE == 0);
+
+    CHECK_STATUS(TestDeviceControl(device_object, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &length, sizeof(length),
+        &information), STATUS_SUCCESS);
+
+    CHECK(length.Length.QuadPart == compress->Length);
+
+    RtlZeroMemory(&check, sizeof(check));
+
+    CHECK(FatCheckVolume(TestReadVolume, device_object, compress->Length, &check));
+
+    if (check.Error[0])
+    {
+        printf("    %s\n", check.Error);
+    }
+
+    CHECK((LONGLONG) check.DataOffset + (LONGLONG) check.NumberOfClusters * check.ClusterSize > TEST_DISK_LENGTH);
+}
+
+static void
+test_round_trip (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PCOMPRESS       compress;
+    PUCHAR          written, read;
+    ULONG           length;
+    ULONG           n;
+
+    device_object = test_load(TEST_DISK_LENGTH, TEST_RATIO, &disk);
+
+    compress = test_compress(device_object);
+
+    length = 16 * COMPRESS_UNIT_SIZE;
+
+    written = (PUCHAR) malloc(length);
+    read = (PUCHAR) malloc(length);
+
+    test_text(written, length, 1);
+
+    TestDiskResetCounts(disk);
+
+    /* a write of 16 units and writes of one unit that is not aligned to the units */
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, compress->Identity, length, written), STATUS_SUCCESS);
+
+    for (n = 0; n < 4; n++)
+    {
+        CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE,
+            compress->Identity + length + n * COMPRESS_UNIT_SIZE + 4096, COMPRESS_UNIT_SIZE, written), STATUS_SUCCESS);
+    }
+
+    printf("    %u bytes of text in %lld bytes on the disk\n", length + 4 * COMPRESS_UNIT_SIZE, disk->BytesWritten);
+
+    CHECK(disk->BytesWritten * 2 < length);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, compress->Identity, length, read), STATUS_SUCCESS);
+    CHECK(memcmp(written, read, length) == 0);
+
+    for (n = 0; n < 4; n++)
+    {
+        RtlFillMemory(read, COMPRESS_UNIT_SIZE, 0xcc);
+        CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ,
+            compress->Identity + length + n * COMPRESS_UNIT_SIZE + 4096, COMPRESS_UNIT_SIZE, read), STATUS_SUCCESS);
+        CHECK(memcmp(written, read, COMPRESS_UNIT_SIZE) == 0);
+    }
+
+    /* beyond the partition, which a volume that isn't compressed doesn't have */
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, compress->Length - COMPRESS_UNIT_SIZE, COMPRESS_UNIT_SIZE,
+        written), STATUS_SUCCESS);
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, compress->Length - COMPRESS_UNIT_SIZE, COMPRESS_UNIT_SIZE,
+        read), STATUS_SUCCESS);
+    CHECK(memcmp(written, read, COMPRESS_UNIT_SIZE) == 0);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, compress->Length, 4096, read), STATUS_INVALID_PARAMETER);
+
+    free(written);
+    free(read);
+}
+
+static void
+test_partial_write (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PCOMPRESS       compress;
+    UCHAR           expected[COMPRESS_UNIT_SIZE];
+    UCHAR           read[COMPRESS_UNIT_SIZE];
+    UCHAR           part[4096];
+
+    device_object = test_load(TEST_DISK_LENGTH, TEST_RATIO, &disk);
+
+    compress = test_compress(device_object);
+
+    test_text(expected, sizeof(expected), 100);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, compress->Identity, sizeof(expected), expected);
+
+    /* the rest of the unit is read and stored again with the part */
+
+    test_random(part, sizeof(part), 7);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, compress->Identity + 3 * 4096 + 512, sizeof(part), part),
+        STATUS_SUCCESS);
+
+    RtlCopyMemory(expected + 3 * 4096 + 512, part, sizeof(part));
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, compress->Identity, sizeof(read), read), STATUS_SUCCESS);
+    CHECK(memcmp(expected, read, sizeof(read)) == 0);
+
+    /* a unit never written is read as zeros */
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, compress->Identity + 8 * COMPRESS_UNIT_SIZE, 4096, read),
+        STATUS_SUCCESS);
+    CHECK(read[0] == 0 && memcmp(read, read + 1, 4095) == 0);
+}
+
+static void
+test_zero_unit (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PCOMPRESS       compress;
+    UCHAR           data[COMPRESS_UNIT_SIZE];
+    ULONG           used_blocks;
+
+    device_object = test_load(TEST_DISK_LENGTH, TEST_RATIO, &disk);
+
+    compress = test_compress(device_object);
+
+    used_blocks = RtlNumberOfSetBits(&compress->Blocks);
+
+    test_random(data, sizeof(data), 3);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, compress->Identity, sizeof(data), data);
+
+    /* random data doesn't get smaller and takes all the blocks of the unit */
+
+    CHECK(RtlNumberOfSetBits(&compress->Blocks) == used_blocks + COMPRESS_UNIT_SIZE / COMPRESS_BLOCK_SIZE);
+
+    RtlZeroMemory(data, sizeof(data));
+
+    TestDiskResetCounts(disk);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, compress->Identity, sizeof(data), data), STATUS_SUCCESS);
+
+    CHECK(disk->Writes == 0);
+    CHECK(RtlNumberOfSetBits(&compress->Blocks) == used_blocks);
+
+    RtlFillMemory(data, sizeof(data), 0xcc);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, compress->Identity, sizeof(data), data), STATUS_SUCCESS);
+    CHECK(data[0] == 0 && memcmp(data, data + 1, sizeof(data) - 1) == 0);
+}
+
+static void
+test_disk_full (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PCOMPRESS       compress;
+    UCHAR           first[COMPRESS_UNIT_SIZE];
+    UCHAR           data[COMPRESS_UNIT_SIZE];
+    LONGLONG        offset;
+    NTSTATUS        status;
+    ULONG           n;
+
+    /* random data on a volume reported 4 times larger fills the device */
+
+    device_object = test_load(8 * 1024 * 1024, 400, &disk);
+
+    compress = test_compress(device_object);
+
+    test_random(first, sizeof(first), 1);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, compress->Identity, sizeof(first), first), STATUS_SUCCESS);
+
+    status = STATUS_SUCCESS;
+
+    for (n = 1, offset = compress->Identity + COMPRESS_UNIT_SIZE; offset < compress->Length; n++, offset += COMPRESS_UNIT_SIZE)
+    {
+        test_random(data, sizeof(data), n + 1);
+
+        status = TestReadWrite(device_object, IRP_MJ_WRITE, offset, sizeof(data), data);
+
+        if (status != STATUS_SUCCESS)
+        {
+            break;
+        }
+    }
+
+    CHECK_STATUS(status, STATUS_DISK_FULL);
+    CHECK(compress->Blocks.SizeOfBitMap - RtlNumberOfSetBits(&compress->Blocks) < COMPRESS_UNIT_SIZE / COMPRESS_BLOCK_SIZE);
+
+    /* a unit written again on the full device fails and keeps what it had */
+
+    test_random(data, sizeof(data), 1000);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, compress->Identity, sizeof(data), data), STATUS_DISK_FULL);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, compress->Identity, sizeof(data), data), STATUS_SUCCESS);
+    CHECK(memcmp(first, data, sizeof(data)) == 0);
+
+    /* text takes fewer blocks than the random data it replaces */
+
+    test_text(data, sizeof(data), 5);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, compress->Identity, sizeof(data), data), STATUS_SUCCESS);
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, compress->Identity, sizeof(first), first), STATUS_SUCCESS);
+    CHECK(memcmp(first, data, sizeof(data)) == 0);
+}
+
+/* a TRIM or a verify of the ranges of the volume would reach the blocks of other units */
+
+static void
+test_ranges (void)
+{
+    PDEVICE_OBJECT      device_object;
+    PTEST_DISK          disk;
+    PCOMPRESS           compress;
+    UCHAR               data[COMPRESS_UNIT_SIZE];
+    UCHAR               read[COMPRESS_UNIT_SIZE];
+    ULONG_PTR           information;
+    VERIFY_INFORMATION  verify;
+    struct {
+        DEVICE_MANAGE_DATA_SET_ATTRIBUTES   Attributes;
+        DEVICE_DATA_SET_RANGE               Range;
+    } trim;
+
+    device_object = test_load(TEST_DISK_LENGTH, TEST_RATIO, &disk);
+
+    compress = test_compress(device_object);
+
+    test_text(data, sizeof(data), 6);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, compress->Identity + 4 * COMPRESS_UNIT_SIZE, sizeof(data), data);
+
+    disk->Trim = TRUE;
+
+    TestDiskResetCounts(disk);
+
+    RtlZeroMemory(&trim, sizeof(trim));
+    trim.Attributes.Size = sizeof(trim.Attributes);
+    trim.Attributes.Action = DeviceDsmAction_Trim;
+    trim.Attributes.DataSetRangesOffset = sizeof(trim.Attributes);
+    trim.Attributes.DataSetRangesLength = sizeof(trim.Range);
+    trim.Range.StartingOffset = compress->Identity + sizeof(union swap_header);
+    trim.Range.LengthInBytes = 4 * COMPRESS_UNIT_SIZE;
+
+    CHECK_STATUS(TestDeviceControl(device_object, IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES, &trim, sizeof(trim),
+        NULL, 0, &information), STATUS_INVALID_DEVICE_REQUEST);
+
+    verify.StartingOffset.QuadPart = trim.Range.StartingOffset;
+    verify.Length = 4 * COMPRESS_UNIT_SIZE;
+
+    CHECK_STATUS(TestDeviceControl(device_object, IOCTL_DISK_VERIFY, &verify, sizeof(verify),
+        NULL, 0, &information), STATUS_INVALID_DEVICE_REQUEST);
+
+    CHECK(disk->Trims == 0);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, compress->Identity + 4 * COMPRESS_UNIT_SIZE, sizeof(read), read), STATUS_SUCCESS);
+    CHECK(memcmp(read, data, sizeof(data)) == 0);
+}
+
+/* each thread writes its own 4 KB of the same units, a merge must not lose those of the others */
+
+typedef struct _TEST_WRITER {
+    pthread_t       Thread;
+    PDEVICE_OBJECT  DeviceObject;
+    ULONG           Index;
+} TEST_WRITER;
+
+#define TEST_UNITS  32
+
+static void *
+test_writer (
+    void *Context
+    )
+{
+    TEST_WRITER *writer = (TEST_WRITER *) Context;
+    PCOMPRESS   compress;
+    UCHAR       data[4096];
+    ULONG       round, unit;
+
+    compress = test_compress(writer->DeviceObject);
+
+    for (round = 0; round < 8; round++)
+    {
+        for (unit = 0; unit < TEST_UNITS; unit++)
+        {
+            test_text(data, sizeof(data), (writer->Index * 1000 + unit) * 16 + round);
+
+            TestReadWrite(writer->DeviceObject, IRP_MJ_WRITE,
+                compress->Identity + (LONGLONG) unit * COMPRESS_UNIT_SIZE + writer->Index * 4096, sizeof(data), data);
+        }
+    }
+
+    return NULL;
+}
+
+static void
+test_threads (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PCOMPRESS       compress;
+    TEST_WRITER     writer[TEST_THREADS];
+    UCHAR           expected[4096];
+    UCHAR           read[4096];
+    ULONG           unit, n;
+    ULONG           differ;
+
+    device_object = test_load(TEST_DISK_LENGTH, TEST_RATIO, &disk);
+
+    compress = test_compress(device_object);
+
+    TestDiskStartThreads(disk, TEST_THREADS);
+
+    for (n = 0; n < TEST_THREADS; n++)
+    {
+        writer[n].DeviceObject = device_object;
+        writer[n].Index = n;
+        pthread_create(&writer[n].Thread, NULL, test_writer, &writer[n]);
+    }
+
+    for (n = 0; n < TEST_THREADS; n++)
+    {
+        pthread_join(writer[n].Thread, NULL);
+    }
+
+    for (differ = 0, unit = 0; unit < TEST_UNITS; unit++)
+    {
+        for (n = 0; n < TEST_THREADS; n++)
+        {
+            test_text(expected, sizeof(expected), (n * 1000 + unit) * 16 + 7);
+
+            TestReadWrite(device_object, IRP_MJ_READ, compress->Identity + (LONGLONG) unit * COMPRESS_UNIT_SIZE + n * 4096,
+                sizeof(read), read);
+
+            if (memcmp(expected, read, sizeof(read)))
+            {
+                differ++;
+            }
+        }
+    }
+
+    CHECK(differ == 0);
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_volume);
+    TEST_RUN(test_round_trip);
+    TEST_RUN(test_partial_write);
+    TEST_RUN(test_zero_unit);
+    TEST_RUN(test_disk_full);
+    TEST_RUN(test_ranges);
+    TEST_RUN(test_threads);
+
+    return TestFailures != 0;
+}
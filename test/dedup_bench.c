@@ -0,0 +1,392 @@
+/*
+    Benchmark of the hash and the ratio of the deduplication.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Reports the throughput of the hash the driver takes of each block
+    written with DedupIndexSize, and for each sample the ratio of the
+    blocks written to the blocks stored, the collisions of the hash and
+    the throughput of the writes through the driver with and without the
+    deduplication, to a disk in memory. The samples are zeros, random
+    data, pages drawn from a pool of a quarter as many as a swap of
+    processes that share pages, the sources of the driver and this
+    program as a build object, or the files given.
+
+        dedup_bench [-r MB] [-i KB] [file...]
+*/
+
+#include "../sys/src/dedup.c"
+
+#include <stdlib.h>
+#include <string.h>
+#include <glob.h>
+#include <unistd.h>
+#include <ntstrsafe.h>
+#include "test.h"
+
+#define BENCH_WRITE     0x10000
+#define BENCH_METADATA  (16 * 1024 * 1024)
+
+static ULONG bench_megabytes = 64;
+
+static ULONG bench_index_size = 1024;
+
+static ULONG bench_number;
+
+typedef struct _BENCH_SAMPLE {
+    const char  *Name;
+    PUCHAR      Data;
+    ULONG       Length;
+} BENCH_SAMPLE;
+
+/* the bytes of rand_r repeat every 16 MB, which would be deduplicated */
+
+static void
+bench_random (
+    OUT PUCHAR  Data,
+    IN ULONG    Length
+    )
+{
+    ULONGLONG   x = 0x9e3779b97f4a7c15ULL;
+    ULONG       n;
+
+    for (n = 0; n + sizeof(ULONGLONG) <= Length; n += sizeof(ULONGLONG))
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        *(PULONGLONG) (Data + n) = x;
+    }
+}
+
+static BOOLEAN
+bench_read_file (
+    IN const char   *Path,
+    IN OUT PUCHAR   *Data,
+    IN OUT ULONG    *Length
+    )
+{
+    FILE    *file;
+    long    size;
+    PUCHAR  data;
+
+    file = fopen(Path, "rb");
+
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    rewind(file);
+
+    data = (PUCHAR) realloc(*Data, *Length + size);
+
+    if (data && fread(data + *Length, 1, size, file) == (size_t) size)
+    {
+        *Data = data;
+        *Length += size;
+    }
+
+    fclose(file);
+
+    return data != NULL;
+}
+
+static void
+bench_hash (void)
+{
+    PUCHAR          buffer;
+    ULONGLONG       time, hash;
+    ULONG           length, offset;
+
+    length = bench_megabytes * 1048576;
+
+    buffer = (PUCHAR) aligned_alloc(64, length);
+
+    if (!buffer)
+    {
+        return;
+    }
+
+    bench_random(buffer, length);
+
+    hash = 0;
+
+    time = TestTime();
+
+    for (offset = 0; offset < length; offset += DEDUP_BLOCK_SIZE)
+    {
+        hash += dedup_hash(buffer + offset);
+    }
+
+    time = TestTime() - time;
+
+    printf("hash %u MB at %.2f GB/s, %.0f ns a block (%llx)\n\n", bench_megabytes, length / (time / 1e9) / 1e9,
+        (double) time / (length / DEDUP_BLOCK_SIZE), (unsigned long long) hash & 0xf);
+
+    free(buffer);
+}
+
+/* writes the sample to a new volume and returns the MB/s, with the statistics of the deduplication */
+
+static double
+bench_write (
+    IN BENCH_SAMPLE         *Sample,
+    IN ULONG                IndexSize,
+    OUT PSWAPFS_STATISTICS  Statistics,
+    OUT PLONGLONG           Stored
+    )
+{
+    PDEVICE_OBJECT              device_object;
+    PTEST_DISK                  disk;
+    SWAPFS_STATISTICS_REQUEST   request;
+    ULONG_PTR                   information;
+    WCHAR                       name[64];
+    LONGLONG                    start;
+    ULONGLONG                   time;
+    ULONG                       offset, length;
+    NTSTATUS                    status;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk13\\Partition%u", ++bench_number);
+
+    disk = TestDiskCreate(name, Sample->Length + BENCH_METADATA, 512, NULL);
+
+    TestDiskSetSwapHeader(disk);
+
+    WdkClearRegistry();
+
+    if (IndexSize)
+    {
+        TestSetParameter("DedupIndexSize", IndexSize);
+    }
+
+    device_object = TestLoadDriver(disk, &status);
+
+    if (!NT_SUCCESS(status))
+    {
+        fprintf(stderr, "%s: the driver is not loaded, %08x\n", Sample->Name, (unsigned) status);
+        return 0;
+    }
+
+    /* the data region starts after the metadata, as with the deduplication */
+
+    start = (LONGLONG) ((PDEVICE_EXTENSION) device_object->DeviceExtension)->Stamp.MetaSectors * 512;
+
+    start = (start + DEDUP_BLOCK_SIZE - 1) & ~((LONGLONG) DEDUP_BLOCK_SIZE - 1);
+
+    request.Flags = SWAPFS_STATISTICS_RESET;
+
+    TestDeviceControl(device_object, IOCTL_SWAPFS_QUERY_STATISTICS, &request, sizeof(request),
+        Statistics, sizeof(SWAPFS_STATISTICS), &information);
+
+    TestDiskResetCounts(disk);
+
+    time = TestTime();
+
+    for (offset = 0; offset < Sample->Length; offset += length)
+    {
+        length = min(Sample->Length - offset, BENCH_WRITE);
+
+        status = TestReadWrite(device_object, IRP_MJ_WRITE, start + offset, length, Sample->Data + offset);
+
+        if (!NT_SUCCESS(status))
+        {
+            fprintf(stderr, "%s: the write at %u failed, %08x\n", Sample->Name, offset, (unsigned) status);
+            return 0;
+        }
+    }
+
+    time = TestTime() - time;
+
+    TestDeviceControl(device_object, IOCTL_SWAPFS_QUERY_STATISTICS, &request, sizeof(request),
+        Statistics, sizeof(SWAPFS_STATISTICS), &information);
+
+    *Stored = disk->BytesWritten;
+
+    return Sample->Length / 1048576.0 / (time / 1e9);
+}
+
+static void
+bench_sample (
+    IN BENCH_SAMPLE *Sample
+    )
+{
+    SWAPFS_STATISTICS   statistics;
+    LONGLONG            stored;
+    double              plain, dedup;
+
+    /* whole blocks, as the pages of a swap */
+
+    Sample->Length &= ~(DEDUP_BLOCK_SIZE - 1);
+
+    if (!Sample->Length)
+    {
+        return;
+    }
+
+    plain = bench_write(Sample, 0, &statistics, &stored);
+    dedup = bench_write(Sample, bench_index_size, &statistics, &stored);
+
+    printf("%-10s %8.1f", Sample->Name, Sample->Length / 1048576.0);
+
+    /* none of a sample of zeros is stored */
+
+    if (statistics.DedupWritten)
+    {
+        printf(" %9.2f", (double) Sample->Length / statistics.DedupWritten);
+    }
+    else
+    {
+        printf(" %9s", "-");
+    }
+
+    printf(" %9.1f %10.0f %10.0f %10llu\n", stored / 1048576.0, plain, dedup,
+        (unsigned long long) statistics.DedupCollisions);
+}
+
+int
+main (
+    int     argc,
+    char    **argv
+    )
+{
+    BENCH_SAMPLE    sample;
+    PUCHAR          pool;
+    glob_t          sources;
+    unsigned int    seed;
+    ULONG           npage, n;
+    int             c;
+
+    while ((c = getopt(argc, argv, "r:i:")) != -1)
+    {
+        switch (c)
+        {
+        case 'r':
+            bench_megabytes = (ULONG) strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            bench_index_size = (ULONG) strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: dedup_bench [-r MB] [-i KB] [file...]\n");
+            return 2;
+        }
+    }
+
+    if (!bench_megabytes || bench_megabytes > 1024 || !bench_index_size)
+    {
+        fprintf(stderr, "dedup_bench: -r is 1 to 1024 MB and -i at least 1 KB\n");
+        return 2;
+    }
+
+    bench_hash();
+
+    printf("index %u KB\n", min(max(bench_index_size, DEDUP_MINIMUM_SIZE), DEDUP_MAXIMUM_SIZE));
+    printf("sample           MB     ratio stored MB plain MB/s dedup MB/s collisions\n");
+
+    if (optind < argc)
+    {
+        for (; optind < argc; optind++)
+        {
+            RtlZeroMemory(&sample, sizeof(sample));
+
+            sample.Name = strrchr(argv[optind], '/') ? strrchr(argv[optind], '/') + 1 : argv[optind];
+
+            if (!bench_read_file(argv[optind], &sample.Data, &sample.Length) || !sample.Length)
+            {
+                perror(argv[optind]);
+                return 1;
+            }
+
+            bench_sample(&sample);
+            free(sample.Data);
+        }
+
+        return 0;
+    }
+
+    sample.Length = bench_megabytes * 1048576;
+    sample.Data = (PUCHAR) malloc(sample.Length);
+
+    if (!sample.Data)
+    {
+        return 1;
+    }
+
+    sample.Name = "zeros";
+    RtlZeroMemory(sample.Data, sample.Length);
+    bench_sample(&sample);
+
+    sample.Name = "random";
+    bench_random(sample.Data, sample.Length);
+
+    bench_sample(&sample);
+
+    /* the random data is the pool the pages are drawn from */
+
+    sample.Name = "pages";
+    npage = sample.Length / DEDUP_BLOCK_SIZE / 4;
+    pool = (PUCHAR) malloc(npage * DEDUP_BLOCK_SIZE);
+
+    if (pool)
+    {
+        RtlCopyMemory(pool, sample.Data, npage * DEDUP_BLOCK_SIZE);
+
+        for (seed = 1, n = 0; n < sample.Length / DEDUP_BLOCK_SIZE; n++)
+        {
+            RtlCopyMemory(sample.Data + n * DEDUP_BLOCK_SIZE, pool + rand_r(&seed) % npage * DEDUP_BLOCK_SIZE, DEDUP_BLOCK_SIZE);
+        }
+
+        bench_sample(&sample);
+        free(pool);
+    }
+
+    free(sample.Data);
+
+    /* the sources of the driver */
+
+    RtlZeroMemory(&sample, sizeof(sample));
+    sample.Name = "source";
+
+    if (glob("../sys/src/*.c", 0, NULL, &sources) == 0)
+    {
+        for (n = 0; n < sources.gl_pathc; n++)
+        {
+            bench_read_file(sources.gl_pathv[n], &sample.Data, &sample.Length);
+        }
+
+        globfree(&sources);
+    }
+
+    bench_sample(&sample);
+    free(sample.Data);
+
+    /* a build object */
+
+    RtlZeroMemory(&sample, sizeof(sample));
+    sample.Name = "object";
+
+    bench_read_file("/proc/self/exe", &sample.Data, &sample.Length);
+
+    bench_sample(&sample);
+    free(sample.Data);
+
+    return 0;
+}
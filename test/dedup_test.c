@@ -0,0 +1,553 @@
+/*
+    Tests of the deduplication of the blocks of the data region.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With DedupIndexSize the blocks of 4 KB written to the data region are
+    stored once on the device. The tests check the hash of the driver for
+    a block of zeros and blocks that differ in one word, a block written
+    many times that is stored once and read back, blocks of zeros that are
+    not stored, a block written over while another one shares it, a write
+    of a part of a shared block, a TRIM and a verify of a shared block
+    that are refused, a volume that is full of one block and then written
+    with all different blocks without running out of space, and random
+    writes of a few patterns, parts of blocks included, that are compared
+    with a copy in memory while the disk completes them on its own
+    threads.
+*/
+
+#include "../sys/src/dedup.c"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ntstrsafe.h>
+#include "test.h"
+
+#define TEST_DISK_LENGTH    (16 * 1024 * 1024)
+#define TEST_INDEX_SIZE     256
+#define TEST_BLOCK          DEDUP_BLOCK_SIZE
+#define TEST_PATTERNS       16
+#define TEST_WRITES         20000
+
+static ULONG test_number;
+
+static PDEVICE_OBJECT
+test_load (
+    OUT PTEST_DISK *Disk
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    WCHAR           name[64];
+    NTSTATUS        status;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk12\\Partition%u", ++test_number);
+
+    *Disk = TestDiskCreate(name, TEST_DISK_LENGTH, 512, NULL);
+
+    TestDiskSetSwapHeader(*Disk);
+
+    WdkClearRegistry();
+
+    TestSetParameter("DedupIndexSize", TEST_INDEX_SIZE);
+
+    device_object = TestLoadDriver(*Disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    return device_object;
+}
+
+static PDEDUP
+test_dedup (
+    IN PDEVICE_OBJECT DeviceObject
+    )
+{
+    return &((PDEVICE_EXTENSION) DeviceObject->DeviceExtension)->Dedup;
+}
+
+/* the offset of a block of the data region */
+
+static LONGLONG
+test_block (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            Block
+    )
+{
+    return test_dedup(DeviceObject)->Start + (LONGLONG) Block * TEST_BLOCK;
+}
+
+/* the number of blocks of the data region */
+
+static ULONG
+test_blocks (
+    IN PDEVICE_OBJECT DeviceObject
+    )
+{
+    PDEDUP dedup = test_dedup(DeviceObject);
+
+    return (ULONG) (dedup->NumberOfBlocks - dedup->Start / TEST_BLOCK);
+}
+
+static void
+test_fill (
+    OUT PUCHAR  Data,
+    IN ULONG    Length,
+    IN ULONG    Pattern
+    )
+{
+    ULONG n;
+
+    for (n = 0; n < Length; n++)
+    {
+        Data[n] = (UCHAR) (Pattern * 37 + n / 7 + (n >> 8) * Pattern);
+    }
+}
+
+static BOOLEAN
+test_all_zero (
+    IN PUCHAR   Data,
+    IN ULONG    Length
+    )
+{
+    while (Length--)
+    {
+        if (*Data++)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+test_statistics (
+    IN PDEVICE_OBJECT       DeviceObject,
+    OUT PSWAPFS_STATISTICS  Statistics
+    )
+{
+    SWAPFS_STATISTICS_REQUEST   request;
+    ULONG_PTR                   information;
+
+    request.Flags = SWAPFS_STATISTICS_RESET;
+
+    CHECK_STATUS(TestDeviceControl(DeviceObject, IOCTL_SWAPFS_QUERY_STATISTICS, &request, sizeof(request),
+        Statistics, sizeof(SWAPFS_STATISTICS), &information), STATUS_SUCCESS);
+}
+
+static int
+test_compare_hash (
+    const void  *A,
+    const void  *B
+    )
+{
+    ULONGLONG a = *(const ULONGLONG *) A;
+    ULONGLONG b = *(const ULONGLONG *) B;
+
+    return a < b ? -1 : a > b;
+}
+
+static void
+test_hash (void)
+{
+    static UCHAR    data[TEST_BLOCK] __attribute__((aligned(64)));
+    static ULONGLONG hash[TEST_BLOCK / sizeof(ULONGLONG) * 8 + 1];
+    PULONGLONG      word = (PULONGLONG) data;
+    ULONG           nhash, n, bit;
+    ULONG           same;
+
+    RtlZeroMemory(data, sizeof(data));
+
+    CHECK(dedup_hash(data) == 0);
+
+    /* a few bits of each word of the block set alone, and the first two words set */
+
+    nhash = 0;
+
+    for (n = 0; n < TEST_BLOCK / sizeof(ULONGLONG); n++)
+    {
+        for (bit = 0; bit < 64; bit += 9)
+        {
+            word[n] = 1ULL << bit;
+            hash[nhash++] = dedup_hash(data);
+            word[n] = 0;
+        }
+    }
+
+    word[0] = 1;
+    word[1] = 1;
+    hash[nhash++] = dedup_hash(data);
+
+    for (same = 0, n = 0; n < nhash; n++)
+    {
+        same += hash[n] == 0;
+    }
+
+    CHECK(same == 0);
+
+    qsort(hash, nhash, sizeof(hash[0]), test_compare_hash);
+
+    for (same = 0, n = 1; n < nhash; n++)
+    {
+        same += hash[n] == hash[n - 1];
+    }
+
+    CHECK(same == 0);
+
+    /* the order of the words counts */
+
+    RtlZeroMemory(data, sizeof(data));
+
+    word[0] = 1;
+    word[1] = 2;
+
+    hash[0] = dedup_hash(data);
+
+    word[0] = 2;
+    word[1] = 1;
+
+    CHECK(dedup_hash(data) != hash[0]);
+}
+
+static void
+test_duplicates (void)
+{
+    PDEVICE_OBJECT      device_object;
+    PTEST_DISK          disk;
+    SWAPFS_STATISTICS   statistics;
+    static UCHAR        data[64 * TEST_BLOCK];
+    static UCHAR        read[64 * TEST_BLOCK];
+    ULONG               n;
+
+    device_object = test_load(&disk);
+
+    test_statistics(device_object, &statistics);
+
+    for (n = 0; n < 64; n++)
+    {
+        test_fill(data + n * TEST_BLOCK, TEST_BLOCK, 1);
+    }
+
+    TestDiskResetCounts(disk);
+
+    /* the first block is written, the others are compared with it and mapped to it */
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 0), sizeof(data), data), STATUS_SUCCESS);
+    CHECK(disk->BytesWritten == TEST_BLOCK);
+
+    RtlZeroMemory(read, sizeof(read));
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, test_block(device_object, 0), sizeof(read), read), STATUS_SUCCESS);
+    CHECK(memcmp(read, data, sizeof(data)) == 0);
+
+    test_statistics(device_object, &statistics);
+
+    CHECK(statistics.DedupWritten == TEST_BLOCK);
+    CHECK(statistics.DedupDuplicate == 63 * TEST_BLOCK);
+    CHECK(statistics.DedupCollisions == 0);
+
+    /* the same block written again somewhere else is not stored either */
+
+    TestDiskResetCounts(disk);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 100), TEST_BLOCK, data), STATUS_SUCCESS);
+    CHECK(disk->BytesWritten == 0);
+}
+
+static void
+test_zero_blocks (void)
+{
+    PDEVICE_OBJECT      device_object;
+    PTEST_DISK          disk;
+    SWAPFS_STATISTICS   statistics;
+    UCHAR               data[4 * TEST_BLOCK];
+    UCHAR               read[4 * TEST_BLOCK];
+    ULONG               n;
+
+    device_object = test_load(&disk);
+
+    test_fill(data, sizeof(data), 2);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 10), sizeof(data), data);
+
+    test_statistics(device_object, &statistics);
+
+    TestDiskResetCounts(disk);
+
+    RtlZeroMemory(data, sizeof(data));
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 10), sizeof(data), data), STATUS_SUCCESS);
+    CHECK(disk->Writes == 0);
+
+    for (n = 10; n < 14; n++)
+    {
+        CHECK(test_dedup(device_object)->Map[test_dedup(device_object)->Start / TEST_BLOCK + n] == DEDUP_ZERO_BLOCK);
+    }
+
+    RtlFillMemory(read, sizeof(read), 0xcc);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, test_block(device_object, 10), sizeof(read), read), STATUS_SUCCESS);
+    CHECK(disk->Reads == 0);
+    CHECK(test_all_zero(read, sizeof(read)));
+
+    test_statistics(device_object, &statistics);
+
+    CHECK(statistics.DedupWritten == 0);
+    CHECK(statistics.DedupDuplicate == sizeof(data));
+}
+
+static void
+test_shared_write (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    UCHAR           a[TEST_BLOCK];
+    UCHAR           b[TEST_BLOCK];
+    UCHAR           read[2 * TEST_BLOCK];
+
+    device_object = test_load(&disk);
+
+    test_fill(a, sizeof(a), 3);
+    test_fill(b, sizeof(b), 4);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 0), TEST_BLOCK, a);
+    TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 1), TEST_BLOCK, a);
+
+    /* the block written over is stored elsewhere, the one that shared it keeps it */
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 0), TEST_BLOCK, b), STATUS_SUCCESS);
+
+    TestReadWrite(device_object, IRP_MJ_READ, test_block(device_object, 0), sizeof(read), read);
+
+    CHECK(memcmp(read, b, TEST_BLOCK) == 0);
+    CHECK(memcmp(read + TEST_BLOCK, a, TEST_BLOCK) == 0);
+
+    /* a part of a shared block written keeps the rest of it, and the other block */
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 0), TEST_BLOCK, a);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 1) + 1024, 512, b), STATUS_SUCCESS);
+
+    TestReadWrite(device_object, IRP_MJ_READ, test_block(device_object, 0), sizeof(read), read);
+
+    CHECK(memcmp(read, a, TEST_BLOCK) == 0);
+    CHECK(memcmp(read + TEST_BLOCK, a, 1024) == 0);
+    CHECK(memcmp(read + TEST_BLOCK + 1024, b, 512) == 0);
+    CHECK(memcmp(read + TEST_BLOCK + 1536, a + 1536, TEST_BLOCK - 1536) == 0);
+}
+
+/* a TRIM or a verify of a block would reach the block on the device that others share */
+
+static void
+test_ranges (void)
+{
+    PDEVICE_OBJECT      device_object;
+    PTEST_DISK          disk;
+    UCHAR               data[TEST_BLOCK];
+    UCHAR               read[2 * TEST_BLOCK];
+    ULONG_PTR           information;
+    VERIFY_INFORMATION  verify;
+    struct {
+        DEVICE_MANAGE_DATA_SET_ATTRIBUTES   Attributes;
+        DEVICE_DATA_SET_RANGE               Range;
+    } trim;
+
+    device_object = test_load(&disk);
+
+    test_fill(data, sizeof(data), 6);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 0), TEST_BLOCK, data);
+    TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 1), TEST_BLOCK, data);
+
+    disk->Trim = TRUE;
+
+    TestDiskResetCounts(disk);
+
+    RtlZeroMemory(&trim, sizeof(trim));
+    trim.Attributes.Size = sizeof(trim.Attributes);
+    trim.Attributes.Action = DeviceDsmAction_Trim;
+    trim.Attributes.DataSetRangesOffset = sizeof(trim.Attributes);
+    trim.Attributes.DataSetRangesLength = sizeof(trim.Range);
+    trim.Range.StartingOffset = test_block(device_object, 0) + sizeof(union swap_header);
+    trim.Range.LengthInBytes = TEST_BLOCK;
+
+    CHECK_STATUS(TestDeviceControl(device_object, IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES, &trim, sizeof(trim),
+        NULL, 0, &information), STATUS_INVALID_DEVICE_REQUEST);
+
+    verify.StartingOffset.QuadPart = trim.Range.StartingOffset;
+    verify.Length = TEST_BLOCK;
+
+    CHECK_STATUS(TestDeviceControl(device_object, IOCTL_DISK_VERIFY, &verify, sizeof(verify),
+        NULL, 0, &information), STATUS_INVALID_DEVICE_REQUEST);
+
+    CHECK(disk->Trims == 0);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, test_block(device_object, 0), sizeof(read), read), STATUS_SUCCESS);
+    CHECK(memcmp(read, data, TEST_BLOCK) == 0);
+    CHECK(memcmp(read + TEST_BLOCK, data, TEST_BLOCK) == 0);
+}
+
+static void
+test_full (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    UCHAR           data[TEST_BLOCK];
+    UCHAR           read[TEST_BLOCK];
+    ULONG           nblock, n;
+    ULONG           failed, wrong;
+
+    device_object = test_load(&disk);
+
+    nblock = test_blocks(device_object);
+
+    test_fill(data, sizeof(data), 5);
+
+    for (n = 0; n < nblock; n++)
+    {
+        TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, n), TEST_BLOCK, data);
+    }
+
+    /* every block of the volume shares one block on the device, then each is written different */
+
+    for (failed = 0, n = 0; n < nblock; n++)
+    {
+        test_fill(data, sizeof(data), 5);
+        *(PULONG) data = n + 1;
+
+        failed += !NT_SUCCESS(TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, n), TEST_BLOCK, data));
+    }
+
+    CHECK(failed == 0);
+
+    for (wrong = 0, n = 0; n < nblock; n++)
+    {
+        test_fill(data, sizeof(data), 5);
+        *(PULONG) data = n + 1;
+
+        TestReadWrite(device_object, IRP_MJ_READ, test_block(device_object, n), TEST_BLOCK, read);
+
+        wrong += memcmp(read, data, TEST_BLOCK) != 0;
+    }
+
+    CHECK(wrong == 0);
+}
+
+static void
+test_random (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PUCHAR          pattern[TEST_PATTERNS];
+    PUCHAR          shadow;
+    PUCHAR          read;
+    ULONG           nblock, n;
+    ULONG           block, start, length;
+    ULONG           failed;
+    unsigned int    seed;
+
+    device_object = test_load(&disk);
+
+    TestDiskStartThreads(disk, 4);
+
+    nblock = min(test_blocks(device_object), 1024);
+
+    shadow = (PUCHAR) calloc(nblock, TEST_BLOCK);
+    read = (PUCHAR) malloc(16 * TEST_BLOCK);
+
+    /* the last pattern is zeros */
+
+    for (n = 0; n < TEST_PATTERNS; n++)
+    {
+        pattern[n] = (PUCHAR) calloc(16, TEST_BLOCK);
+
+        if (n < TEST_PATTERNS - 1)
+        {
+            test_fill(pattern[n], 16 * TEST_BLOCK, n + 10);
+        }
+    }
+
+    seed = 17;
+    failed = 0;
+
+    for (n = 0; n < TEST_WRITES; n++)
+    {
+        block = rand_r(&seed) % (nblock - 16);
+
+        /* whole blocks most of the time, else sectors of a block */
+
+        if (rand_r(&seed) % 4)
+        {
+            start = 0;
+            length = (rand_r(&seed) % 16 + 1) * TEST_BLOCK;
+        }
+        else
+        {
+            start = rand_r(&seed) % 8 * 512;
+            length = (rand_r(&seed) % (8 - start / 512) + 1) * 512;
+        }
+
+        RtlCopyMemory(shadow + block * TEST_BLOCK + start, pattern[rand_r(&seed) % TEST_PATTERNS], length);
+
+        failed += !NT_SUCCESS(TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, block) + start,
+            length, shadow + block * TEST_BLOCK + start));
+
+        /* a read of what was written and the blocks around it */
+
+        if (n % 8 == 0)
+        {
+            block = block >= 4 ? block - 4 : 0;
+
+            TestReadWrite(device_object, IRP_MJ_READ, test_block(device_object, block), 16 * TEST_BLOCK, read);
+
+            failed += memcmp(read, shadow + block * TEST_BLOCK, 16 * TEST_BLOCK) != 0;
+        }
+    }
+
+    CHECK(failed == 0);
+
+    for (failed = 0, block = 0; block + 16 <= nblock; block += 16)
+    {
+        TestReadWrite(device_object, IRP_MJ_READ, test_block(device_object, block), 16 * TEST_BLOCK, read);
+
+        failed += memcmp(read, shadow + block * TEST_BLOCK, 16 * TEST_BLOCK) != 0;
+    }
+
+    CHECK(failed == 0);
+
+    for (n = 0; n < TEST_PATTERNS; n++)
+    {
+        free(pattern[n]);
+    }
+
+    free(read);
+    free(shadow);
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_hash);
+    TEST_RUN(test_duplicates);
+    TEST_RUN(test_zero_blocks);
+    TEST_RUN(test_shared_write);
+    TEST_RUN(test_ranges);
+    TEST_RUN(test_full);
+    TEST_RUN(test_random);
+
+    return TestFailures != 0;
+}
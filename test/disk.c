@@ -0,0 +1,692 @@
+/*
+    A mock disk for the user-mode tests of the driver.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include <ntddk.h>
+#include <ntdddisk.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <linux/fs.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "disk.h"
+
+#define SWAP_SIGNATURE          "SWAPSPACE2"
+#define SWAP_SIGNATURE_OFFSET   (PAGE_SIZE - 10)
+
+static DRIVER_OBJECT disk_driver_object;
+
+/* the disk of a device object is kept after the pointer in its extension */
+
+static PTEST_DISK
+disk_from_device (
+    IN PDEVICE_OBJECT DeviceObject
+    )
+{
+    return *(PTEST_DISK *) DeviceObject->DeviceExtension;
+}
+
+static VOID
+disk_count_write (
+    IN PTEST_DISK   Disk,
+    IN ULONG        Length
+    )
+{
+    ULONG bucket;
+
+    for (bucket = 0; bucket < TEST_DISK_SIZE_BUCKETS - 1 && Length >= (1024u << bucket); bucket++)
+    {
+    }
+
+    InterlockedIncrement(&Disk->WriteSizes[bucket]);
+}
+
+/* a range that is not whole pages is cleared, the pages in it are given back */
+
+static VOID
+disk_zero (
+    IN PTEST_DISK   Disk,
+    IN LONGLONG     Offset,
+    IN LONGLONG     Length
+    )
+{
+    LONGLONG start, end;
+
+    start = ALIGN_UP_BY(Offset, PAGE_SIZE);
+    end = ALIGN_DOWN_BY(Offset + Length, PAGE_SIZE);
+
+    if (end <= start)
+    {
+        RtlZeroMemory(Disk->Image + Offset, Length);
+        return;
+    }
+
+    RtlZeroMemory(Disk->Image + Offset, start - Offset);
+    RtlZeroMemory(Disk->Image + end, Offset + Length - end);
+
+    if (Disk->File >= 0)
+    {
+        if (fallocate(Disk->File, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, end - start))
+        {
+            RtlZeroMemory(Disk->Image + start, end - start);
+        }
+    }
+    else if (madvise(Disk->Image + start, end - start, MADV_DONTNEED))
+    {
+        RtlZeroMemory(Disk->Image + start, end - start);
+    }
+}
+
+static NTSTATUS
+disk_read_write (
+    IN PTEST_DISK   Disk,
+    IN PIRP         Irp
+    )
+{
+    PIO_STACK_LOCATION  io_stack;
+    LONGLONG            offset;
+    ULONG               length;
+    PUCHAR              buffer;
+    NTSTATUS            status;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    offset = io_stack->Parameters.Read.ByteOffset.QuadPart;
+    length = io_stack->Parameters.Read.Length;
+
+    if (offset < 0 || offset + length > Disk->Length || (offset | length) % Disk->SectorSize)
+    {
+        fprintf(stderr, "disk: %s of %u bytes at %lld is outside or not of whole sectors\n",
+            io_stack->MajorFunction == IRP_MJ_READ ? "read" : "write", length, offset);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    buffer = (PUCHAR) MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
+
+    if (!buffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    if ((ULONG_PTR) buffer & Disk->AlignmentMask)
+    {
+        fprintf(stderr, "disk: buffer %p is not aligned to %#x\n", (PVOID) buffer, Disk->AlignmentMask + 1);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (Disk->Hook)
+    {
+        status = Disk->Hook(Disk, io_stack->MajorFunction, offset, length);
+
+        if (!NT_SUCCESS(status))
+        {
+            return status;
+        }
+    }
+
+    if (io_stack->MajorFunction == IRP_MJ_READ)
+    {
+        RtlCopyMemory(buffer, Disk->Image + offset, length);
+        InterlockedIncrement(&Disk->Reads);
+        InterlockedExchangeAdd64(&Disk->BytesRead, length);
+    }
+    else
+    {
+        RtlCopyMemory(Disk->Image + offset, buffer, length);
+        InterlockedIncrement(&Disk->Writes);
+        InterlockedExchangeAdd64(&Disk->BytesWritten, length);
+        disk_count_write(Disk, length);
+    }
+
+    Irp->IoStatus.Information = length;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+disk_query_property (
+    IN PTEST_DISK   Disk,
+    IN PIRP         Irp,
+    IN ULONG        OutputLength
+    )
+{
+    PSTORAGE_PROPERTY_QUERY             query;
+    STORAGE_ADAPTER_DESCRIPTOR          adapter;
+    STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment;
+    DEVICE_TRIM_DESCRIPTOR              trim;
+    DEVICE_LB_PROVISIONING_DESCRIPTOR   provisioning;
+    PVOID                               descriptor;
+    ULONG                               size;
+
+    query = (PSTORAGE_PROPERTY_QUERY) Irp->AssociatedIrp.SystemBuffer;
+
+    switch (query->PropertyId)
+    {
+    case StorageAdapterProperty:
+        RtlZeroMemory(&adapter, sizeof(adapter));
+        adapter.Version = adapter.Size = sizeof(adapter);
+        adapter.MaximumTransferLength = Disk->MaximumTransferLength;
+        adapter.MaximumPhysicalPages = Disk->MaximumPhysicalPages;
+        adapter.AlignmentMask = Disk->AlignmentMask;
+        adapter.CommandQueueing = TRUE;
+        descriptor = &adapter;
+        size = sizeof(adapter);
+        break;
+
+    case StorageAccessAlignmentProperty:
+        RtlZeroMemory(&alignment, sizeof(alignment));
+        alignment.Version = alignment.Size = sizeof(alignment);
+        alignment.BytesPerCacheLine = 64;
+        alignment.BytesPerLogicalSector = Disk->SectorSize;
+        alignment.BytesPerPhysicalSector = Disk->PhysicalSectorSize;
+        alignment.BytesOffsetForSectorAlignment = Disk->PhysicalSectorOffset;
+        descriptor = &alignment;
+        size = sizeof(alignment);
+        break;
+
+    case StorageDeviceTrimProperty:
+        RtlZeroMemory(&trim, sizeof(trim));
+        trim.Version = trim.Size = sizeof(trim);
+        trim.TrimEnabled = Disk->Trim;
+        descriptor = &trim;
+        size = sizeof(trim);
+        break;
+
+    case StorageDeviceLBProvisioningProperty:
+        if (!Disk->UnmapGranularity)
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+        RtlZeroMemory(&provisioning, sizeof(provisioning));
+        provisioning.Version = provisioning.Size = sizeof(provisioning);
+        provisioning.ThinProvisioningEnabled = Disk->Trim;
+        provisioning.ThinProvisioningReadZeros = Disk->Trim;
+        provisioning.OptimalUnmapGranularity = Disk->UnmapGranularity;
+        descriptor = &provisioning;
+        size = sizeof(provisioning);
+        break;
+
+    default:
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    size = min(size, OutputLength);
+
+    RtlCopyMemory(Irp->AssociatedIrp.SystemBuffer, descriptor, size);
+
+    Irp->IoStatus.Information = size;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+disk_trim (
+    IN PTEST_DISK   Disk,
+    IN PIRP         Irp,
+    IN ULONG        InputLength
+    )
+{
+    PDEVICE_MANAGE_DATA_SET_ATTRIBUTES  attributes;
+    PDEVICE_DATA_SET_RANGE              range;
+    ULONG                               n;
+    NTSTATUS                            status;
+
+    attributes = (PDEVICE_MANAGE_DATA_SET_ATTRIBUTES) Irp->AssociatedIrp.SystemBuffer;
+
+    if (!Disk->Trim || InputLength < sizeof(DEVICE_MANAGE_DATA_SET_ATTRIBUTES) ||
+        attributes->Action != DeviceDsmAction_Trim ||
+        attributes->DataSetRangesOffset + attributes->DataSetRangesLength > InputLength)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    range = (PDEVICE_DATA_SET_RANGE) ((PUCHAR) attributes + attributes->DataSetRangesOffset);
+
+    for (n = 0; n < attributes->DataSetRangesLength / sizeof(DEVICE_DATA_SET_RANGE); n++)
+    {
+        if (range[n].StartingOffset < 0 ||
+            range[n].StartingOffset + (LONGLONG) range[n].LengthInBytes > Disk->Length ||
+            (range[n].StartingOffset | range[n].LengthInBytes) % Disk->SectorSize)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        if (Disk->Hook)
+        {
+            status = Disk->Hook(Disk, IRP_MJ_DEVICE_CONTROL, range[n].StartingOffset, (ULONG) range[n].LengthInBytes);
+
+            if (!NT_SUCCESS(status))
+            {
+                return status;
+            }
+        }
+
+        disk_zero(Disk, range[n].StartingOffset, range[n].LengthInBytes);
+
+        InterlockedExchangeAdd64(&Disk->BytesTrimmed, range[n].LengthInBytes);
+    }
+
+    InterlockedIncrement(&Disk->Trims);
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+disk_device_control (
+    IN PTEST_DISK   Disk,
+    IN PIRP         Irp
+    )
+{
+    PIO_STACK_LOCATION          io_stack;
+    PDISK_GEOMETRY              geometry;
+    PDISK_GEOMETRY_EX           geometry_ex;
+    PPARTITION_INFORMATION      partition;
+    PPARTITION_INFORMATION_EX   partition_ex;
+    PGET_LENGTH_INFORMATION     length;
+    ULONG                       output_length;
+    ULONG                       size;
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    output_length = io_stack->Parameters.DeviceIoControl.OutputBufferLength;
+
+    InterlockedIncrement(&Disk->Ioctls);
+
+    switch (io_stack->Parameters.DeviceIoControl.IoControlCode)
+    {
+    case IOCTL_DISK_GET_DRIVE_GEOMETRY:
+    case IOCTL_DISK_GET_DRIVE_GEOMETRY_EX:
+        size = (io_stack->Parameters.DeviceIoControl.IoControlCode == IOCTL_DISK_GET_DRIVE_GEOMETRY) ?
+            sizeof(DISK_GEOMETRY) : FIELD_OFFSET(DISK_GEOMETRY_EX, Data);
+        if (output_length < size)
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+        geometry_ex = (PDISK_GEOMETRY_EX) Irp->AssociatedIrp.SystemBuffer;
+        geometry = &geometry_ex->Geometry;
+        geometry->MediaType = FixedMedia;
+        geometry->TracksPerCylinder = 255;
+        geometry->SectorsPerTrack = 63;
+        geometry->BytesPerSector = Disk->SectorSize;
+        geometry->Cylinders.QuadPart = (Disk->StartingOffset + Disk->Length) / (255 * 63 * Disk->SectorSize);
+        if (size > sizeof(DISK_GEOMETRY))
+        {
+            geometry_ex->DiskSize.QuadPart = Disk->StartingOffset + Disk->Length;
+        }
+        Irp->IoStatus.Information = size;
+        return STATUS_SUCCESS;
+
+    case IOCTL_DISK_GET_PARTITION_INFO:
+        if (output_length < sizeof(PARTITION_INFORMATION))
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+        partition = (PPARTITION_INFORMATION) Irp->AssociatedIrp.SystemBuffer;
+        partition->StartingOffset.QuadPart = Disk->StartingOffset;
+        partition->PartitionLength.QuadPart = Disk->Length;
+        partition->HiddenSectors = (ULONG) (Disk->StartingOffset / Disk->SectorSize);
+        partition->PartitionNumber = 1;
+        partition->PartitionType = 0x82;
+        partition->RecognizedPartition = TRUE;
+        Irp->IoStatus.Information = sizeof(PARTITION_INFORMATION);
+        return STATUS_SUCCESS;
+
+    case IOCTL_DISK_GET_PARTITION_INFO_EX:
+        if (output_length < sizeof(PARTITION_INFORMATION_EX))
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+        partition_ex = (PPARTITION_INFORMATION_EX) Irp->AssociatedIrp.SystemBuffer;
+        partition_ex->PartitionStyle = PARTITION_STYLE_MBR;
+        partition_ex->StartingOffset.QuadPart = Disk->StartingOffset;
+        partition_ex->PartitionLength.QuadPart = Disk->Length;
+        partition_ex->PartitionNumber = 1;
+        Irp->IoStatus.Information = sizeof(PARTITION_INFORMATION_EX);
+        return STATUS_SUCCESS;
+
+    case IOCTL_DISK_GET_LENGTH_INFO:
+        if (output_length < sizeof(GET_LENGTH_INFORMATION))
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+        length = (PGET_LENGTH_INFORMATION) Irp->AssociatedIrp.SystemBuffer;
+        length->Length.QuadPart = Disk->Length;
+        Irp->IoStatus.Information = sizeof(GET_LENGTH_INFORMATION);
+        return STATUS_SUCCESS;
+
+    case IOCTL_STORAGE_QUERY_PROPERTY:
+        if (io_stack->Parameters.DeviceIoControl.InputBufferLength < FIELD_OFFSET(STORAGE_PROPERTY_QUERY, AdditionalParameters))
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+        return disk_query_property(Disk, Irp, output_length);
+
+    case IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES:
+        return disk_trim(Disk, Irp, io_stack->Parameters.DeviceIoControl.InputBufferLength);
+
+    case IOCTL_DISK_IS_WRITABLE:
+    case IOCTL_DISK_CHECK_VERIFY:
+    case IOCTL_STORAGE_CHECK_VERIFY:
+    case IOCTL_DISK_VERIFY:
+        return STATUS_SUCCESS;
+
+    default:
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+}
+
+static NTSTATUS
+disk_complete (
+    IN PTEST_DISK   Disk,
+    IN PIRP         Irp,
+    IN NTSTATUS     Status
+    )
+{
+    InterlockedDecrement(&Disk->InFlight);
+
+    Irp->IoStatus.Status = Status;
+
+    if (!NT_SUCCESS(Status))
+    {
+        Irp->IoStatus.Information = 0;
+    }
+
+    IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+
+    return Status;
+}
+
+static VOID *
+disk_thread (
+    VOID *Context
+    )
+{
+    PTEST_DISK  disk;
+    PLIST_ENTRY entry;
+    PIRP        irp;
+
+    disk = (PTEST_DISK) Context;
+
+    pthread_mutex_lock(&disk->QueueLock);
+
+    while (!disk->Stop)
+    {
+        if (IsListEmpty(&disk->Queue))
+        {
+            pthread_cond_wait(&disk->QueueSignal, &disk->QueueLock);
+            continue;
+        }
+
+        entry = RemoveHeadList(&disk->Queue);
+
+        pthread_mutex_unlock(&disk->QueueLock);
+
+        irp = CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry);
+
+        disk_complete(disk, irp, disk_read_write(disk, irp));
+
+        pthread_mutex_lock(&disk->QueueLock);
+    }
+
+    pthread_mutex_unlock(&disk->QueueLock);
+
+    return NULL;
+}
+
+static NTSTATUS
+disk_dispatch (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp
+    )
+{
+    PTEST_DISK          disk;
+    PIO_STACK_LOCATION  io_stack;
+    LONG                in_flight, maximum;
+
+    disk = disk_from_device(DeviceObject);
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    Irp->IoStatus.Information = 0;
+
+    in_flight = InterlockedIncrement(&disk->InFlight);
+
+    while ((maximum = disk->MaximumInFlight) < in_flight &&
+           InterlockedCompareExchange(&disk->MaximumInFlight, in_flight, maximum) != maximum)
+    {
+    }
+
+    switch (io_stack->MajorFunction)
+    {
+    case IRP_MJ_READ:
+    case IRP_MJ_WRITE:
+        if (disk->Threads)
+        {
+            IoMarkIrpPending(Irp);
+
+            pthread_mutex_lock(&disk->QueueLock);
+            InsertTailList(&disk->Queue, &Irp->Tail.Overlay.ListEntry);
+            pthread_cond_signal(&disk->QueueSignal);
+            pthread_mutex_unlock(&disk->QueueLock);
+
+            return STATUS_PENDING;
+        }
+        return disk_complete(disk, Irp, disk_read_write(disk, Irp));
+
+    case IRP_MJ_DEVICE_CONTROL:
+    case IRP_MJ_INTERNAL_DEVICE_CONTROL:
+        return disk_complete(disk, Irp, disk_device_control(disk, Irp));
+
+    case IRP_MJ_FLUSH_BUFFERS:
+        InterlockedIncrement(&disk->Flushes);
+        return disk_complete(disk, Irp, disk->Hook ? disk->Hook(disk, IRP_MJ_FLUSH_BUFFERS, 0, 0) : STATUS_SUCCESS);
+
+    default:
+        return disk_complete(disk, Irp, STATUS_SUCCESS);
+    }
+}
+
+PTEST_DISK
+TestDiskCreate (
+    IN PCWSTR       Name,
+    IN LONGLONG     Length,
+    IN ULONG        SectorSize,
+    IN const char   *Path
+    )
+{
+    PTEST_DISK      disk;
+    UNICODE_STRING  name;
+    struct stat     st;
+    uint64_t        size;
+    ULONG           n;
+
+    for (n = 0; n <= IRP_MJ_MAXIMUM_FUNCTION; n++)
+    {
+        disk_driver_object.MajorFunction[n] = disk_dispatch;
+    }
+
+    disk = (PTEST_DISK) calloc(1, sizeof(TEST_DISK));
+
+    if (!disk)
+    {
+        return NULL;
+    }
+
+    disk->Length = Length;
+    disk->SectorSize = SectorSize;
+    disk->PhysicalSectorSize = SectorSize;
+    disk->StartingOffset = 1024 * 1024;
+    disk->MaximumTransferLength = 1024 * 1024;
+    disk->MaximumPhysicalPages = 1024 * 1024 / PAGE_SIZE + 1;
+    disk->File = -1;
+
+    /* a file is made sparse at the length of the partition, memory is only given to the pages written */
+
+    if (Path)
+    {
+        disk->File = open(Path, O_RDWR | O_CREAT, 0644);
+
+        if (disk->File < 0 || fstat(disk->File, &st))
+        {
+            perror(Path);
+            free(disk);
+            return NULL;
+        }
+
+        /* a block device is used as it is, up to its size or the length given */
+
+        if (S_ISBLK(st.st_mode))
+        {
+            if (ioctl(disk->File, BLKGETSIZE64, &size))
+            {
+                perror(Path);
+                close(disk->File);
+                free(disk);
+                return NULL;
+            }
+
+            if (!Length || Length > (LONGLONG) size)
+            {
+                Length = (LONGLONG) size;
+            }
+
+            disk->Length = Length;
+        }
+        else if (ftruncate(disk->File, 0) || ftruncate(disk->File, Length))
+        {
+            perror(Path);
+            close(disk->File);
+            free(disk);
+            return NULL;
+        }
+
+        disk->Image = (PUCHAR) mmap(NULL, Length, PROT_READ | PROT_WRITE, MAP_SHARED, disk->File, 0);
+    }
+    else
+    {
+        disk->Image = (PUCHAR) mmap(NULL, Length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+
+    if (disk->Image == MAP_FAILED)
+    {
+        perror("mmap");
+        free(disk);
+        return NULL;
+    }
+
+    for (n = 0; Name[n] && n + 1 < RTL_NUMBER_OF(disk->Name); n++)
+    {
+        disk->Name[n] = Name[n];
+    }
+
+    RtlInitUnicodeString(&name, disk->Name);
+
+    if (!NT_SUCCESS(IoCreateDevice(&disk_driver_object, sizeof(PTEST_DISK), &name, FILE_DEVICE_DISK, 0, FALSE, &disk->DeviceObject)))
+    {
+        munmap(disk->Image, Length);
+        free(disk);
+        return NULL;
+    }
+
+    *(PTEST_DISK *) disk->DeviceObject->DeviceExtension = disk;
+
+    disk->DeviceObject->Flags |= DO_DIRECT_IO | DO_POWER_PAGABLE;
+    disk->DeviceObject->Flags &= ~DO_DEVICE_INITIALIZING;
+
+    pthread_mutex_init(&disk->QueueLock, NULL);
+    pthread_cond_init(&disk->QueueSignal, NULL);
+    InitializeListHead(&disk->Queue);
+
+    return disk;
+}
+
+VOID
+TestDiskSetSwapHeader (
+    IN PTEST_DISK Disk
+    )
+{
+    RtlCopyMemory(Disk->Image + SWAP_SIGNATURE_OFFSET, SWAP_SIGNATURE, 10);
+}
+
+VOID
+TestDiskStartThreads (
+    IN PTEST_DISK   Disk,
+    IN ULONG        Threads
+    )
+{
+    ULONG n;
+
+    Disk->Threads = min(Threads, RTL_NUMBER_OF(Disk->Thread));
+
+    for (n = 0; n < Disk->Threads; n++)
+    {
+        pthread_create(&Disk->Thread[n], NULL, disk_thread, Disk);
+    }
+}
+
+VOID
+TestDiskResetCounts (
+    IN PTEST_DISK Disk
+    )
+{
+    Disk->Reads = 0;
+    Disk->Writes = 0;
+    Disk->Trims = 0;
+    Disk->Ioctls = 0;
+    Disk->Flushes = 0;
+    Disk->BytesRead = 0;
+    Disk->BytesWritten = 0;
+    Disk->BytesTrimmed = 0;
+    Disk->MaximumInFlight = Disk->InFlight;
+
+    RtlZeroMemory((PVOID) Disk->WriteSizes, sizeof(Disk->WriteSizes));
+}
+
+VOID
+TestDiskDelete (
+    IN PTEST_DISK Disk
+    )
+{
+    ULONG n;
+
+    pthread_mutex_lock(&Disk->QueueLock);
+    Disk->Stop = TRUE;
+    pthread_cond_broadcast(&Disk->QueueSignal);
+    pthread_mutex_unlock(&Disk->QueueLock);
+
+    for (n = 0; n < Disk->Threads; n++)
+    {
+        pthread_join(Disk->Thread[n], NULL);
+    }
+
+    IoDeleteDevice(Disk->DeviceObject);
+
+    munmap(Disk->Image, Disk->Length);
+
+    if (Disk->File >= 0)
+    {
+        close(Disk->File);
+    }
+
+    free(Disk);
+}
@@ -0,0 +1,120 @@
+/*
+    A mock disk for the user-mode tests of the driver.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The disk is a partition of a memory image, a file or a block device
+    that the driver is attached to by name, like the partitions of the kernel. It takes the
+    reads and writes, the TRIM of IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES
+    and the device controls the driver sends to find the geometry, the
+    partition, the alignment and the adapter limits of the device. Each
+    request is counted with its bytes and the writes are also counted by
+    size, a hook can look at a request or fail it before it is done. With
+    Threads set the reads and writes are pended and completed on threads
+    of the disk, as a real disk completes them from its interrupt.
+*/
+
+#ifndef _DISK_H_
+#define _DISK_H_
+
+#include <ntddk.h>
+#include <ntdddisk.h>
+
+/* bucket N counts the writes of 2^(N+9) to 2^(N+10) - 1 bytes, the last those larger */
+
+#define TEST_DISK_SIZE_BUCKETS  16
+
+typedef struct _TEST_DISK TEST_DISK, *PTEST_DISK;
+
+typedef NTSTATUS TEST_DISK_HOOK (PTEST_DISK Disk, UCHAR MajorFunction, LONGLONG Offset, ULONG Length);
+
+struct _TEST_DISK {
+    PDEVICE_OBJECT  DeviceObject;
+    WCHAR           Name[64];
+    PUCHAR          Image;
+    LONGLONG        Length;
+    int             File;
+
+    /* the geometry, set before the driver is attached */
+    LONGLONG        StartingOffset;
+    ULONG           SectorSize;
+    ULONG           PhysicalSectorSize;
+    ULONG           PhysicalSectorOffset;
+    ULONG           UnmapGranularity;
+    BOOLEAN         Trim;
+    ULONG           MaximumTransferLength;
+    ULONG           MaximumPhysicalPages;
+    ULONG           AlignmentMask;
+
+    TEST_DISK_HOOK  *Hook;
+    PVOID           HookContext;
+
+    /* the counts since the disk was created or reset */
+    volatile LONG       Reads;
+    volatile LONG       Writes;
+    volatile LONG       Trims;
+    volatile LONG       Ioctls;
+    volatile LONG       Flushes;
+    volatile LONGLONG   BytesRead;
+    volatile LONGLONG   BytesWritten;
+    volatile LONGLONG   BytesTrimmed;
+    volatile LONG       WriteSizes[TEST_DISK_SIZE_BUCKETS];
+    volatile LONG       InFlight;
+    volatile LONG       MaximumInFlight;
+
+    /* the queue of the requests the threads complete */
+    ULONG           Threads;
+    pthread_t       Thread[16];
+    pthread_mutex_t QueueLock;
+    pthread_cond_t  QueueSignal;
+    LIST_ENTRY      Queue;
+    BOOLEAN         Stop;
+};
+
+/* without a Path the image is in memory, a file is made sparse at Length
+   and a block device is used as it is, up to Length when it's not 0 */
+
+PTEST_DISK
+TestDiskCreate (
+    IN PCWSTR       Name,
+    IN LONGLONG     Length,
+    IN ULONG        SectorSize,
+    IN const char   *Path
+    );
+
+VOID
+TestDiskSetSwapHeader (
+    IN PTEST_DISK Disk
+    );
+
+VOID
+TestDiskStartThreads (
+    IN PTEST_DISK   Disk,
+    IN ULONG        Threads
+    );
+
+VOID
+TestDiskResetCounts (
+    IN PTEST_DISK Disk
+    );
+
+VOID
+TestDiskDelete (
+    IN PTEST_DISK Disk
+    );
+
+#endif /* _DISK_H_ */
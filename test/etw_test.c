@@ -0,0 +1,462 @@
+/*
+    Tests of the ETW events of the driver.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The driver writes TraceLogging events, and the stand-in of the
+    provider keeps the events a test has enabled. The tests check the
+    GUID of the provider against the one TraceLogging derives from its
+    name, that no event is written when no session wants it, and the
+    payload of the read and write, length fixup, paging path and format
+    events.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swapfsetw.h"
+#include "swap.h"
+
+#define TEST_DISK_LENGTH    (512 * 1024 * 1024)
+
+static PTEST_DISK test_disk;
+static PDEVICE_OBJECT test_device;
+
+/* SHA-1 as in FIPS 180-4, only for the GUID of the provider name */
+
+static ULONG
+test_rol (
+    IN ULONG    Value,
+    IN ULONG    Bits
+    )
+{
+    return (Value << Bits) | (Value >> (32 - Bits));
+}
+
+static VOID
+test_sha1 (
+    IN const UCHAR  *Data,
+    IN ULONG        Length,
+    OUT UCHAR       Digest[20]
+    )
+{
+    ULONG   h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    UCHAR   block[64];
+    ULONG   w[80];
+    ULONG   a, b, c, d, e, f, k, t;
+    ULONG   n, i, nblock;
+
+    nblock = (Length + 8) / 64 + 1;
+
+    for (n = 0; n < nblock; n++)
+    {
+        for (i = 0; i < 64; i++)
+        {
+            ULONG offset = n * 64 + i;
+
+            block[i] = offset < Length ? Data[offset] : offset == Length ? 0x80 : 0;
+        }
+
+        if (n == nblock - 1)
+        {
+            for (i = 0; i < 8; i++)
+            {
+                block[63 - i] = (UCHAR) (((ULONGLONG) Length * 8) >> (i * 8));
+            }
+        }
+
+        for (i = 0; i < 16; i++)
+        {
+            w[i] = (ULONG) block[i * 4] << 24 | block[i * 4 + 1] << 16 | block[i * 4 + 2] << 8 | block[i * 4 + 3];
+        }
+
+        for (i = 16; i < 80; i++)
+        {
+            w[i] = test_rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+        for (i = 0; i < 80; i++)
+        {
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5a827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ed9eba1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+            else             { f = b ^ c ^ d;                   k = 0xca62c1d6; }
+
+            t = test_rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = test_rol(b, 30); b = a; a = t;
+        }
+
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    for (i = 0; i < 20; i++)
+    {
+        Digest[i] = (UCHAR) (h[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+static const WDK_TRACE_FIELD *
+test_field (
+    IN const WDK_TRACE_EVENT    *Event,
+    IN const char               *Name
+    )
+{
+    ULONG n;
+
+    for (n = 0; n < Event->NumberOfFields; n++)
+    {
+        if (Event->Field[n].Name && !strcmp(Event->Field[n].Name, Name))
+        {
+            return &Event->Field[n];
+        }
+    }
+
+    fprintf(stderr, "%s has no field %s\n", Event->Name, Name);
+
+    return NULL;
+}
+
+static ULONGLONG
+test_value (
+    IN const WDK_TRACE_EVENT    *Event,
+    IN const char               *Name
+    )
+{
+    const WDK_TRACE_FIELD *field;
+
+    field = test_field(Event, Name);
+
+    return field ? field->Value : (ULONGLONG) -1;
+}
+
+static const WDK_TRACE_EVENT *
+test_event (
+    IN const char   *Name,
+    IN ULONG        Occurrence
+    )
+{
+    LONG n;
+
+    for (n = 0; n < min(WdkTraceEventCount, WDK_TRACE_EVENTS); n++)
+    {
+        if (!strcmp(WdkTraceEvents[n].Name, Name) && Occurrence-- == 0)
+        {
+            return &WdkTraceEvents[n];
+        }
+    }
+
+    return NULL;
+}
+
+static ULONG
+test_count (
+    IN const char *Name
+    )
+{
+    ULONG n;
+
+    for (n = 0; test_event(Name, n); n++)
+        ;
+
+    return n;
+}
+
+static NTSTATUS
+test_usage_completion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    KeSetEvent((PKEVENT) Context, IO_NO_INCREMENT, FALSE);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+/* the notification the memory manager sends when a page file is created or deleted on the volume */
+
+static NTSTATUS
+test_paging_notification (
+    IN BOOLEAN InPath
+    )
+{
+    PIO_STACK_LOCATION  io_stack;
+    KEVENT              event;
+    PIRP                irp;
+    NTSTATUS            status;
+
+    irp = IoAllocateIrp(test_device->StackSize, FALSE);
+
+    if (!irp)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    KeInitializeEvent(&event, NotificationEvent, FALSE);
+
+    irp->IoStatus.Status = STATUS_NOT_SUPPORTED;
+
+    io_stack = IoGetNextIrpStackLocation(irp);
+
+    io_stack->MajorFunction = IRP_MJ_PNP;
+    io_stack->MinorFunction = IRP_MN_DEVICE_USAGE_NOTIFICATION;
+    io_stack->Parameters.UsageNotification.InPath = InPath;
+    io_stack->Parameters.UsageNotification.Type = DeviceUsageTypePaging;
+
+    IoSetCompletionRoutine(irp, test_usage_completion, &event, TRUE, TRUE, TRUE);
+
+    IoCallDriver(test_device, irp);
+
+    KeWaitForSingleObject(&event, Executive, KernelMode, FALSE, NULL);
+
+    status = irp->IoStatus.Status;
+
+    IoFreeIrp(irp);
+
+    return status;
+}
+
+static void
+test_provider_guid (void)
+{
+    static const UCHAR name_space[16] = {
+        0x48, 0x2c, 0x2d, 0xb2, 0xc3, 0x90, 0x47, 0xc8, 0x87, 0xf8, 0x1a, 0x15, 0xbf, 0xc1, 0x30, 0xfb
+    };
+    UCHAR   data[16 + 2 * 32];
+    UCHAR   digest[20];
+    GUID    guid;
+    ULONG   n, length;
+
+    /* the name space of TraceLogging followed by the upper case name in UTF-16BE */
+
+    RtlCopyMemory(data, name_space, sizeof(name_space));
+
+    length = (ULONG) strlen(SwapFsTraceProvider->Name);
+
+    for (n = 0; n < length; n++)
+    {
+        data[16 + n * 2] = 0;
+        data[16 + n * 2 + 1] = (UCHAR) toupper(SwapFsTraceProvider->Name[n]);
+    }
+
+    test_sha1(data, 16 + length * 2, digest);
+
+    digest[7] = (digest[7] & 0x0f) | 0x50;
+
+    guid.Data1 = digest[0] | digest[1] << 8 | digest[2] << 16 | (ULONG) digest[3] << 24;
+    guid.Data2 = (USHORT) (digest[4] | digest[5] << 8);
+    guid.Data3 = (USHORT) (digest[6] | digest[7] << 8);
+
+    RtlCopyMemory(guid.Data4, digest + 8, 8);
+
+    CHECK(!strcmp(SwapFsTraceProvider->Name, "SwapFs"));
+    CHECK(RtlCompareMemory(&guid, &SwapFsTraceProvider->Guid, sizeof(GUID)) == sizeof(GUID));
+    CHECK(guid.Data1 == 0xb0b212b3 && guid.Data2 == 0x5db2 && guid.Data3 == 0x5d09);
+}
+
+static void
+test_format_phases (void)
+{
+    const WDK_TRACE_EVENT   *event;
+    const WDK_TRACE_FIELD   *phase;
+    NTSTATUS                status;
+    ULONG                   n;
+
+    test_disk = TestDiskCreate(L"\\Device\\Harddisk4\\Partition1", TEST_DISK_LENGTH, 512, NULL);
+
+    TestDiskSetSwapHeader(test_disk);
+
+    WdkClearRegistry();
+
+    /* only the format is traced while the driver loads */
+
+    WdkTraceEnable(SwapFsTraceProvider, WINEVENT_LEVEL_INFO, SWAPFS_KEYWORD_FORMAT);
+
+    test_device = TestLoadDriver(test_disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    if (!test_device)
+    {
+        exit(1);
+    }
+
+    CHECK(test_count("FormatPhase") > 0);
+    CHECK(test_count("FormatPhase") == (ULONG) WdkTraceEventCount);
+
+    for (n = 0; (event = test_event("FormatPhase", n)) != NULL; n++)
+    {
+        phase = test_field(event, "Phase");
+
+        CHECK(phase && phase->Type == WdkTraceString && ((const char *) phase->Pointer)[0]);
+        CHECK(test_value(event, "DeviceObject") == (ULONG_PTR) test_device);
+        CHECK(test_value(event, "NumberOfSectors") != (ULONGLONG) -1);
+        CHECK(test_value(event, "Sector") + test_value(event, "NumberOfSectors") <= TEST_DISK_LENGTH / 512);
+
+        if (phase)
+        {
+            printf("    %-24s sector %8llu, %6llu sectors\n", (const char *) phase->Pointer,
+                test_value(event, "Sector"), test_value(event, "NumberOfSectors"));
+        }
+    }
+}
+
+static void
+test_untraced (void)
+{
+    UCHAR buffer[4096];
+
+    /* no session has the provider enabled, so the payload is not even collected */
+
+    WdkTraceEnable(SwapFsTraceProvider, 0, 0);
+
+    WdkTraceWrites = 0;
+
+    CHECK_STATUS(TestReadWrite(test_device, IRP_MJ_READ, 0, sizeof(buffer), buffer), STATUS_SUCCESS);
+    CHECK_STATUS(TestReadWrite(test_device, IRP_MJ_WRITE, 64 * 1024 * 1024, sizeof(buffer), buffer), STATUS_SUCCESS);
+    CHECK_STATUS(test_paging_notification(TRUE), STATUS_SUCCESS);
+    CHECK_STATUS(test_paging_notification(FALSE), STATUS_SUCCESS);
+
+    CHECK(WdkTraceWrites == 0);
+    CHECK(WdkTraceEventCount == 0);
+}
+
+static void
+test_read_write (void)
+{
+    const WDK_TRACE_EVENT   *dispatch, *complete;
+    UCHAR                   buffer[8192];
+
+    WdkTraceEnable(SwapFsTraceProvider, WINEVENT_LEVEL_VERBOSE, SWAPFS_KEYWORD_READ_WRITE);
+
+    CHECK_STATUS(TestReadWrite(test_device, IRP_MJ_WRITE, 64 * 1024 * 1024, sizeof(buffer), buffer), STATUS_SUCCESS);
+    CHECK_STATUS(TestReadWrite(test_device, IRP_MJ_READ, 32 * 1024 * 1024, 4096, buffer), STATUS_SUCCESS);
+
+    CHECK(test_count("ReadWriteDispatch") == 2);
+    CHECK(test_count("ReadWriteComplete") == 2);
+
+    dispatch = test_event("ReadWriteDispatch", 0);
+    complete = test_event("ReadWriteComplete", 0);
+
+    if (dispatch && complete)
+    {
+        CHECK(test_value(dispatch, "MajorFunction") == IRP_MJ_WRITE);
+        CHECK(test_value(dispatch, "Offset") == 64 * 1024 * 1024);
+        CHECK(test_value(dispatch, "Length") == sizeof(buffer));
+        CHECK(test_value(dispatch, "DeviceObject") == (ULONG_PTR) test_device);
+
+        CHECK(test_value(complete, "MajorFunction") == IRP_MJ_WRITE);
+        CHECK(test_value(complete, "Status") == STATUS_SUCCESS);
+        CHECK(test_value(complete, "Information") == sizeof(buffer));
+        CHECK(test_value(complete, "Irp") == test_value(dispatch, "Irp"));
+        CHECK((LONGLONG) test_value(complete, "LatencyUs") >= 0);
+    }
+
+    dispatch = test_event("ReadWriteDispatch", 1);
+
+    if (dispatch)
+    {
+        CHECK(test_value(dispatch, "MajorFunction") == IRP_MJ_READ);
+        CHECK(test_value(dispatch, "Offset") == 32 * 1024 * 1024);
+        CHECK(test_value(dispatch, "Length") == 4096);
+    }
+
+    /* the reads and writes are verbose, so a session at the info level does not get them */
+
+    WdkTraceEnable(SwapFsTraceProvider, WINEVENT_LEVEL_INFO, SWAPFS_KEYWORD_READ_WRITE);
+
+    WdkTraceWrites = 0;
+
+    CHECK_STATUS(TestReadWrite(test_device, IRP_MJ_READ, 0, 4096, buffer), STATUS_SUCCESS);
+
+    CHECK(WdkTraceWrites == 0);
+}
+
+static void
+test_length_fixup (void)
+{
+    const WDK_TRACE_EVENT   *event;
+    GET_LENGTH_INFORMATION  length;
+    ULONG_PTR               information;
+
+    /* a session for the device controls does not get the reads and writes */
+
+    WdkTraceEnable(SwapFsTraceProvider, WINEVENT_LEVEL_VERBOSE, SWAPFS_KEYWORD_IOCTL);
+
+    CHECK_STATUS(TestDeviceControl(test_device, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &length, sizeof(length), &information), STATUS_SUCCESS);
+
+    CHECK(length.Length.QuadPart == TEST_DISK_LENGTH - sizeof(union swap_header));
+
+    event = test_event("LengthFixup", 0);
+
+    CHECK(event != NULL);
+    CHECK(WdkTraceEventCount == 1);
+
+    if (event)
+    {
+        CHECK(test_value(event, "IoControlCode") == IOCTL_DISK_GET_LENGTH_INFO);
+        CHECK(test_value(event, "PartitionLength") == TEST_DISK_LENGTH);
+        CHECK(test_value(event, "VolumeLength") == TEST_DISK_LENGTH - sizeof(union swap_header));
+    }
+}
+
+static void
+test_paging_path (void)
+{
+    const WDK_TRACE_EVENT *event;
+
+    WdkTraceEnable(SwapFsTraceProvider, WINEVENT_LEVEL_INFO, SWAPFS_KEYWORD_PNP);
+
+    CHECK_STATUS(test_paging_notification(TRUE), STATUS_SUCCESS);
+    CHECK_STATUS(test_paging_notification(FALSE), STATUS_SUCCESS);
+
+    CHECK(test_count("PagingPath") == 2);
+
+    event = test_event("PagingPath", 0);
+
+    if (event)
+    {
+        CHECK(test_value(event, "InPath") == TRUE);
+        CHECK(test_value(event, "PagingPathCount") == 1);
+        CHECK(test_value(event, "Status") == STATUS_SUCCESS);
+    }
+
+    event = test_event("PagingPath", 1);
+
+    if (event)
+    {
+        CHECK(test_value(event, "InPath") == FALSE);
+        CHECK(test_value(event, "PagingPathCount") == 0);
+    }
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_provider_guid);
+    TEST_RUN(test_format_phases);
+    TEST_RUN(test_untraced);
+    TEST_RUN(test_read_write);
+    TEST_RUN(test_length_fixup);
+    TEST_RUN(test_paging_path);
+
+    return TestFailures != 0;
+}
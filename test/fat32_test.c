@@ -0,0 +1,341 @@
+/*
+    Tests of the virtual zero fill of the FAT32 metadata region.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    VirtualZeroFill marks the sectors of the FAT32 metadata region in a
+    bitmap instead of writing zeros to them, so the first tests look at
+    the bookkeeping of the bitmap and the others at a volume formated on
+    a disk with garbage where the FATs go: it must check as a valid
+    volume, read the sectors not written as zeros and the written ones as
+    written, and take fewer bytes to format than a volume that is cleared.
+    Without it a FAT32 volume whose FATs can't be cleared must not be
+    written, the format falls back to FAT16.
+*/
+
+#include <stdlib.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swap.h"
+
+#define TEST_DISK_LENGTH    (512 * 1024 * 1024)
+#define TEST_GARBAGE_LENGTH (32 * 1024 * 1024)
+
+static PTEST_DISK
+test_disk (
+    IN PCWSTR Name
+    )
+{
+    PTEST_DISK disk;
+
+    disk = TestDiskCreate(Name, TEST_DISK_LENGTH, 512, NULL);
+
+    if (disk)
+    {
+        /* what a FAT or the root directory that is not cleared would read */
+
+        RtlFillMemory(disk->Image + sizeof(union swap_header), TEST_GARBAGE_LENGTH, 0xA5);
+
+        TestDiskSetSwapHeader(disk);
+    }
+
+    return disk;
+}
+
+static PDEVICE_OBJECT
+test_load (
+    IN PTEST_DISK   Disk,
+    IN ULONG        VirtualZeroFill
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    NTSTATUS        status;
+
+    WdkClearRegistry();
+
+    TestSetParameter("VirtualZeroFill", VirtualZeroFill);
+
+    device_object = TestLoadDriver(Disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    return device_object;
+}
+
+static BOOLEAN
+test_is_filled (
+    IN PUCHAR   Buffer,
+    IN ULONG    Length,
+    IN UCHAR    Value
+    )
+{
+    ULONG n;
+
+    for (n = 0; n < Length; n++)
+    {
+        if (Buffer[n] != Value)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+test_bitmap_bookkeeping (void)
+{
+    PDEVICE_EXTENSION   device_extension;
+    PRTL_BITMAP         bitmap;
+    LONG                allocations;
+
+    allocations = WdkPoolAllocations;
+
+    device_extension = (PDEVICE_EXTENSION) calloc(1, sizeof(DEVICE_EXTENSION));
+
+    CHECK_STATUS(ZeroFillInitialize(device_extension, 512, 100), STATUS_SUCCESS);
+
+    bitmap = &device_extension->ZeroFill.Bitmap;
+
+    CHECK(device_extension->ZeroFill.Length == 100 * 512);
+    CHECK(RtlNumberOfSetBits(bitmap) == 100);
+
+    /* a write of part of two sectors clears both of them */
+
+    ZeroFillMarkWritten(device_extension, 3 * 512 + 10, 600);
+
+    CHECK(RtlCheckBit(bitmap, 2));
+    CHECK(!RtlCheckBit(bitmap, 3));
+    CHECK(!RtlCheckBit(bitmap, 4));
+    CHECK(RtlCheckBit(bitmap, 5));
+
+    /* a write past the end clears up to the end */
+
+    ZeroFillMarkWritten(device_extension, 99 * 512, 4096);
+
+    CHECK(!RtlCheckBit(bitmap, 99));
+    CHECK(RtlNumberOfSetBits(bitmap) == 97);
+
+    /* writes after the end or of nothing does not change it */
+
+    ZeroFillMarkWritten(device_extension, 100 * 512, 512);
+    ZeroFillMarkWritten(device_extension, 0, 0);
+
+    CHECK(RtlNumberOfSetBits(bitmap) == 97);
+
+    ZeroFillRelease(device_extension);
+
+    CHECK(device_extension->ZeroFill.Bitmap.Buffer == NULL);
+    CHECK(device_extension->ZeroFill.Length == 0);
+    CHECK(WdkPoolAllocations == allocations);
+
+    /* a released bitmap is not written to and can be created again */
+
+    ZeroFillMarkWritten(device_extension, 0, 512);
+
+    CHECK_STATUS(ZeroFillInitialize(device_extension, 4096, 33), STATUS_SUCCESS);
+    CHECK(RtlNumberOfSetBits(&device_extension->ZeroFill.Bitmap) == 33);
+
+    ZeroFillRelease(device_extension);
+
+    free(device_extension);
+}
+
+static void
+test_volume_is_valid (void)
+{
+    PTEST_DISK      disk;
+    PDEVICE_OBJECT  device_object;
+    FATCHECK        check;
+
+    disk = test_disk(L"\\Device\\Harddisk0\\Partition1");
+
+    device_object = test_load(disk, 1);
+
+    if (!device_object)
+    {
+        return;
+    }
+
+    CHECK(((PDEVICE_EXTENSION) device_object->DeviceExtension)->ZeroFill.Bitmap.Buffer != NULL);
+
+    if (!FatCheckVolume(TestReadVolume, device_object, disk->Length - sizeof(union swap_header), &check))
+    {
+        fprintf(stderr, "fatcheck: %s\n", check.Error);
+        CHECK(FALSE);
+        return;
+    }
+
+    CHECK(check.FileSystem == FATCHECK_FAT32);
+    CHECK(check.FreeClusters + 1 == check.NumberOfClusters);
+
+    /* the last sector of the FAT is read as zeros from memory, not from the disk */
+
+    CHECK(test_is_filled(
+        disk->Image + sizeof(union swap_header) + check.FatOffset + check.FatSectors * check.SectorSize - 512,
+        512,
+        0xA5
+        ));
+}
+
+static void
+test_reads_and_writes (void)
+{
+    PTEST_DISK      disk;
+    PDEVICE_OBJECT  device_object;
+    FATCHECK        check;
+    PUCHAR          buffer;
+    LONGLONG        offset;
+    LONG            reads;
+
+    disk = test_disk(L"\\Device\\Harddisk0\\Partition2");
+
+    device_object = test_load(disk, 1);
+
+    if (!device_object || !FatCheckVolume(TestReadVolume, device_object, disk->Length - sizeof(union swap_header), &check))
+    {
+        CHECK(FALSE);
+        return;
+    }
+
+    buffer = (PUCHAR) ExAllocatePoolWithTag(NonPagedPool, 8192, 0);
+
+    /* a sector in the middle of the first FAT that is not written */
+
+    offset = check.FatOffset + check.FatSectors / 2 * check.SectorSize;
+
+    offset = ALIGN_DOWN_BY(offset, 4096);
+
+    reads = disk->Reads;
+
+    RtlFillMemory(buffer, 4096, 0x11);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, offset, 4096, buffer), STATUS_SUCCESS);
+    CHECK(test_is_filled(buffer, 4096, 0));
+    CHECK(disk->Reads == reads);
+
+    /* one sector written, the read of it and the sectors after goes to the disk */
+
+    RtlFillMemory(buffer, 512, 0x5A);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, offset, 512, buffer), STATUS_SUCCESS);
+    CHECK(test_is_filled(disk->Image + sizeof(union swap_header) + offset, 512, 0x5A));
+
+    RtlFillMemory(buffer, 4096, 0x11);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, offset, 4096, buffer), STATUS_SUCCESS);
+    CHECK(test_is_filled(buffer, 512, 0x5A));
+    CHECK(test_is_filled(buffer + 512, 4096 - 512, 0));
+    CHECK(disk->Reads == reads + 1);
+
+    /* a read past the metadata region is not changed */
+
+    offset = check.DataOffset + 64 * check.ClusterSize;
+
+    RtlFillMemory(disk->Image + sizeof(union swap_header) + offset, 4096, 0x77);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, offset, 4096, buffer), STATUS_SUCCESS);
+    CHECK(test_is_filled(buffer, 4096, 0x77));
+
+    ExFreePool(buffer);
+}
+
+static void
+test_fewer_bytes_written (void)
+{
+    PTEST_DISK      cleared, virtual;
+    PDEVICE_OBJECT  device_object;
+    FATCHECK        check;
+
+    cleared = test_disk(L"\\Device\\Harddisk0\\Partition3");
+    virtual = test_disk(L"\\Device\\Harddisk0\\Partition4");
+
+    device_object = test_load(cleared, 0);
+
+    CHECK(device_object && FatCheckVolume(TestReadVolume, device_object, cleared->Length - sizeof(union swap_header), &check));
+
+    device_object = test_load(virtual, 1);
+
+    CHECK(device_object && FatCheckVolume(TestReadVolume, device_object, virtual->Length - sizeof(union swap_header), &check));
+
+    printf("    cleared: %d writes of %lld bytes, virtual zero fill: %d writes of %lld bytes\n",
+        cleared->Writes, cleared->BytesWritten, virtual->Writes, virtual->BytesWritten);
+
+    /* the FATs are no longer written, only the sectors with something in them */
+
+    CHECK(virtual->BytesWritten * 16 < cleared->BytesWritten);
+    CHECK(virtual->BytesWritten < (LONGLONG) check.FatSectors * check.SectorSize);
+}
+
+static LONG test_failed_writes;
+
+static NTSTATUS
+test_fail_clear (
+    IN PTEST_DISK   Disk,
+    IN UCHAR        MajorFunction,
+    IN LONGLONG     Offset,
+    IN ULONG        Length
+    )
+{
+    /* the first of the large writes of zeros over the FATs fails */
+
+    if (MajorFunction == IRP_MJ_WRITE && Length >= 65536 && !test_failed_writes)
+    {
+        test_failed_writes++;
+        return STATUS_DATA_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static void
+test_clear_fails (void)
+{
+    PTEST_DISK      disk;
+    PDEVICE_OBJECT  device_object;
+    FATCHECK        check;
+
+    disk = test_disk(L"\\Device\\Harddisk0\\Partition5");
+
+    disk->Hook = test_fail_clear;
+
+    device_object = test_load(disk, 0);
+
+    CHECK(test_failed_writes == 1);
+
+    if (!device_object || !FatCheckVolume(TestReadVolume, device_object, disk->Length - sizeof(union swap_header), &check))
+    {
+        CHECK(FALSE);
+        return;
+    }
+
+    CHECK(check.FileSystem == FATCHECK_FAT16);
+
+    disk->Hook = NULL;
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_bitmap_bookkeeping);
+    TEST_RUN(test_volume_is_valid);
+    TEST_RUN(test_reads_and_writes);
+    TEST_RUN(test_fewer_bytes_written);
+    TEST_RUN(test_clear_fails);
+
+    return TestFailures != 0;
+}
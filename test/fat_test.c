@@ -0,0 +1,162 @@
+/*
+    Tests of the FAT12 and FAT16 formatter.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    FormatDeviceToFat writes the boot sector, the FAT, the root directory
+    and the sector after it in bursts of up to 64 KB. The tests format
+    partitions from 2 MB to 1 GB with 512 and 4096 byte sectors, check
+    the volumes and count the requests, which before were one for each
+    of these sectors.
+*/
+
+#include <stdlib.h>
+#include <ntstrsafe.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swap.h"
+
+#define TEST_BURST_SIZE 0x10000
+
+typedef struct _TEST_CASE {
+    LONGLONG    Length;
+    ULONG       SectorSize;
+    ULONG       FileSystem;
+} TEST_CASE;
+
+static const TEST_CASE test_cases[] = {
+    {    2 * 1024 * 1024,  512, FATCHECK_FAT12 },
+    {    2 * 1024 * 1024, 4096, FATCHECK_FAT12 },
+    {   16 * 1024 * 1024,  512, FATCHECK_FAT16 },
+    {   16 * 1024 * 1024, 4096, FATCHECK_FAT16 },
+    {  256 * 1024 * 1024,  512, FATCHECK_FAT16 },
+    {  256 * 1024 * 1024, 4096, FATCHECK_FAT16 },
+    { 1024 * 1024 * 1024,  512, FATCHECK_FAT16 },
+    { 1024 * 1024 * 1024, 4096, FATCHECK_FAT16 },
+};
+
+static ULONG test_number;
+
+static BOOLEAN
+test_is_filled (
+    IN PUCHAR   Buffer,
+    IN ULONG    Length,
+    IN UCHAR    Value
+    )
+{
+    ULONG n;
+
+    for (n = 0; n < Length; n++)
+    {
+        if (Buffer[n] != Value)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+test_format (
+    IN const TEST_CASE *Case
+    )
+{
+    PTEST_DISK          disk;
+    PDEVICE_OBJECT      device_object;
+    PDEVICE_EXTENSION   device_extension;
+    WCHAR               name[64];
+    FATCHECK            check;
+    PUCHAR              volume;
+    ULONG               nmeta, burst;
+    NTSTATUS            status;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk1\\Partition%u", ++test_number);
+
+    disk = TestDiskCreate(name, Case->Length, Case->SectorSize, NULL);
+
+    TestDiskSetSwapHeader(disk);
+
+    WdkClearRegistry();
+
+    device_object = TestLoadDriver(disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    if (!device_object)
+    {
+        return;
+    }
+
+    device_extension = (PDEVICE_EXTENSION) device_object->DeviceExtension;
+
+    /* the larger partitions were formated to FAT32 by the driver, so the
+       FAT formatter is run again with garbage where it writes */
+
+    volume = disk->Image + sizeof(union swap_header);
+
+    RtlFillMemory(volume, (SIZE_T) min(Case->Length - sizeof(union swap_header), 4 * 1024 * 1024), 0xA5);
+
+    TestDiskResetCounts(disk);
+
+    CHECK_STATUS(FormatDeviceToFat(device_extension), STATUS_SUCCESS);
+
+    if (!FatCheckVolume(TestReadVolume, device_object, disk->Length - sizeof(union swap_header), &check))
+    {
+        fprintf(stderr, "fatcheck: %s\n", check.Error);
+        CHECK(FALSE);
+        return;
+    }
+
+    CHECK(check.FileSystem == Case->FileSystem);
+    CHECK(check.SectorSize == Case->SectorSize);
+
+    /* the boot sector, the FAT, the root directory and the sector after it */
+
+    nmeta = check.ReservedSectors + check.FatSectors + check.RootEntries * 32 / check.SectorSize + 1;
+
+    burst = min(nmeta, TEST_BURST_SIZE / check.SectorSize);
+
+    CHECK(disk->Writes == (LONG) ((nmeta + burst - 1) / burst));
+    CHECK(disk->BytesWritten == (LONGLONG) nmeta * check.SectorSize);
+    CHECK(disk->Trims == 0);
+
+    CHECK(test_is_filled(volume + (nmeta - 1) * check.SectorSize, check.SectorSize, 0));
+    CHECK(test_is_filled(volume + nmeta * check.SectorSize, check.SectorSize, 0xA5));
+
+    printf("    %5lld MB %4u: FAT%-2u %4u sectors in %d requests of %lld bytes\n",
+        Case->Length >> 20, Case->SectorSize, check.FileSystem, nmeta, disk->Writes, disk->BytesWritten);
+}
+
+static void
+test_formats (void)
+{
+    ULONG n;
+
+    for (n = 0; n < RTL_NUMBER_OF(test_cases); n++)
+    {
+        test_format(&test_cases[n]);
+    }
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_formats);
+
+    return TestFailures != 0;
+}
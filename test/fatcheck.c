@@ -0,0 +1,735 @@
+/*
+    A checker of the FAT and exFAT volumes the formatters write.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ntddk.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "fatcheck.h"
+
+#define FAT12_MAX_CLUSTERS  4084
+#define FAT16_MAX_CLUSTERS  65524
+
+static BOOLEAN
+fatcheck_error (
+    OUT PFATCHECK   Check,
+    IN const char   *Format,
+    ...
+    )
+{
+    va_list ap;
+
+    va_start(ap, Format);
+    vsnprintf(Check->Error, sizeof(Check->Error), Format, ap);
+    va_end(ap);
+
+    return FALSE;
+}
+
+static ULONG
+get16 (
+    IN const UCHAR *p
+    )
+{
+    return p[0] | (p[1] << 8);
+}
+
+static ULONG
+get32 (
+    IN const UCHAR *p
+    )
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((ULONG) p[3] << 24);
+}
+
+static ULONGLONG
+get64 (
+    IN const UCHAR *p
+    )
+{
+    return get32(p) | ((ULONGLONG) get32(p + 4) << 32);
+}
+
+BOOLEAN
+FatCheckReadMemory (
+    PVOID       Context,
+    ULONGLONG   Offset,
+    ULONG       Length,
+    PVOID       Buffer
+    )
+{
+    RtlCopyMemory(Buffer, (PUCHAR) Context + Offset, Length);
+
+    return TRUE;
+}
+
+/* a large region is read in parts so a read of the volume through the driver can be one request each */
+
+static PUCHAR
+fatcheck_read (
+    IN FATCHECK_READ    *Read,
+    IN PVOID            Context,
+    IN ULONGLONG        Offset,
+    IN ULONGLONG        Length
+    )
+{
+    PUCHAR      buffer;
+    ULONGLONG   n;
+    ULONG       count;
+
+    buffer = (PUCHAR) malloc(max(Length, 1));
+
+    if (!buffer)
+    {
+        return NULL;
+    }
+
+    for (n = 0; n < Length; n += count)
+    {
+        count = (ULONG) min(Length - n, 1024 * 1024);
+
+        if (!Read(Context, Offset + n, count, buffer + n))
+        {
+            free(buffer);
+            return NULL;
+        }
+    }
+
+    return buffer;
+}
+
+static ULONG
+fatcheck_entry (
+    IN const UCHAR  *Fat,
+    IN ULONG        FileSystem,
+    IN ULONG        Cluster
+    )
+{
+    ULONG value;
+
+    switch (FileSystem)
+    {
+    case FATCHECK_FAT12:
+        value = get16(Fat + Cluster + Cluster / 2);
+        return (Cluster & 1) ? value >> 4 : value & 0xfff;
+
+    case FATCHECK_FAT16:
+        return get16(Fat + Cluster * 2);
+
+    case FATCHECK_FAT32:
+        return get32(Fat + Cluster * 4) & 0x0fffffff;
+
+    default:
+        return get32(Fat + Cluster * 4);
+    }
+}
+
+/* every entry is free, bad, the end of a chain or the next cluster, which no other entry has */
+
+static BOOLEAN
+fatcheck_chains (
+    IN const UCHAR  *Fat,
+    IN OUT PFATCHECK Check,
+    OUT PULONG      FreeClusters
+    )
+{
+    PUCHAR  linked;
+    ULONG   bad, end;
+    ULONG   cluster, next, nfree;
+
+    bad = (Check->FileSystem == FATCHECK_FAT12) ? 0xff7 :
+          (Check->FileSystem == FATCHECK_FAT16) ? 0xfff7 :
+          (Check->FileSystem == FATCHECK_FAT32) ? 0x0ffffff7 : 0xfffffff7;
+
+    end = bad + 1;
+
+    linked = (PUCHAR) calloc(Check->NumberOfClusters + 2, 1);
+
+    if (!linked)
+    {
+        return fatcheck_error(Check, "out of memory");
+    }
+
+    for (nfree = 0, cluster = 2; cluster < Check->NumberOfClusters + 2; cluster++)
+    {
+        next = fatcheck_entry(Fat, Check->FileSystem, cluster);
+
+        if (!next)
+        {
+            nfree++;
+        }
+        else if (next == bad || next >= end)
+        {
+        }
+        else if (next < 2 || next >= Check->NumberOfClusters + 2)
+        {
+            free(linked);
+            return fatcheck_error(Check, "cluster %u links to %u outside the volume", cluster, next);
+        }
+        else if (linked[next]++)
+        {
+            free(linked);
+            return fatcheck_error(Check, "cluster %u is linked from two clusters", next);
+        }
+        else if (!fatcheck_entry(Fat, Check->FileSystem, next))
+        {
+            free(linked);
+            return fatcheck_error(Check, "cluster %u links to the free cluster %u", cluster, next);
+        }
+    }
+
+    free(linked);
+
+    *FreeClusters = nfree;
+
+    return TRUE;
+}
+
+/* the clusters of the chain from First, without a loop and ending with the end mark */
+
+static ULONG
+fatcheck_chain_length (
+    IN const UCHAR  *Fat,
+    IN PFATCHECK    Check,
+    IN ULONG        First
+    )
+{
+    ULONG cluster, n;
+
+    for (n = 0, cluster = First; cluster >= 2 && cluster < Check->NumberOfClusters + 2; n++)
+    {
+        if (n > Check->NumberOfClusters)
+        {
+            return 0;
+        }
+
+        cluster = fatcheck_entry(Fat, Check->FileSystem, cluster);
+
+        if (!cluster)
+        {
+            return 0;
+        }
+    }
+
+    return (cluster >= 2 && cluster < Check->NumberOfClusters + 2) ? 0 : n;
+}
+
+static BOOLEAN
+fatcheck_fats (
+    IN FATCHECK_READ    *Read,
+    IN PVOID            Context,
+    IN OUT PFATCHECK    Check,
+    OUT PUCHAR          *Fat
+    )
+{
+    PUCHAR      fat, copy;
+    ULONGLONG   length;
+    ULONG       n;
+
+    length = (ULONGLONG) Check->FatSectors * Check->SectorSize;
+
+    fat = fatcheck_read(Read, Context, Check->FatOffset, length);
+
+    if (!fat)
+    {
+        return fatcheck_error(Check, "the FAT can not be read");
+    }
+
+    for (n = 1; n < Check->NumberOfFats; n++)
+    {
+        copy = fatcheck_read(Read, Context, Check->FatOffset + n * length, length);
+
+        if (!copy || memcmp(fat, copy, length))
+        {
+            free(copy);
+            free(fat);
+            return fatcheck_error(Check, "FAT %u is not the same as the first", n + 1);
+        }
+
+        free(copy);
+    }
+
+    *Fat = fat;
+
+    return TRUE;
+}
+
+static BOOLEAN
+fatcheck_directory (
+    IN const UCHAR  *Directory,
+    IN ULONG        Length,
+    IN const UCHAR  *Fat,
+    IN OUT PFATCHECK Check
+    )
+{
+    const UCHAR *entry;
+    ULONG       n, cluster;
+
+    for (n = 0; n < Length; n += 32)
+    {
+        entry = Directory + n;
+
+        if (!entry[0])
+        {
+            break;
+        }
+
+        if (entry[0] == 0xe5 || entry[11] == 0x0f || (entry[11] & 0x08))
+        {
+            continue;
+        }
+
+        cluster = get16(entry + 26) | (Check->FileSystem == FATCHECK_FAT32 ? get16(entry + 20) << 16 : 0);
+
+        if (cluster && (cluster < 2 || cluster >= Check->NumberOfClusters + 2 ||
+            !fatcheck_entry(Fat, Check->FileSystem, cluster)))
+        {
+            return fatcheck_error(Check, "the root directory entry %u starts at cluster %u that is not in use", n / 32, cluster);
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOLEAN
+fatcheck_fat (
+    IN FATCHECK_READ    *Read,
+    IN PVOID            Context,
+    IN ULONGLONG        Length,
+    IN const UCHAR      *Boot,
+    IN OUT PFATCHECK    Check
+    )
+{
+    PUCHAR      fat, sector, directory;
+    ULONG       root_sectors, media, first, second, nfree, n;
+    ULONGLONG   data_sectors;
+    ULONG       fsinfo, backup;
+    BOOLEAN     ok;
+
+    if (!(Boot[0] == 0xeb && Boot[2] == 0x90) && Boot[0] != 0xe9)
+    {
+        return fatcheck_error(Check, "the boot sector has no jump instruction");
+    }
+
+    Check->SectorSize = get16(Boot + 11);
+    Check->ClusterSize = Boot[13] * Check->SectorSize;
+    Check->ReservedSectors = get16(Boot + 14);
+    Check->NumberOfFats = Boot[16];
+    Check->RootEntries = get16(Boot + 17);
+    Check->TotalSectors = get16(Boot + 19) ? get16(Boot + 19) : get32(Boot + 32);
+    Check->FatSectors = get16(Boot + 22) ? get16(Boot + 22) : get32(Boot + 36);
+
+    media = Boot[21];
+
+    if (!Boot[13] || (Boot[13] & (Boot[13] - 1)) || Check->ClusterSize > 64 * 1024)
+    {
+        return fatcheck_error(Check, "%u sectors per cluster", Boot[13]);
+    }
+
+    if (!Check->ReservedSectors || Check->NumberOfFats < 1 || Check->NumberOfFats > 2 || media < 0xf0 ||
+        (media > 0xf0 && media < 0xf8))
+    {
+        return fatcheck_error(Check, "%u reserved sectors, %u FATs, media %#x", Check->ReservedSectors, Check->NumberOfFats, media);
+    }
+
+    if (Check->TotalSectors * Check->SectorSize > Length)
+    {
+        return fatcheck_error(Check, "%llu sectors do not fit in %llu bytes", Check->TotalSectors, Length);
+    }
+
+    root_sectors = (Check->RootEntries * 32 + Check->SectorSize - 1) / Check->SectorSize;
+
+    Check->FatOffset = (ULONGLONG) Check->ReservedSectors * Check->SectorSize;
+    Check->RootOffset = Check->FatOffset + (ULONGLONG) Check->NumberOfFats * Check->FatSectors * Check->SectorSize;
+    Check->DataOffset = Check->RootOffset + (ULONGLONG) root_sectors * Check->SectorSize;
+
+    if (Check->DataOffset >= Check->TotalSectors * Check->SectorSize)
+    {
+        return fatcheck_error(Check, "no data region");
+    }
+
+    data_sectors = Check->TotalSectors - Check->DataOffset / Check->SectorSize;
+
+    Check->NumberOfClusters = (ULONG) (data_sectors / Boot[13]);
+
+    Check->FileSystem =
+        (Check->NumberOfClusters <= FAT12_MAX_CLUSTERS) ? FATCHECK_FAT12 :
+        (Check->NumberOfClusters <= FAT16_MAX_CLUSTERS) ? FATCHECK_FAT16 : FATCHECK_FAT32;
+
+    if ((Check->FileSystem == FATCHECK_FAT32) != (get16(Boot + 22) == 0))
+    {
+        return fatcheck_error(Check, "%u clusters is FAT%u but the boot sector is not", Check->NumberOfClusters, Check->FileSystem);
+    }
+
+    if (Check->FileSystem == FATCHECK_FAT32 ? Check->RootEntries || memcmp(Boot + 82, "FAT32   ", 8) :
+        !Check->RootEntries || memcmp(Boot + 54, Check->FileSystem == FATCHECK_FAT12 ? "FAT12   " : "FAT16   ", 8))
+    {
+        return fatcheck_error(Check, "the boot sector of FAT%u has %u root entries or the wrong type", Check->FileSystem, Check->RootEntries);
+    }
+
+    if ((ULONGLONG) (Check->NumberOfClusters + 2) * Check->FileSystem > (ULONGLONG) Check->FatSectors * Check->SectorSize * 8)
+    {
+        return fatcheck_error(Check, "a FAT of %u sectors is too small for %u clusters", Check->FatSectors, Check->NumberOfClusters);
+    }
+
+    if (!fatcheck_fats(Read, Context, Check, &fat))
+    {
+        return FALSE;
+    }
+
+    first = fatcheck_entry(fat, Check->FileSystem, 0);
+    second = fatcheck_entry(fat, Check->FileSystem, 1);
+
+    ok = (Check->FileSystem == FATCHECK_FAT12) ? first == (0xf00 | media) && second == 0xfff :
+         (Check->FileSystem == FATCHECK_FAT16) ? first == (0xff00 | media) && (second | 0xc000) == 0xffff :
+         first == (0x0fffff00 | media) && (second | 0x0c000000) == 0x0fffffff;
+
+    if (!ok)
+    {
+        free(fat);
+        return fatcheck_error(Check, "the first FAT entries are %#x and %#x", first, second);
+    }
+
+    if (!fatcheck_chains(fat, Check, &nfree))
+    {
+        free(fat);
+        return FALSE;
+    }
+
+    Check->FreeClusters = nfree;
+
+    if (Check->FileSystem == FATCHECK_FAT32)
+    {
+        Check->RootCluster = get32(Boot + 44);
+
+        n = fatcheck_chain_length(fat, Check, Check->RootCluster);
+
+        if (!n)
+        {
+            free(fat);
+            return fatcheck_error(Check, "the root directory at cluster %u has no valid chain", Check->RootCluster);
+        }
+
+        Check->RootOffset = Check->DataOffset + (ULONGLONG) (Check->RootCluster - 2) * Check->ClusterSize;
+
+        directory = fatcheck_read(Read, Context, Check->RootOffset, Check->ClusterSize);
+        ok = directory && fatcheck_directory(directory, Check->ClusterSize, fat, Check);
+        free(directory);
+
+        fsinfo = get16(Boot + 48);
+        backup = get16(Boot + 50);
+
+        sector = (PUCHAR) malloc(Check->SectorSize);
+
+        if (ok && fsinfo && fsinfo != 0xffff)
+        {
+            ok = sector && Read(Context, (ULONGLONG) fsinfo * Check->SectorSize, Check->SectorSize, sector);
+
+            if (ok && (get32(sector) != 0x41615252 || get32(sector + 484) != 0x61417272 || get32(sector + 508) != 0xaa550000))
+            {
+                ok = fatcheck_error(Check, "the FSInfo sector has no signatures");
+            }
+            else if (ok && get32(sector + 488) != 0xffffffff && get32(sector + 488) != nfree)
+            {
+                ok = fatcheck_error(Check, "the FSInfo sector has %u free clusters but the FAT %u", get32(sector + 488), nfree);
+            }
+        }
+
+        if (ok && backup && backup != 0xffff)
+        {
+            ok = sector && Read(Context, (ULONGLONG) backup * Check->SectorSize, Check->SectorSize, sector);
+
+            if (ok && memcmp(sector, Boot, Check->SectorSize))
+            {
+                ok = fatcheck_error(Check, "the backup boot sector is not the same");
+            }
+        }
+
+        free(sector);
+    }
+    else
+    {
+        directory = fatcheck_read(Read, Context, Check->RootOffset, root_sectors * Check->SectorSize);
+        ok = directory && fatcheck_directory(directory, root_sectors * Check->SectorSize, fat, Check);
+        free(directory);
+    }
+
+    free(fat);
+
+    if (!ok && !Check->Error[0])
+    {
+        return fatcheck_error(Check, "the root directory can not be read");
+    }
+
+    return ok;
+}
+
+/* the checksum of the boot region and the up-case table, as in the exFAT specification */
+
+static ULONG
+fatcheck_exfat_checksum (
+    IN ULONG        Checksum,
+    IN const UCHAR  *Buffer,
+    IN ULONG        Length,
+    IN BOOLEAN      BootSector
+    )
+{
+    ULONG n;
+
+    for (n = 0; n < Length; n++)
+    {
+        if (BootSector && (n == 106 || n == 107 || n == 112))
+        {
+            continue;
+        }
+
+        Checksum = ((Checksum & 1) ? 0x80000000 : 0) + (Checksum >> 1) + Buffer[n];
+    }
+
+    return Checksum;
+}
+
+static BOOLEAN
+fatcheck_exfat (
+    IN FATCHECK_READ    *Read,
+    IN PVOID            Context,
+    IN ULONGLONG        Length,
+    IN const UCHAR      *Boot,
+    IN OUT PFATCHECK    Check
+    )
+{
+    PUCHAR      region, fat, directory, bitmap, upcase;
+    ULONGLONG   volume_length, bitmap_length, upcase_length;
+    ULONG       sector_shift, cluster_shift, checksum, upcase_checksum;
+    ULONG       bitmap_cluster, upcase_cluster, cluster, nfree, n;
+    ULONG       sectors_per_cluster;
+    BOOLEAN     ok;
+
+    sector_shift = Boot[108];
+    cluster_shift = Boot[109];
+
+    if (sector_shift < 9 || sector_shift > 12 || sector_shift + cluster_shift > 25)
+    {
+        return fatcheck_error(Check, "sector shift %u and cluster shift %u", sector_shift, cluster_shift);
+    }
+
+    sectors_per_cluster = 1u << cluster_shift;
+
+    Check->FileSystem = FATCHECK_EXFAT;
+    Check->SectorSize = 1u << sector_shift;
+    Check->ClusterSize = Check->SectorSize << cluster_shift;
+    Check->NumberOfFats = Boot[110];
+    Check->ReservedSectors = get32(Boot + 80);
+    Check->FatSectors = get32(Boot + 84);
+    Check->NumberOfClusters = get32(Boot + 92);
+    Check->RootCluster = get32(Boot + 96);
+
+    volume_length = get64(Boot + 72);
+
+    Check->TotalSectors = volume_length;
+    Check->FatOffset = (ULONGLONG) Check->ReservedSectors * Check->SectorSize;
+    Check->DataOffset = (ULONGLONG) get32(Boot + 88) * Check->SectorSize;
+
+    if (volume_length * Check->SectorSize > Length ||
+        get32(Boot + 88) + (ULONGLONG) Check->NumberOfClusters * sectors_per_cluster > volume_length)
+    {
+        return fatcheck_error(Check, "the volume of %llu sectors does not fit", volume_length);
+    }
+
+    if (Check->NumberOfFats != 1 || Check->ReservedSectors < 24 ||
+        Check->ReservedSectors + (ULONGLONG) Check->FatSectors > get32(Boot + 88) ||
+        (ULONGLONG) (Check->NumberOfClusters + 2) * 4 > (ULONGLONG) Check->FatSectors * Check->SectorSize)
+    {
+        return fatcheck_error(Check, "the FAT at sector %u of %u sectors does not fit", Check->ReservedSectors, Check->FatSectors);
+    }
+
+    /* the main and the backup boot region, with the checksum in the last sector of each */
+
+    region = fatcheck_read(Read, Context, 0, 24 * Check->SectorSize);
+
+    if (!region)
+    {
+        return fatcheck_error(Check, "the boot region can not be read");
+    }
+
+    checksum = fatcheck_exfat_checksum(0, region, Check->SectorSize, TRUE);
+    checksum = fatcheck_exfat_checksum(checksum, region + Check->SectorSize, 10 * Check->SectorSize, FALSE);
+
+    for (n = 0, ok = TRUE; n < Check->SectorSize / 4; n++)
+    {
+        ok &= get32(region + 11 * Check->SectorSize + n * 4) == checksum;
+    }
+
+    if (!ok || memcmp(region, region + 12 * Check->SectorSize, 12 * Check->SectorSize))
+    {
+        free(region);
+        return fatcheck_error(Check, "the checksum of the boot region or its backup is wrong");
+    }
+
+    free(region);
+
+    if (!fatcheck_fats(Read, Context, Check, &fat))
+    {
+        return FALSE;
+    }
+
+    if (get32(fat) != 0xfffffff8 || get32(fat + 4) != 0xffffffff)
+    {
+        fatcheck_error(Check, "the first FAT entries are %#x and %#x", get32(fat), get32(fat + 4));
+        free(fat);
+        return FALSE;
+    }
+
+    if (!fatcheck_chains(fat, Check, &nfree))
+    {
+        free(fat);
+        return FALSE;
+    }
+
+    if (!fatcheck_chain_length(fat, Check, Check->RootCluster))
+    {
+        free(fat);
+        return fatcheck_error(Check, "the root directory at cluster %u has no valid chain", Check->RootCluster);
+    }
+
+    Check->RootOffset = Check->DataOffset + (ULONGLONG) (Check->RootCluster - 2) * Check->ClusterSize;
+
+    directory = fatcheck_read(Read, Context, Check->RootOffset, Check->ClusterSize);
+
+    if (!directory)
+    {
+        free(fat);
+        return fatcheck_error(Check, "the root directory can not be read");
+    }
+
+    bitmap_cluster = upcase_cluster = 0;
+    bitmap_length = upcase_length = 0;
+    upcase_checksum = 0;
+
+    for (n = 0; n < Check->ClusterSize && directory[n]; n += 32)
+    {
+        if (directory[n] == 0x81)
+        {
+            bitmap_cluster = get32(directory + n + 20);
+            bitmap_length = get64(directory + n + 24);
+        }
+        else if (directory[n] == 0x82)
+        {
+            upcase_checksum = get32(directory + n + 4);
+            upcase_cluster = get32(directory + n + 20);
+            upcase_length = get64(directory + n + 24);
+        }
+    }
+
+    free(directory);
+
+    if (!bitmap_cluster || bitmap_length < (Check->NumberOfClusters + 7) / 8 ||
+        fatcheck_chain_length(fat, Check, bitmap_cluster) * (ULONGLONG) Check->ClusterSize < bitmap_length)
+    {
+        free(fat);
+        return fatcheck_error(Check, "the allocation bitmap at cluster %u of %llu bytes is not valid", bitmap_cluster, bitmap_length);
+    }
+
+    if (!upcase_cluster || !upcase_length ||
+        fatcheck_chain_length(fat, Check, upcase_cluster) * (ULONGLONG) Check->ClusterSize < upcase_length)
+    {
+        free(fat);
+        return fatcheck_error(Check, "the up-case table at cluster %u of %llu bytes is not valid", upcase_cluster, upcase_length);
+    }
+
+    bitmap = fatcheck_read(Read, Context, Check->DataOffset + (ULONGLONG) (bitmap_cluster - 2) * Check->ClusterSize, (ULONG) bitmap_length);
+    upcase = fatcheck_read(Read, Context, Check->DataOffset + (ULONGLONG) (upcase_cluster - 2) * Check->ClusterSize, (ULONG) upcase_length);
+
+    ok = bitmap && upcase;
+
+    if (ok && fatcheck_exfat_checksum(0, upcase, (ULONG) upcase_length, FALSE) != upcase_checksum)
+    {
+        ok = fatcheck_error(Check, "the checksum of the up-case table is wrong");
+    }
+
+    /* the clusters in a chain are in use in the bitmap, the free ones are counted from it */
+
+    for (cluster = 2; ok && cluster < Check->NumberOfClusters + 2; cluster++)
+    {
+        if (fatcheck_entry(fat, FATCHECK_EXFAT, cluster) && !(bitmap[(cluster - 2) / 8] & (1 << ((cluster - 2) % 8))))
+        {
+            ok = fatcheck_error(Check, "cluster %u is in a chain but free in the bitmap", cluster);
+        }
+    }
+
+    for (nfree = 0, n = 0; ok && n < Check->NumberOfClusters; n++)
+    {
+        nfree += !(bitmap[n / 8] & (1 << (n % 8)));
+    }
+
+    Check->FreeClusters = nfree;
+
+    if (!ok && !Check->Error[0])
+    {
+        fatcheck_error(Check, "the allocation bitmap or the up-case table can not be read");
+    }
+
+    free(upcase);
+    free(bitmap);
+    free(fat);
+
+    return ok;
+}
+
+BOOLEAN
+FatCheckVolume (
+    IN FATCHECK_READ    *Read,
+    IN PVOID            Context,
+    IN ULONGLONG        Length,
+    OUT PFATCHECK       Check
+    )
+{
+    UCHAR       sector[4096];
+    ULONG       sector_size;
+    BOOLEAN     ok;
+
+    RtlZeroMemory(Check, sizeof(FATCHECK));
+
+    if (Length < 4096 || !Read(Context, 0, 512, sector))
+    {
+        return fatcheck_error(Check, "the boot sector can not be read");
+    }
+
+    sector_size = !memcmp(sector + 3, "EXFAT   ", 8) ? 1u << min(sector[108], 12) : get16(sector + 11);
+
+    if (sector_size < 512 || sector_size > 4096 || (sector_size & (sector_size - 1)))
+    {
+        return fatcheck_error(Check, "a sector of %u bytes", sector_size);
+    }
+
+    if (!Read(Context, 0, sector_size, sector) || get16(sector + 510) != 0xaa55)
+    {
+        return fatcheck_error(Check, "the boot sector has no signature");
+    }
+
+    if (!memcmp(sector + 3, "EXFAT   ", 8))
+    {
+        ok = fatcheck_exfat(Read, Context, Length, sector, Check);
+    }
+    else
+    {
+        ok = fatcheck_fat(Read, Context, Length, sector, Check);
+    }
+
+    return ok;
+}
@@ -0,0 +1,74 @@
+/*
+    A checker of the FAT and exFAT volumes the formatters write.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The checker reads a volume the way the file systems mount it and not
+    the way the formatters plan it, from the boot sector on and with the
+    FAT type given by the number of clusters. It checks the boot sector
+    and its backup, the FSInfo sector, that the FATs are the same and that
+    every chain in them is valid, that the root directory is where its
+    entries say, and for exFAT the checksum of the boot region, the
+    allocation bitmap and the up-case table. The layout it found is
+    returned so a test can look at the offsets and the alignment.
+*/
+
+#ifndef _FATCHECK_H_
+#define _FATCHECK_H_
+
+#include <ntddk.h>
+
+#define FATCHECK_FAT12  12
+#define FATCHECK_FAT16  16
+#define FATCHECK_FAT32  32
+#define FATCHECK_EXFAT  64
+
+/* reads Length bytes at Offset from the start of the volume */
+
+typedef BOOLEAN FATCHECK_READ (PVOID Context, ULONGLONG Offset, ULONG Length, PVOID Buffer);
+
+typedef struct _FATCHECK {
+    ULONG       FileSystem;
+    ULONG       SectorSize;
+    ULONG       ClusterSize;
+    ULONGLONG   TotalSectors;
+    ULONG       ReservedSectors;
+    ULONG       NumberOfFats;
+    ULONG       FatSectors;
+    ULONG       RootEntries;
+    ULONG       RootCluster;
+    ULONGLONG   FatOffset;
+    ULONGLONG   RootOffset;
+    ULONGLONG   DataOffset;
+    ULONG       NumberOfClusters;
+    ULONG       FreeClusters;
+    char        Error[160];
+} FATCHECK, *PFATCHECK;
+
+BOOLEAN
+FatCheckVolume (
+    IN FATCHECK_READ    *Read,
+    IN PVOID            Context,
+    IN ULONGLONG        Length,
+    OUT PFATCHECK       Check
+    );
+
+/* the read of a volume that is all in memory */
+
+FATCHECK_READ FatCheckReadMemory;
+
+#endif /* _FATCHECK_H_ */
@@ -0,0 +1,265 @@
+/*
+    A benchmark of the formatters on memory, sparse file and block device images.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Loads the driver on a swap partition for each size, sector size and
+    geometry of the sweep and reports the time the probe and format took,
+    the number of writes, the bytes written and the sizes of the writes,
+    then checks the volume with the checker. The partition is in memory,
+    in a sparse file given with -f that is left with the last volume, or
+    on a block device given with -d, which is overwritten. Parameters of
+    the driver, such as VirtualZeroFill or ClusterSize, are set with -p.
+
+        format_bench [-f file | -d device] [-s MB,...] [-p Name=Value]...
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ntstrsafe.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swap.h"
+
+#define BENCH_MAX_SIZES         16
+#define BENCH_MAX_PARAMETERS    16
+
+typedef struct _BENCH_GEOMETRY {
+    ULONG   SectorSize;
+    ULONG   PhysicalSectorSize;
+    ULONG   StartingSector;
+} BENCH_GEOMETRY;
+
+/* an old style partition at sector 63 and an aligned one at 1 MB on 4 KB physical sectors */
+
+static const BENCH_GEOMETRY bench_geometry[] = {
+    {  512,  512,   63 },
+    {  512, 4096, 2048 },
+    { 4096, 4096,   63 },
+    { 4096, 4096,  256 },
+};
+
+static ULONG bench_sizes[BENCH_MAX_SIZES] = { 4, 32, 256, 2048, 16384, 65536 };
+static ULONG bench_number_of_sizes = 6;
+
+static char *bench_parameter[BENCH_MAX_PARAMETERS];
+static ULONG bench_parameter_value[BENCH_MAX_PARAMETERS];
+static ULONG bench_number_of_parameters;
+
+static const char *bench_file;
+static const char *bench_device;
+
+static const char *
+bench_file_system (
+    IN ULONG FileSystem
+    )
+{
+    switch (FileSystem)
+    {
+    case FATCHECK_FAT12:
+        return "FAT12";
+    case FATCHECK_FAT16:
+        return "FAT16";
+    case FATCHECK_FAT32:
+        return "FAT32";
+    case FATCHECK_EXFAT:
+        return "exFAT";
+    default:
+        return "-";
+    }
+}
+
+static void
+bench_print_sizes (
+    IN PTEST_DISK Disk
+    )
+{
+    ULONG bucket;
+
+    for (bucket = 0; bucket < TEST_DISK_SIZE_BUCKETS; bucket++)
+    {
+        if (!Disk->WriteSizes[bucket])
+        {
+            continue;
+        }
+
+        if (bucket == 0)
+        {
+            printf(" <1K:%d", Disk->WriteSizes[bucket]);
+        }
+        else if (bucket < 11)
+        {
+            printf(" %uK:%d", 1u << (bucket - 1), Disk->WriteSizes[bucket]);
+        }
+        else
+        {
+            printf(" %uM:%d", 1u << (bucket - 11), Disk->WriteSizes[bucket]);
+        }
+    }
+
+    printf("\n");
+}
+
+static BOOLEAN
+bench_format (
+    IN ULONG                    SizeInMb,
+    IN const BENCH_GEOMETRY     *Geometry
+    )
+{
+    static ULONG    number;
+    PTEST_DISK      disk;
+    PDEVICE_OBJECT  device_object;
+    WCHAR           name[64];
+    FATCHECK        check;
+    LONGLONG        start_time, elapsed;
+    NTSTATUS        status;
+    BOOLEAN         valid;
+    ULONG           n;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk5\\Partition%u", ++number);
+
+    disk = TestDiskCreate(name, bench_device ? 0 : (LONGLONG) SizeInMb << 20, Geometry->SectorSize,
+        bench_device ? bench_device : bench_file);
+
+    if (!disk)
+    {
+        return FALSE;
+    }
+
+    disk->StartingOffset = (LONGLONG) Geometry->StartingSector * Geometry->SectorSize;
+    disk->PhysicalSectorSize = Geometry->PhysicalSectorSize;
+
+    TestDiskSetSwapHeader(disk);
+
+    TestDiskResetCounts(disk);
+
+    WdkClearRegistry();
+
+    for (n = 0; n < bench_number_of_parameters; n++)
+    {
+        TestSetParameter(bench_parameter[n], bench_parameter_value[n]);
+    }
+
+    start_time = TestTime();
+
+    device_object = TestLoadDriver(disk, &status);
+
+    elapsed = TestTime() - start_time;
+
+    RtlZeroMemory(&check, sizeof(check));
+
+    valid = device_object != NULL &&
+        FatCheckVolume(TestReadVolume, device_object, disk->Length - sizeof(union swap_header), &check);
+
+    printf("%7lld %6u %4u %5u  %-5s %9.2f %7d %12lld ",
+        disk->Length >> 20, Geometry->SectorSize, Geometry->PhysicalSectorSize, Geometry->StartingSector,
+        bench_file_system(check.FileSystem), elapsed / 1e6, disk->Writes, disk->BytesWritten);
+
+    bench_print_sizes(disk);
+
+    if (!valid)
+    {
+        printf("    %s\n", device_object ? check.Error : "the driver did not load");
+    }
+
+    return valid;
+}
+
+static void
+bench_usage (void)
+{
+    fprintf(stderr, "usage: format_bench [-f file | -d device] [-s MB,...] [-p Name=Value]...\n");
+    exit(2);
+}
+
+int
+main (
+    int     argc,
+    char    **argv
+    )
+{
+    char    *size, *value;
+    ULONG   n, m;
+    int     failed;
+    int     c;
+
+    while ((c = getopt(argc, argv, "f:d:s:p:")) != -1)
+    {
+        switch (c)
+        {
+        case 'f':
+            bench_file = optarg;
+            break;
+        case 'd':
+            bench_device = optarg;
+            break;
+        case 's':
+            for (bench_number_of_sizes = 0, size = strtok(optarg, ",");
+                 size && bench_number_of_sizes < BENCH_MAX_SIZES;
+                 size = strtok(NULL, ","))
+            {
+                bench_sizes[bench_number_of_sizes++] = (ULONG) strtoul(size, NULL, 0);
+            }
+            break;
+        case 'p':
+            value = strchr(optarg, '=');
+            if (!value || bench_number_of_parameters == BENCH_MAX_PARAMETERS)
+            {
+                bench_usage();
+            }
+            *value++ = 0;
+            bench_parameter[bench_number_of_parameters] = optarg;
+            bench_parameter_value[bench_number_of_parameters++] = (ULONG) strtoul(value, NULL, 0);
+            break;
+        default:
+            bench_usage();
+        }
+    }
+
+    if ((bench_file && bench_device) || optind != argc)
+    {
+        bench_usage();
+    }
+
+    /* a block device has the one size it has */
+
+    if (bench_device)
+    {
+        bench_number_of_sizes = 1;
+    }
+
+    printf("     MB sector phys start  fs      time ms  writes        bytes  write sizes\n");
+
+    for (failed = 0, n = 0; n < bench_number_of_sizes; n++)
+    {
+        for (m = 0; m < RTL_NUMBER_OF(bench_geometry); m++)
+        {
+            if (!bench_format(bench_sizes[n], &bench_geometry[m]))
+            {
+                failed++;
+            }
+        }
+    }
+
+    if (bench_file)
+    {
+        printf("%s has the last volume at offset %u\n", bench_file, (ULONG) sizeof(union swap_header));
+    }
+
+    return failed != 0;
+}
@@ -0,0 +1,428 @@
+/*
+    A benchmark of the paths of the requests through the driver.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Sends requests through the device the driver attached to a disk in
+    memory and straight to the disk, and reports the time of each in
+    nanoseconds, so the difference is what the driver adds:
+
+        read, write     SwapFsReadWrite and the completion of the statistics
+        length ioctl    SwapFsDeviceControl and DeviceControlCompletion
+        statistics      an ioctl the driver completes itself
+        create          SendIrpToNextDriver
+        paging path     SwapFsPnp and ForwardIrpSynchronously
+
+    The time of a read or a write is split at the disk into the dispatch,
+    until the disk is called, and the completion, from there until the
+    request is back with the sender. Then the disk completes the requests
+    on its own threads, as from an interrupt, and as many threads as the
+    queue depth send reads and writes of 4 KB at random offsets, through
+    the driver and straight to the disk, for the requests per second.
+    Parameters of the driver, such as TraceBufferSize, are set with -p and
+    the number of requests of each measurement with -n.
+
+        irp_bench [-n requests] [-p Name=Value]...
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swapfsio.h"
+#include "swap.h"
+
+#define BENCH_DISK_LENGTH       (256 * 1024 * 1024)
+#define BENCH_DATA_OFFSET       (64 * 1024 * 1024)
+#define BENCH_MAX_PARAMETERS    16
+#define BENCH_MAX_DEPTH         32
+#define BENCH_DISK_THREADS      4
+
+typedef NTSTATUS BENCH_REQUEST (PDEVICE_OBJECT DeviceObject, ULONG Index);
+
+static PTEST_DISK       bench_disk;
+static PDEVICE_OBJECT   bench_device;
+static ULONG            bench_requests = 100000;
+static UCHAR            bench_buffer[BENCH_MAX_DEPTH][4096] __attribute__((aligned(4096)));
+
+/* the time the disk was called for the request in flight, when there is one at a time */
+
+static LONGLONG         bench_disk_time;
+
+static NTSTATUS
+bench_hook (
+    IN PTEST_DISK   Disk,
+    IN UCHAR        MajorFunction,
+    IN LONGLONG     Offset,
+    IN ULONG        Length
+    )
+{
+    bench_disk_time = TestTime();
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+bench_irp_completion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    KeSetEvent((PKEVENT) Context, IO_NO_INCREMENT, FALSE);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+/* sends a request that is not a read, a write or an ioctl as the I/O manager and the PnP manager do */
+
+static NTSTATUS
+bench_send_irp (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN UCHAR            MajorFunction,
+    IN UCHAR            MinorFunction,
+    IN BOOLEAN          InPath
+    )
+{
+    PIO_STACK_LOCATION  io_stack;
+    KEVENT              event;
+    PIRP                irp;
+    NTSTATUS            status;
+
+    irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+
+    if (!irp)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    KeInitializeEvent(&event, NotificationEvent, FALSE);
+
+    irp->IoStatus.Status = STATUS_NOT_SUPPORTED;
+
+    io_stack = IoGetNextIrpStackLocation(irp);
+
+    io_stack->MajorFunction = MajorFunction;
+    io_stack->MinorFunction = MinorFunction;
+
+    if (MajorFunction == IRP_MJ_PNP)
+    {
+        io_stack->Parameters.UsageNotification.InPath = InPath;
+        io_stack->Parameters.UsageNotification.Type = DeviceUsageTypePaging;
+    }
+
+    IoSetCompletionRoutine(irp, bench_irp_completion, &event, TRUE, TRUE, TRUE);
+
+    if (IoCallDriver(DeviceObject, irp) == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&event, Executive, KernelMode, FALSE, NULL);
+    }
+
+    status = irp->IoStatus.Status;
+
+    IoFreeIrp(irp);
+
+    return status;
+}
+
+static NTSTATUS
+bench_read (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            Index
+    )
+{
+    return TestReadWrite(DeviceObject, IRP_MJ_READ, BENCH_DATA_OFFSET + (Index % 4096) * 4096ULL, 4096, bench_buffer[0]);
+}
+
+static NTSTATUS
+bench_write (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            Index
+    )
+{
+    return TestReadWrite(DeviceObject, IRP_MJ_WRITE, BENCH_DATA_OFFSET + (Index % 4096) * 4096ULL, 4096, bench_buffer[0]);
+}
+
+static NTSTATUS
+bench_length (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            Index
+    )
+{
+    GET_LENGTH_INFORMATION  length;
+    ULONG_PTR               information;
+
+    return TestDeviceControl(DeviceObject, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &length, sizeof(length), &information);
+}
+
+static NTSTATUS
+bench_statistics (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            Index
+    )
+{
+    SWAPFS_STATISTICS   statistics;
+    ULONG_PTR           information;
+
+    return TestDeviceControl(DeviceObject, IOCTL_SWAPFS_QUERY_STATISTICS, NULL, 0, &statistics, sizeof(statistics),
+        &information);
+}
+
+static NTSTATUS
+bench_create (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            Index
+    )
+{
+    return bench_send_irp(DeviceObject, IRP_MJ_CREATE, 0, FALSE);
+}
+
+/* a page file is created and deleted by turns so the count of the paging path is kept */
+
+static NTSTATUS
+bench_paging_path (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            Index
+    )
+{
+    return bench_send_irp(DeviceObject, IRP_MJ_PNP, IRP_MN_DEVICE_USAGE_NOTIFICATION, !(Index & 1));
+}
+
+/* the nanoseconds per request, and with Split the part of it until the disk is called */
+
+static double
+bench_time (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN BENCH_REQUEST    *Request,
+    IN BOOLEAN          Split,
+    OUT double          *Dispatch
+    )
+{
+    LONGLONG    start_time, total, dispatch, time;
+    ULONG       n;
+
+    /* a first round warms up the caches and the allocator */
+
+    for (n = 0; n < bench_requests / 10; n++)
+    {
+        Request(DeviceObject, n);
+    }
+
+    bench_disk->Hook = Split ? bench_hook : NULL;
+
+    dispatch = 0;
+
+    start_time = TestTime();
+
+    for (n = 0; n < bench_requests; n++)
+    {
+        if (Split)
+        {
+            time = TestTime();
+            Request(DeviceObject, n);
+            dispatch += bench_disk_time - time;
+        }
+        else if (!NT_SUCCESS(Request(DeviceObject, n)))
+        {
+            fprintf(stderr, "a request failed\n");
+            exit(1);
+        }
+    }
+
+    total = TestTime() - start_time;
+
+    bench_disk->Hook = NULL;
+
+    if (Dispatch)
+    {
+        *Dispatch = (double) dispatch / bench_requests;
+    }
+
+    return (double) total / bench_requests;
+}
+
+static void
+bench_path (
+    IN const char       *Name,
+    IN BENCH_REQUEST    *Request,
+    IN BOOLEAN          Direct,
+    IN BOOLEAN          Split
+    )
+{
+    double filter, disk, filter_dispatch, disk_dispatch;
+
+    filter = bench_time(bench_device, Request, Split, &filter_dispatch);
+
+    printf("%-16s %10.0f", Name, filter);
+
+    if (Direct)
+    {
+        disk = bench_time(bench_disk->DeviceObject, Request, Split, &disk_dispatch);
+
+        printf(" %10.0f %10.0f", disk, filter - disk);
+
+        if (Split)
+        {
+            printf(" %10.0f %10.0f", filter_dispatch - disk_dispatch,
+                (filter - filter_dispatch) - (disk - disk_dispatch));
+        }
+    }
+
+    printf("\n");
+}
+
+typedef struct _BENCH_SENDER {
+    pthread_t       Thread;
+    PDEVICE_OBJECT  DeviceObject;
+    ULONG           Index;
+    ULONG           Requests;
+} BENCH_SENDER;
+
+static void *
+bench_sender (
+    void *Context
+    )
+{
+    BENCH_SENDER    *sender = (BENCH_SENDER *) Context;
+    unsigned int    seed;
+    ULONG           n;
+
+    seed = sender->Index + 1;
+
+    for (n = 0; n < sender->Requests; n++)
+    {
+        TestReadWrite(sender->DeviceObject, (n & 1) ? IRP_MJ_WRITE : IRP_MJ_READ,
+            BENCH_DATA_OFFSET + (rand_r(&seed) % 32768) * 4096ULL, 4096, bench_buffer[sender->Index]);
+    }
+
+    return NULL;
+}
+
+static double
+bench_throughput (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            Depth
+    )
+{
+    BENCH_SENDER    sender[BENCH_MAX_DEPTH];
+    LONGLONG        start_time;
+    ULONG           n;
+
+    start_time = TestTime();
+
+    for (n = 0; n < Depth; n++)
+    {
+        sender[n].DeviceObject = DeviceObject;
+        sender[n].Index = n;
+        sender[n].Requests = bench_requests / Depth;
+        pthread_create(&sender[n].Thread, NULL, bench_sender, &sender[n]);
+    }
+
+    for (n = 0; n < Depth; n++)
+    {
+        pthread_join(sender[n].Thread, NULL);
+    }
+
+    return (double) (bench_requests / Depth * Depth) / ((TestTime() - start_time) / 1e9);
+}
+
+static void
+bench_usage (void)
+{
+    fprintf(stderr, "usage: irp_bench [-n requests] [-p Name=Value]...\n");
+    exit(2);
+}
+
+int
+main (
+    int     argc,
+    char    **argv
+    )
+{
+    static const ULONG  depth[] = { 1, 2, 4, 8, 16, 32 };
+    NTSTATUS            status;
+    char                *value;
+    double              filter, disk;
+    ULONG               n;
+    int                 c;
+
+    WdkClearRegistry();
+
+    while ((c = getopt(argc, argv, "n:p:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            bench_requests = (ULONG) strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            value = strchr(optarg, '=');
+            if (!value)
+            {
+                bench_usage();
+            }
+            *value++ = 0;
+            TestSetParameter(optarg, (ULONG) strtoul(value, NULL, 0));
+            break;
+        default:
+            bench_usage();
+        }
+    }
+
+    if (optind != argc || bench_requests < BENCH_MAX_DEPTH)
+    {
+        bench_usage();
+    }
+
+    bench_disk = TestDiskCreate(L"\\Device\\Harddisk9\\Partition1", BENCH_DISK_LENGTH, 512, NULL);
+
+    TestDiskSetSwapHeader(bench_disk);
+
+    bench_device = TestLoadDriver(bench_disk, &status);
+
+    if (!bench_device)
+    {
+        fprintf(stderr, "the driver did not load, 0x%08x\n", status);
+        return 1;
+    }
+
+    printf("ns per request       driver       disk     driver   dispatch completion\n");
+
+    bench_path("read", bench_read, TRUE, TRUE);
+    bench_path("write", bench_write, TRUE, TRUE);
+    bench_path("length ioctl", bench_length, TRUE, FALSE);
+    bench_path("statistics", bench_statistics, FALSE, FALSE);
+    bench_path("create", bench_create, TRUE, FALSE);
+    bench_path("paging path", bench_paging_path, FALSE, FALSE);
+
+    /* from here the disk completes the reads and writes on its threads */
+
+    TestDiskStartThreads(bench_disk, BENCH_DISK_THREADS);
+
+    printf("\nqueue depth   driver/s     disk/s\n");
+
+    for (n = 0; n < RTL_NUMBER_OF(depth); n++)
+    {
+        filter = bench_throughput(bench_device, depth[n]);
+        disk = bench_throughput(bench_disk->DeviceObject, depth[n]);
+
+        printf("%11u %10.0f %10.0f\n", depth[n], filter, disk);
+    }
+
+    return 0;
+}
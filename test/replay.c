@@ -0,0 +1,652 @@
+/*
+    A tool that replays the traces of the driver on an image or a device.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Reads the traces drained with IOCTL_SWAPFS_DRAIN_TRACE, a file of the
+    SWAPFS_TRACE buffers one after the other, or a text trace of lines of
+    an operation R, W or F, the offset on the volume, the length and the
+    time in microseconds, and replays the requests in the order they were
+    started. The requests are sent through the driver loaded on a disk in
+    memory, in a sparse file given with -f or on a block device given
+    with -d, with the parameters set with -p, so the policies of the
+    driver can be compared on the same workload. With -r the requests
+    are read and written directly to an image or a device at the offset
+    the driver would send them to, after the swap header.
+
+    The requests are sent as fast as possible or with -t at the times
+    they were started, by as many threads as the queue depth of -q, or
+    with -q 0 at the depth each request was recorded with. The tool
+    reports the throughput and the percentiles of the latencies of the
+    replay and of those recorded.
+
+        replay [-f file | -d device | -r image] [-t] [-q depth] [-s MB] [-p Name=Value]... trace...
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <ntstrsafe.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swapfsio.h"
+#include "swap.h"
+
+#define REPLAY_MAX_PARAMETERS   16
+#define REPLAY_MAX_THREADS      64
+
+typedef struct _REPLAY_REQUEST {
+    LONGLONG        Timestamp;
+    LONGLONG        Offset;
+    ULONG           Length;
+    ULONG           RecordedLatency;
+    UCHAR           Operation;
+    USHORT          Depth;
+    NTSTATUS        Status;
+    LONGLONG        Latency;
+} REPLAY_REQUEST, *PREPLAY_REQUEST;
+
+typedef struct _REPLAY {
+    PREPLAY_REQUEST Request;
+    ULONG           NumberOfRequests;
+    ULONG           MaximumRequests;
+    ULONGLONG       Lost;
+    ULONG           MaximumLength;
+    BOOLEAN         Recorded;
+
+    /* the requests go through the driver or, with -r, straight to File */
+    PDEVICE_OBJECT  DeviceObject;
+    int             File;
+
+    BOOLEAN         Paced;
+    ULONG           QueueDepth;
+
+    /* the next request to start and the requests in flight */
+    pthread_mutex_t Lock;
+    pthread_cond_t  Signal;
+    ULONG           Next;
+    ULONG           InFlight;
+    LONGLONG        StartTime;
+    LONGLONG        Elapsed;
+} REPLAY, *PREPLAY;
+
+static BOOLEAN
+replay_add (
+    IN OUT PREPLAY  Replay,
+    IN UCHAR        Operation,
+    IN LONGLONG     Offset,
+    IN ULONG        Length,
+    IN LONGLONG     Timestamp,
+    IN ULONG        Latency,
+    IN USHORT       Depth
+    )
+{
+    PREPLAY_REQUEST request;
+
+    /* a shutdown has nothing to replay */
+
+    if (Operation != IRP_MJ_READ && Operation != IRP_MJ_WRITE && Operation != IRP_MJ_FLUSH_BUFFERS)
+    {
+        return TRUE;
+    }
+
+    if (Replay->NumberOfRequests == Replay->MaximumRequests)
+    {
+        Replay->MaximumRequests = Replay->MaximumRequests ? Replay->MaximumRequests * 2 : 4096;
+
+        request = (PREPLAY_REQUEST) realloc(Replay->Request, Replay->MaximumRequests * sizeof(REPLAY_REQUEST));
+
+        if (!request)
+        {
+            return FALSE;
+        }
+
+        Replay->Request = request;
+    }
+
+    request = &Replay->Request[Replay->NumberOfRequests++];
+
+    RtlZeroMemory(request, sizeof(REPLAY_REQUEST));
+
+    request->Operation = Operation;
+    request->Offset = Offset;
+    request->Length = Length;
+    request->Timestamp = Timestamp;
+    request->RecordedLatency = Latency;
+    request->Depth = Depth ? Depth : 1;
+
+    Replay->MaximumLength = max(Replay->MaximumLength, Length);
+
+    return TRUE;
+}
+
+static int
+replay_compare_start (
+    const void *A,
+    const void *B
+    )
+{
+    const REPLAY_REQUEST *a = (const REPLAY_REQUEST *) A;
+    const REPLAY_REQUEST *b = (const REPLAY_REQUEST *) B;
+
+    return (a->Timestamp > b->Timestamp) - (a->Timestamp < b->Timestamp);
+}
+
+/* the records are drained in the order the requests completed, the offsets are on
+   the partition and are kept as the offsets on the volume the driver was sent */
+
+BOOLEAN
+ReplayLoad (
+    IN OUT PREPLAY  Replay,
+    IN const char   *Path
+    )
+{
+    FILE                *file;
+    SWAPFS_TRACE        header;
+    SWAPFS_TRACE_RECORD record;
+    char                line[256];
+    char                operation;
+    long long           offset, timestamp;
+    unsigned long       length;
+    ULONG               n;
+    BOOLEAN             ok;
+
+    file = fopen(Path, "rb");
+
+    if (!file)
+    {
+        perror(Path);
+        return FALSE;
+    }
+
+    ok = TRUE;
+
+    if (fread(&header, FIELD_OFFSET(SWAPFS_TRACE, Record), 1, file) == 1 && header.Version == SWAPFS_TRACE_VERSION)
+    {
+        do
+        {
+            if (header.Version != SWAPFS_TRACE_VERSION)
+            {
+                fprintf(stderr, "%s: a trace of version %u\n", Path, header.Version);
+                ok = FALSE;
+                break;
+            }
+
+            Replay->Lost = header.Lost;
+            Replay->Recorded = TRUE;
+
+            for (n = 0; ok && n < header.NumberOfRecords; n++)
+            {
+                ok = fread(&record, sizeof(record), 1, file) == 1 &&
+                    replay_add(Replay, record.Operation,
+                        record.Length ? record.Offset - (LONGLONG) sizeof(union swap_header) : 0,
+                        record.Length, record.Timestamp, record.Latency, record.Depth);
+            }
+        }
+        while (ok && fread(&header, FIELD_OFFSET(SWAPFS_TRACE, Record), 1, file) == 1);
+    }
+    else
+    {
+        rewind(file);
+
+        while (ok && fgets(line, sizeof(line), file))
+        {
+            if (line[0] == '#' || line[0] == '\n')
+            {
+                continue;
+            }
+
+            offset = 0;
+            length = 0;
+            timestamp = 0;
+
+            if (sscanf(line, " %c %lli %li %lli", &operation, &offset, &length, &timestamp) < 1 ||
+                !strchr("RWF", operation) || offset < 0)
+            {
+                fprintf(stderr, "%s: can't read %s", Path, line);
+                ok = FALSE;
+                break;
+            }
+
+            ok = replay_add(Replay,
+                operation == 'R' ? IRP_MJ_READ : operation == 'W' ? IRP_MJ_WRITE : IRP_MJ_FLUSH_BUFFERS,
+                offset, (ULONG) length, timestamp, 0, 1);
+        }
+    }
+
+    fclose(file);
+
+    if (ok && Replay->NumberOfRequests)
+    {
+        qsort(Replay->Request, Replay->NumberOfRequests, sizeof(REPLAY_REQUEST), replay_compare_start);
+    }
+
+    return ok;
+}
+
+static NTSTATUS
+replay_request (
+    IN PREPLAY          Replay,
+    IN PREPLAY_REQUEST  Request,
+    IN PUCHAR           Buffer
+    )
+{
+    LONGLONG    offset;
+    ssize_t     done;
+
+    if (Replay->DeviceObject)
+    {
+        return TestReadWrite(Replay->DeviceObject, Request->Operation, Request->Offset, Request->Length,
+            Request->Length ? Buffer : NULL);
+    }
+
+    /* the offset the driver sends to the partition */
+
+    offset = Request->Offset + sizeof(union swap_header);
+
+    switch (Request->Operation)
+    {
+    case IRP_MJ_READ:
+        done = pread(Replay->File, Buffer, Request->Length, offset);
+        break;
+    case IRP_MJ_WRITE:
+        done = pwrite(Replay->File, Buffer, Request->Length, offset);
+        break;
+    default:
+        return fdatasync(Replay->File) ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+    }
+
+    return done == (ssize_t) Request->Length ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
+}
+
+static void *
+replay_thread (
+    void *Context
+    )
+{
+    PREPLAY         replay = (PREPLAY) Context;
+    PREPLAY_REQUEST request;
+    PUCHAR          buffer;
+    LONGLONG        delay;
+    struct timespec ts;
+    ULONG           n;
+
+    if (posix_memalign((void **) &buffer, 4096, max(replay->MaximumLength, 4096)))
+    {
+        return NULL;
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&replay->Lock);
+
+        /* with the recorded depth a request waits for those before it to complete */
+
+        while (replay->Next < replay->NumberOfRequests && !replay->QueueDepth &&
+               replay->InFlight >= replay->Request[replay->Next].Depth)
+        {
+            pthread_cond_wait(&replay->Signal, &replay->Lock);
+        }
+
+        if (replay->Next == replay->NumberOfRequests)
+        {
+            pthread_mutex_unlock(&replay->Lock);
+            break;
+        }
+
+        request = &replay->Request[replay->Next++];
+
+        replay->InFlight++;
+
+        pthread_mutex_unlock(&replay->Lock);
+
+        if (replay->Paced)
+        {
+            delay = replay->StartTime + (request->Timestamp - replay->Request[0].Timestamp) * 1000 - TestTime();
+
+            if (delay > 0)
+            {
+                ts.tv_sec = delay / 1000000000;
+                ts.tv_nsec = delay % 1000000000;
+                nanosleep(&ts, NULL);
+            }
+        }
+
+        /* each block written is told apart from the others by the request that wrote it */
+
+        if (request->Operation == IRP_MJ_WRITE)
+        {
+            for (n = 0; n + sizeof(LONGLONG) <= request->Length; n += 512)
+            {
+                *(PLONGLONG) (buffer + n) = (request - replay->Request) + 1;
+            }
+        }
+
+        request->Latency = TestTime();
+
+        request->Status = replay_request(replay, request, buffer);
+
+        request->Latency = TestTime() - request->Latency;
+
+        pthread_mutex_lock(&replay->Lock);
+
+        replay->InFlight--;
+
+        pthread_cond_broadcast(&replay->Signal);
+
+        pthread_mutex_unlock(&replay->Lock);
+    }
+
+    free(buffer);
+
+    return NULL;
+}
+
+VOID
+ReplayRun (
+    IN OUT PREPLAY Replay
+    )
+{
+    pthread_t   thread[REPLAY_MAX_THREADS];
+    ULONG       nthread;
+    ULONG       n;
+
+    /* the recorded depth needs as many threads as the deepest request */
+
+    if (Replay->QueueDepth)
+    {
+        nthread = Replay->QueueDepth;
+    }
+    else
+    {
+        for (nthread = 1, n = 0; n < Replay->NumberOfRequests; n++)
+        {
+            nthread = max(nthread, Replay->Request[n].Depth);
+        }
+    }
+
+    nthread = min(nthread, REPLAY_MAX_THREADS);
+
+    pthread_mutex_init(&Replay->Lock, NULL);
+    pthread_cond_init(&Replay->Signal, NULL);
+
+    Replay->Next = 0;
+    Replay->InFlight = 0;
+    Replay->StartTime = TestTime();
+
+    for (n = 0; n < nthread; n++)
+    {
+        pthread_create(&thread[n], NULL, replay_thread, Replay);
+    }
+
+    for (n = 0; n < nthread; n++)
+    {
+        pthread_join(thread[n], NULL);
+    }
+
+    Replay->Elapsed = TestTime() - Replay->StartTime;
+
+    pthread_cond_destroy(&Replay->Signal);
+    pthread_mutex_destroy(&Replay->Lock);
+}
+
+static int
+replay_compare_latency (
+    const void *A,
+    const void *B
+    )
+{
+    LONGLONG a = *(const LONGLONG *) A;
+    LONGLONG b = *(const LONGLONG *) B;
+
+    return (a > b) - (a < b);
+}
+
+/* the percentiles of the latencies in microseconds of the requests of an operation */
+
+static void
+replay_percentiles (
+    IN PREPLAY      Replay,
+    IN UCHAR        Operation,
+    IN BOOLEAN      Recorded,
+    IN const char   *Name
+    )
+{
+    static const ULONG  permille[] = { 500, 900, 990, 999, 1000 };
+    LONGLONG            *latency;
+    ULONG               count;
+    ULONG               n;
+
+    latency = (LONGLONG *) malloc((Replay->NumberOfRequests + 1) * sizeof(LONGLONG));
+
+    for (count = 0, n = 0; n < Replay->NumberOfRequests; n++)
+    {
+        if (Replay->Request[n].Operation == Operation)
+        {
+            latency[count++] = Recorded ? (LONGLONG) Replay->Request[n].RecordedLatency * 1000 :
+                Replay->Request[n].Latency;
+        }
+    }
+
+    if (count)
+    {
+        qsort(latency, count, sizeof(LONGLONG), replay_compare_latency);
+
+        printf("%-16s %8u", Name, count);
+
+        for (n = 0; n < RTL_NUMBER_OF(permille); n++)
+        {
+            printf(" %10.1f", latency[(ULONGLONG) (count - 1) * permille[n] / 1000] / 1e3);
+        }
+
+        printf("\n");
+    }
+
+    free(latency);
+}
+
+VOID
+ReplayReport (
+    IN PREPLAY Replay
+    )
+{
+    ULONGLONG   bytes_read, bytes_written;
+    ULONG       failed;
+    ULONG       n;
+
+    for (bytes_read = 0, bytes_written = 0, failed = 0, n = 0; n < Replay->NumberOfRequests; n++)
+    {
+        if (!NT_SUCCESS(Replay->Request[n].Status))
+        {
+            failed++;
+        }
+        else if (Replay->Request[n].Operation == IRP_MJ_READ)
+        {
+            bytes_read += Replay->Request[n].Length;
+        }
+        else if (Replay->Request[n].Operation == IRP_MJ_WRITE)
+        {
+            bytes_written += Replay->Request[n].Length;
+        }
+    }
+
+    printf("%u requests in %.3f s, %.0f requests/s, %.1f MB/s read, %.1f MB/s written, %u failed\n",
+        Replay->NumberOfRequests, Replay->Elapsed / 1e9,
+        Replay->NumberOfRequests / (Replay->Elapsed / 1e9),
+        bytes_read / 1048576.0 / (Replay->Elapsed / 1e9),
+        bytes_written / 1048576.0 / (Replay->Elapsed / 1e9),
+        failed);
+
+    if (Replay->Lost)
+    {
+        printf("%llu requests were lost when traced\n", Replay->Lost);
+    }
+
+    printf("latency us       requests        p50        p90        p99      p99.9        max\n");
+
+    replay_percentiles(Replay, IRP_MJ_READ, FALSE, "read");
+    replay_percentiles(Replay, IRP_MJ_WRITE, FALSE, "write");
+    replay_percentiles(Replay, IRP_MJ_FLUSH_BUFFERS, FALSE, "flush");
+    /* a text trace has no latencies */
+
+    if (Replay->Recorded)
+    {
+        replay_percentiles(Replay, IRP_MJ_READ, TRUE, "recorded read");
+        replay_percentiles(Replay, IRP_MJ_WRITE, TRUE, "recorded write");
+    }
+}
+
+#ifndef REPLAY_NO_MAIN
+
+static void
+replay_usage (void)
+{
+    fprintf(stderr, "usage: replay [-f file | -d device | -r image] [-t] [-q depth] [-s MB] [-p Name=Value]... trace...\n");
+    exit(2);
+}
+
+int
+main (
+    int     argc,
+    char    **argv
+    )
+{
+    static REPLAY   replay;
+    char            *parameter[REPLAY_MAX_PARAMETERS];
+    ULONG           parameter_value[REPLAY_MAX_PARAMETERS];
+    ULONG           number_of_parameters;
+    const char      *file, *device, *image;
+    char            *value;
+    LONGLONG        length;
+    PTEST_DISK      disk;
+    NTSTATUS        status;
+    ULONG           n;
+    int             c;
+
+    file = device = image = NULL;
+    number_of_parameters = 0;
+    length = 0;
+
+    replay.QueueDepth = 1;
+
+    while ((c = getopt(argc, argv, "f:d:r:tq:s:p:")) != -1)
+    {
+        switch (c)
+        {
+        case 'f':
+            file = optarg;
+            break;
+        case 'd':
+            device = optarg;
+            break;
+        case 'r':
+            image = optarg;
+            break;
+        case 't':
+            replay.Paced = TRUE;
+            break;
+        case 'q':
+            replay.QueueDepth = (ULONG) strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            length = (LONGLONG) strtoull(optarg, NULL, 0) << 20;
+            break;
+        case 'p':
+            value = strchr(optarg, '=');
+            if (!value || number_of_parameters == REPLAY_MAX_PARAMETERS)
+            {
+                replay_usage();
+            }
+            *value++ = 0;
+            parameter[number_of_parameters] = optarg;
+            parameter_value[number_of_parameters++] = (ULONG) strtoul(value, NULL, 0);
+            break;
+        default:
+            replay_usage();
+        }
+    }
+
+    if (optind == argc || (file != NULL) + (device != NULL) + (image != NULL) > 1)
+    {
+        replay_usage();
+    }
+
+    for (; optind < argc; optind++)
+    {
+        if (!ReplayLoad(&replay, argv[optind]))
+        {
+            return 1;
+        }
+    }
+
+    if (image)
+    {
+        replay.File = open(image, O_RDWR);
+
+        if (replay.File < 0)
+        {
+            perror(image);
+            return 1;
+        }
+    }
+    else
+    {
+        /* the disk is large enough for the requests unless it's a device or -s says otherwise */
+
+        if (!length && !device)
+        {
+            for (n = 0; n < replay.NumberOfRequests; n++)
+            {
+                length = max(length, replay.Request[n].Offset + replay.Request[n].Length);
+            }
+
+            length = (length + sizeof(union swap_header) + 0xfffff) & ~0xfffffLL;
+        }
+
+        disk = TestDiskCreate(L"\\Device\\Harddisk7\\Partition1", length, 512, device ? device : file);
+
+        if (!disk)
+        {
+            return 1;
+        }
+
+        TestDiskSetSwapHeader(disk);
+
+        for (n = 0; n < number_of_parameters; n++)
+        {
+            TestSetParameter(parameter[n], parameter_value[n]);
+        }
+
+        replay.DeviceObject = TestLoadDriver(disk, &status);
+
+        if (!replay.DeviceObject)
+        {
+            fprintf(stderr, "the driver did not load, 0x%08x\n", status);
+            return 1;
+        }
+    }
+
+    ReplayRun(&replay);
+
+    ReplayReport(&replay);
+
+    return 0;
+}
+
+#endif /* REPLAY_NO_MAIN */
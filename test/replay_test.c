@@ -0,0 +1,292 @@
+/*
+    Tests of the replay of the traces of the driver.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Traces a known workload through the driver, drains the trace to a
+    file as a drain tool would and replays it with the functions of the
+    replay tool, on an image directly and through the driver again. The
+    tests check that the requests are read back in the order they were
+    started at the offsets on the volume, that the direct replay writes
+    them after the swap header, that the driver is sent the same writes,
+    that a text trace is read and that a paced replay keeps the times.
+*/
+
+#define REPLAY_NO_MAIN
+
+#include "replay.c"
+
+#define TEST_DISK_LENGTH    (64 * 1024 * 1024)
+#define TEST_DATA_OFFSET    (16 * 1024 * 1024)
+#define TEST_WRITES         24
+
+static ULONG test_number;
+static char test_trace[] = "/tmp/replay_test_XXXXXX";
+static UCHAR test_buffer[65536];
+
+static PDEVICE_OBJECT
+test_load (
+    IN ULONG        TraceBufferSize,
+    OUT PTEST_DISK  *Disk
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    WCHAR           name[64];
+    NTSTATUS        status;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk8\\Partition%u", ++test_number);
+
+    *Disk = TestDiskCreate(name, TEST_DISK_LENGTH, 512, NULL);
+
+    TestDiskSetSwapHeader(*Disk);
+
+    WdkClearRegistry();
+
+    if (TraceBufferSize)
+    {
+        TestSetParameter("TraceBufferSize", TraceBufferSize);
+    }
+
+    device_object = TestLoadDriver(*Disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    return device_object;
+}
+
+/* the trace is drained twice so the file has two buffers as a drain tool would write */
+
+static void
+test_drain_to_file (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN FILE             *File
+    )
+{
+    static UCHAR    output[FIELD_OFFSET(SWAPFS_TRACE, Record) + 16 * sizeof(SWAPFS_TRACE_RECORD)];
+    ULONG_PTR       information;
+    int             n;
+
+    for (n = 0; n < 3; n++)
+    {
+        CHECK_STATUS(TestDeviceControl(DeviceObject, IOCTL_SWAPFS_DRAIN_TRACE, NULL, 0, output, sizeof(output),
+            &information), STATUS_SUCCESS);
+
+        fwrite(output, information, 1, File);
+    }
+}
+
+static void
+test_trace_workload (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    FILE            *file;
+    ULONG           n;
+
+    device_object = test_load(64, &disk);
+
+    /* the writes are of 4 KB to 64 KB at offsets that go back and forth */
+
+    for (n = 0; n < TEST_WRITES; n++)
+    {
+        TestReadWrite(device_object, IRP_MJ_WRITE, TEST_DATA_OFFSET + (LONGLONG) ((n * 7) % TEST_WRITES) * 65536,
+            4096 << (n % 5), test_buffer);
+    }
+
+    TestReadWrite(device_object, IRP_MJ_READ, TEST_DATA_OFFSET, 8192, test_buffer);
+    TestReadWrite(device_object, IRP_MJ_FLUSH_BUFFERS, 0, 0, NULL);
+
+    file = fdopen(mkstemp(test_trace), "wb");
+
+    test_drain_to_file(device_object, file);
+
+    fclose(file);
+}
+
+static void
+test_load_trace (void)
+{
+    REPLAY  replay;
+    ULONG   n;
+
+    RtlZeroMemory(&replay, sizeof(replay));
+
+    CHECK(ReplayLoad(&replay, test_trace));
+
+    CHECK(replay.NumberOfRequests == TEST_WRITES + 2);
+    CHECK(replay.Lost == 0);
+
+    for (n = 0; n < TEST_WRITES && n < replay.NumberOfRequests; n++)
+    {
+        CHECK(replay.Request[n].Operation == IRP_MJ_WRITE);
+        CHECK(replay.Request[n].Offset == TEST_DATA_OFFSET + (LONGLONG) ((n * 7) % TEST_WRITES) * 65536);
+        CHECK(replay.Request[n].Length == 4096u << (n % 5));
+        CHECK(replay.Request[n].Depth == 1);
+        CHECK(n == 0 || replay.Request[n].Timestamp >= replay.Request[n - 1].Timestamp);
+    }
+
+    CHECK(replay.Request[TEST_WRITES].Operation == IRP_MJ_READ);
+    CHECK(replay.Request[TEST_WRITES + 1].Operation == IRP_MJ_FLUSH_BUFFERS);
+    CHECK(replay.MaximumLength == 65536);
+
+    free(replay.Request);
+}
+
+static void
+test_replay_image (void)
+{
+    REPLAY      replay;
+    char        image[] = "/tmp/replay_image_XXXXXX";
+    LONGLONG    tag;
+    ULONG       n;
+
+    RtlZeroMemory(&replay, sizeof(replay));
+
+    CHECK(ReplayLoad(&replay, test_trace));
+
+    replay.File = mkstemp(image);
+    CHECK(ftruncate(replay.File, TEST_DISK_LENGTH) == 0);
+
+    replay.QueueDepth = 4;
+
+    ReplayRun(&replay);
+
+    /* the writes don't overlap and each starts with the tag of its request */
+
+    for (n = 0; n < replay.NumberOfRequests; n++)
+    {
+        CHECK_STATUS(replay.Request[n].Status, STATUS_SUCCESS);
+    }
+
+    for (n = TEST_WRITES - 5; n < TEST_WRITES; n++)
+    {
+        CHECK(pread(replay.File, &tag, sizeof(tag), replay.Request[n].Offset + sizeof(union swap_header)) == sizeof(tag));
+        CHECK(tag == n + 1);
+    }
+
+    close(replay.File);
+    unlink(image);
+    free(replay.Request);
+}
+
+static void
+test_replay_driver (void)
+{
+    REPLAY      replay;
+    PTEST_DISK  disk;
+    LONGLONG    bytes;
+    ULONG       n;
+
+    RtlZeroMemory(&replay, sizeof(replay));
+
+    CHECK(ReplayLoad(&replay, test_trace));
+
+    replay.DeviceObject = test_load(0, &disk);
+
+    TestDiskResetCounts(disk);
+
+    /* the recorded depth of each request */
+
+    replay.QueueDepth = 0;
+
+    ReplayRun(&replay);
+
+    for (bytes = 0, n = 0; n < replay.NumberOfRequests; n++)
+    {
+        CHECK_STATUS(replay.Request[n].Status, STATUS_SUCCESS);
+
+        if (replay.Request[n].Operation == IRP_MJ_WRITE)
+        {
+            bytes += replay.Request[n].Length;
+        }
+    }
+
+    CHECK(disk->Writes == TEST_WRITES);
+    CHECK(disk->BytesWritten == bytes);
+    CHECK(disk->Reads == 1);
+    CHECK(disk->Flushes == 1);
+
+    free(replay.Request);
+}
+
+static void
+test_text_trace (void)
+{
+    REPLAY  replay;
+    char    path[] = "/tmp/replay_text_XXXXXX";
+    FILE    *file;
+
+    file = fdopen(mkstemp(path), "w");
+
+    fprintf(file, "# op offset length time\n");
+    fprintf(file, "W 0x10000 4096 20000\n");
+    fprintf(file, "R 0 512 0\n");
+    fprintf(file, "F\n");
+
+    fclose(file);
+
+    RtlZeroMemory(&replay, sizeof(replay));
+
+    CHECK(ReplayLoad(&replay, path));
+
+    /* the requests are in the order they started */
+
+    CHECK(replay.NumberOfRequests == 3);
+    CHECK(replay.Request[0].Operation == IRP_MJ_READ || replay.Request[0].Operation == IRP_MJ_FLUSH_BUFFERS);
+    CHECK(replay.Request[2].Operation == IRP_MJ_WRITE);
+    CHECK(replay.Request[2].Offset == 0x10000 && replay.Request[2].Length == 4096);
+
+    /* paced the write is 20 ms after the first request */
+
+    replay.File = open("/dev/null", O_RDWR);
+    replay.Paced = TRUE;
+    replay.QueueDepth = 1;
+
+    ReplayRun(&replay);
+
+    CHECK(replay.Elapsed >= 20000000);
+
+    close(replay.File);
+    unlink(path);
+    free(replay.Request);
+
+    file = fopen(path, "w");
+    fprintf(file, "X 0 512 0\n");
+    fclose(file);
+
+    RtlZeroMemory(&replay, sizeof(replay));
+
+    fprintf(stderr, "    an error is expected: ");
+    CHECK(!ReplayLoad(&replay, path));
+
+    unlink(path);
+    free(replay.Request);
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_trace_workload);
+    TEST_RUN(test_load_trace);
+    TEST_RUN(test_replay_image);
+    TEST_RUN(test_replay_driver);
+    TEST_RUN(test_text_trace);
+
+    unlink(test_trace);
+
+    return TestFailures != 0;
+}
@@ -0,0 +1,188 @@
+/*
+    Tests of the striped volumes.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With StripeSize the listed swap partitions are joined to one volume.
+    The tests check that a stripe size that is not a multiple of the page
+    size, is larger than 1 MB, or is large enough to overflow when it's
+    made bytes is refused and the driver is not attached, that the
+    largest stripes make a volume the checker accepts, and that a flush
+    reaches every member and fails when one of them fails it.
+*/
+
+#include <stdlib.h>
+#include <ntstrsafe.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swap.h"
+
+#define TEST_DISK_LENGTH    (64 * 1024 * 1024)
+#define TEST_MEMBERS        3
+
+static ULONG test_number;
+
+static PDEVICE_OBJECT
+test_load (
+    IN ULONG        StripeSize,
+    OUT PTEST_DISK  Disk[TEST_MEMBERS],
+    OUT NTSTATUS    *Status
+    )
+{
+    WCHAR   name[64];
+    char    value[64];
+    char    member[16];
+    ULONG   n;
+
+    WdkClearRegistry();
+
+    for (n = 0; n < TEST_MEMBERS; n++)
+    {
+        RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk14\\Partition%u", ++test_number);
+
+        Disk[n] = TestDiskCreate(name, TEST_DISK_LENGTH, 512, NULL);
+
+        TestDiskSetSwapHeader(Disk[n]);
+
+        /* the first member is listed by TestLoadDriver */
+
+        if (n)
+        {
+            snprintf(value, sizeof(value), "\\Device\\Harddisk14\\Partition%u", test_number);
+            snprintf(member, sizeof(member), "SwapDevice%u", n);
+            WdkSetRegistryString(TEST_PARAMETERS_KEY, member, value);
+        }
+    }
+
+    TestSetParameter("StripeSize", StripeSize);
+
+    return TestLoadDriver(Disk[0], Status);
+}
+
+static void
+test_stripe_size (void)
+{
+    static const ULONG refused[] = { 6, 2048, 0x400000, 0x400001 };
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk[TEST_MEMBERS];
+    NTSTATUS        status;
+    ULONG           n;
+
+    for (n = 0; n < RTL_NUMBER_OF(refused); n++)
+    {
+        device_object = test_load(refused[n], disk, &status);
+
+        CHECK(!NT_SUCCESS(status));
+        CHECK(device_object == NULL);
+        CHECK(disk[0]->DeviceObject->AttachedDevice == NULL);
+    }
+}
+
+static NTSTATUS
+test_fail_flush (
+    IN PTEST_DISK   Disk,
+    IN UCHAR        MajorFunction,
+    IN LONGLONG     Offset,
+    IN ULONG        Length
+    )
+{
+    return MajorFunction == IRP_MJ_FLUSH_BUFFERS ? STATUS_DATA_ERROR : STATUS_SUCCESS;
+}
+
+static void
+test_flush (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk[TEST_MEMBERS];
+    NTSTATUS        status;
+    ULONG           n;
+
+    device_object = test_load(64, disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    if (!device_object)
+    {
+        return;
+    }
+
+    for (n = 0; n < TEST_MEMBERS; n++)
+    {
+        TestDiskResetCounts(disk[n]);
+    }
+
+    /* every member is flushed */
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_FLUSH_BUFFERS, 0, 0, NULL), STATUS_SUCCESS);
+
+    for (n = 0; n < TEST_MEMBERS; n++)
+    {
+        CHECK(disk[n]->Flushes == 1);
+    }
+
+    /* a member that fails fails the flush, the others are still flushed */
+
+    disk[1]->Hook = test_fail_flush;
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_FLUSH_BUFFERS, 0, 0, NULL), STATUS_DATA_ERROR);
+
+    for (n = 0; n < TEST_MEMBERS; n++)
+    {
+        CHECK(disk[n]->Flushes == 2);
+    }
+
+    disk[1]->Hook = NULL;
+}
+
+static void
+test_largest_stripes (void)
+{
+    PDEVICE_OBJECT      device_object;
+    PDEVICE_EXTENSION   device_extension;
+    PTEST_DISK          disk[TEST_MEMBERS];
+    FATCHECK            check;
+    NTSTATUS            status;
+
+    device_object = test_load(STRIPE_MAXIMUM_SIZE, disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    if (!device_object)
+    {
+        return;
+    }
+
+    device_extension = (PDEVICE_EXTENSION) device_object->DeviceExtension;
+
+    CHECK(device_extension->Stripe.StripeSize == STRIPE_MAXIMUM_SIZE * 1024);
+
+    if (!FatCheckVolume(TestReadVolume, device_object, device_extension->Stripe.Length, &check))
+    {
+        fprintf(stderr, "fatcheck: %s\n", check.Error);
+        CHECK(FALSE);
+    }
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_stripe_size);
+    TEST_RUN(test_largest_stripes);
+    TEST_RUN(test_flush);
+
+    return TestFailures != 0;
+}
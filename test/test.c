@@ -0,0 +1,220 @@
+/*
+    What the user-mode tests of the driver have in common.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <time.h>
+#include "test.h"
+
+int TestFailures;
+
+static DRIVER_OBJECT test_driver_object;
+static DRIVER_EXTENSION test_driver_extension;
+
+VOID
+TestSetParameter (
+    IN const char   *Name,
+    IN ULONG        Value
+    )
+{
+    WdkSetRegistryValue(TEST_PARAMETERS_KEY, Name, REG_DWORD, &Value, sizeof(ULONG));
+}
+
+PDEVICE_OBJECT
+TestLoadDriver (
+    IN PTEST_DISK   Disk,
+    OUT NTSTATUS    *Status
+    )
+{
+    UNICODE_STRING  registry_path;
+    WCHAR           path[128];
+    char            name[64];
+    ULONG           n;
+
+    for (n = 0; n + 1 < RTL_NUMBER_OF(path) && TEST_SERVICE_KEY[n]; n++)
+    {
+        path[n] = TEST_SERVICE_KEY[n];
+    }
+
+    path[n] = 0;
+
+    for (n = 0; n + 1 < sizeof(name) && Disk->Name[n]; n++)
+    {
+        name[n] = (char) Disk->Name[n];
+    }
+
+    name[n] = 0;
+
+    WdkSetRegistryString(TEST_PARAMETERS_KEY, "SwapDevice", name);
+
+    RtlInitUnicodeString(&registry_path, path);
+
+    test_driver_object.DriverExtension = &test_driver_extension;
+    test_driver_extension.DriverObject = &test_driver_object;
+
+    RtlInitUnicodeString(&test_driver_extension.ServiceKeyName, L"SwapFs");
+
+    *Status = DriverEntry(&test_driver_object, &registry_path);
+
+    return NT_SUCCESS(*Status) ? Disk->DeviceObject->AttachedDevice : NULL;
+}
+
+NTSTATUS
+TestReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN UCHAR            MajorFunction,
+    IN LONGLONG         Offset,
+    IN ULONG            Length,
+    IN PVOID            Buffer
+    )
+{
+    IO_STATUS_BLOCK iosb;
+    LARGE_INTEGER   offset;
+    KEVENT          event;
+    PIRP            irp;
+    NTSTATUS        status;
+
+    KeInitializeEvent(&event, NotificationEvent, FALSE);
+
+    offset.QuadPart = Offset;
+
+    irp = IoBuildSynchronousFsdRequest(MajorFunction, DeviceObject, Buffer, Length, &offset, &event, &iosb);
+
+    if (!irp)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    status = IoCallDriver(DeviceObject, irp);
+
+    if (status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&event, Executive, KernelMode, FALSE, NULL);
+        status = iosb.Status;
+    }
+
+    return status;
+}
+
+NTSTATUS
+TestDeviceControl (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            IoControlCode,
+    IN PVOID            InputBuffer,
+    IN ULONG            InputLength,
+    OUT PVOID           OutputBuffer,
+    IN ULONG            OutputLength,
+    OUT PULONG_PTR      Information
+    )
+{
+    IO_STATUS_BLOCK iosb;
+    KEVENT          event;
+    PIRP            irp;
+    NTSTATUS        status;
+
+    KeInitializeEvent(&event, NotificationEvent, FALSE);
+
+    irp = IoBuildDeviceIoControlRequest(
+        IoControlCode,
+        DeviceObject,
+        InputBuffer,
+        InputLength,
+        OutputBuffer,
+        OutputLength,
+        FALSE,
+        &event,
+        &iosb
+        );
+
+    if (!irp)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    iosb.Information = 0;
+
+    status = IoCallDriver(DeviceObject, irp);
+
+    if (status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&event, Executive, KernelMode, FALSE, NULL);
+        status = iosb.Status;
+    }
+
+    if (Information)
+    {
+        *Information = iosb.Information;
+    }
+
+    return status;
+}
+
+BOOLEAN
+TestReadVolume (
+    PVOID       Context,
+    ULONGLONG   Offset,
+    ULONG       Length,
+    PVOID       Buffer
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    PUCHAR          sector;
+    ULONG           sector_size;
+    LONGLONG        start;
+    ULONG           count;
+    BOOLEAN         ok;
+
+    device_object = (PDEVICE_OBJECT) Context;
+
+    /* the checker reads parts of sectors, the device only reads whole ones */
+
+    sector_size = 4096;
+
+    start = ALIGN_DOWN_BY(Offset, sector_size);
+
+    count = (ULONG) (ALIGN_UP_BY(Offset + Length, sector_size) - start);
+
+    sector = (PUCHAR) ExAllocatePoolWithTag(NonPagedPool, count, 0);
+
+    if (!sector)
+    {
+        return FALSE;
+    }
+
+    ok = NT_SUCCESS(TestReadWrite(device_object, IRP_MJ_READ, start, count, sector));
+
+    if (ok)
+    {
+        RtlCopyMemory(Buffer, sector + (Offset - start), Length);
+    }
+
+    ExFreePool(sector);
+
+    return ok;
+}
+
+LONGLONG
+TestTime (
+    VOID
+    )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (LONGLONG) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
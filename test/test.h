@@ -0,0 +1,112 @@
+/*
+    What the user-mode tests of the driver have in common.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    A test is a program that returns 0 when all its checks passed. CHECK
+    prints the check that failed and goes on, so one run shows all of
+    them. TestLoadDriver runs DriverEntry with the parameters a test has
+    set with TestSetParameter, the SwapDevice is the disk given, and
+    returns the device the driver attached to it. The requests a test
+    sends to the device are built and waited for as the file systems do.
+*/
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <ntddk.h>
+#include <ntdddisk.h>
+#include <stdio.h>
+#include "wdk.h"
+#include "disk.h"
+#include "fatcheck.h"
+
+#define TEST_SERVICE_KEY    "\\Registry\\Machine\\System\\CurrentControlSet\\Services\\SwapFs"
+#define TEST_PARAMETERS_KEY TEST_SERVICE_KEY "\\Parameters"
+
+extern int TestFailures;
+
+#define CHECK(e) \
+    do { \
+        if (!(e)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #e); \
+            TestFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_STATUS(s, e) \
+    do { \
+        NTSTATUS check_status = (s); \
+        if (check_status != (e)) { \
+            fprintf(stderr, "%s:%d: %s is 0x%08x, not 0x%08x\n", __FILE__, __LINE__, #s, check_status, (NTSTATUS) (e)); \
+            TestFailures++; \
+        } \
+    } while (0)
+
+#define TEST_RUN(t) \
+    do { \
+        int failures = TestFailures; \
+        t(); \
+        printf("%-48s %s\n", #t, TestFailures == failures ? "ok" : "FAILED"); \
+    } while (0)
+
+NTSTATUS DriverEntry (PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath);
+
+VOID
+TestSetParameter (
+    IN const char   *Name,
+    IN ULONG        Value
+    );
+
+PDEVICE_OBJECT
+TestLoadDriver (
+    IN PTEST_DISK   Disk,
+    OUT NTSTATUS    *Status
+    );
+
+NTSTATUS
+TestReadWrite (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN UCHAR            MajorFunction,
+    IN LONGLONG         Offset,
+    IN ULONG            Length,
+    IN PVOID            Buffer
+    );
+
+NTSTATUS
+TestDeviceControl (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            IoControlCode,
+    IN PVOID            InputBuffer,
+    IN ULONG            InputLength,
+    OUT PVOID           OutputBuffer,
+    IN ULONG            OutputLength,
+    OUT PULONG_PTR      Information
+    );
+
+/* reads the volume through the device the driver attached, the context is the device */
+
+FATCHECK_READ TestReadVolume;
+
+/* the time in nanoseconds from an arbitrary start */
+
+LONGLONG
+TestTime (
+    VOID
+    );
+
+#endif /* _TEST_H_ */
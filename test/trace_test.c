@@ -0,0 +1,390 @@
+/*
+    Tests of the trace ring buffer of the driver.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    With TraceBufferSize the completion routine of the statistics records
+    each read, write and flush in a ring buffer that IOCTL_SWAPFS_DRAIN_TRACE
+    returns. The tests check the records of known requests, a drain into
+    a buffer smaller than the records waiting, the records that are lost
+    when the ring is overrun and the ring written from several threads
+    while it's drained, where each request must be drained once or be
+    counted as lost and no record may be torn.
+*/
+
+#include <stdlib.h>
+#include <ntstrsafe.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swap.h"
+
+#define TEST_DISK_LENGTH    (64 * 1024 * 1024)
+#define TEST_DATA_OFFSET    (16 * 1024 * 1024)
+#define TEST_THREADS        4
+#define TEST_REQUESTS       2000
+
+/* a buffer of 1 KB holds 16 records and one of 4 KB 64 */
+
+#define TEST_SMALL_RING     16
+#define TEST_LARGE_RING     64
+
+static ULONG test_number;
+static UCHAR test_buffer[TEST_THREADS][4096 * TEST_THREADS];
+
+static PDEVICE_OBJECT
+test_load (
+    IN ULONG        TraceBufferSize,
+    OUT PTEST_DISK  *Disk
+    )
+{
+    PTEST_DISK      disk;
+    PDEVICE_OBJECT  device_object;
+    WCHAR           name[64];
+    NTSTATUS        status;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk6\\Partition%u", ++test_number);
+
+    disk = TestDiskCreate(name, TEST_DISK_LENGTH, 512, NULL);
+
+    TestDiskSetSwapHeader(disk);
+
+    WdkClearRegistry();
+
+    if (TraceBufferSize)
+    {
+        TestSetParameter("TraceBufferSize", TraceBufferSize);
+    }
+
+    device_object = TestLoadDriver(disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    *Disk = disk;
+
+    return device_object;
+}
+
+static PSWAPFS_TRACE
+test_drain (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            NumberOfRecords
+    )
+{
+    PSWAPFS_TRACE   trace;
+    ULONG           length;
+    ULONG_PTR       information;
+
+    length = FIELD_OFFSET(SWAPFS_TRACE, Record) + NumberOfRecords * sizeof(SWAPFS_TRACE_RECORD);
+
+    trace = (PSWAPFS_TRACE) calloc(1, length);
+
+    CHECK_STATUS(TestDeviceControl(DeviceObject, IOCTL_SWAPFS_DRAIN_TRACE, NULL, 0, trace, length, &information),
+        STATUS_SUCCESS);
+
+    CHECK(trace->Version == SWAPFS_TRACE_VERSION);
+    CHECK(information == FIELD_OFFSET(SWAPFS_TRACE, Record) + trace->NumberOfRecords * sizeof(SWAPFS_TRACE_RECORD));
+
+    return trace;
+}
+
+static NTSTATUS
+test_fail_reads (
+    IN PTEST_DISK   Disk,
+    IN UCHAR        MajorFunction,
+    IN LONGLONG     Offset,
+    IN ULONG        Length
+    )
+{
+    return MajorFunction == IRP_MJ_READ ? STATUS_DATA_ERROR : STATUS_SUCCESS;
+}
+
+static void
+test_records (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PSWAPFS_TRACE   trace;
+    ULONG           n;
+
+    device_object = test_load(1, &disk);
+
+    /* what the format did is not traced */
+
+    trace = test_drain(device_object, TEST_SMALL_RING);
+    CHECK(trace->NumberOfRecords == 0);
+    CHECK(trace->Lost == 0);
+    CHECK(trace->StartTime != 0);
+    free(trace);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, TEST_DATA_OFFSET, 4096, test_buffer[0]), STATUS_SUCCESS);
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, TEST_DATA_OFFSET + 8192, 1024, test_buffer[0]), STATUS_SUCCESS);
+
+    disk->Hook = test_fail_reads;
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, TEST_DATA_OFFSET, 512, test_buffer[0]), STATUS_DATA_ERROR);
+    disk->Hook = NULL;
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_FLUSH_BUFFERS, 0, 0, NULL), STATUS_SUCCESS);
+
+    trace = test_drain(device_object, TEST_SMALL_RING);
+
+    CHECK(trace->NumberOfRecords == 4);
+    CHECK(trace->Lost == 0);
+
+    /* the offsets are on the swap partition, after the swap header */
+
+    CHECK(trace->Record[0].Operation == IRP_MJ_WRITE);
+    CHECK(trace->Record[0].Offset == TEST_DATA_OFFSET + sizeof(union swap_header));
+    CHECK(trace->Record[0].Length == 4096);
+    CHECK(trace->Record[0].Status == STATUS_SUCCESS);
+
+    CHECK(trace->Record[1].Operation == IRP_MJ_READ);
+    CHECK(trace->Record[1].Offset == TEST_DATA_OFFSET + 8192 + sizeof(union swap_header));
+    CHECK(trace->Record[1].Length == 1024);
+
+    CHECK(trace->Record[2].Operation == IRP_MJ_READ);
+    CHECK(trace->Record[2].Status == STATUS_DATA_ERROR);
+
+    CHECK(trace->Record[3].Operation == IRP_MJ_FLUSH_BUFFERS);
+    CHECK(trace->Record[3].Offset == 0 && trace->Record[3].Length == 0);
+
+    for (n = 0; n < trace->NumberOfRecords; n++)
+    {
+        CHECK(trace->Record[n].Sequence == n + 1);
+        CHECK(trace->Record[n].Depth == 1);
+        CHECK(n == 0 || trace->Record[n].Timestamp >= trace->Record[n - 1].Timestamp);
+    }
+
+    free(trace);
+
+    /* a record is drained once */
+
+    trace = test_drain(device_object, TEST_SMALL_RING);
+    CHECK(trace->NumberOfRecords == 0);
+    free(trace);
+}
+
+static void
+test_partial_drain (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PSWAPFS_TRACE   trace;
+    ULONG_PTR       information;
+    SWAPFS_TRACE    header;
+    ULONG           n;
+
+    device_object = test_load(1, &disk);
+
+    for (n = 0; n < 10; n++)
+    {
+        TestReadWrite(device_object, IRP_MJ_WRITE, TEST_DATA_OFFSET + n * 4096, 4096, test_buffer[0]);
+    }
+
+    CHECK_STATUS(TestDeviceControl(device_object, IOCTL_SWAPFS_DRAIN_TRACE, NULL, 0, &header,
+        FIELD_OFFSET(SWAPFS_TRACE, Record) - 1, &information), STATUS_BUFFER_TOO_SMALL);
+
+    /* a buffer of only the header drains nothing */
+
+    trace = test_drain(device_object, 0);
+    CHECK(trace->NumberOfRecords == 0);
+    free(trace);
+
+    trace = test_drain(device_object, 3);
+    CHECK(trace->NumberOfRecords == 3);
+    CHECK(trace->Record[0].Sequence == 1 && trace->Record[2].Sequence == 3);
+    free(trace);
+
+    trace = test_drain(device_object, TEST_SMALL_RING);
+    CHECK(trace->NumberOfRecords == 7);
+    CHECK(trace->Record[0].Sequence == 4);
+    CHECK(trace->Record[6].Offset == TEST_DATA_OFFSET + 9 * 4096 + sizeof(union swap_header));
+    CHECK(trace->Lost == 0);
+    free(trace);
+}
+
+static void
+test_overrun (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PSWAPFS_TRACE   trace;
+    ULONG           n;
+
+    device_object = test_load(1, &disk);
+
+    for (n = 0; n < 40; n++)
+    {
+        TestReadWrite(device_object, IRP_MJ_WRITE, TEST_DATA_OFFSET + n * 4096, 4096, test_buffer[0]);
+    }
+
+    /* the oldest 24 were overwritten, the newest 16 are returned */
+
+    trace = test_drain(device_object, 64);
+
+    CHECK(trace->NumberOfRecords == TEST_SMALL_RING);
+    CHECK(trace->Lost == 40 - TEST_SMALL_RING);
+    CHECK(trace->Record[0].Sequence == 40 - TEST_SMALL_RING + 1);
+    CHECK(trace->Record[0].Offset == TEST_DATA_OFFSET + (40 - TEST_SMALL_RING) * 4096 + sizeof(union swap_header));
+    CHECK(trace->Record[TEST_SMALL_RING - 1].Sequence == 40);
+
+    free(trace);
+
+    /* the count of lost records is kept across drains */
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, TEST_DATA_OFFSET, 4096, test_buffer[0]);
+
+    trace = test_drain(device_object, 64);
+    CHECK(trace->NumberOfRecords == 1);
+    CHECK(trace->Record[0].Sequence == 41);
+    CHECK(trace->Lost == 40 - TEST_SMALL_RING);
+    free(trace);
+}
+
+static void
+test_untraced (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    ULONG_PTR       information;
+    UCHAR           output[256];
+
+    device_object = test_load(0, &disk);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, TEST_DATA_OFFSET, 4096, test_buffer[0]);
+
+    CHECK_STATUS(TestDeviceControl(device_object, IOCTL_SWAPFS_DRAIN_TRACE, NULL, 0, output, sizeof(output),
+        &information), STATUS_INVALID_DEVICE_REQUEST);
+
+    CHECK(information == 0);
+}
+
+/* each thread writes its own offsets with a length of its own so a torn record is seen */
+
+typedef struct _TEST_WRITER {
+    pthread_t       Thread;
+    PDEVICE_OBJECT  DeviceObject;
+    ULONG           Index;
+} TEST_WRITER;
+
+static volatile LONG test_writers_done;
+
+static void *
+test_writer (
+    void *Context
+    )
+{
+    TEST_WRITER *writer = (TEST_WRITER *) Context;
+    ULONG       n;
+
+    for (n = 0; n < TEST_REQUESTS; n++)
+    {
+        TestReadWrite(writer->DeviceObject, IRP_MJ_WRITE,
+            TEST_DATA_OFFSET + ((LONGLONG) writer->Index * TEST_REQUESTS + n) * 4096,
+            (writer->Index + 1) * 512, test_buffer[writer->Index]);
+    }
+
+    InterlockedIncrement(&test_writers_done);
+
+    return NULL;
+}
+
+static void
+test_concurrent_drain (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    PSWAPFS_TRACE   trace;
+    TEST_WRITER     writer[TEST_THREADS];
+    LONGLONG        last_sequence, index;
+    ULONGLONG       drained, lost;
+    ULONG           torn, n;
+    BOOLEAN         done, more;
+
+    device_object = test_load(4, &disk);
+
+    TestDiskStartThreads(disk, TEST_THREADS);
+
+    test_writers_done = 0;
+
+    for (n = 0; n < TEST_THREADS; n++)
+    {
+        writer[n].DeviceObject = device_object;
+        writer[n].Index = n;
+        pthread_create(&writer[n].Thread, NULL, test_writer, &writer[n]);
+    }
+
+    last_sequence = 0;
+    drained = 0;
+    lost = 0;
+    torn = 0;
+
+    /* the writers are done when a drain after they are returns nothing */
+
+    do
+    {
+        done = test_writers_done == TEST_THREADS;
+
+        trace = test_drain(device_object, TEST_LARGE_RING / 4);
+
+        for (n = 0; n < trace->NumberOfRecords; n++)
+        {
+            index = (trace->Record[n].Offset - sizeof(union swap_header) - TEST_DATA_OFFSET) / 4096 / TEST_REQUESTS;
+
+            if (trace->Record[n].Operation != IRP_MJ_WRITE || index < 0 || index >= TEST_THREADS ||
+                trace->Record[n].Length != (index + 1) * 512 || trace->Record[n].Status != STATUS_SUCCESS ||
+                trace->Record[n].Depth < 1 || trace->Record[n].Depth > TEST_THREADS)
+            {
+                torn++;
+            }
+
+            CHECK(trace->Record[n].Sequence > last_sequence);
+
+            last_sequence = trace->Record[n].Sequence;
+        }
+
+        drained += trace->NumberOfRecords;
+        lost = trace->Lost;
+
+        more = trace->NumberOfRecords != 0;
+
+        free(trace);
+    }
+    while (!done || more);
+
+    for (n = 0; n < TEST_THREADS; n++)
+    {
+        pthread_join(writer[n].Thread, NULL);
+    }
+
+    printf("    %llu records drained and %llu lost of %u\n", drained, lost, TEST_THREADS * TEST_REQUESTS);
+
+    CHECK(torn == 0);
+    CHECK(last_sequence == TEST_THREADS * TEST_REQUESTS);
+    CHECK(drained + lost == TEST_THREADS * TEST_REQUESTS);
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_records);
+    TEST_RUN(test_partial_drain);
+    TEST_RUN(test_overrun);
+    TEST_RUN(test_untraced);
+    TEST_RUN(test_concurrent_drain);
+
+    return TestFailures != 0;
+}
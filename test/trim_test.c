@@ -0,0 +1,208 @@
+/*
+    Tests of the format by TRIM of devices that read trimmed blocks as zero.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    On a device that reports TRIM and that trimmed blocks read as zero the
+    formatters clear the metadata with TRIM instead of writing zeros. The
+    tests format the same partition with and without TRIM and compare the
+    volumes, with the unmap granularity reported for both since the layout
+    is aligned to it. They also check that each trimmed range is aligned
+    to the granularity from the start of the disk, and that a device where
+    the TRIM fails is formated with writes as before.
+*/
+
+#include <stdlib.h>
+#include <ntstrsafe.h>
+#include "test.h"
+#include "swapfs.h"
+#include "swap.h"
+
+#define TEST_GRANULARITY    (16 * 1024)
+
+static ULONG test_number;
+static ULONG test_misaligned;
+
+static NTSTATUS
+test_check_alignment (
+    IN PTEST_DISK   Disk,
+    IN UCHAR        MajorFunction,
+    IN LONGLONG     Offset,
+    IN ULONG        Length
+    )
+{
+    if (MajorFunction == IRP_MJ_DEVICE_CONTROL &&
+        ((Disk->StartingOffset + Offset) % Disk->UnmapGranularity ||
+         Length % Disk->UnmapGranularity))
+    {
+        test_misaligned++;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+test_fail_trim (
+    IN PTEST_DISK   Disk,
+    IN UCHAR        MajorFunction,
+    IN LONGLONG     Offset,
+    IN ULONG        Length
+    )
+{
+    return MajorFunction == IRP_MJ_DEVICE_CONTROL ? STATUS_INVALID_DEVICE_REQUEST : STATUS_SUCCESS;
+}
+
+static PTEST_DISK
+test_format (
+    IN LONGLONG         Length,
+    IN BOOLEAN          Trim,
+    IN ULONG            Granularity,
+    IN TEST_DISK_HOOK   *Hook,
+    OUT PFATCHECK       Check
+    )
+{
+    PTEST_DISK      disk;
+    PDEVICE_OBJECT  device_object;
+    WCHAR           name[64];
+    NTSTATUS        status;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk2\\Partition%u", ++test_number);
+
+    disk = TestDiskCreate(name, Length, 512, NULL);
+
+    /* an old style partition at sector 63, which is not aligned to the granularity */
+
+    disk->StartingOffset = 63 * 512;
+
+    disk->Trim = Trim;
+    disk->UnmapGranularity = Granularity;
+    disk->Hook = Hook;
+
+    RtlFillMemory(disk->Image + sizeof(union swap_header), 8 * 1024 * 1024, 0xA5);
+
+    TestDiskSetSwapHeader(disk);
+
+    WdkClearRegistry();
+
+    device_object = TestLoadDriver(disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    if (!device_object || !FatCheckVolume(TestReadVolume, device_object, Length - sizeof(union swap_header), Check))
+    {
+        fprintf(stderr, "fatcheck: %s\n", device_object ? Check->Error : "not loaded");
+        CHECK(FALSE);
+        return NULL;
+    }
+
+    return disk;
+}
+
+static void
+test_same_volume (
+    IN LONGLONG Length,
+    IN ULONG    FileSystem
+    )
+{
+    PTEST_DISK  written, trimmed;
+    FATCHECK    check;
+    LONGLONG    metadata;
+
+    test_misaligned = 0;
+
+    written = test_format(Length, FALSE, TEST_GRANULARITY, NULL, &check);
+    trimmed = test_format(Length, TRUE, TEST_GRANULARITY, test_check_alignment, &check);
+
+    if (!written || !trimmed)
+    {
+        return;
+    }
+
+    CHECK(check.FileSystem == FileSystem);
+
+    /* the metadata and the first clusters, where the root directory is */
+
+    metadata = sizeof(union swap_header) + check.DataOffset + 16 * check.ClusterSize;
+
+    CHECK(RtlCompareMemory(written->Image, trimmed->Image, (SIZE_T) metadata) == (SIZE_T) metadata);
+
+    CHECK(written->Trims == 0);
+    CHECK(trimmed->Trims > 0);
+    CHECK(test_misaligned == 0);
+    CHECK(trimmed->BytesWritten < written->BytesWritten);
+
+    printf("    FAT%u: written %lld bytes, trimmed %lld bytes in %d requests and written %lld bytes\n",
+        check.FileSystem, written->BytesWritten, trimmed->BytesTrimmed, trimmed->Trims, trimmed->BytesWritten);
+}
+
+static void
+test_fat16_trim (void)
+{
+    test_same_volume(16 * 1024 * 1024, FATCHECK_FAT16);
+}
+
+static void
+test_fat32_trim (void)
+{
+    test_same_volume(512 * 1024 * 1024, FATCHECK_FAT32);
+}
+
+static void
+test_failed_trim (void)
+{
+    PTEST_DISK  written, failed;
+    FATCHECK    check;
+    LONGLONG    metadata;
+
+    written = test_format(512 * 1024 * 1024, FALSE, TEST_GRANULARITY, NULL, &check);
+    failed = test_format(512 * 1024 * 1024, TRUE, TEST_GRANULARITY, test_fail_trim, &check);
+
+    if (!written || !failed)
+    {
+        return;
+    }
+
+    metadata = sizeof(union swap_header) + check.DataOffset + 16 * check.ClusterSize;
+
+    CHECK(RtlCompareMemory(written->Image, failed->Image, (SIZE_T) metadata) == (SIZE_T) metadata);
+    CHECK(failed->BytesTrimmed == 0);
+    CHECK(failed->BytesWritten == written->BytesWritten);
+}
+
+static void
+test_no_read_zeros (void)
+{
+    PTEST_DISK  disk;
+    FATCHECK    check;
+
+    /* without the provisioning granularity trimmed blocks are not known to read as zero */
+
+    disk = test_format(512 * 1024 * 1024, TRUE, 0, NULL, &check);
+
+    CHECK(disk && disk->Trims == 0);
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_fat16_trim);
+    TEST_RUN(test_fat32_trim);
+    TEST_RUN(test_failed_trim);
+    TEST_RUN(test_no_read_zeros);
+
+    return TestFailures != 0;
+}
@@ -0,0 +1,106 @@
+/*
+    A user-mode stand-in for the TraceLogging macros the driver uses.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    TraceLoggingWrite collects its fields in an array and passes it to
+    WdkTraceWrite, which keeps the events written while the provider is
+    enabled so a test can look at the name, level, keyword and payload
+    of each. TRACELOGGING_DEFINE_PROVIDER keeps the name and the GUID so
+    they can be checked against each other.
+*/
+
+#ifndef _TRACELOGGINGPROVIDER_H_
+#define _TRACELOGGINGPROVIDER_H_
+
+#include <ntddk.h>
+
+#define WINEVENT_LEVEL_CRITICAL 1
+#define WINEVENT_LEVEL_ERROR    2
+#define WINEVENT_LEVEL_WARNING  3
+#define WINEVENT_LEVEL_INFO     4
+#define WINEVENT_LEVEL_VERBOSE  5
+
+typedef struct _WDK_TRACE_PROVIDER {
+    const char *Name;
+    GUID Guid;
+    BOOLEAN Registered;
+    UCHAR Level;
+    ULONGLONG Keyword;
+} WDK_TRACE_PROVIDER;
+
+typedef WDK_TRACE_PROVIDER *TraceLoggingHProvider;
+
+typedef enum _WDK_TRACE_TYPE {
+    WdkTraceLevel,
+    WdkTraceKeyword,
+    WdkTraceInt32,
+    WdkTraceUInt8,
+    WdkTraceUInt32,
+    WdkTraceHexUInt32,
+    WdkTraceInt64,
+    WdkTraceUInt64,
+    WdkTraceBoolean,
+    WdkTraceNTStatus,
+    WdkTracePointer,
+    WdkTraceString
+} WDK_TRACE_TYPE;
+
+typedef struct _WDK_TRACE_FIELD {
+    WDK_TRACE_TYPE Type;
+    const char *Name;
+    ULONGLONG Value;
+    const void *Pointer;
+} WDK_TRACE_FIELD;
+
+#define TRACELOGGING_DECLARE_PROVIDER(h) \
+    extern const TraceLoggingHProvider h
+
+#define WDK_TRACE_GUID(d1, d2, d3, b0, b1, b2, b3, b4, b5, b6, b7) \
+    { d1, d2, d3, { b0, b1, b2, b3, b4, b5, b6, b7 } }
+
+#define TRACELOGGING_DEFINE_PROVIDER(h, name, guid) \
+    static WDK_TRACE_PROVIDER h##_Storage = { name, WDK_TRACE_GUID guid, FALSE, 0, 0 }; \
+    const TraceLoggingHProvider h = &h##_Storage
+
+#define TraceLoggingLevel(v)            { WdkTraceLevel, NULL, (ULONGLONG) (v), NULL }
+#define TraceLoggingKeyword(v)          { WdkTraceKeyword, NULL, (ULONGLONG) (v), NULL }
+#define TraceLoggingInt32(v, n)         { WdkTraceInt32, n, (ULONGLONG) (LONGLONG) (LONG) (v), NULL }
+#define TraceLoggingUInt8(v, n)         { WdkTraceUInt8, n, (ULONGLONG) (UCHAR) (v), NULL }
+#define TraceLoggingUInt32(v, n)        { WdkTraceUInt32, n, (ULONGLONG) (ULONG) (v), NULL }
+#define TraceLoggingHexUInt32(v, n)     { WdkTraceHexUInt32, n, (ULONGLONG) (ULONG) (v), NULL }
+#define TraceLoggingInt64(v, n)         { WdkTraceInt64, n, (ULONGLONG) (LONGLONG) (v), NULL }
+#define TraceLoggingUInt64(v, n)        { WdkTraceUInt64, n, (ULONGLONG) (v), NULL }
+#define TraceLoggingBoolean(v, n)       { WdkTraceBoolean, n, (ULONGLONG) !!(v), NULL }
+#define TraceLoggingNTStatus(v, n)      { WdkTraceNTStatus, n, (ULONGLONG) (ULONG) (v), NULL }
+#define TraceLoggingPointer(v, n)       { WdkTracePointer, n, (ULONGLONG) (ULONG_PTR) (v), NULL }
+#define TraceLoggingString(v, n)        { WdkTraceString, n, 0, (v) }
+
+#define TraceLoggingWrite(h, name, ...) \
+    do { \
+        const WDK_TRACE_FIELD wdk_trace_fields[] = { __VA_ARGS__ }; \
+        WdkTraceWrite((h), (name), wdk_trace_fields, RTL_NUMBER_OF(wdk_trace_fields)); \
+    } while (0)
+
+#define TraceLoggingProviderEnabled(h, level, keyword) \
+    ((h)->Registered && (level) <= (h)->Level && ((keyword) == 0 || ((keyword) & (h)->Keyword)))
+
+NTSTATUS TraceLoggingRegister (TraceLoggingHProvider);
+VOID TraceLoggingUnregister (TraceLoggingHProvider);
+VOID WdkTraceWrite (TraceLoggingHProvider, const char *, const WDK_TRACE_FIELD *, ULONG);
+
+#endif /* _TRACELOGGINGPROVIDER_H_ */
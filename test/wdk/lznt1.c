@@ -0,0 +1,372 @@
+/*
+    The LZNT1 compression of the kernel, for the user-mode tests.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The buffer is compressed in chunks of 4096 bytes, each with a 16 bit
+    header that has the size of the chunk less three, the signature 3 and
+    the high bit set when the chunk is compressed. In a compressed chunk
+    every flag byte tells for the eight tokens after it if they are a
+    literal byte or a two byte copy from earlier in the chunk, where the
+    bits of the copy that give the displacement grow with the position in
+    the chunk. A chunk that would not get smaller is stored as it is. The
+    matches are found with a table of the last position of each three
+    byte hash in the workspace, greedy as the standard engine is.
+*/
+
+#include <ntifs.h>
+
+#define LZNT1_CHUNK_SIZE    4096
+#define LZNT1_HASH_BITS     12
+#define LZNT1_HASH_SIZE     (1 << LZNT1_HASH_BITS)
+
+/* the number of bits of a copy token that give the length at a position in the chunk */
+
+static ULONG
+lznt1_length_bits (
+    IN ULONG Position
+    )
+{
+    ULONG bits, n;
+
+    for (bits = 12, n = Position - 1; n >= 0x10; n >>= 1)
+    {
+        bits--;
+    }
+
+    return bits;
+}
+
+static ULONG
+lznt1_hash (
+    IN PUCHAR Data
+    )
+{
+    return ((Data[0] << 8) ^ (Data[1] << 4) ^ Data[2]) & (LZNT1_HASH_SIZE - 1);
+}
+
+static ULONG
+lznt1_compress_chunk (
+    IN PUCHAR   Chunk,
+    IN ULONG    Length,
+    OUT PUCHAR  Output,
+    IN ULONG    OutputLength,
+    IN PLONG    Table
+    )
+{
+    ULONG   position, out, flags_at, ntoken;
+    ULONG   bits, max_length, max_displacement;
+    ULONG   best, length, displacement, hash;
+    LONG    candidate;
+    USHORT  token;
+
+    for (hash = 0; hash < LZNT1_HASH_SIZE; hash++)
+    {
+        Table[hash] = -1;
+    }
+
+    out = 0;
+    flags_at = 0;
+    ntoken = 8;
+
+    for (position = 0; position < Length; )
+    {
+        if (ntoken == 8)
+        {
+            if (out >= OutputLength)
+            {
+                return 0;
+            }
+
+            flags_at = out++;
+            Output[flags_at] = 0;
+            ntoken = 0;
+        }
+
+        best = 0;
+        displacement = 0;
+
+        if (position && position + 3 <= Length)
+        {
+            bits = lznt1_length_bits(position);
+            max_length = min((1u << bits) + 2, Length - position);
+            max_displacement = 1u << (16 - bits);
+
+            hash = lznt1_hash(Chunk + position);
+            candidate = Table[hash];
+
+            if (candidate >= 0 && position - candidate <= max_displacement)
+            {
+                for (length = 0; length < max_length && Chunk[candidate + length] == Chunk[position + length]; length++)
+                {
+                }
+
+                if (length >= 3)
+                {
+                    best = length;
+                    displacement = position - candidate;
+                }
+            }
+        }
+
+        if (position + 3 <= Length)
+        {
+            Table[lznt1_hash(Chunk + position)] = position;
+        }
+
+        if (best)
+        {
+            if (out + 2 > OutputLength)
+            {
+                return 0;
+            }
+
+            bits = lznt1_length_bits(position);
+            token = (USHORT) (((displacement - 1) << bits) | (best - 3));
+
+            Output[out++] = (UCHAR) token;
+            Output[out++] = (UCHAR) (token >> 8);
+            Output[flags_at] |= 1 << ntoken;
+
+            /* the positions inside the copy are hashed too so later matches find them */
+
+            for (length = 1; length < best; length++)
+            {
+                if (position + length + 3 <= Length)
+                {
+                    Table[lznt1_hash(Chunk + position + length)] = position + length;
+                }
+            }
+
+            position += best;
+        }
+        else
+        {
+            if (out >= OutputLength)
+            {
+                return 0;
+            }
+
+            Output[out++] = Chunk[position++];
+        }
+
+        ntoken++;
+    }
+
+    return out;
+}
+
+NTSTATUS
+RtlGetCompressionWorkSpaceSize (
+    USHORT  CompressionFormatAndEngine,
+    PULONG  CompressBufferWorkSpaceSize,
+    PULONG  CompressFragmentWorkSpaceSize
+    )
+{
+    if ((CompressionFormatAndEngine & 0xff) != COMPRESSION_FORMAT_LZNT1)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    *CompressBufferWorkSpaceSize = LZNT1_HASH_SIZE * sizeof(LONG);
+    *CompressFragmentWorkSpaceSize = 0;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RtlCompressBuffer (
+    USHORT  CompressionFormatAndEngine,
+    PUCHAR  UncompressedBuffer,
+    ULONG   UncompressedBufferSize,
+    PUCHAR  CompressedBuffer,
+    ULONG   CompressedBufferSize,
+    ULONG   UncompressedChunkSize,
+    PULONG  FinalCompressedSize,
+    PVOID   WorkSpace
+    )
+{
+    ULONG   offset, length, out, size;
+    BOOLEAN zeros;
+
+    if ((CompressionFormatAndEngine & 0xff) != COMPRESSION_FORMAT_LZNT1 || UncompressedChunkSize != LZNT1_CHUNK_SIZE)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    zeros = TRUE;
+
+    for (offset = 0; offset < UncompressedBufferSize && zeros; offset++)
+    {
+        zeros = !UncompressedBuffer[offset];
+    }
+
+    out = 0;
+
+    for (offset = 0; offset < UncompressedBufferSize; offset += length)
+    {
+        length = min(UncompressedBufferSize - offset, LZNT1_CHUNK_SIZE);
+
+        if (out + 2 > CompressedBufferSize)
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+
+        size = lznt1_compress_chunk(
+            UncompressedBuffer + offset,
+            length,
+            CompressedBuffer + out + 2,
+            min(CompressedBufferSize - out - 2, length - 1),
+            (PLONG) WorkSpace
+            );
+
+        if (size)
+        {
+            CompressedBuffer[out] = (UCHAR) (size - 1);
+            CompressedBuffer[out + 1] = (UCHAR) (0xb0 | ((size - 1) >> 8));
+        }
+        else
+        {
+            /* a chunk that doesn't get smaller is stored with a header that says so */
+
+            if (length != LZNT1_CHUNK_SIZE || out + 2 + length > CompressedBufferSize)
+            {
+                return STATUS_BUFFER_TOO_SMALL;
+            }
+
+            RtlCopyMemory(CompressedBuffer + out + 2, UncompressedBuffer + offset, length);
+
+            size = length;
+
+            CompressedBuffer[out] = (UCHAR) (size - 1);
+            CompressedBuffer[out + 1] = (UCHAR) (0x30 | ((size - 1) >> 8));
+        }
+
+        out += size + 2;
+    }
+
+    *FinalCompressedSize = out;
+
+    return zeros ? STATUS_BUFFER_ALL_ZEROS : STATUS_SUCCESS;
+}
+
+NTSTATUS
+RtlDecompressBuffer (
+    USHORT  CompressionFormat,
+    PUCHAR  UncompressedBuffer,
+    ULONG   UncompressedBufferSize,
+    PUCHAR  CompressedBuffer,
+    ULONG   CompressedBufferSize,
+    PULONG  FinalUncompressedSize
+    )
+{
+    ULONG   in, out, end, chunk, position, n;
+    ULONG   bits, length, displacement;
+    USHORT  header, token;
+    UCHAR   flags;
+
+    if ((CompressionFormat & 0xff) != COMPRESSION_FORMAT_LZNT1)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    in = 0;
+    out = 0;
+
+    /* a header of zero or the end of the buffer ends the data */
+
+    while (in + 2 <= CompressedBufferSize && out < UncompressedBufferSize)
+    {
+        header = CompressedBuffer[in] | (CompressedBuffer[in + 1] << 8);
+
+        if (!header)
+        {
+            break;
+        }
+
+        end = in + 2 + (header & 0xfff) + 1;
+
+        if (((header >> 12) & 7) != 3 || end > CompressedBufferSize)
+        {
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        }
+
+        in += 2;
+
+        if (!(header & 0x8000))
+        {
+            n = min(end - in, UncompressedBufferSize - out);
+            RtlCopyMemory(UncompressedBuffer + out, CompressedBuffer + in, n);
+            out += n;
+            in = end;
+            continue;
+        }
+
+        chunk = out;
+
+        while (in < end)
+        {
+            flags = CompressedBuffer[in++];
+
+            for (n = 0; n < 8 && in < end; n++, flags >>= 1)
+            {
+                position = out - chunk;
+
+                if (!(flags & 1))
+                {
+                    if (out >= UncompressedBufferSize || position >= LZNT1_CHUNK_SIZE)
+                    {
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    }
+
+                    UncompressedBuffer[out++] = CompressedBuffer[in++];
+                    continue;
+                }
+
+                if (in + 2 > end || !position)
+                {
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                }
+
+                token = CompressedBuffer[in] | (CompressedBuffer[in + 1] << 8);
+                in += 2;
+
+                bits = lznt1_length_bits(position);
+                length = (token & ((1u << bits) - 1)) + 3;
+                displacement = (token >> bits) + 1;
+
+                if (displacement > position || position + length > LZNT1_CHUNK_SIZE || out + length > UncompressedBufferSize)
+                {
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                }
+
+                /* the copy can overlap what it writes, byte by byte repeats the pattern */
+
+                for (; length; length--, out++)
+                {
+                    UncompressedBuffer[out] = UncompressedBuffer[out - displacement];
+                }
+            }
+        }
+
+        in = end;
+    }
+
+    *FinalUncompressedSize = out;
+
+    return STATUS_SUCCESS;
+}
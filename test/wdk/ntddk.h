@@ -0,0 +1,767 @@
+/*
+    A user-mode stand-in for the parts of ntddk.h the driver uses.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The types and functions here are only what the sources in sys/src
+    need to build and run as a Linux program with gcc -fshort-wchar. The
+    layouts are not the ones of the WDK, only the fields the driver uses
+    are there. The functions are in wdk.c and behave like the kernel ones
+    as far as the driver can tell: IRPs have stack locations and
+    completion routines, the dispatcher objects can be waited on from
+    threads and the timers run their DPCs on a thread of their own.
+*/
+
+#ifndef _NTDDK_
+#define _NTDDK_
+
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define VOID void
+#define NTAPI
+#define FORCEINLINE static inline
+#define DECLSPEC_ALIGN(x) __attribute__((aligned(x)))
+#define DECLSPEC_CACHEALIGN __attribute__((aligned(64)))
+#define UNREFERENCED_PARAMETER(x) ((void)(x))
+#define C_ASSERT(e) typedef char __C_ASSERT__[(e) ? 1 : -1]
+#define PAGED_CODE() ((void)0)
+
+#define DBG 1
+#define ASSERT(x) assert(x)
+#define KdPrint(x) DbgPrint x
+
+#define PAGE_SIZE 4096
+#define TRUE 1
+#define FALSE 0
+#define MAXULONG 0xffffffffUL
+#define MAXUSHORT 0xffff
+#define MAXLONG 0x7fffffff
+#define MAXLONGLONG 0x7fffffffffffffffLL
+
+#define FIELD_OFFSET(t, f) offsetof(t, f)
+#define RTL_NUMBER_OF(a) (sizeof(a) / sizeof((a)[0]))
+#define ARGUMENT_PRESENT(p) ((p) != NULL)
+#define CONTAINING_RECORD(address, type, field) ((type *) ((char *) (address) - offsetof(type, field)))
+#define ALIGN_UP_BY(l, a) ((((ULONG_PTR) (l)) + (a) - 1) & ~((ULONG_PTR) (a) - 1))
+#define ALIGN_DOWN_BY(l, a) (((ULONG_PTR) (l)) & ~((ULONG_PTR) (a) - 1))
+#define BYTES_TO_PAGES(s) (((s) + PAGE_SIZE - 1) / PAGE_SIZE)
+#define ROUND_TO_PAGES(s) (((ULONG_PTR) (s) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+typedef void *PVOID, **PPVOID;
+typedef char CHAR, *PCHAR, CCHAR;
+typedef const char *PCSTR;
+typedef unsigned char UCHAR, *PUCHAR, BOOLEAN, *PBOOLEAN;
+typedef short SHORT;
+typedef unsigned short USHORT, *PUSHORT, WCHAR, *PWCHAR, *PWSTR;
+typedef const WCHAR *PCWSTR;
+typedef int LONG, *PLONG;
+typedef unsigned int ULONG, *PULONG, ULONG32, LOGICAL;
+typedef long long LONGLONG, *PLONGLONG, LONG64, *PLONG64;
+typedef unsigned long long ULONGLONG, *PULONGLONG, ULONG64, *PULONG64, DWORD64;
+typedef unsigned long ULONG_PTR, *PULONG_PTR, SIZE_T, *PSIZE_T, KAFFINITY;
+typedef long LONG_PTR;
+typedef LONG NTSTATUS;
+typedef void *HANDLE, **PHANDLE;
+typedef UCHAR KIRQL, *PKIRQL;
+typedef ULONG ACCESS_MASK;
+typedef ULONG DEVICE_TYPE;
+typedef ULONG_PTR KSPIN_LOCK, *PKSPIN_LOCK;
+
+typedef union _LARGE_INTEGER {
+    struct { ULONG LowPart; LONG HighPart; };
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef union _ULARGE_INTEGER {
+    struct { ULONG LowPart; ULONG HighPart; };
+    ULONGLONG QuadPart;
+} ULARGE_INTEGER;
+
+typedef struct _UNICODE_STRING {
+    USHORT Length;
+    USHORT MaximumLength;
+    PWSTR Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+typedef const UNICODE_STRING *PCUNICODE_STRING;
+
+typedef struct _GUID {
+    ULONG Data1;
+    USHORT Data2, Data3;
+    UCHAR Data4[8];
+} GUID, *LPGUID;
+typedef const GUID *LPCGUID;
+
+/* status codes */
+
+#define STATUS_SUCCESS                  ((NTSTATUS) 0x00000000)
+#define STATUS_TIMEOUT                  ((NTSTATUS) 0x00000102)
+#define STATUS_PENDING                  ((NTSTATUS) 0x00000103)
+#define STATUS_BUFFER_ALL_ZEROS         ((NTSTATUS) 0x00000117)
+#define STATUS_DATATYPE_MISALIGNMENT    ((NTSTATUS) 0x80000002)
+#define STATUS_BUFFER_OVERFLOW          ((NTSTATUS) 0x80000005)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS) 0xC0000001)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS) 0xC0000002)
+#define STATUS_INFO_LENGTH_MISMATCH     ((NTSTATUS) 0xC0000004)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS) 0xC000000D)
+#define STATUS_INVALID_DEVICE_REQUEST   ((NTSTATUS) 0xC0000010)
+#define STATUS_MORE_PROCESSING_REQUIRED ((NTSTATUS) 0xC0000016)
+#define STATUS_BUFFER_TOO_SMALL         ((NTSTATUS) 0xC0000023)
+#define STATUS_OBJECT_TYPE_MISMATCH     ((NTSTATUS) 0xC0000024)
+#define STATUS_OBJECT_NAME_NOT_FOUND    ((NTSTATUS) 0xC0000034)
+#define STATUS_DATA_ERROR               ((NTSTATUS) 0xC000003E)
+#define STATUS_DELETE_PENDING           ((NTSTATUS) 0xC0000056)
+#define STATUS_DISK_FULL                ((NTSTATUS) 0xC000007F)
+#define STATUS_INSUFFICIENT_RESOURCES   ((NTSTATUS) 0xC000009A)
+#define STATUS_DEVICE_NOT_READY         ((NTSTATUS) 0xC00000A3)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS) 0xC00000BB)
+#define STATUS_FILE_CORRUPT_ERROR       ((NTSTATUS) 0xC0000102)
+#define STATUS_CANCELLED                ((NTSTATUS) 0xC0000120)
+#define STATUS_UNRECOGNIZED_VOLUME      ((NTSTATUS) 0xC000014F)
+#define STATUS_INVALID_DEVICE_STATE     ((NTSTATUS) 0xC0000184)
+#define STATUS_INVALID_BUFFER_SIZE      ((NTSTATUS) 0xC0000206)
+#define STATUS_BAD_COMPRESSION_BUFFER   ((NTSTATUS) 0xC0000242)
+#define STATUS_CONTINUE_COMPLETION      STATUS_SUCCESS
+
+#define NT_SUCCESS(s) (((NTSTATUS) (s)) >= 0)
+#define NT_ERROR(s) ((((ULONG) (s)) >> 30) == 3)
+
+#define IO_ERR_CONFIGURATION_ERROR      ((NTSTATUS) 0xC0040003)
+
+/* lists */
+
+typedef struct _LIST_ENTRY {
+    struct _LIST_ENTRY *Flink;
+    struct _LIST_ENTRY *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct _SINGLE_LIST_ENTRY {
+    struct _SINGLE_LIST_ENTRY *Next;
+} SINGLE_LIST_ENTRY, *PSINGLE_LIST_ENTRY;
+
+FORCEINLINE VOID InitializeListHead (PLIST_ENTRY ListHead)
+{
+    ListHead->Flink = ListHead->Blink = ListHead;
+}
+
+FORCEINLINE BOOLEAN IsListEmpty (const LIST_ENTRY *ListHead)
+{
+    return ListHead->Flink == ListHead;
+}
+
+FORCEINLINE BOOLEAN RemoveEntryList (PLIST_ENTRY Entry)
+{
+    PLIST_ENTRY Flink = Entry->Flink, Blink = Entry->Blink;
+    Blink->Flink = Flink;
+    Flink->Blink = Blink;
+    return Flink == Blink;
+}
+
+FORCEINLINE PLIST_ENTRY RemoveHeadList (PLIST_ENTRY ListHead)
+{
+    PLIST_ENTRY Entry = ListHead->Flink;
+    RemoveEntryList(Entry);
+    return Entry;
+}
+
+FORCEINLINE PLIST_ENTRY RemoveTailList (PLIST_ENTRY ListHead)
+{
+    PLIST_ENTRY Entry = ListHead->Blink;
+    RemoveEntryList(Entry);
+    return Entry;
+}
+
+FORCEINLINE VOID InsertTailList (PLIST_ENTRY ListHead, PLIST_ENTRY Entry)
+{
+    Entry->Flink = ListHead;
+    Entry->Blink = ListHead->Blink;
+    ListHead->Blink->Flink = Entry;
+    ListHead->Blink = Entry;
+}
+
+FORCEINLINE VOID InsertHeadList (PLIST_ENTRY ListHead, PLIST_ENTRY Entry)
+{
+    Entry->Flink = ListHead->Flink;
+    Entry->Blink = ListHead;
+    ListHead->Flink->Blink = Entry;
+    ListHead->Flink = Entry;
+}
+
+/* interlocked operations */
+
+PLIST_ENTRY ExInterlockedInsertHeadList (PLIST_ENTRY, PLIST_ENTRY, PKSPIN_LOCK);
+PLIST_ENTRY ExInterlockedInsertTailList (PLIST_ENTRY, PLIST_ENTRY, PKSPIN_LOCK);
+PLIST_ENTRY ExInterlockedRemoveHeadList (PLIST_ENTRY, PKSPIN_LOCK);
+
+#define InterlockedIncrement(p)                 __sync_add_and_fetch((p), 1)
+#define InterlockedDecrement(p)                 __sync_sub_and_fetch((p), 1)
+#define InterlockedIncrement64(p)               __sync_add_and_fetch((p), 1)
+#define InterlockedExchangeAdd(p, v)            __sync_fetch_and_add((p), (v))
+#define InterlockedExchangeAdd64(p, v)          __sync_fetch_and_add((p), (v))
+#define InterlockedExchange(p, v)               __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define InterlockedExchange64(p, v)             __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define InterlockedExchangePointer(p, v)        __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define InterlockedCompareExchange(p, v, c)     __sync_val_compare_and_swap((p), (c), (v))
+#define InterlockedCompareExchange64(p, v, c)   __sync_val_compare_and_swap((p), (c), (v))
+#define InterlockedCompareExchangePointer(p, v, c) __sync_val_compare_and_swap((p), (c), (v))
+#define InterlockedOr(p, v)                     __sync_fetch_and_or((p), (v))
+#define InterlockedAnd(p, v)                    __sync_fetch_and_and((p), (v))
+#define KeMemoryBarrier()                       __sync_synchronize()
+#define ReadNoFence(p)                          (*(volatile LONG *) (p))
+#define YieldProcessor()                        ((void) 0)
+
+/* dispatcher objects, spin locks and DPCs */
+
+#define PASSIVE_LEVEL   0
+#define APC_LEVEL       1
+#define DISPATCH_LEVEL  2
+
+typedef struct _DISPATCHER_HEADER {
+    LONG Type;
+    volatile LONG SignalState;
+} DISPATCHER_HEADER;
+
+typedef enum _EVENT_TYPE { NotificationEvent, SynchronizationEvent } EVENT_TYPE;
+typedef enum _TIMER_TYPE { NotificationTimer, SynchronizationTimer } TIMER_TYPE;
+typedef enum _WAIT_TYPE { WaitAll, WaitAny } WAIT_TYPE;
+typedef enum _KWAIT_REASON { Executive } KWAIT_REASON;
+typedef enum _MODE { KernelMode, UserMode } KPROCESSOR_MODE, MODE;
+
+typedef struct _KEVENT {
+    DISPATCHER_HEADER Header;
+} KEVENT, *PKEVENT, *PRKEVENT;
+
+typedef struct _KSEMAPHORE {
+    DISPATCHER_HEADER Header;
+    LONG Limit;
+} KSEMAPHORE, *PKSEMAPHORE;
+
+typedef struct _KDPC KDPC, *PKDPC, *PRKDPC;
+typedef VOID KDEFERRED_ROUTINE (PKDPC, PVOID, PVOID, PVOID);
+typedef KDEFERRED_ROUTINE *PKDEFERRED_ROUTINE;
+
+struct _KDPC {
+    PKDEFERRED_ROUTINE DeferredRoutine;
+    PVOID DeferredContext;
+};
+
+typedef struct _KTIMER {
+    DISPATCHER_HEADER Header;
+    LIST_ENTRY TimerListEntry;
+    BOOLEAN Inserted;
+    LONGLONG DueTime;
+    LONG Period;
+    PKDPC Dpc;
+} KTIMER, *PKTIMER;
+
+typedef struct _KWAIT_BLOCK { int Unused; } KWAIT_BLOCK, *PKWAIT_BLOCK;
+
+typedef struct _FAST_MUTEX {
+    pthread_mutex_t Mutex;
+} FAST_MUTEX, *PFAST_MUTEX;
+
+typedef struct _NPAGED_LOOKASIDE_LIST {
+    SIZE_T Size;
+} NPAGED_LOOKASIDE_LIST, *PNPAGED_LOOKASIDE_LIST;
+
+typedef struct _PROCESSOR_NUMBER {
+    USHORT Group;
+    UCHAR Number;
+    UCHAR Reserved;
+} PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+
+typedef struct _ETHREAD *PETHREAD, *PKTHREAD;
+
+#define ALL_PROCESSOR_GROUPS 0xffff
+
+VOID KeInitializeEvent (PRKEVENT, EVENT_TYPE, BOOLEAN);
+LONG KeSetEvent (PRKEVENT, LONG, BOOLEAN);
+VOID KeClearEvent (PRKEVENT);
+LONG KeResetEvent (PRKEVENT);
+LONG KeReadStateEvent (PRKEVENT);
+VOID KeInitializeSemaphore (PKSEMAPHORE, LONG, LONG);
+LONG KeReleaseSemaphore (PKSEMAPHORE, LONG, LONG, BOOLEAN);
+NTSTATUS KeWaitForSingleObject (PVOID, KWAIT_REASON, KPROCESSOR_MODE, BOOLEAN, PLARGE_INTEGER);
+NTSTATUS KeDelayExecutionThread (KPROCESSOR_MODE, BOOLEAN, PLARGE_INTEGER);
+VOID KeInitializeSpinLock (PKSPIN_LOCK);
+VOID KeAcquireSpinLock (PKSPIN_LOCK, PKIRQL);
+VOID KeReleaseSpinLock (PKSPIN_LOCK, KIRQL);
+VOID KeAcquireSpinLockAtDpcLevel (PKSPIN_LOCK);
+VOID KeReleaseSpinLockFromDpcLevel (PKSPIN_LOCK);
+KIRQL KeGetCurrentIrql (VOID);
+VOID KeInitializeDpc (PRKDPC, PKDEFERRED_ROUTINE, PVOID);
+VOID KeInitializeTimer (PKTIMER);
+BOOLEAN KeSetTimer (PKTIMER, LARGE_INTEGER, PKDPC);
+BOOLEAN KeSetTimerEx (PKTIMER, LARGE_INTEGER, LONG, PKDPC);
+BOOLEAN KeCancelTimer (PKTIMER);
+VOID KeFlushQueuedDpcs (VOID);
+ULONG KeGetCurrentProcessorNumberEx (PPROCESSOR_NUMBER);
+ULONG KeQueryMaximumProcessorCountEx (USHORT);
+LARGE_INTEGER KeQueryPerformanceCounter (PLARGE_INTEGER);
+VOID KeQuerySystemTime (PLARGE_INTEGER);
+VOID ExInitializeFastMutex (PFAST_MUTEX);
+VOID ExAcquireFastMutex (PFAST_MUTEX);
+VOID ExReleaseFastMutex (PFAST_MUTEX);
+
+/* memory */
+
+typedef enum _POOL_TYPE {
+    NonPagedPool,
+    PagedPool,
+    NonPagedPoolCacheAligned = 4,
+    NonPagedPoolNx = 512
+} POOL_TYPE;
+
+typedef enum _MM_PAGE_PRIORITY {
+    LowPagePriority,
+    NormalPagePriority = 16,
+    HighPagePriority = 32
+} MM_PAGE_PRIORITY;
+
+#define MdlMappingNoExecute 0x40000000
+
+typedef struct _MDL {
+    struct _MDL *Next;
+    USHORT Size;
+    USHORT MdlFlags;
+    PVOID MappedSystemVa;
+    PVOID StartVa;
+    ULONG ByteCount;
+    ULONG ByteOffset;
+} MDL, *PMDL;
+
+PVOID ExAllocatePoolWithTag (POOL_TYPE, SIZE_T, ULONG);
+VOID ExFreePool (PVOID);
+VOID ExFreePoolWithTag (PVOID, ULONG);
+VOID ExInitializeNPagedLookasideList (PNPAGED_LOOKASIDE_LIST, PVOID, PVOID, ULONG, SIZE_T, ULONG, USHORT);
+VOID ExDeleteNPagedLookasideList (PNPAGED_LOOKASIDE_LIST);
+PVOID ExAllocateFromNPagedLookasideList (PNPAGED_LOOKASIDE_LIST);
+VOID ExFreeToNPagedLookasideList (PNPAGED_LOOKASIDE_LIST, PVOID);
+PVOID MmGetSystemAddressForMdlSafe (PMDL, ULONG);
+PVOID MmGetMdlVirtualAddress (PMDL);
+VOID MmBuildMdlForNonPagedPool (PMDL);
+VOID MmUnlockPages (PMDL);
+
+#define RtlCopyMemory(d, s, l)      memcpy((d), (s), (l))
+#define RtlMoveMemory(d, s, l)      memmove((d), (s), (l))
+#define RtlZeroMemory(d, l)         memset((d), 0, (l))
+#define RtlFillMemory(d, l, f)      memset((d), (f), (l))
+#define RtlEqualMemory(a, b, l)     (!memcmp((a), (b), (l)))
+
+SIZE_T RtlCompareMemory (const VOID *, const VOID *, SIZE_T);
+
+/* IRPs, devices and drivers */
+
+typedef struct _IO_STATUS_BLOCK {
+    NTSTATUS Status;
+    ULONG_PTR Information;
+} IO_STATUS_BLOCK, *PIO_STATUS_BLOCK;
+
+typedef struct _DRIVER_OBJECT DRIVER_OBJECT, *PDRIVER_OBJECT;
+typedef struct _DEVICE_OBJECT DEVICE_OBJECT, *PDEVICE_OBJECT;
+typedef struct _IRP IRP, *PIRP;
+
+typedef NTSTATUS DRIVER_DISPATCH (PDEVICE_OBJECT, PIRP);
+typedef DRIVER_DISPATCH *PDRIVER_DISPATCH;
+typedef NTSTATUS DRIVER_INITIALIZE (PDRIVER_OBJECT, PUNICODE_STRING);
+typedef VOID DRIVER_UNLOAD (PDRIVER_OBJECT);
+typedef NTSTATUS IO_COMPLETION_ROUTINE (PDEVICE_OBJECT, PIRP, PVOID);
+typedef IO_COMPLETION_ROUTINE *PIO_COMPLETION_ROUTINE;
+typedef VOID KSTART_ROUTINE (PVOID);
+typedef KSTART_ROUTINE *PKSTART_ROUTINE;
+typedef VOID IO_WORKITEM_ROUTINE (PDEVICE_OBJECT, PVOID);
+typedef IO_WORKITEM_ROUTINE *PIO_WORKITEM_ROUTINE;
+typedef struct _IO_WORKITEM IO_WORKITEM, *PIO_WORKITEM;
+
+typedef enum _WORK_QUEUE_TYPE {
+    DelayedWorkQueue,
+    CriticalWorkQueue,
+    HyperCriticalWorkQueue
+} WORK_QUEUE_TYPE;
+
+typedef enum _DEVICE_USAGE_NOTIFICATION_TYPE {
+    DeviceUsageTypeUndefined,
+    DeviceUsageTypePaging,
+    DeviceUsageTypeHibernation,
+    DeviceUsageTypeDumpFile
+} DEVICE_USAGE_NOTIFICATION_TYPE;
+
+typedef enum _POWER_STATE_TYPE { SystemPowerState, DevicePowerState } POWER_STATE_TYPE;
+
+typedef enum _SYSTEM_POWER_STATE {
+    PowerSystemUnspecified,
+    PowerSystemWorking,
+    PowerSystemSleeping1,
+    PowerSystemSleeping2,
+    PowerSystemSleeping3,
+    PowerSystemHibernate,
+    PowerSystemShutdown
+} SYSTEM_POWER_STATE;
+
+typedef enum _POWER_ACTION {
+    PowerActionNone,
+    PowerActionShutdown = 5,
+    PowerActionShutdownReset,
+    PowerActionShutdownOff
+} POWER_ACTION;
+
+typedef enum _DEVICE_POWER_STATE {
+    PowerDeviceUnspecified,
+    PowerDeviceD0,
+    PowerDeviceD1,
+    PowerDeviceD2,
+    PowerDeviceD3
+} DEVICE_POWER_STATE;
+
+typedef union _POWER_STATE {
+    SYSTEM_POWER_STATE SystemState;
+    DEVICE_POWER_STATE DeviceState;
+} POWER_STATE;
+
+typedef struct _IO_STACK_LOCATION {
+    UCHAR MajorFunction;
+    UCHAR MinorFunction;
+    UCHAR Flags;
+    UCHAR Control;
+    union {
+        struct { ULONG Length; ULONG Key; LARGE_INTEGER ByteOffset; } Read;
+        struct { ULONG Length; ULONG Key; LARGE_INTEGER ByteOffset; } Write;
+        struct { ULONG OutputBufferLength; ULONG InputBufferLength; ULONG IoControlCode; PVOID Type3InputBuffer; } DeviceIoControl;
+        struct { BOOLEAN InPath; BOOLEAN Reserved[3]; DEVICE_USAGE_NOTIFICATION_TYPE Type; } UsageNotification;
+        struct { ULONG SystemContext; POWER_STATE_TYPE Type; POWER_STATE State; POWER_ACTION ShutdownType; } Power;
+        struct { PVOID Argument1, Argument2, Argument3, Argument4; } Others;
+    } Parameters;
+    PDEVICE_OBJECT DeviceObject;
+    PVOID FileObject;
+    PIO_COMPLETION_ROUTINE CompletionRoutine;
+    PVOID Context;
+} IO_STACK_LOCATION, *PIO_STACK_LOCATION;
+
+struct _IRP {
+    PMDL MdlAddress;
+    ULONG Flags;
+    union {
+        struct _IRP *MasterIrp;
+        LONG IrpCount;
+        PVOID SystemBuffer;
+    } AssociatedIrp;
+    IO_STATUS_BLOCK IoStatus;
+    KPROCESSOR_MODE RequestorMode;
+    BOOLEAN PendingReturned;
+    BOOLEAN Cancel;
+    PIO_STATUS_BLOCK UserIosb;
+    PKEVENT UserEvent;
+    PVOID UserBuffer;
+    union {
+        struct {
+            LIST_ENTRY ListEntry;
+            PVOID DriverContext[4];
+            PETHREAD Thread;
+            PIO_STACK_LOCATION CurrentStackLocation;
+        } Overlay;
+    } Tail;
+    CCHAR StackCount;
+    CCHAR CurrentLocation;
+};
+
+struct _DEVICE_OBJECT {
+    PDRIVER_OBJECT DriverObject;
+    PDEVICE_OBJECT AttachedDevice;
+    ULONG Flags;
+    ULONG Characteristics;
+    PVOID DeviceExtension;
+    DEVICE_TYPE DeviceType;
+    CCHAR StackSize;
+    ULONG AlignmentRequirement;
+    USHORT SectorSize;
+    UNICODE_STRING Name;
+};
+
+typedef struct _DRIVER_EXTENSION {
+    PDRIVER_OBJECT DriverObject;
+    PVOID AddDevice;
+    ULONG Count;
+    UNICODE_STRING ServiceKeyName;
+} DRIVER_EXTENSION, *PDRIVER_EXTENSION;
+
+#define IRP_MJ_MAXIMUM_FUNCTION 0x1b
+
+struct _DRIVER_OBJECT {
+    PDEVICE_OBJECT DeviceObject;
+    PDRIVER_EXTENSION DriverExtension;
+    DRIVER_UNLOAD *DriverUnload;
+    PDRIVER_DISPATCH MajorFunction[IRP_MJ_MAXIMUM_FUNCTION + 1];
+};
+
+typedef struct _FILE_OBJECT { int Unused; } FILE_OBJECT, *PFILE_OBJECT;
+
+#define IRP_MJ_CREATE                   0x00
+#define IRP_MJ_CLOSE                    0x02
+#define IRP_MJ_READ                     0x03
+#define IRP_MJ_WRITE                    0x04
+#define IRP_MJ_FLUSH_BUFFERS            0x09
+#define IRP_MJ_DEVICE_CONTROL           0x0e
+#define IRP_MJ_INTERNAL_DEVICE_CONTROL  0x0f
+#define IRP_MJ_SHUTDOWN                 0x10
+#define IRP_MJ_POWER                    0x16
+#define IRP_MJ_SYSTEM_CONTROL           0x17
+#define IRP_MJ_PNP                      0x1b
+
+#define IRP_MN_SET_POWER                0x02
+#define IRP_MN_QUERY_POWER              0x03
+#define IRP_MN_DEVICE_USAGE_NOTIFICATION 0x16
+
+#define IRP_NOCACHE                     0x00000001
+#define IRP_PAGING_IO                   0x00000002
+#define IRP_BUFFERED_IO                 0x00000010
+#define IRP_DEALLOCATE_BUFFER           0x00000020
+#define IRP_INPUT_OPERATION             0x00000040
+#define IRP_SYNCHRONOUS_PAGING_IO       0x00000040
+
+#define SL_PENDING_RETURNED             0x01
+#define SL_WRITE_THROUGH                0x04
+#define SL_FORCE_UNIT_ACCESS            0x10
+#define SL_INVOKE_ON_CANCEL             0x20
+#define SL_INVOKE_ON_SUCCESS            0x40
+#define SL_INVOKE_ON_ERROR              0x80
+
+#define DO_BUFFERED_IO                  0x00000004
+#define DO_DIRECT_IO                    0x00000010
+#define DO_DEVICE_INITIALIZING          0x00000080
+#define DO_POWER_PAGABLE                0x00002000
+#define DO_POWER_INRUSH                 0x00004000
+
+#define FILE_DEVICE_DISK                0x00000007
+#define FILE_DEVICE_SECURE_OPEN         0x00000100
+#define FILE_CHARACTERISTICS_PROPAGATED 0x0000010d
+#define FILE_READ_DATA                  0x0001
+#define FILE_WRITE_DATA                 0x0002
+
+#define IO_NO_INCREMENT                 0
+#define IO_DISK_INCREMENT               1
+
+#define METHOD_BUFFERED                 0
+#define METHOD_IN_DIRECT                1
+#define METHOD_OUT_DIRECT               2
+#define METHOD_NEITHER                  3
+#define FILE_ANY_ACCESS                 0
+#define FILE_READ_ACCESS                1
+#define FILE_WRITE_ACCESS               2
+#define CTL_CODE(t, f, m, a)            (((t) << 16) | ((a) << 14) | ((f) << 2) | (m))
+#define DEVICE_TYPE_FROM_CTL_CODE(c)    (((ULONG) (c) & 0xffff0000) >> 16)
+
+NTSTATUS IoCallDriver (PDEVICE_OBJECT, PIRP);
+NTSTATUS PoCallDriver (PDEVICE_OBJECT, PIRP);
+VOID PoStartNextPowerIrp (PIRP);
+VOID IoCompleteRequest (PIRP, CCHAR);
+PIRP IoAllocateIrp (CCHAR, BOOLEAN);
+VOID IoFreeIrp (PIRP);
+PMDL IoAllocateMdl (PVOID, ULONG, BOOLEAN, BOOLEAN, PIRP);
+VOID IoFreeMdl (PMDL);
+VOID IoBuildPartialMdl (PMDL, PMDL, PVOID, ULONG);
+PIRP IoBuildSynchronousFsdRequest (ULONG, PDEVICE_OBJECT, PVOID, ULONG, PLARGE_INTEGER, PKEVENT, PIO_STATUS_BLOCK);
+PIRP IoBuildAsynchronousFsdRequest (ULONG, PDEVICE_OBJECT, PVOID, ULONG, PLARGE_INTEGER, PIO_STATUS_BLOCK);
+PIRP IoBuildDeviceIoControlRequest (ULONG, PDEVICE_OBJECT, PVOID, ULONG, PVOID, ULONG, BOOLEAN, PKEVENT, PIO_STATUS_BLOCK);
+NTSTATUS IoCreateDevice (PDRIVER_OBJECT, ULONG, PUNICODE_STRING, DEVICE_TYPE, ULONG, BOOLEAN, PDEVICE_OBJECT *);
+VOID IoDeleteDevice (PDEVICE_OBJECT);
+NTSTATUS IoAttachDevice (PDEVICE_OBJECT, PUNICODE_STRING, PDEVICE_OBJECT *);
+VOID IoDetachDevice (PDEVICE_OBJECT);
+NTSTATUS IoGetDeviceObjectPointer (PUNICODE_STRING, ACCESS_MASK, PFILE_OBJECT *, PDEVICE_OBJECT *);
+VOID IoAdjustPagingPathCount (PLONG, BOOLEAN);
+PIO_WORKITEM IoAllocateWorkItem (PDEVICE_OBJECT);
+VOID IoFreeWorkItem (PIO_WORKITEM);
+VOID IoQueueWorkItem (PIO_WORKITEM, PIO_WORKITEM_ROUTINE, WORK_QUEUE_TYPE, PVOID);
+NTSTATUS IoRegisterShutdownNotification (PDEVICE_OBJECT);
+NTSTATUS IoRegisterLastChanceShutdownNotification (PDEVICE_OBJECT);
+PKEVENT IoCreateNotificationEvent (PUNICODE_STRING, PHANDLE);
+
+FORCEINLINE PIO_STACK_LOCATION IoGetCurrentIrpStackLocation (PIRP Irp)
+{
+    return Irp->Tail.Overlay.CurrentStackLocation;
+}
+
+FORCEINLINE PIO_STACK_LOCATION IoGetNextIrpStackLocation (PIRP Irp)
+{
+    return Irp->Tail.Overlay.CurrentStackLocation - 1;
+}
+
+FORCEINLINE VOID IoSetNextIrpStackLocation (PIRP Irp)
+{
+    Irp->CurrentLocation--;
+    Irp->Tail.Overlay.CurrentStackLocation--;
+}
+
+FORCEINLINE VOID IoSkipCurrentIrpStackLocation (PIRP Irp)
+{
+    Irp->CurrentLocation++;
+    Irp->Tail.Overlay.CurrentStackLocation++;
+}
+
+FORCEINLINE VOID IoCopyCurrentIrpStackLocationToNext (PIRP Irp)
+{
+    PIO_STACK_LOCATION Stack = IoGetCurrentIrpStackLocation(Irp);
+    PIO_STACK_LOCATION Next = IoGetNextIrpStackLocation(Irp);
+    memcpy(Next, Stack, FIELD_OFFSET(IO_STACK_LOCATION, CompletionRoutine));
+    Next->Control = 0;
+}
+
+FORCEINLINE VOID IoSetCompletionRoutine (
+    PIRP Irp,
+    PIO_COMPLETION_ROUTINE CompletionRoutine,
+    PVOID Context,
+    BOOLEAN InvokeOnSuccess,
+    BOOLEAN InvokeOnError,
+    BOOLEAN InvokeOnCancel
+    )
+{
+    PIO_STACK_LOCATION Next = IoGetNextIrpStackLocation(Irp);
+    Next->CompletionRoutine = CompletionRoutine;
+    Next->Context = Context;
+    Next->Control = 0;
+    if (InvokeOnSuccess) Next->Control |= SL_INVOKE_ON_SUCCESS;
+    if (InvokeOnError) Next->Control |= SL_INVOKE_ON_ERROR;
+    if (InvokeOnCancel) Next->Control |= SL_INVOKE_ON_CANCEL;
+}
+
+FORCEINLINE VOID IoMarkIrpPending (PIRP Irp)
+{
+    IoGetCurrentIrpStackLocation(Irp)->Control |= SL_PENDING_RETURNED;
+}
+
+/* threads and objects */
+
+typedef struct _OBJECT_ATTRIBUTES { ULONG Length; } OBJECT_ATTRIBUTES, *POBJECT_ATTRIBUTES;
+
+#define InitializeObjectAttributes(p, n, a, r, s) ((p)->Length = sizeof(OBJECT_ATTRIBUTES))
+#define OBJ_CASE_INSENSITIVE    0x00000040
+#define OBJ_KERNEL_HANDLE       0x00000200
+#define THREAD_ALL_ACCESS       0x001fffff
+
+NTSTATUS PsCreateSystemThread (PHANDLE, ULONG, POBJECT_ATTRIBUTES, HANDLE, PVOID, PKSTART_ROUTINE, PVOID);
+NTSTATUS PsTerminateSystemThread (NTSTATUS);
+NTSTATUS ObReferenceObjectByHandle (HANDLE, ACCESS_MASK, PVOID, KPROCESSOR_MODE, PVOID *, PVOID);
+VOID ObDereferenceObject (PVOID);
+NTSTATUS ZwClose (HANDLE);
+NTSTATUS ZwWaitForSingleObject (HANDLE, BOOLEAN, PLARGE_INTEGER);
+
+/* registry and strings */
+
+#define REG_NONE        0
+#define REG_SZ          1
+#define REG_EXPAND_SZ   2
+#define REG_BINARY      3
+#define REG_DWORD       4
+#define REG_MULTI_SZ    7
+#define REG_QWORD       11
+
+#define RTL_REGISTRY_ABSOLUTE               0
+#define RTL_REGISTRY_SERVICES               1
+#define RTL_QUERY_REGISTRY_REQUIRED         0x00000004
+#define RTL_QUERY_REGISTRY_NOEXPAND         0x00000010
+#define RTL_QUERY_REGISTRY_DIRECT           0x00000020
+#define RTL_QUERY_REGISTRY_TYPECHECK        0x00000100
+#define RTL_QUERY_REGISTRY_TYPECHECK_SHIFT  24
+
+typedef NTSTATUS RTL_QUERY_REGISTRY_ROUTINE (PWSTR, ULONG, PVOID, ULONG, PVOID, PVOID);
+typedef RTL_QUERY_REGISTRY_ROUTINE *PRTL_QUERY_REGISTRY_ROUTINE;
+
+typedef struct _RTL_QUERY_REGISTRY_TABLE {
+    PRTL_QUERY_REGISTRY_ROUTINE QueryRoutine;
+    ULONG Flags;
+    PWSTR Name;
+    PVOID EntryContext;
+    ULONG DefaultType;
+    PVOID DefaultData;
+    ULONG DefaultLength;
+} RTL_QUERY_REGISTRY_TABLE, *PRTL_QUERY_REGISTRY_TABLE;
+
+NTSTATUS RtlQueryRegistryValues (ULONG, PCWSTR, PRTL_QUERY_REGISTRY_TABLE, PVOID, PVOID);
+NTSTATUS RtlWriteRegistryValue (ULONG, PCWSTR, PCWSTR, ULONG, PVOID, ULONG);
+VOID RtlInitUnicodeString (PUNICODE_STRING, PCWSTR);
+VOID RtlInitEmptyUnicodeString (PUNICODE_STRING, PWCHAR, USHORT);
+VOID RtlCopyUnicodeString (PUNICODE_STRING, PCUNICODE_STRING);
+NTSTATUS RtlAppendUnicodeToString (PUNICODE_STRING, PCWSTR);
+BOOLEAN RtlEqualUnicodeString (PCUNICODE_STRING, PCUNICODE_STRING, BOOLEAN);
+WCHAR RtlUpcaseUnicodeChar (WCHAR);
+
+/* the driver is built with 16 bit WCHAR so the C library can't be used for them */
+
+#define wcslen WdkStringLength
+#define _wcsicmp WdkStringCompare
+
+SIZE_T WdkStringLength (PCWSTR);
+int WdkStringCompare (PCWSTR, PCWSTR);
+
+/* bitmaps */
+
+typedef struct _RTL_BITMAP {
+    ULONG SizeOfBitMap;
+    PULONG Buffer;
+} RTL_BITMAP, *PRTL_BITMAP;
+
+VOID RtlInitializeBitMap (PRTL_BITMAP, PULONG, ULONG);
+VOID RtlClearAllBits (PRTL_BITMAP);
+VOID RtlSetAllBits (PRTL_BITMAP);
+VOID RtlClearBits (PRTL_BITMAP, ULONG, ULONG);
+VOID RtlSetBits (PRTL_BITMAP, ULONG, ULONG);
+BOOLEAN RtlAreBitsSet (PRTL_BITMAP, ULONG, ULONG);
+BOOLEAN RtlAreBitsClear (PRTL_BITMAP, ULONG, ULONG);
+BOOLEAN RtlCheckBit (PRTL_BITMAP, ULONG);
+ULONG RtlFindSetBits (PRTL_BITMAP, ULONG, ULONG);
+ULONG RtlFindClearBits (PRTL_BITMAP, ULONG, ULONG);
+ULONG RtlFindClearBitsAndSet (PRTL_BITMAP, ULONG, ULONG);
+ULONG RtlNumberOfSetBits (PRTL_BITMAP);
+CCHAR RtlFindMostSignificantBit (ULONGLONG);
+
+/* error log */
+
+#define ERROR_LOG_MAXIMUM_SIZE 240
+
+typedef struct _IO_ERROR_LOG_PACKET {
+    UCHAR MajorFunctionCode;
+    UCHAR RetryCount;
+    USHORT DumpDataSize;
+    USHORT NumberOfStrings;
+    USHORT StringOffset;
+    USHORT EventCategory;
+    NTSTATUS ErrorCode;
+    ULONG UniqueErrorValue;
+    NTSTATUS FinalStatus;
+    ULONG SequenceNumber;
+    ULONG IoControlCode;
+    LARGE_INTEGER DeviceOffset;
+    ULONG DumpData[1];
+} IO_ERROR_LOG_PACKET, *PIO_ERROR_LOG_PACKET;
+
+PVOID IoAllocateErrorLogEntry (PVOID, UCHAR);
+VOID IoWriteErrorLogEntry (PVOID);
+
+ULONG DbgPrint (PCSTR, ...);
+
+#endif /* _NTDDK_ */
@@ -0,0 +1,31 @@
+/*
+    A user-mode stand-in for the parts of ntifs.h the driver uses.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _NTIFS_
+#define _NTIFS_
+
+#include <ntddk.h>
+
+#define COMPRESSION_FORMAT_LZNT1        0x0002
+#define COMPRESSION_ENGINE_STANDARD     0x0000
+
+NTSTATUS RtlGetCompressionWorkSpaceSize (USHORT, PULONG, PULONG);
+NTSTATUS RtlCompressBuffer (USHORT, PUCHAR, ULONG, PUCHAR, ULONG, ULONG, PULONG, PVOID);
+NTSTATUS RtlDecompressBuffer (USHORT, PUCHAR, ULONG, PUCHAR, ULONG, PULONG);
+
+#endif /* _NTIFS_ */
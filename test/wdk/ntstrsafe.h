@@ -0,0 +1,29 @@
+/*
+    A user-mode stand-in for the parts of ntstrsafe.h the driver uses.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _NTSTRSAFE_H_INCLUDED_
+#define _NTSTRSAFE_H_INCLUDED_
+
+#include <ntddk.h>
+
+/* only %u, %d, %x and %ws are formatted */
+
+NTSTATUS RtlUnicodeStringPrintf (PUNICODE_STRING, PCWSTR, ...);
+NTSTATUS RtlStringCbPrintfW (PWSTR, SIZE_T, PCWSTR, ...);
+
+#endif /* _NTSTRSAFE_H_INCLUDED_ */
@@ -0,0 +1,2777 @@
+/*
+    A user-mode implementation of the kernel functions the driver uses.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    All dispatcher objects share one mutex and one condition variable, a
+    wait sleeps until any object is signaled and looks again. That is slow
+    when many threads wait but simple to get right, and the driver only
+    waits for its own threads, for requests that pend and for timers.
+    The timers are kept in a list that a thread of their own goes through
+    to run the DPCs when they are due. Spin locks are spun on with
+    sched_yield and the IRQL is only a number kept per thread so that the
+    ASSERTs of the driver can look at it.
+*/
+
+#define _GNU_SOURCE
+
+#include <ntddk.h>
+#include <ntdddisk.h>
+#include <ntstrsafe.h>
+#include <TraceLoggingProvider.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "wdk.h"
+
+#define WDK_OBJECT_NOTIFICATION_EVENT   0
+#define WDK_OBJECT_SYNCHRONIZATION_EVENT 1
+#define WDK_OBJECT_SEMAPHORE            5
+#define WDK_OBJECT_THREAD               6
+#define WDK_OBJECT_TIMER                8
+
+#define WDK_IRP_BUILT                   0x80000000
+
+struct _ETHREAD {
+    DISPATCHER_HEADER   Header;
+    LONG                References;
+    PKSTART_ROUTINE     StartRoutine;
+    PVOID               StartContext;
+    pthread_t           Thread;
+};
+
+struct _IO_WORKITEM {
+    PDEVICE_OBJECT          DeviceObject;
+    PIO_WORKITEM_ROUTINE    Routine;
+    PVOID                   Context;
+};
+
+static pthread_mutex_t wdk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wdk_signal;
+static pthread_once_t wdk_once = PTHREAD_ONCE_INIT;
+static __thread KIRQL wdk_irql;
+static __thread struct _ETHREAD *wdk_current_thread;
+
+static LIST_ENTRY wdk_timers = { &wdk_timers, &wdk_timers };
+static LONG wdk_dpcs_running;
+
+static PDEVICE_OBJECT wdk_devices[64];
+static FILE_OBJECT wdk_file_object;
+
+volatile LONG WdkPoolAllocations;
+volatile LONG WdkIrpAllocations;
+volatile LONG WdkMdlAllocations;
+volatile LONG WdkPoolFailAfter = -1;
+volatile LONG WdkErrorLogEntries;
+IO_ERROR_LOG_PACKET WdkLastErrorLogEntry;
+
+static VOID *wdk_timer_thread (VOID *Context);
+
+static VOID
+wdk_initialize (
+    VOID
+    )
+{
+    pthread_condattr_t  attr;
+    pthread_t           thread;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wdk_signal, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_create(&thread, NULL, wdk_timer_thread, NULL);
+    pthread_detach(thread);
+}
+
+static LONGLONG
+wdk_monotonic (
+    VOID
+    )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (LONGLONG) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static LONGLONG
+wdk_system_time (
+    VOID
+    )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return ((LONGLONG) ts.tv_sec * 1000000000 + ts.tv_nsec) / 100 + 116444736000000000LL;
+}
+
+/* a kernel timeout is in 100 ns units, relative when negative and system time when positive */
+
+static LONGLONG
+wdk_deadline (
+    IN PLARGE_INTEGER Timeout
+    )
+{
+    if (Timeout->QuadPart < 0)
+    {
+        return wdk_monotonic() - Timeout->QuadPart * 100;
+    }
+
+    return wdk_monotonic() + max(Timeout->QuadPart - wdk_system_time(), 0) * 100;
+}
+
+static int
+wdk_wait_until (
+    IN LONGLONG Deadline
+    )
+{
+    struct timespec ts;
+
+    ts.tv_sec = Deadline / 1000000000;
+    ts.tv_nsec = Deadline % 1000000000;
+
+    return pthread_cond_timedwait(&wdk_signal, &wdk_lock, &ts);
+}
+
+/* debug output */
+
+ULONG
+DbgPrint (
+    PCSTR Format,
+    ...
+    )
+{
+    static int  verbose = -1;
+    char        format[512];
+    const char  *p;
+    char        *q;
+    va_list     ap;
+
+    if (verbose < 0)
+    {
+        verbose = getenv("WDK_VERBOSE") != NULL;
+    }
+
+    if (!verbose)
+    {
+        return 0;
+    }
+
+    /* the Microsoft size prefixes and %wZ are changed to what glibc knows */
+
+    for (p = Format, q = format; *p && q < format + sizeof(format) - 8; )
+    {
+        if (!strncmp(p, "%I64", 4))
+        {
+            memcpy(q, "%ll", 3);
+            q += 3;
+            p += 4;
+        }
+        else if (!strncmp(p, "%wZ", 3) || !strncmp(p, "%ws", 3))
+        {
+            memcpy(q, "%p", 2);
+            q += 2;
+            p += 3;
+        }
+        else
+        {
+            *q++ = *p++;
+        }
+    }
+
+    *q = 0;
+
+    va_start(ap, Format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+
+    return 0;
+}
+
+/* memory */
+
+PVOID
+ExAllocatePoolWithTag (
+    POOL_TYPE   PoolType,
+    SIZE_T      NumberOfBytes,
+    ULONG       Tag
+    )
+{
+    PVOID p;
+
+    UNREFERENCED_PARAMETER(PoolType);
+    UNREFERENCED_PARAMETER(Tag);
+
+    if (WdkPoolFailAfter >= 0 && InterlockedDecrement(&WdkPoolFailAfter) < 0)
+    {
+        return NULL;
+    }
+
+    /* the pool gives page aligned blocks from a page and up */
+
+    if (posix_memalign(&p, NumberOfBytes >= PAGE_SIZE ? PAGE_SIZE : 16, max(NumberOfBytes, 1)))
+    {
+        return NULL;
+    }
+
+    InterlockedIncrement(&WdkPoolAllocations);
+
+    return p;
+}
+
+VOID
+ExFreePool (
+    PVOID P
+    )
+{
+    ASSERT(P != NULL);
+
+    InterlockedDecrement(&WdkPoolAllocations);
+
+    free(P);
+}
+
+VOID
+ExFreePoolWithTag (
+    PVOID P,
+    ULONG Tag
+    )
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    ExFreePool(P);
+}
+
+VOID
+ExInitializeNPagedLookasideList (
+    PNPAGED_LOOKASIDE_LIST  Lookaside,
+    PVOID                   Allocate,
+    PVOID                   Free,
+    ULONG                   Flags,
+    SIZE_T                  Size,
+    ULONG                   Tag,
+    USHORT                  Depth
+    )
+{
+    UNREFERENCED_PARAMETER(Allocate);
+    UNREFERENCED_PARAMETER(Free);
+    UNREFERENCED_PARAMETER(Flags);
+    UNREFERENCED_PARAMETER(Tag);
+    UNREFERENCED_PARAMETER(Depth);
+
+    Lookaside->Size = Size;
+}
+
+VOID
+ExDeleteNPagedLookasideList (
+    PNPAGED_LOOKASIDE_LIST Lookaside
+    )
+{
+    UNREFERENCED_PARAMETER(Lookaside);
+}
+
+PVOID
+ExAllocateFromNPagedLookasideList (
+    PNPAGED_LOOKASIDE_LIST Lookaside
+    )
+{
+    return ExAllocatePoolWithTag(NonPagedPool, Lookaside->Size, 0);
+}
+
+VOID
+ExFreeToNPagedLookasideList (
+    PNPAGED_LOOKASIDE_LIST  Lookaside,
+    PVOID                   Entry
+    )
+{
+    UNREFERENCED_PARAMETER(Lookaside);
+
+    ExFreePool(Entry);
+}
+
+SIZE_T
+RtlCompareMemory (
+    const VOID  *Source1,
+    const VOID  *Source2,
+    SIZE_T      Length
+    )
+{
+    SIZE_T i;
+
+    for (i = 0; i < Length && ((const UCHAR *) Source1)[i] == ((const UCHAR *) Source2)[i]; i++)
+    {
+    }
+
+    return i;
+}
+
+PMDL
+IoAllocateMdl (
+    PVOID   VirtualAddress,
+    ULONG   Length,
+    BOOLEAN SecondaryBuffer,
+    BOOLEAN ChargeQuota,
+    PIRP    Irp
+    )
+{
+    PMDL mdl, last;
+
+    UNREFERENCED_PARAMETER(ChargeQuota);
+
+    mdl = (PMDL) calloc(1, sizeof(MDL));
+
+    if (!mdl)
+    {
+        return NULL;
+    }
+
+    InterlockedIncrement(&WdkMdlAllocations);
+
+    mdl->Size = sizeof(MDL);
+    mdl->MappedSystemVa = VirtualAddress;
+    mdl->StartVa = VirtualAddress;
+    mdl->ByteCount = Length;
+
+    if (Irp)
+    {
+        if (!SecondaryBuffer || !Irp->MdlAddress)
+        {
+            Irp->MdlAddress = mdl;
+        }
+        else
+        {
+            for (last = Irp->MdlAddress; last->Next; last = last->Next)
+            {
+            }
+
+            last->Next = mdl;
+        }
+    }
+
+    return mdl;
+}
+
+VOID
+IoFreeMdl (
+    PMDL Mdl
+    )
+{
+    InterlockedDecrement(&WdkMdlAllocations);
+
+    free(Mdl);
+}
+
+VOID
+IoBuildPartialMdl (
+    PMDL    SourceMdl,
+    PMDL    TargetMdl,
+    PVOID   VirtualAddress,
+    ULONG   Length
+    )
+{
+    ASSERT((PUCHAR) VirtualAddress >= (PUCHAR) SourceMdl->StartVa);
+    ASSERT((PUCHAR) VirtualAddress + Length <= (PUCHAR) SourceMdl->StartVa + SourceMdl->ByteCount);
+
+    TargetMdl->MappedSystemVa = VirtualAddress;
+    TargetMdl->StartVa = VirtualAddress;
+    TargetMdl->ByteCount = Length;
+}
+
+PVOID
+MmGetSystemAddressForMdlSafe (
+    PMDL    Mdl,
+    ULONG   Priority
+    )
+{
+    UNREFERENCED_PARAMETER(Priority);
+
+    return Mdl->MappedSystemVa;
+}
+
+PVOID
+MmGetMdlVirtualAddress (
+    PMDL Mdl
+    )
+{
+    return Mdl->StartVa;
+}
+
+VOID
+MmBuildMdlForNonPagedPool (
+    PMDL Mdl
+    )
+{
+    UNREFERENCED_PARAMETER(Mdl);
+}
+
+VOID
+MmUnlockPages (
+    PMDL Mdl
+    )
+{
+    UNREFERENCED_PARAMETER(Mdl);
+}
+
+/* spin locks and IRQL */
+
+VOID
+KeInitializeSpinLock (
+    PKSPIN_LOCK SpinLock
+    )
+{
+    *SpinLock = 0;
+}
+
+VOID
+KeAcquireSpinLockAtDpcLevel (
+    PKSPIN_LOCK SpinLock
+    )
+{
+    while (__atomic_exchange_n(SpinLock, 1, __ATOMIC_ACQUIRE))
+    {
+        sched_yield();
+    }
+}
+
+VOID
+KeReleaseSpinLockFromDpcLevel (
+    PKSPIN_LOCK SpinLock
+    )
+{
+    ASSERT(*SpinLock);
+
+    __atomic_store_n(SpinLock, 0, __ATOMIC_RELEASE);
+}
+
+VOID
+KeAcquireSpinLock (
+    PKSPIN_LOCK SpinLock,
+    PKIRQL      OldIrql
+    )
+{
+    *OldIrql = wdk_irql;
+
+    wdk_irql = DISPATCH_LEVEL;
+
+    KeAcquireSpinLockAtDpcLevel(SpinLock);
+}
+
+VOID
+KeReleaseSpinLock (
+    PKSPIN_LOCK SpinLock,
+    KIRQL       NewIrql
+    )
+{
+    KeReleaseSpinLockFromDpcLevel(SpinLock);
+
+    wdk_irql = NewIrql;
+}
+
+static PLIST_ENTRY
+wdk_interlocked_insert (
+    IN PLIST_ENTRY  ListHead,
+    IN PLIST_ENTRY  ListEntry,
+    IN PKSPIN_LOCK  Lock,
+    IN BOOLEAN      Head
+    )
+{
+    PLIST_ENTRY first;
+    KIRQL       irql;
+
+    KeAcquireSpinLock(Lock, &irql);
+
+    first = IsListEmpty(ListHead) ? NULL : ListHead->Flink;
+
+    if (Head)
+    {
+        InsertHeadList(ListHead, ListEntry);
+    }
+    else
+    {
+        InsertTailList(ListHead, ListEntry);
+    }
+
+    KeReleaseSpinLock(Lock, irql);
+
+    return first;
+}
+
+PLIST_ENTRY
+ExInterlockedInsertHeadList (
+    PLIST_ENTRY ListHead,
+    PLIST_ENTRY ListEntry,
+    PKSPIN_LOCK Lock
+    )
+{
+    return wdk_interlocked_insert(ListHead, ListEntry, Lock, TRUE);
+}
+
+PLIST_ENTRY
+ExInterlockedInsertTailList (
+    PLIST_ENTRY ListHead,
+    PLIST_ENTRY ListEntry,
+    PKSPIN_LOCK Lock
+    )
+{
+    return wdk_interlocked_insert(ListHead, ListEntry, Lock, FALSE);
+}
+
+PLIST_ENTRY
+ExInterlockedRemoveHeadList (
+    PLIST_ENTRY ListHead,
+    PKSPIN_LOCK Lock
+    )
+{
+    PLIST_ENTRY entry;
+    KIRQL       irql;
+
+    KeAcquireSpinLock(Lock, &irql);
+
+    entry = IsListEmpty(ListHead) ? NULL : RemoveHeadList(ListHead);
+
+    KeReleaseSpinLock(Lock, irql);
+
+    return entry;
+}
+
+KIRQL
+KeGetCurrentIrql (
+    VOID
+    )
+{
+    return wdk_irql;
+}
+
+VOID
+ExInitializeFastMutex (
+    PFAST_MUTEX FastMutex
+    )
+{
+    pthread_mutex_init(&FastMutex->Mutex, NULL);
+}
+
+VOID
+ExAcquireFastMutex (
+    PFAST_MUTEX FastMutex
+    )
+{
+    pthread_mutex_lock(&FastMutex->Mutex);
+}
+
+VOID
+ExReleaseFastMutex (
+    PFAST_MUTEX FastMutex
+    )
+{
+    pthread_mutex_unlock(&FastMutex->Mutex);
+}
+
+/* dispatcher objects */
+
+static VOID
+wdk_signal_object (
+    IN DISPATCHER_HEADER    *Header,
+    IN LONG                 SignalState
+    )
+{
+    pthread_once(&wdk_once, wdk_initialize);
+
+    pthread_mutex_lock(&wdk_lock);
+
+    Header->SignalState = SignalState;
+
+    pthread_cond_broadcast(&wdk_signal);
+
+    pthread_mutex_unlock(&wdk_lock);
+}
+
+VOID
+KeInitializeEvent (
+    PRKEVENT    Event,
+    EVENT_TYPE  Type,
+    BOOLEAN     State
+    )
+{
+    Event->Header.Type = (Type == SynchronizationEvent) ? WDK_OBJECT_SYNCHRONIZATION_EVENT : WDK_OBJECT_NOTIFICATION_EVENT;
+    Event->Header.SignalState = State;
+}
+
+LONG
+KeSetEvent (
+    PRKEVENT    Event,
+    LONG        Increment,
+    BOOLEAN     Wait
+    )
+{
+    LONG previous;
+
+    UNREFERENCED_PARAMETER(Increment);
+    UNREFERENCED_PARAMETER(Wait);
+
+    previous = Event->Header.SignalState;
+
+    wdk_signal_object(&Event->Header, 1);
+
+    return previous;
+}
+
+VOID
+KeClearEvent (
+    PRKEVENT Event
+    )
+{
+    Event->Header.SignalState = 0;
+}
+
+LONG
+KeResetEvent (
+    PRKEVENT Event
+    )
+{
+    return InterlockedExchange(&Event->Header.SignalState, 0);
+}
+
+LONG
+KeReadStateEvent (
+    PRKEVENT Event
+    )
+{
+    return Event->Header.SignalState;
+}
+
+VOID
+KeInitializeSemaphore (
+    PKSEMAPHORE Semaphore,
+    LONG        Count,
+    LONG        Limit
+    )
+{
+    Semaphore->Header.Type = WDK_OBJECT_SEMAPHORE;
+    Semaphore->Header.SignalState = Count;
+    Semaphore->Limit = Limit;
+}
+
+LONG
+KeReleaseSemaphore (
+    PKSEMAPHORE Semaphore,
+    LONG        Increment,
+    LONG        Adjustment,
+    BOOLEAN     Wait
+    )
+{
+    LONG previous;
+
+    UNREFERENCED_PARAMETER(Increment);
+    UNREFERENCED_PARAMETER(Wait);
+
+    pthread_once(&wdk_once, wdk_initialize);
+
+    pthread_mutex_lock(&wdk_lock);
+
+    previous = Semaphore->Header.SignalState;
+
+    ASSERT(previous + Adjustment <= Semaphore->Limit);
+
+    Semaphore->Header.SignalState = previous + Adjustment;
+
+    pthread_cond_broadcast(&wdk_signal);
+
+    pthread_mutex_unlock(&wdk_lock);
+
+    return previous;
+}
+
+NTSTATUS
+KeWaitForSingleObject (
+    PVOID           Object,
+    KWAIT_REASON    WaitReason,
+    KPROCESSOR_MODE WaitMode,
+    BOOLEAN         Alertable,
+    PLARGE_INTEGER  Timeout
+    )
+{
+    DISPATCHER_HEADER   *header;
+    LONGLONG            deadline;
+    NTSTATUS            status;
+
+    UNREFERENCED_PARAMETER(WaitReason);
+    UNREFERENCED_PARAMETER(WaitMode);
+    UNREFERENCED_PARAMETER(Alertable);
+
+    ASSERT(wdk_irql < DISPATCH_LEVEL || (Timeout && !Timeout->QuadPart));
+
+    pthread_once(&wdk_once, wdk_initialize);
+
+    header = (DISPATCHER_HEADER *) Object;
+
+    deadline = Timeout ? wdk_deadline(Timeout) : 0;
+
+    status = STATUS_SUCCESS;
+
+    pthread_mutex_lock(&wdk_lock);
+
+    while (header->SignalState <= 0)
+    {
+        if (Timeout && (!Timeout->QuadPart || wdk_wait_until(deadline) == ETIMEDOUT) && header->SignalState <= 0)
+        {
+            status = STATUS_TIMEOUT;
+            break;
+        }
+        else if (!Timeout)
+        {
+            pthread_cond_wait(&wdk_signal, &wdk_lock);
+        }
+    }
+
+    if (status == STATUS_SUCCESS)
+    {
+        if (header->Type == WDK_OBJECT_SYNCHRONIZATION_EVENT)
+        {
+            header->SignalState = 0;
+        }
+        else if (header->Type == WDK_OBJECT_SEMAPHORE)
+        {
+            header->SignalState--;
+        }
+    }
+
+    pthread_mutex_unlock(&wdk_lock);
+
+    return status;
+}
+
+NTSTATUS
+KeDelayExecutionThread (
+    KPROCESSOR_MODE WaitMode,
+    BOOLEAN         Alertable,
+    PLARGE_INTEGER  Interval
+    )
+{
+    struct timespec ts;
+    LONGLONG        ns;
+
+    UNREFERENCED_PARAMETER(WaitMode);
+    UNREFERENCED_PARAMETER(Alertable);
+
+    ns = wdk_deadline(Interval) - wdk_monotonic();
+
+    if (ns > 0)
+    {
+        ts.tv_sec = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+        nanosleep(&ts, NULL);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* timers and DPCs */
+
+VOID
+KeInitializeDpc (
+    PRKDPC              Dpc,
+    PKDEFERRED_ROUTINE  DeferredRoutine,
+    PVOID               DeferredContext
+    )
+{
+    Dpc->DeferredRoutine = DeferredRoutine;
+    Dpc->DeferredContext = DeferredContext;
+}
+
+VOID
+KeInitializeTimer (
+    PKTIMER Timer
+    )
+{
+    RtlZeroMemory(Timer, sizeof(KTIMER));
+
+    Timer->Header.Type = WDK_OBJECT_TIMER;
+}
+
+BOOLEAN
+KeSetTimerEx (
+    PKTIMER         Timer,
+    LARGE_INTEGER   DueTime,
+    LONG            Period,
+    PKDPC           Dpc
+    )
+{
+    BOOLEAN inserted;
+
+    pthread_once(&wdk_once, wdk_initialize);
+
+    pthread_mutex_lock(&wdk_lock);
+
+    inserted = Timer->Inserted;
+
+    if (inserted)
+    {
+        RemoveEntryList(&Timer->TimerListEntry);
+    }
+
+    Timer->Header.SignalState = 0;
+    Timer->DueTime = wdk_deadline(&DueTime);
+    Timer->Period = Period;
+    Timer->Dpc = Dpc;
+    Timer->Inserted = TRUE;
+
+    InsertTailList(&wdk_timers, &Timer->TimerListEntry);
+
+    pthread_cond_broadcast(&wdk_signal);
+
+    pthread_mutex_unlock(&wdk_lock);
+
+    return inserted;
+}
+
+BOOLEAN
+KeSetTimer (
+    PKTIMER         Timer,
+    LARGE_INTEGER   DueTime,
+    PKDPC           Dpc
+    )
+{
+    return KeSetTimerEx(Timer, DueTime, 0, Dpc);
+}
+
+BOOLEAN
+KeCancelTimer (
+    PKTIMER Timer
+    )
+{
+    BOOLEAN inserted;
+
+    pthread_once(&wdk_once, wdk_initialize);
+
+    pthread_mutex_lock(&wdk_lock);
+
+    inserted = Timer->Inserted;
+
+    if (inserted)
+    {
+        RemoveEntryList(&Timer->TimerListEntry);
+        Timer->Inserted = FALSE;
+    }
+
+    pthread_mutex_unlock(&wdk_lock);
+
+    return inserted;
+}
+
+VOID
+KeFlushQueuedDpcs (
+    VOID
+    )
+{
+    pthread_once(&wdk_once, wdk_initialize);
+
+    pthread_mutex_lock(&wdk_lock);
+
+    while (wdk_dpcs_running)
+    {
+        pthread_cond_wait(&wdk_signal, &wdk_lock);
+    }
+
+    pthread_mutex_unlock(&wdk_lock);
+}
+
+static VOID *
+wdk_timer_thread (
+    VOID *Context
+    )
+{
+    PLIST_ENTRY entry;
+    PKTIMER     timer, next;
+    PKDPC       dpc;
+    LONGLONG    now;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    pthread_mutex_lock(&wdk_lock);
+
+    for (;;)
+    {
+        next = NULL;
+
+        for (entry = wdk_timers.Flink; entry != &wdk_timers; entry = entry->Flink)
+        {
+            timer = CONTAINING_RECORD(entry, KTIMER, TimerListEntry);
+
+            if (!next || timer->DueTime < next->DueTime)
+            {
+                next = timer;
+            }
+        }
+
+        now = wdk_monotonic();
+
+        if (!next)
+        {
+            pthread_cond_wait(&wdk_signal, &wdk_lock);
+            continue;
+        }
+
+        if (next->DueTime > now)
+        {
+            wdk_wait_until(next->DueTime);
+            continue;
+        }
+
+        RemoveEntryList(&next->TimerListEntry);
+
+        if (next->Period)
+        {
+            next->DueTime = now + (LONGLONG) next->Period * 1000000;
+            InsertTailList(&wdk_timers, &next->TimerListEntry);
+        }
+        else
+        {
+            next->Inserted = FALSE;
+        }
+
+        next->Header.SignalState = 1;
+
+        dpc = next->Dpc;
+
+        if (dpc)
+        {
+            wdk_dpcs_running++;
+
+            pthread_mutex_unlock(&wdk_lock);
+
+            wdk_irql = DISPATCH_LEVEL;
+
+            dpc->DeferredRoutine(dpc, dpc->DeferredContext, NULL, NULL);
+
+            wdk_irql = PASSIVE_LEVEL;
+
+            pthread_mutex_lock(&wdk_lock);
+
+            wdk_dpcs_running--;
+        }
+
+        pthread_cond_broadcast(&wdk_signal);
+    }
+
+    return NULL;
+}
+
+/* time and processors */
+
+LARGE_INTEGER
+KeQueryPerformanceCounter (
+    PLARGE_INTEGER PerformanceFrequency
+    )
+{
+    LARGE_INTEGER counter;
+
+    if (PerformanceFrequency)
+    {
+        PerformanceFrequency->QuadPart = 10000000;
+    }
+
+    counter.QuadPart = wdk_monotonic() / 100;
+
+    return counter;
+}
+
+VOID
+KeQuerySystemTime (
+    PLARGE_INTEGER CurrentTime
+    )
+{
+    CurrentTime->QuadPart = wdk_system_time();
+}
+
+ULONG
+KeQueryMaximumProcessorCountEx (
+    USHORT GroupNumber
+    )
+{
+    static volatile LONG count;
+    long n;
+
+    UNREFERENCED_PARAMETER(GroupNumber);
+
+    /* sysconf reads it from /sys each time, the kernel has it at hand */
+
+    if (!count)
+    {
+        n = sysconf(_SC_NPROCESSORS_CONF);
+
+        count = (LONG) min(max(n, 1), 64);
+    }
+
+    return (ULONG) count;
+}
+
+ULONG
+KeGetCurrentProcessorNumberEx (
+    PPROCESSOR_NUMBER ProcNumber
+    )
+{
+    int cpu;
+
+    cpu = sched_getcpu();
+
+    cpu = (cpu < 0) ? 0 : cpu % (int) KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    if (ProcNumber)
+    {
+        ProcNumber->Group = 0;
+        ProcNumber->Number = (UCHAR) cpu;
+        ProcNumber->Reserved = 0;
+    }
+
+    return (ULONG) cpu;
+}
+
+/* threads, work items and objects */
+
+static VOID *
+wdk_thread_start (
+    VOID *Context
+    )
+{
+    struct _ETHREAD *thread;
+
+    thread = (struct _ETHREAD *) Context;
+
+    wdk_current_thread = thread;
+
+    thread->StartRoutine(thread->StartContext);
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+
+    return NULL;
+}
+
+NTSTATUS
+PsCreateSystemThread (
+    PHANDLE             ThreadHandle,
+    ULONG               DesiredAccess,
+    POBJECT_ATTRIBUTES  ObjectAttributes,
+    HANDLE              ProcessHandle,
+    PVOID               ClientId,
+    PKSTART_ROUTINE     StartRoutine,
+    PVOID               StartContext
+    )
+{
+    struct _ETHREAD *thread;
+
+    UNREFERENCED_PARAMETER(DesiredAccess);
+    UNREFERENCED_PARAMETER(ObjectAttributes);
+    UNREFERENCED_PARAMETER(ProcessHandle);
+    UNREFERENCED_PARAMETER(ClientId);
+
+    pthread_once(&wdk_once, wdk_initialize);
+
+    thread = (struct _ETHREAD *) calloc(1, sizeof(struct _ETHREAD));
+
+    if (!thread)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* one reference for the handle and one for the running thread */
+
+    thread->Header.Type = WDK_OBJECT_THREAD;
+    thread->References = 2;
+    thread->StartRoutine = StartRoutine;
+    thread->StartContext = StartContext;
+
+    if (pthread_create(&thread->Thread, NULL, wdk_thread_start, thread))
+    {
+        free(thread);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pthread_detach(thread->Thread);
+
+    *ThreadHandle = (HANDLE) thread;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+PsTerminateSystemThread (
+    NTSTATUS ExitStatus
+    )
+{
+    struct _ETHREAD *thread;
+
+    UNREFERENCED_PARAMETER(ExitStatus);
+
+    thread = wdk_current_thread;
+
+    ASSERT(thread != NULL);
+
+    wdk_current_thread = NULL;
+
+    wdk_signal_object(&thread->Header, 1);
+
+    ObDereferenceObject(thread);
+
+    pthread_exit(NULL);
+}
+
+NTSTATUS
+ObReferenceObjectByHandle (
+    HANDLE          Handle,
+    ACCESS_MASK     DesiredAccess,
+    PVOID           ObjectType,
+    KPROCESSOR_MODE AccessMode,
+    PVOID           *Object,
+    PVOID           HandleInformation
+    )
+{
+    struct _ETHREAD *thread;
+
+    UNREFERENCED_PARAMETER(DesiredAccess);
+    UNREFERENCED_PARAMETER(ObjectType);
+    UNREFERENCED_PARAMETER(AccessMode);
+    UNREFERENCED_PARAMETER(HandleInformation);
+
+    thread = (struct _ETHREAD *) Handle;
+
+    if (!thread || thread->Header.Type != WDK_OBJECT_THREAD)
+    {
+        return STATUS_OBJECT_TYPE_MISMATCH;
+    }
+
+    InterlockedIncrement(&thread->References);
+
+    *Object = thread;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+ObDereferenceObject (
+    PVOID Object
+    )
+{
+    struct _ETHREAD *thread;
+
+    /* only threads are counted, the file objects are all the same one */
+
+    if (Object == &wdk_file_object)
+    {
+        return;
+    }
+
+    thread = (struct _ETHREAD *) Object;
+
+    ASSERT(thread->Header.Type == WDK_OBJECT_THREAD);
+
+    if (InterlockedDecrement(&thread->References) == 0)
+    {
+        free(thread);
+    }
+}
+
+NTSTATUS
+ZwClose (
+    HANDLE Handle
+    )
+{
+    /* the handles of threads are the thread objects and other handles are events that stay */
+
+    if (((DISPATCHER_HEADER *) Handle)->Type == WDK_OBJECT_THREAD)
+    {
+        ObDereferenceObject(Handle);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+ZwWaitForSingleObject (
+    HANDLE          Handle,
+    BOOLEAN         Alertable,
+    PLARGE_INTEGER  Timeout
+    )
+{
+    return KeWaitForSingleObject(Handle, Executive, KernelMode, Alertable, Timeout);
+}
+
+static VOID *
+wdk_work_item_start (
+    VOID *Context
+    )
+{
+    PIO_WORKITEM item;
+
+    item = (PIO_WORKITEM) Context;
+
+    item->Routine(item->DeviceObject, item->Context);
+
+    return NULL;
+}
+
+PIO_WORKITEM
+IoAllocateWorkItem (
+    PDEVICE_OBJECT DeviceObject
+    )
+{
+    PIO_WORKITEM item;
+
+    item = (PIO_WORKITEM) calloc(1, sizeof(IO_WORKITEM));
+
+    if (item)
+    {
+        item->DeviceObject = DeviceObject;
+    }
+
+    return item;
+}
+
+VOID
+IoFreeWorkItem (
+    PIO_WORKITEM IoWorkItem
+    )
+{
+    free(IoWorkItem);
+}
+
+VOID
+IoQueueWorkItem (
+    PIO_WORKITEM            IoWorkItem,
+    PIO_WORKITEM_ROUTINE    WorkerRoutine,
+    WORK_QUEUE_TYPE         QueueType,
+    PVOID                   Context
+    )
+{
+    pthread_t thread;
+
+    UNREFERENCED_PARAMETER(QueueType);
+
+    IoWorkItem->Routine = WorkerRoutine;
+    IoWorkItem->Context = Context;
+
+    if (pthread_create(&thread, NULL, wdk_work_item_start, IoWorkItem))
+    {
+        abort();
+    }
+
+    pthread_detach(thread);
+}
+
+PKEVENT
+IoCreateNotificationEvent (
+    PUNICODE_STRING EventName,
+    PHANDLE         EventHandle
+    )
+{
+    UNREFERENCED_PARAMETER(EventName);
+
+    *EventHandle = &WdkLowMemoryEvent;
+
+    return &WdkLowMemoryEvent;
+}
+
+KEVENT WdkLowMemoryEvent;
+
+/* IRPs */
+
+PIRP
+IoAllocateIrp (
+    CCHAR   StackSize,
+    BOOLEAN ChargeQuota
+    )
+{
+    PIRP irp;
+
+    UNREFERENCED_PARAMETER(ChargeQuota);
+
+    if (WdkPoolFailAfter >= 0 && InterlockedDecrement(&WdkPoolFailAfter) < 0)
+    {
+        return NULL;
+    }
+
+    irp = (PIRP) calloc(1, sizeof(IRP) + StackSize * sizeof(IO_STACK_LOCATION));
+
+    if (!irp)
+    {
+        return NULL;
+    }
+
+    InterlockedIncrement(&WdkIrpAllocations);
+
+    /* the stack locations follow the IRP and the first driver gets the last one */
+
+    irp->StackCount = StackSize;
+    irp->CurrentLocation = StackSize + 1;
+    irp->Tail.Overlay.CurrentStackLocation = (PIO_STACK_LOCATION) (irp + 1) + StackSize;
+
+    return irp;
+}
+
+VOID
+IoFreeIrp (
+    PIRP Irp
+    )
+{
+    InterlockedDecrement(&WdkIrpAllocations);
+
+    free(Irp);
+}
+
+NTSTATUS
+IoCallDriver (
+    PDEVICE_OBJECT  DeviceObject,
+    PIRP            Irp
+    )
+{
+    PIO_STACK_LOCATION  io_stack;
+    PDRIVER_DISPATCH    dispatch;
+
+    IoSetNextIrpStackLocation(Irp);
+
+    ASSERT(Irp->CurrentLocation > 0);
+
+    io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+    io_stack->DeviceObject = DeviceObject;
+
+    dispatch = DeviceObject->DriverObject->MajorFunction[io_stack->MajorFunction];
+
+    ASSERT(dispatch != NULL);
+
+    return dispatch(DeviceObject, Irp);
+}
+
+NTSTATUS
+PoCallDriver (
+    PDEVICE_OBJECT  DeviceObject,
+    PIRP            Irp
+    )
+{
+    return IoCallDriver(DeviceObject, Irp);
+}
+
+VOID
+PoStartNextPowerIrp (
+    PIRP Irp
+    )
+{
+    UNREFERENCED_PARAMETER(Irp);
+}
+
+VOID
+IoCompleteRequest (
+    PIRP    Irp,
+    CCHAR   PriorityBoost
+    )
+{
+    PIO_STACK_LOCATION      io_stack;
+    PIO_COMPLETION_ROUTINE  routine;
+    PVOID                   context;
+    PDEVICE_OBJECT          device_object;
+    UCHAR                   control;
+    PMDL                    mdl, next;
+    BOOLEAN                 invoke;
+
+    UNREFERENCED_PARAMETER(PriorityBoost);
+
+    ASSERT(Irp->IoStatus.Status != STATUS_PENDING);
+    ASSERT(Irp->CurrentLocation <= Irp->StackCount);
+
+    /* each location up the stack has the completion routine of the driver above it */
+
+    while (Irp->CurrentLocation <= Irp->StackCount)
+    {
+        io_stack = IoGetCurrentIrpStackLocation(Irp);
+
+        routine = io_stack->CompletionRoutine;
+        context = io_stack->Context;
+        control = io_stack->Control;
+
+        Irp->PendingReturned = (control & SL_PENDING_RETURNED) != 0;
+
+        io_stack->CompletionRoutine = NULL;
+        io_stack->Context = NULL;
+        io_stack->Control = 0;
+
+        IoSkipCurrentIrpStackLocation(Irp);
+
+        device_object = (Irp->CurrentLocation <= Irp->StackCount) ?
+            IoGetCurrentIrpStackLocation(Irp)->DeviceObject : NULL;
+
+        invoke = routine && (
+            (NT_SUCCESS(Irp->IoStatus.Status) && (control & SL_INVOKE_ON_SUCCESS)) ||
+            (!NT_SUCCESS(Irp->IoStatus.Status) && (control & SL_INVOKE_ON_ERROR)) ||
+            (Irp->Cancel && (control & SL_INVOKE_ON_CANCEL)));
+
+        if (invoke)
+        {
+            if (routine(device_object, Irp, context) == STATUS_MORE_PROCESSING_REQUIRED)
+            {
+                return;
+            }
+        }
+        else if (Irp->PendingReturned && Irp->CurrentLocation <= Irp->StackCount)
+        {
+            IoMarkIrpPending(Irp);
+        }
+    }
+
+    /* an IRP the driver allocated itself is left to it, a built one is finished here */
+
+    if (!(Irp->Flags & WDK_IRP_BUILT))
+    {
+        return;
+    }
+
+    if ((Irp->Flags & IRP_INPUT_OPERATION) && Irp->UserBuffer && !(NT_ERROR(Irp->IoStatus.Status)))
+    {
+        RtlCopyMemory(Irp->UserBuffer, Irp->AssociatedIrp.SystemBuffer, Irp->IoStatus.Information);
+    }
+
+    if (Irp->Flags & IRP_DEALLOCATE_BUFFER)
+    {
+        ExFreePool(Irp->AssociatedIrp.SystemBuffer);
+    }
+
+    for (mdl = Irp->MdlAddress; mdl; mdl = next)
+    {
+        next = mdl->Next;
+        IoFreeMdl(mdl);
+    }
+
+    if (Irp->UserIosb)
+    {
+        *Irp->UserIosb = Irp->IoStatus;
+    }
+
+    if (Irp->UserEvent)
+    {
+        KeSetEvent(Irp->UserEvent, IO_NO_INCREMENT, FALSE);
+    }
+
+    IoFreeIrp(Irp);
+}
+
+static PIRP
+wdk_build_irp (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN UCHAR            MajorFunction,
+    IN PKEVENT          Event,
+    IN PIO_STATUS_BLOCK IoStatusBlock
+    )
+{
+    PIRP irp;
+
+    irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+
+    if (irp)
+    {
+        irp->Flags = WDK_IRP_BUILT;
+        irp->UserEvent = Event;
+        irp->UserIosb = IoStatusBlock;
+
+        IoGetNextIrpStackLocation(irp)->MajorFunction = MajorFunction;
+    }
+
+    return irp;
+}
+
+PIRP
+IoBuildAsynchronousFsdRequest (
+    ULONG               MajorFunction,
+    PDEVICE_OBJECT      DeviceObject,
+    PVOID               Buffer,
+    ULONG               Length,
+    PLARGE_INTEGER      StartingOffset,
+    PIO_STATUS_BLOCK    IoStatusBlock
+    )
+{
+    PIO_STACK_LOCATION  io_stack;
+    PIRP                irp;
+
+    irp = wdk_build_irp(DeviceObject, (UCHAR) MajorFunction, NULL, IoStatusBlock);
+
+    if (!irp)
+    {
+        return NULL;
+    }
+
+    io_stack = IoGetNextIrpStackLocation(irp);
+
+    if (MajorFunction == IRP_MJ_READ || MajorFunction == IRP_MJ_WRITE)
+    {
+        io_stack->Parameters.Read.Length = Length;
+        io_stack->Parameters.Read.ByteOffset = *StartingOffset;
+
+        /* the disks are all direct I/O devices */
+
+        if (!IoAllocateMdl(Buffer, Length, FALSE, FALSE, irp))
+        {
+            IoFreeIrp(irp);
+            return NULL;
+        }
+    }
+
+    return irp;
+}
+
+PIRP
+IoBuildSynchronousFsdRequest (
+    ULONG               MajorFunction,
+    PDEVICE_OBJECT      DeviceObject,
+    PVOID               Buffer,
+    ULONG               Length,
+    PLARGE_INTEGER      StartingOffset,
+    PKEVENT             Event,
+    PIO_STATUS_BLOCK    IoStatusBlock
+    )
+{
+    PIRP irp;
+
+    irp = IoBuildAsynchronousFsdRequest(MajorFunction, DeviceObject, Buffer, Length, StartingOffset, IoStatusBlock);
+
+    if (irp)
+    {
+        irp->UserEvent = Event;
+    }
+
+    return irp;
+}
+
+PIRP
+IoBuildDeviceIoControlRequest (
+    ULONG               IoControlCode,
+    PDEVICE_OBJECT      DeviceObject,
+    PVOID               InputBuffer,
+    ULONG               InputBufferLength,
+    PVOID               OutputBuffer,
+    ULONG               OutputBufferLength,
+    BOOLEAN             InternalDeviceIoControl,
+    PKEVENT             Event,
+    PIO_STATUS_BLOCK    IoStatusBlock
+    )
+{
+    PIO_STACK_LOCATION  io_stack;
+    PIRP                irp;
+    ULONG               length;
+
+    irp = wdk_build_irp(
+        DeviceObject,
+        InternalDeviceIoControl ? IRP_MJ_INTERNAL_DEVICE_CONTROL : IRP_MJ_DEVICE_CONTROL,
+        Event,
+        IoStatusBlock
+        );
+
+    if (!irp)
+    {
+        return NULL;
+    }
+
+    io_stack = IoGetNextIrpStackLocation(irp);
+
+    io_stack->Parameters.DeviceIoControl.IoControlCode = IoControlCode;
+    io_stack->Parameters.DeviceIoControl.InputBufferLength = InputBufferLength;
+    io_stack->Parameters.DeviceIoControl.OutputBufferLength = OutputBufferLength;
+
+    /* only METHOD_BUFFERED is used, the input and output share the system buffer */
+
+    ASSERT((IoControlCode & 3) == METHOD_BUFFERED);
+
+    length = max(InputBufferLength, OutputBufferLength);
+
+    if (length)
+    {
+        irp->AssociatedIrp.SystemBuffer = ExAllocatePoolWithTag(NonPagedPool, length, 0);
+
+        if (!irp->AssociatedIrp.SystemBuffer)
+        {
+            IoFreeIrp(irp);
+            return NULL;
+        }
+
+        RtlZeroMemory(irp->AssociatedIrp.SystemBuffer, length);
+
+        if (InputBuffer)
+        {
+            RtlCopyMemory(irp->AssociatedIrp.SystemBuffer, InputBuffer, InputBufferLength);
+        }
+
+        irp->Flags |= IRP_BUFFERED_IO | IRP_DEALLOCATE_BUFFER;
+
+        if (OutputBuffer)
+        {
+            irp->Flags |= IRP_INPUT_OPERATION;
+            irp->UserBuffer = OutputBuffer;
+        }
+    }
+
+    return irp;
+}
+
+/* devices */
+
+NTSTATUS
+IoCreateDevice (
+    PDRIVER_OBJECT  DriverObject,
+    ULONG           DeviceExtensionSize,
+    PUNICODE_STRING DeviceName,
+    DEVICE_TYPE     DeviceType,
+    ULONG           DeviceCharacteristics,
+    BOOLEAN         Exclusive,
+    PDEVICE_OBJECT  *DeviceObject
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    ULONG           size, n;
+
+    UNREFERENCED_PARAMETER(Exclusive);
+
+    size = (ULONG) ALIGN_UP_BY(sizeof(DEVICE_OBJECT), 64);
+
+    device_object = (PDEVICE_OBJECT) ExAllocatePoolWithTag(NonPagedPool, size + DeviceExtensionSize, 0);
+
+    if (!device_object)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(device_object, size + DeviceExtensionSize);
+
+    device_object->DriverObject = DriverObject;
+    device_object->DeviceType = DeviceType;
+    device_object->Characteristics = DeviceCharacteristics;
+    device_object->Flags = DO_DEVICE_INITIALIZING;
+    device_object->StackSize = 1;
+    device_object->DeviceExtension = DeviceExtensionSize ? (PUCHAR) device_object + size : NULL;
+
+    if (DeviceName)
+    {
+        device_object->Name.Buffer = (PWSTR) ExAllocatePoolWithTag(NonPagedPool, DeviceName->Length + sizeof(WCHAR), 0);
+
+        if (!device_object->Name.Buffer)
+        {
+            ExFreePool(device_object);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        device_object->Name.MaximumLength = DeviceName->Length + sizeof(WCHAR);
+        RtlCopyUnicodeString(&device_object->Name, DeviceName);
+        device_object->Name.Buffer[device_object->Name.Length / sizeof(WCHAR)] = 0;
+    }
+
+    for (n = 0; n < RTL_NUMBER_OF(wdk_devices) && wdk_devices[n]; n++)
+    {
+    }
+
+    ASSERT(n < RTL_NUMBER_OF(wdk_devices));
+
+    wdk_devices[n] = device_object;
+
+    *DeviceObject = device_object;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+IoDeleteDevice (
+    PDEVICE_OBJECT DeviceObject
+    )
+{
+    ULONG n;
+
+    for (n = 0; n < RTL_NUMBER_OF(wdk_devices); n++)
+    {
+        if (wdk_devices[n] == DeviceObject)
+        {
+            wdk_devices[n] = NULL;
+        }
+    }
+
+    if (DeviceObject->Name.Buffer)
+    {
+        ExFreePool(DeviceObject->Name.Buffer);
+    }
+
+    ExFreePool(DeviceObject);
+}
+
+static PDEVICE_OBJECT
+wdk_find_device (
+    IN PUNICODE_STRING Name
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    ULONG           n;
+
+    for (n = 0; n < RTL_NUMBER_OF(wdk_devices); n++)
+    {
+        device_object = wdk_devices[n];
+
+        if (device_object && device_object->Name.Buffer && RtlEqualUnicodeString(&device_object->Name, Name, TRUE))
+        {
+            while (device_object->AttachedDevice)
+            {
+                device_object = device_object->AttachedDevice;
+            }
+
+            return device_object;
+        }
+    }
+
+    return NULL;
+}
+
+NTSTATUS
+IoAttachDevice (
+    PDEVICE_OBJECT  SourceDevice,
+    PUNICODE_STRING TargetDevice,
+    PDEVICE_OBJECT  *AttachedDevice
+    )
+{
+    PDEVICE_OBJECT target;
+
+    target = wdk_find_device(TargetDevice);
+
+    if (!target)
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    target->AttachedDevice = SourceDevice;
+
+    SourceDevice->StackSize = target->StackSize + 1;
+
+    *AttachedDevice = target;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+IoDetachDevice (
+    PDEVICE_OBJECT TargetDevice
+    )
+{
+    TargetDevice->AttachedDevice = NULL;
+}
+
+NTSTATUS
+IoGetDeviceObjectPointer (
+    PUNICODE_STRING ObjectName,
+    ACCESS_MASK     DesiredAccess,
+    PFILE_OBJECT    *FileObject,
+    PDEVICE_OBJECT  *DeviceObject
+    )
+{
+    PDEVICE_OBJECT device_object;
+
+    UNREFERENCED_PARAMETER(DesiredAccess);
+
+    device_object = wdk_find_device(ObjectName);
+
+    if (!device_object)
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    *FileObject = &wdk_file_object;
+    *DeviceObject = device_object;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+IoAdjustPagingPathCount (
+    PLONG   Count,
+    BOOLEAN Increment
+    )
+{
+    if (Increment)
+    {
+        InterlockedIncrement(Count);
+    }
+    else
+    {
+        InterlockedDecrement(Count);
+    }
+}
+
+NTSTATUS
+IoRegisterShutdownNotification (
+    PDEVICE_OBJECT DeviceObject
+    )
+{
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+IoRegisterLastChanceShutdownNotification (
+    PDEVICE_OBJECT DeviceObject
+    )
+{
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    return STATUS_SUCCESS;
+}
+
+PVOID
+IoAllocateErrorLogEntry (
+    PVOID IoObject,
+    UCHAR EntrySize
+    )
+{
+    PVOID entry;
+
+    UNREFERENCED_PARAMETER(IoObject);
+
+    ASSERT(EntrySize <= ERROR_LOG_MAXIMUM_SIZE);
+
+    entry = ExAllocatePoolWithTag(NonPagedPool, EntrySize, 0);
+
+    if (entry)
+    {
+        RtlZeroMemory(entry, EntrySize);
+    }
+
+    return entry;
+}
+
+VOID
+IoWriteErrorLogEntry (
+    PVOID ElEntry
+    )
+{
+    RtlCopyMemory(&WdkLastErrorLogEntry, ElEntry, sizeof(IO_ERROR_LOG_PACKET));
+
+    InterlockedIncrement(&WdkErrorLogEntries);
+
+    ExFreePool(ElEntry);
+}
+
+/* strings */
+
+SIZE_T
+WdkStringLength (
+    PCWSTR String
+    )
+{
+    SIZE_T n;
+
+    for (n = 0; String[n]; n++)
+    {
+    }
+
+    return n;
+}
+
+WCHAR
+RtlUpcaseUnicodeChar (
+    WCHAR SourceCharacter
+    )
+{
+    return (SourceCharacter >= 'a' && SourceCharacter <= 'z') ? SourceCharacter - 'a' + 'A' : SourceCharacter;
+}
+
+int
+WdkStringCompare (
+    PCWSTR String1,
+    PCWSTR String2
+    )
+{
+    while (*String1 && RtlUpcaseUnicodeChar(*String1) == RtlUpcaseUnicodeChar(*String2))
+    {
+        String1++;
+        String2++;
+    }
+
+    return (int) RtlUpcaseUnicodeChar(*String1) - (int) RtlUpcaseUnicodeChar(*String2);
+}
+
+VOID
+RtlInitUnicodeString (
+    PUNICODE_STRING DestinationString,
+    PCWSTR          SourceString
+    )
+{
+    DestinationString->Buffer = (PWSTR) SourceString;
+    DestinationString->Length = SourceString ? (USHORT) (WdkStringLength(SourceString) * sizeof(WCHAR)) : 0;
+    DestinationString->MaximumLength = SourceString ? DestinationString->Length + sizeof(WCHAR) : 0;
+}
+
+VOID
+RtlInitEmptyUnicodeString (
+    PUNICODE_STRING DestinationString,
+    PWCHAR          Buffer,
+    USHORT          BufferSize
+    )
+{
+    DestinationString->Buffer = Buffer;
+    DestinationString->Length = 0;
+    DestinationString->MaximumLength = BufferSize;
+}
+
+VOID
+RtlCopyUnicodeString (
+    PUNICODE_STRING     DestinationString,
+    PCUNICODE_STRING    SourceString
+    )
+{
+    USHORT length;
+
+    length = SourceString ? min(SourceString->Length, DestinationString->MaximumLength) : 0;
+
+    if (length)
+    {
+        RtlMoveMemory(DestinationString->Buffer, SourceString->Buffer, length);
+    }
+
+    DestinationString->Length = length;
+
+    if (length < DestinationString->MaximumLength)
+    {
+        DestinationString->Buffer[length / sizeof(WCHAR)] = 0;
+    }
+}
+
+NTSTATUS
+RtlAppendUnicodeToString (
+    PUNICODE_STRING Destination,
+    PCWSTR          Source
+    )
+{
+    USHORT length;
+
+    length = (USHORT) (WdkStringLength(Source) * sizeof(WCHAR));
+
+    if (Destination->Length + length > Destination->MaximumLength)
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    RtlMoveMemory((PUCHAR) Destination->Buffer + Destination->Length, Source, length);
+
+    Destination->Length += length;
+
+    if (Destination->Length < Destination->MaximumLength)
+    {
+        Destination->Buffer[Destination->Length / sizeof(WCHAR)] = 0;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+RtlEqualUnicodeString (
+    PCUNICODE_STRING    String1,
+    PCUNICODE_STRING    String2,
+    BOOLEAN             CaseInSensitive
+    )
+{
+    USHORT n;
+
+    if (String1->Length != String2->Length)
+    {
+        return FALSE;
+    }
+
+    for (n = 0; n < String1->Length / sizeof(WCHAR); n++)
+    {
+        WCHAR a = String1->Buffer[n], b = String2->Buffer[n];
+
+        if (CaseInSensitive)
+        {
+            a = RtlUpcaseUnicodeChar(a);
+            b = RtlUpcaseUnicodeChar(b);
+        }
+
+        if (a != b)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static NTSTATUS
+wdk_format (
+    OUT PWSTR   Buffer,
+    IN SIZE_T   Count,
+    OUT PSIZE_T Length,
+    IN PCWSTR   Format,
+    IN va_list  Arguments
+    )
+{
+    char    number[32];
+    SIZE_T  n;
+    PCWSTR  string;
+    int     i;
+
+    for (n = 0; *Format; Format++)
+    {
+        number[0] = 0;
+        string = NULL;
+
+        if (*Format == '%' && (Format[1] == 'u' || Format[1] == 'd' || Format[1] == 'x'))
+        {
+            Format++;
+            snprintf(number, sizeof(number), *Format == 'u' ? "%u" : *Format == 'd' ? "%d" : "%x", va_arg(Arguments, ULONG));
+        }
+        else if (*Format == '%' && Format[1] == 'w' && Format[2] == 's')
+        {
+            Format += 2;
+            string = va_arg(Arguments, PCWSTR);
+        }
+        else
+        {
+            if (n + 1 >= Count)
+            {
+                return STATUS_BUFFER_OVERFLOW;
+            }
+
+            Buffer[n++] = *Format;
+            continue;
+        }
+
+        for (i = 0; number[i] || (string && string[i]); i++)
+        {
+            if (n + 1 >= Count)
+            {
+                return STATUS_BUFFER_OVERFLOW;
+            }
+
+            Buffer[n++] = string ? string[i] : (WCHAR) number[i];
+        }
+    }
+
+    Buffer[n] = 0;
+
+    *Length = n;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RtlUnicodeStringPrintf (
+    PUNICODE_STRING DestinationString,
+    PCWSTR          Format,
+    ...
+    )
+{
+    WCHAR       buffer[256];
+    SIZE_T      length;
+    NTSTATUS    status;
+    va_list     ap;
+
+    va_start(ap, Format);
+    status = wdk_format(buffer, RTL_NUMBER_OF(buffer), &length, Format, ap);
+    va_end(ap);
+
+    if (!NT_SUCCESS(status) || length * sizeof(WCHAR) > DestinationString->MaximumLength)
+    {
+        return STATUS_BUFFER_OVERFLOW;
+    }
+
+    RtlCopyMemory(DestinationString->Buffer, buffer, length * sizeof(WCHAR));
+
+    DestinationString->Length = (USHORT) (length * sizeof(WCHAR));
+
+    /* the driver gives the buffer to the registry as a string, so it is
+       terminated when there is room as the pool it came from is not cleared */
+
+    if (DestinationString->Length < DestinationString->MaximumLength)
+    {
+        DestinationString->Buffer[length] = 0;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RtlStringCbPrintfW (
+    PWSTR   Destination,
+    SIZE_T  DestinationSize,
+    PCWSTR  Format,
+    ...
+    )
+{
+    SIZE_T      length;
+    NTSTATUS    status;
+    va_list     ap;
+
+    va_start(ap, Format);
+    status = wdk_format(Destination, DestinationSize / sizeof(WCHAR), &length, Format, ap);
+    va_end(ap);
+
+    return status;
+}
+
+/* registry */
+
+typedef struct _WDK_REGISTRY_VALUE {
+    char    Path[256];
+    char    Name[64];
+    ULONG   Type;
+    ULONG   Length;
+    UCHAR   Data[256];
+} WDK_REGISTRY_VALUE;
+
+static WDK_REGISTRY_VALUE wdk_registry[64];
+
+static VOID
+wdk_narrow (
+    OUT char    *Buffer,
+    IN SIZE_T   Size,
+    IN PCWSTR   String
+    )
+{
+    SIZE_T n;
+
+    for (n = 0; String && String[n] && n + 1 < Size; n++)
+    {
+        Buffer[n] = (char) String[n];
+    }
+
+    Buffer[n] = 0;
+}
+
+/* the paths relative to the services are made absolute as the tests set them */
+
+static VOID
+wdk_registry_path (
+    OUT char    *Buffer,
+    IN SIZE_T   Size,
+    IN ULONG    RelativeTo,
+    IN PCWSTR   Path
+    )
+{
+    SIZE_T n;
+
+    n = 0;
+
+    if (RelativeTo == RTL_REGISTRY_SERVICES)
+    {
+        n = snprintf(Buffer, Size, "\\Registry\\Machine\\System\\CurrentControlSet\\Services\\");
+    }
+
+    wdk_narrow(Buffer + n, Size - n, Path);
+}
+
+static WDK_REGISTRY_VALUE *
+wdk_registry_find (
+    IN const char   *Path,
+    IN const char   *Name,
+    IN BOOLEAN      Create
+    )
+{
+    ULONG n;
+
+    for (n = 0; n < RTL_NUMBER_OF(wdk_registry); n++)
+    {
+        if (wdk_registry[n].Path[0] && !strcasecmp(wdk_registry[n].Path, Path) && !strcasecmp(wdk_registry[n].Name, Name))
+        {
+            return &wdk_registry[n];
+        }
+    }
+
+    if (!Create)
+    {
+        return NULL;
+    }
+
+    for (n = 0; n < RTL_NUMBER_OF(wdk_registry); n++)
+    {
+        if (!wdk_registry[n].Path[0])
+        {
+            snprintf(wdk_registry[n].Path, sizeof(wdk_registry[n].Path), "%s", Path);
+            snprintf(wdk_registry[n].Name, sizeof(wdk_registry[n].Name), "%s", Name);
+            return &wdk_registry[n];
+        }
+    }
+
+    return NULL;
+}
+
+VOID
+WdkSetRegistryValue (
+    const char  *Path,
+    const char  *Name,
+    ULONG       Type,
+    const VOID  *Data,
+    ULONG       Length
+    )
+{
+    WDK_REGISTRY_VALUE *value;
+
+    value = wdk_registry_find(Path, Name, TRUE);
+
+    ASSERT(value != NULL && Length <= sizeof(value->Data));
+
+    value->Type = Type;
+    value->Length = Length;
+
+    RtlCopyMemory(value->Data, Data, Length);
+}
+
+VOID
+WdkSetRegistryString (
+    const char  *Path,
+    const char  *Name,
+    const char  *String
+    )
+{
+    WCHAR   buffer[128];
+    ULONG   n;
+
+    for (n = 0; String[n] && n + 1 < RTL_NUMBER_OF(buffer); n++)
+    {
+        buffer[n] = (WCHAR) String[n];
+    }
+
+    buffer[n] = 0;
+
+    WdkSetRegistryValue(Path, Name, REG_SZ, buffer, (n + 1) * sizeof(WCHAR));
+}
+
+VOID
+WdkClearRegistry (
+    VOID
+    )
+{
+    RtlZeroMemory(wdk_registry, sizeof(wdk_registry));
+}
+
+NTSTATUS
+RtlWriteRegistryValue (
+    ULONG   RelativeTo,
+    PCWSTR  Path,
+    PCWSTR  ValueName,
+    ULONG   ValueType,
+    PVOID   ValueData,
+    ULONG   ValueLength
+    )
+{
+    char path[256], name[64];
+
+    wdk_registry_path(path, sizeof(path), RelativeTo, Path);
+    wdk_narrow(name, sizeof(name), ValueName);
+
+    WdkSetRegistryValue(path, name, ValueType, ValueData, ValueLength);
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+wdk_registry_direct (
+    IN PRTL_QUERY_REGISTRY_TABLE    Entry,
+    IN ULONG                        Type,
+    IN PVOID                        Data,
+    IN ULONG                        Length
+    )
+{
+    PUNICODE_STRING string;
+
+    if (Type == REG_SZ || Type == REG_EXPAND_SZ || Type == REG_MULTI_SZ)
+    {
+        string = (PUNICODE_STRING) Entry->EntryContext;
+
+        if (!string->Buffer)
+        {
+            string->Buffer = (PWSTR) ExAllocatePoolWithTag(PagedPool, Length, 0);
+
+            if (!string->Buffer)
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            string->MaximumLength = (USHORT) Length;
+        }
+        else if (Length > string->MaximumLength)
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+
+        RtlCopyMemory(string->Buffer, Data, Length);
+
+        string->Length = (USHORT) (Length - sizeof(WCHAR));
+    }
+    else if (Length <= sizeof(ULONG))
+    {
+        RtlCopyMemory(Entry->EntryContext, Data, Length);
+    }
+
+    /* a longer value needs a buffer whose size is given negated in its first LONG */
+
+    else if (*(PLONG) Entry->EntryContext < 0 && (ULONG) -*(PLONG) Entry->EntryContext >= Length)
+    {
+        RtlCopyMemory(Entry->EntryContext, Data, Length);
+    }
+    else
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RtlQueryRegistryValues (
+    ULONG                       RelativeTo,
+    PCWSTR                      Path,
+    PRTL_QUERY_REGISTRY_TABLE   QueryTable,
+    PVOID                       Context,
+    PVOID                       Environment
+    )
+{
+    PRTL_QUERY_REGISTRY_TABLE   entry;
+    WDK_REGISTRY_VALUE          *value;
+    char                        path[256], name[64];
+    ULONG                       type, length;
+    PVOID                       data;
+    NTSTATUS                    status;
+
+    UNREFERENCED_PARAMETER(Environment);
+
+    wdk_registry_path(path, sizeof(path), RelativeTo, Path);
+
+    for (entry = QueryTable; entry->QueryRoutine || entry->Name; entry++)
+    {
+        wdk_narrow(name, sizeof(name), entry->Name);
+
+        value = wdk_registry_find(path, name, FALSE);
+
+        if (value)
+        {
+            type = value->Type;
+            data = value->Data;
+            length = value->Length;
+        }
+        else if (entry->Flags & RTL_QUERY_REGISTRY_REQUIRED)
+        {
+            return STATUS_OBJECT_NAME_NOT_FOUND;
+        }
+        else if (entry->DefaultType != REG_NONE)
+        {
+            type = entry->DefaultType;
+            data = entry->DefaultData;
+            length = entry->DefaultLength;
+        }
+        else
+        {
+            continue;
+        }
+
+        if (entry->Flags & RTL_QUERY_REGISTRY_DIRECT)
+        {
+            if ((entry->Flags & RTL_QUERY_REGISTRY_TYPECHECK) &&
+                type != (entry->Flags >> RTL_QUERY_REGISTRY_TYPECHECK_SHIFT))
+            {
+                return STATUS_OBJECT_TYPE_MISMATCH;
+            }
+
+            status = wdk_registry_direct(entry, type, data, length);
+        }
+        else
+        {
+            status = entry->QueryRoutine(entry->Name, type, data, length, Context, entry->EntryContext);
+        }
+
+        if (!NT_SUCCESS(status))
+        {
+            return status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* bitmaps */
+
+VOID
+RtlInitializeBitMap (
+    PRTL_BITMAP BitMapHeader,
+    PULONG      BitMapBuffer,
+    ULONG       SizeOfBitMap
+    )
+{
+    BitMapHeader->Buffer = BitMapBuffer;
+    BitMapHeader->SizeOfBitMap = SizeOfBitMap;
+}
+
+BOOLEAN
+RtlCheckBit (
+    PRTL_BITMAP BitMapHeader,
+    ULONG       BitPosition
+    )
+{
+    ASSERT(BitPosition < BitMapHeader->SizeOfBitMap);
+
+    return (BitMapHeader->Buffer[BitPosition / 32] >> (BitPosition % 32)) & 1;
+}
+
+VOID
+RtlSetBits (
+    PRTL_BITMAP BitMapHeader,
+    ULONG       StartingIndex,
+    ULONG       NumberToSet
+    )
+{
+    ULONG n;
+
+    ASSERT(StartingIndex + NumberToSet <= BitMapHeader->SizeOfBitMap);
+
+    for (n = StartingIndex; n < StartingIndex + NumberToSet; n++)
+    {
+        if (!(n % 32) && n + 32 <= StartingIndex + NumberToSet)
+        {
+            BitMapHeader->Buffer[n / 32] = MAXULONG;
+            n += 31;
+        }
+        else
+        {
+            BitMapHeader->Buffer[n / 32] |= 1u << (n % 32);
+        }
+    }
+}
+
+VOID
+RtlClearBits (
+    PRTL_BITMAP BitMapHeader,
+    ULONG       StartingIndex,
+    ULONG       NumberToClear
+    )
+{
+    ULONG n;
+
+    ASSERT(StartingIndex + NumberToClear <= BitMapHeader->SizeOfBitMap);
+
+    for (n = StartingIndex; n < StartingIndex + NumberToClear; n++)
+    {
+        if (!(n % 32) && n + 32 <= StartingIndex + NumberToClear)
+        {
+            BitMapHeader->Buffer[n / 32] = 0;
+            n += 31;
+        }
+        else
+        {
+            BitMapHeader->Buffer[n / 32] &= ~(1u << (n % 32));
+        }
+    }
+}
+
+VOID
+RtlSetAllBits (
+    PRTL_BITMAP BitMapHeader
+    )
+{
+    RtlFillMemory(BitMapHeader->Buffer, (BitMapHeader->SizeOfBitMap + 31) / 32 * sizeof(ULONG), 0xff);
+}
+
+VOID
+RtlClearAllBits (
+    PRTL_BITMAP BitMapHeader
+    )
+{
+    RtlZeroMemory(BitMapHeader->Buffer, (BitMapHeader->SizeOfBitMap + 31) / 32 * sizeof(ULONG));
+}
+
+static BOOLEAN
+wdk_are_bits (
+    IN PRTL_BITMAP  BitMapHeader,
+    IN ULONG        StartingIndex,
+    IN ULONG        Length,
+    IN BOOLEAN      Set
+    )
+{
+    ULONG n;
+
+    if (StartingIndex + Length > BitMapHeader->SizeOfBitMap || StartingIndex + Length < StartingIndex)
+    {
+        return FALSE;
+    }
+
+    for (n = StartingIndex; n < StartingIndex + Length; n++)
+    {
+        if (!(n % 32) && n + 32 <= StartingIndex + Length)
+        {
+            if (BitMapHeader->Buffer[n / 32] != (Set ? MAXULONG : 0))
+            {
+                return FALSE;
+            }
+
+            n += 31;
+        }
+        else if (RtlCheckBit(BitMapHeader, n) != Set)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+RtlAreBitsSet (
+    PRTL_BITMAP BitMapHeader,
+    ULONG       StartingIndex,
+    ULONG       Length
+    )
+{
+    return wdk_are_bits(BitMapHeader, StartingIndex, Length, TRUE);
+}
+
+BOOLEAN
+RtlAreBitsClear (
+    PRTL_BITMAP BitMapHeader,
+    ULONG       StartingIndex,
+    ULONG       Length
+    )
+{
+    return wdk_are_bits(BitMapHeader, StartingIndex, Length, FALSE);
+}
+
+/* the first run of the bits from the hint on, then from the start, as the kernel does */
+
+static ULONG
+wdk_find_bits (
+    IN PRTL_BITMAP  BitMapHeader,
+    IN ULONG        NumberToFind,
+    IN ULONG        HintIndex,
+    IN BOOLEAN      Set
+    )
+{
+    ULONG size, start, n, run;
+    ULONG skip;
+
+    size = BitMapHeader->SizeOfBitMap;
+
+    if (!NumberToFind || NumberToFind > size)
+    {
+        return NumberToFind ? MAXULONG : (HintIndex < size ? HintIndex : 0);
+    }
+
+    skip = Set ? 0 : MAXULONG;
+
+    start = (HintIndex < size) ? HintIndex : 0;
+
+    for (run = 0, n = start; n < size; n++)
+    {
+        /* whole words without a bit of the kind are skipped */
+
+        if (!run && !(n % 32) && BitMapHeader->Buffer[n / 32] == skip)
+        {
+            n += 31;
+            continue;
+        }
+
+        if (RtlCheckBit(BitMapHeader, n) == Set)
+        {
+            if (++run == NumberToFind)
+            {
+                return n + 1 - run;
+            }
+        }
+        else
+        {
+            run = 0;
+        }
+    }
+
+    for (run = 0, n = 0; n < size && n < start + NumberToFind - 1; n++)
+    {
+        if (!run && !(n % 32) && n + 32 <= size && BitMapHeader->Buffer[n / 32] == skip)
+        {
+            n += 31;
+            continue;
+        }
+
+        if (RtlCheckBit(BitMapHeader, n) == Set)
+        {
+            if (++run == NumberToFind)
+            {
+                return n + 1 - run;
+            }
+        }
+        else
+        {
+            run = 0;
+        }
+    }
+
+    return MAXULONG;
+}
+
+ULONG
+RtlFindSetBits (
+    PRTL_BITMAP BitMapHeader,
+    ULONG       NumberToFind,
+    ULONG       HintIndex
+    )
+{
+    return wdk_find_bits(BitMapHeader, NumberToFind, HintIndex, TRUE);
+}
+
+ULONG
+RtlFindClearBits (
+    PRTL_BITMAP BitMapHeader,
+    ULONG       NumberToFind,
+    ULONG       HintIndex
+    )
+{
+    return wdk_find_bits(BitMapHeader, NumberToFind, HintIndex, FALSE);
+}
+
+ULONG
+RtlFindClearBitsAndSet (
+    PRTL_BITMAP BitMapHeader,
+    ULONG       NumberToFind,
+    ULONG       HintIndex
+    )
+{
+    ULONG index;
+
+    index = RtlFindClearBits(BitMapHeader, NumberToFind, HintIndex);
+
+    if (index != MAXULONG)
+    {
+        RtlSetBits(BitMapHeader, index, NumberToFind);
+    }
+
+    return index;
+}
+
+ULONG
+RtlNumberOfSetBits (
+    PRTL_BITMAP BitMapHeader
+    )
+{
+    ULONG n, count;
+
+    for (count = 0, n = 0; n < BitMapHeader->SizeOfBitMap; n++)
+    {
+        count += RtlCheckBit(BitMapHeader, n);
+    }
+
+    return count;
+}
+
+CCHAR
+RtlFindMostSignificantBit (
+    ULONGLONG Set
+    )
+{
+    return Set ? (CCHAR) (63 - __builtin_clzll(Set)) : -1;
+}
+
+/* tracing */
+
+WDK_TRACE_EVENT WdkTraceEvents[WDK_TRACE_EVENTS];
+volatile LONG WdkTraceEventCount;
+volatile LONG WdkTraceWrites;
+
+NTSTATUS
+TraceLoggingRegister (
+    TraceLoggingHProvider Provider
+    )
+{
+    Provider->Registered = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+TraceLoggingUnregister (
+    TraceLoggingHProvider Provider
+    )
+{
+    Provider->Registered = FALSE;
+}
+
+VOID
+WdkTraceEnable (
+    TraceLoggingHProvider   Provider,
+    UCHAR                   Level,
+    ULONGLONG               Keyword
+    )
+{
+    Provider->Level = Level;
+    Provider->Keyword = Keyword;
+
+    WdkTraceEventCount = 0;
+}
+
+VOID
+WdkTraceWrite (
+    TraceLoggingHProvider   Provider,
+    const char              *Name,
+    const WDK_TRACE_FIELD   *Field,
+    ULONG                   NumberOfFields
+    )
+{
+    WDK_TRACE_EVENT *event;
+    LONG            n;
+    ULONG           i;
+
+    InterlockedIncrement(&WdkTraceWrites);
+
+    /* an event is only written when a session has the provider enabled for it */
+
+    for (i = 0; i < NumberOfFields; i++)
+    {
+        if ((Field[i].Type == WdkTraceLevel && Field[i].Value > Provider->Level) ||
+            (Field[i].Type == WdkTraceKeyword && Field[i].Value && !(Field[i].Value & Provider->Keyword)))
+        {
+            return;
+        }
+    }
+
+    if (!Provider->Registered)
+    {
+        return;
+    }
+
+    n = InterlockedIncrement(&WdkTraceEventCount) - 1;
+
+    if (n >= WDK_TRACE_EVENTS)
+    {
+        return;
+    }
+
+    event = &WdkTraceEvents[n];
+
+    event->Name = Name;
+    event->NumberOfFields = min(NumberOfFields, WDK_TRACE_FIELDS);
+
+    for (i = 0; i < event->NumberOfFields; i++)
+    {
+        event->Field[i] = Field[i];
+
+        if (Field[i].Type == WdkTraceString)
+        {
+            snprintf(event->String[i], sizeof(event->String[i]), "%s", (const char *) Field[i].Pointer);
+            event->Field[i].Pointer = event->String[i];
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/*
+    The functions a test uses to set up and look at the user-mode kernel.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The registry is a table in memory that a test fills in before it
+    calls DriverEntry. The counts of the pool, IRP and MDL allocations
+    that are outstanding let a test see that the driver gave back what it
+    took, and WdkPoolFailAfter makes the allocations fail after the given
+    number has been made. The error log keeps the last entry written and
+    the trace provider keeps the events written while a test has it
+    enabled. WdkTraceWrites counts all the events written, also those no
+    session wanted, so a test can see that the driver checks first.
+*/
+
+#ifndef _WDK_H_
+#define _WDK_H_
+
+#include <ntddk.h>
+#include <TraceLoggingProvider.h>
+
+#define WDK_TRACE_EVENTS    1024
+#define WDK_TRACE_FIELDS    16
+
+typedef struct _WDK_TRACE_EVENT {
+    const char *Name;
+    ULONG NumberOfFields;
+    WDK_TRACE_FIELD Field[WDK_TRACE_FIELDS];
+    char String[WDK_TRACE_FIELDS][64];
+} WDK_TRACE_EVENT;
+
+extern volatile LONG WdkPoolAllocations;
+extern volatile LONG WdkIrpAllocations;
+extern volatile LONG WdkMdlAllocations;
+extern volatile LONG WdkPoolFailAfter;
+extern volatile LONG WdkErrorLogEntries;
+extern IO_ERROR_LOG_PACKET WdkLastErrorLogEntry;
+extern KEVENT WdkLowMemoryEvent;
+extern WDK_TRACE_EVENT WdkTraceEvents[WDK_TRACE_EVENTS];
+extern volatile LONG WdkTraceEventCount;
+extern volatile LONG WdkTraceWrites;
+
+VOID WdkSetRegistryValue (const char *Path, const char *Name, ULONG Type, const VOID *Data, ULONG Length);
+VOID WdkSetRegistryString (const char *Path, const char *Name, const char *String);
+VOID WdkClearRegistry (VOID);
+VOID WdkTraceEnable (TraceLoggingHProvider Provider, UCHAR Level, ULONGLONG Keyword);
+
+#endif /* _WDK_H_ */
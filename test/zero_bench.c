@@ -0,0 +1,220 @@
+/*
+    Benchmark of the zero check of the zero elision.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Reports the throughput of the check the driver makes of each block
+    written with ZeroBlockElision, against a loop over the words as the
+    compiler builds it and against memcmp with a block of zeros. The
+    blocks are checked in a buffer larger than the caches, all zeros as
+    when a block is elided, with the last byte set as when it's written
+    after the whole of it is looked at, and with the first byte set as
+    data that is told from zeros at once.
+
+        zero_bench [-r MB] [-b bytes]
+*/
+
+#include "../sys/src/zeroelision.c"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+
+#define BENCH_BUFFER    (64 * 1024 * 1024)
+
+typedef BOOLEAN BENCH_CHECK (PUCHAR Data, ULONG Length);
+
+static ULONG bench_megabytes = 4096;
+
+static PUCHAR bench_zeros;
+
+static __attribute__((noinline)) BOOLEAN
+bench_driver (
+    IN PUCHAR   Data,
+    IN ULONG    Length
+    )
+{
+    return zero_elision_is_zero(Data, Length);
+}
+
+static __attribute__((noinline)) BOOLEAN
+bench_words (
+    IN PUCHAR   Data,
+    IN ULONG    Length
+    )
+{
+    ULONG_PTR   *word = (ULONG_PTR *) Data;
+    ULONG       n;
+
+    for (n = 0; n < Length / sizeof(ULONG_PTR); n++)
+    {
+        if (word[n])
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static __attribute__((noinline)) BOOLEAN
+bench_memcmp (
+    IN PUCHAR   Data,
+    IN ULONG    Length
+    )
+{
+    return memcmp(Data, bench_zeros, Length) == 0;
+}
+
+/* returns GB/s of the blocks checked, or 0 when a check has the wrong result */
+
+static double
+bench_run (
+    IN BENCH_CHECK  *Check,
+    IN PUCHAR       Buffer,
+    IN ULONG        Block,
+    IN BOOLEAN      Zero
+    )
+{
+    ULONGLONG   bytes, time;
+    ULONG       offset;
+    ULONG       wrong;
+
+    wrong = 0;
+
+    time = TestTime();
+
+    for (bytes = 0; bytes < (ULONGLONG) bench_megabytes * 1048576; bytes += BENCH_BUFFER)
+    {
+        for (offset = 0; offset + Block <= BENCH_BUFFER; offset += Block)
+        {
+            wrong += Check(Buffer + offset, Block) != Zero;
+        }
+    }
+
+    time = TestTime() - time;
+
+    return wrong ? 0 : bytes / (time / 1e9) / 1e9;
+}
+
+static void
+bench_fill (
+    IN PUCHAR   Buffer,
+    IN ULONG    Block,
+    IN LONG     Set
+    )
+{
+    ULONG offset;
+
+    RtlZeroMemory(Buffer, BENCH_BUFFER);
+
+    if (Set >= 0)
+    {
+        for (offset = 0; offset + Block <= BENCH_BUFFER; offset += Block)
+        {
+            Buffer[offset + (Set ? Block - 1 : 0)] = 0x10;
+        }
+    }
+}
+
+int
+main (
+    int     argc,
+    char    *argv[]
+    )
+{
+    static const struct {
+        const char  *Name;
+        LONG        Set;
+    } data[] = {
+        { "zeros",      -1 },
+        { "last set",   1 },
+        { "first set",  0 },
+    };
+    ULONG   blocks[] = { 512, ZERO_ELISION_BLOCK_SIZE, 65536 };
+    ULONG   nblocks = sizeof(blocks) / sizeof(blocks[0]);
+    PUCHAR  buffer;
+    double  driver, words, compare;
+    int     failed;
+    int     c;
+    ULONG   d, b;
+
+    while ((c = getopt(argc, argv, "r:b:")) != -1)
+    {
+        switch (c)
+        {
+        case 'r':
+            bench_megabytes = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            blocks[0] = strtoul(optarg, NULL, 0);
+            nblocks = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: zero_bench [-r MB] [-b bytes]\n");
+            return 2;
+        }
+    }
+
+    if (!blocks[0] || blocks[0] % 16 || blocks[0] > 65536 || bench_megabytes * 1048576ULL < BENCH_BUFFER)
+    {
+        fprintf(stderr, "zero_bench: a block is a multiple of 16 up to 64 KB and -r at least %u MB\n",
+            BENCH_BUFFER / 1048576);
+        return 2;
+    }
+
+    buffer = (PUCHAR) aligned_alloc(64, BENCH_BUFFER);
+    bench_zeros = (PUCHAR) aligned_alloc(64, 65536);
+
+    if (!buffer || !bench_zeros)
+    {
+        return 1;
+    }
+
+    RtlZeroMemory(bench_zeros, 65536);
+
+    failed = 0;
+
+    printf("data       block   driver GB/s    words GB/s   memcmp GB/s\n");
+
+    for (d = 0; d < sizeof(data) / sizeof(data[0]); d++)
+    {
+        for (b = 0; b < nblocks; b++)
+        {
+            bench_fill(buffer, blocks[b], data[d].Set);
+
+            driver = bench_run(bench_driver, buffer, blocks[b], data[d].Set < 0);
+            words = bench_run(bench_words, buffer, blocks[b], data[d].Set < 0);
+            compare = bench_run(bench_memcmp, buffer, blocks[b], data[d].Set < 0);
+
+            printf("%-10s %5u %13.2f %13.2f %13.2f\n", data[d].Name, blocks[b], driver, words, compare);
+
+            failed |= driver == 0 || words == 0 || compare == 0;
+        }
+    }
+
+    free(bench_zeros);
+    free(buffer);
+
+    if (failed)
+    {
+        fprintf(stderr, "zero_bench: a check had the wrong result\n");
+    }
+
+    return failed;
+}
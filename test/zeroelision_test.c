@@ -0,0 +1,383 @@
+/*
+    Tests of the elision of the writes of zero blocks.
+    Copyright (C) 2026 The SwapFs contributors.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The zero check of the driver is compared with a check of a byte at a
+    time for each length and alignment up to a few vectors and for each
+    byte of a block. Then with ZeroBlockElision the tests check that
+    writes of zero blocks don't go to the device and reads of them are
+    completed from memory, that a later write of data goes down, that a
+    write of data to a part of an elided block reads back with zeros
+    around it, that a read of some elided blocks is cleared where they
+    are, that the statistics count the bytes, and that threads writing
+    their own sectors of the same elided blocks at once all keep them.
+*/
+
+#include "../sys/src/zeroelision.c"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ntstrsafe.h>
+#include "test.h"
+
+#define TEST_DISK_LENGTH    (32 * 1024 * 1024)
+#define TEST_BLOCK          ZERO_ELISION_BLOCK_SIZE
+#define TEST_THREADS        8
+#define TEST_BLOCKS         64
+
+static ULONG test_number;
+
+static PDEVICE_OBJECT
+test_load (
+    OUT PTEST_DISK *Disk
+    )
+{
+    PDEVICE_OBJECT  device_object;
+    WCHAR           name[64];
+    NTSTATUS        status;
+
+    RtlStringCbPrintfW(name, sizeof(name), L"\\Device\\Harddisk11\\Partition%u", ++test_number);
+
+    *Disk = TestDiskCreate(name, TEST_DISK_LENGTH, 512, NULL);
+
+    TestDiskSetSwapHeader(*Disk);
+
+    WdkClearRegistry();
+
+    TestSetParameter("ZeroBlockElision", 1);
+
+    device_object = TestLoadDriver(*Disk, &status);
+
+    CHECK_STATUS(status, STATUS_SUCCESS);
+
+    return device_object;
+}
+
+/* the offset of a block of the data region */
+
+static LONGLONG
+test_block (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            Block
+    )
+{
+    return ((PDEVICE_EXTENSION) DeviceObject->DeviceExtension)->ZeroElision.Start + (LONGLONG) Block * TEST_BLOCK;
+}
+
+static BOOLEAN
+test_all_zero (
+    IN PUCHAR   Data,
+    IN ULONG    Length
+    )
+{
+    while (Length--)
+    {
+        if (*Data++)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+test_is_zero (void)
+{
+    static UCHAR    data[TEST_BLOCK + 64] __attribute__((aligned(64)));
+    ULONG           alignment, length, n;
+    ULONG           wrong;
+
+    wrong = 0;
+
+    RtlZeroMemory(data, sizeof(data));
+
+    /* every length and alignment up to four cache lines, zero and with each byte set */
+
+    for (alignment = 0; alignment < 16; alignment++)
+    {
+        for (length = 0; length <= 256; length++)
+        {
+            if (!zero_elision_is_zero(data + alignment, length))
+            {
+                wrong++;
+            }
+
+            for (n = 0; n < length; n++)
+            {
+                data[alignment + n] = 0x80;
+
+                if (zero_elision_is_zero(data + alignment, length))
+                {
+                    wrong++;
+                }
+
+                data[alignment + n] = 0;
+            }
+
+            /* the bytes before and after are not looked at */
+
+            data[alignment + length] = 1;
+
+            if (alignment)
+            {
+                data[alignment - 1] = 1;
+            }
+
+            if (!zero_elision_is_zero(data + alignment, length))
+            {
+                wrong++;
+            }
+
+            data[alignment + length] = 0;
+
+            if (alignment)
+            {
+                data[alignment - 1] = 0;
+            }
+        }
+    }
+
+    /* each byte of a block */
+
+    for (n = 0; n < TEST_BLOCK; n++)
+    {
+        data[n] = 1;
+
+        if (zero_elision_is_zero(data, TEST_BLOCK) != test_all_zero(data, TEST_BLOCK))
+        {
+            wrong++;
+        }
+
+        data[n] = 0;
+    }
+
+    CHECK(zero_elision_is_zero(data, TEST_BLOCK));
+    CHECK(wrong == 0);
+}
+
+static void
+test_elided (void)
+{
+    PDEVICE_OBJECT              device_object;
+    PTEST_DISK                  disk;
+    SWAPFS_STATISTICS           statistics;
+    SWAPFS_STATISTICS_REQUEST   request;
+    ULONG_PTR                   information;
+    UCHAR                       data[4 * TEST_BLOCK];
+    UCHAR                       read[4 * TEST_BLOCK];
+    LONGLONG                    offset;
+
+    device_object = test_load(&disk);
+
+    offset = test_block(device_object, 0);
+
+    /* data on the device under the blocks that are elided */
+
+    RtlFillMemory(data, sizeof(data), 0xa5);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, offset, sizeof(data), data);
+
+    request.Flags = SWAPFS_STATISTICS_RESET;
+
+    TestDeviceControl(device_object, IOCTL_SWAPFS_QUERY_STATISTICS, &request, sizeof(request),
+        &statistics, sizeof(statistics), &information);
+
+    TestDiskResetCounts(disk);
+
+    RtlZeroMemory(data, sizeof(data));
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, offset, sizeof(data), data), STATUS_SUCCESS);
+    CHECK(disk->Writes == 0);
+
+    RtlFillMemory(read, sizeof(read), 0xcc);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, offset, sizeof(read), read), STATUS_SUCCESS);
+    CHECK(disk->Reads == 0);
+    CHECK(test_all_zero(read, sizeof(read)));
+
+    /* a write of zeros to a part of a block that is set is elided too */
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, offset + 512, 1024, data), STATUS_SUCCESS);
+    CHECK(disk->Writes == 0);
+
+    /* a read of blocks of which some are set is cleared where they are */
+
+    RtlFillMemory(data, TEST_BLOCK, 0x5a);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, offset + TEST_BLOCK, TEST_BLOCK, data), STATUS_SUCCESS);
+    CHECK(disk->Writes == 1);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, offset, sizeof(read), read), STATUS_SUCCESS);
+    CHECK(disk->Reads == 1);
+    CHECK(test_all_zero(read, TEST_BLOCK));
+    CHECK(memcmp(read + TEST_BLOCK, data, TEST_BLOCK) == 0);
+    CHECK(test_all_zero(read + 2 * TEST_BLOCK, 2 * TEST_BLOCK));
+
+    CHECK_STATUS(TestDeviceControl(device_object, IOCTL_SWAPFS_QUERY_STATISTICS, NULL, 0, &statistics,
+        sizeof(statistics), &information), STATUS_SUCCESS);
+
+    CHECK(statistics.ZeroElisionElided == 4 * TEST_BLOCK + 1024);
+    CHECK(statistics.ZeroElisionWritten == TEST_BLOCK);
+    CHECK(statistics.ZeroElisionRead == 4 * TEST_BLOCK);
+}
+
+static void
+test_partial_write (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    UCHAR           data[TEST_BLOCK];
+    UCHAR           read[TEST_BLOCK];
+    LONGLONG        offset;
+
+    device_object = test_load(&disk);
+
+    offset = test_block(device_object, 3);
+
+    RtlFillMemory(data, sizeof(data), 0xa5);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, offset, sizeof(data), data);
+
+    RtlZeroMemory(data, sizeof(data));
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, offset, sizeof(data), data);
+
+    /* the block is prefilled with zeros over what the device had before the data is written */
+
+    TestDiskResetCounts(disk);
+
+    RtlFillMemory(data, 512, 0x3c);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, offset + 1024, 512, data), STATUS_SUCCESS);
+    CHECK(disk->Writes == 2);
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_READ, offset, sizeof(read), read), STATUS_SUCCESS);
+    CHECK(disk->Reads == 1);
+    CHECK(test_all_zero(read, 1024));
+    CHECK(memcmp(read + 1024, data, 512) == 0);
+    CHECK(test_all_zero(read + 1536, sizeof(read) - 1536));
+
+    /* the block is cleared so the next write goes straight down */
+
+    CHECK_STATUS(TestReadWrite(device_object, IRP_MJ_WRITE, offset + 2048, 512, data), STATUS_SUCCESS);
+    CHECK(disk->Writes == 3);
+}
+
+/* each thread writes its own sector of the same blocks, which are elided with data under them on the device */
+
+typedef struct _TEST_WRITER {
+    pthread_t       Thread;
+    PDEVICE_OBJECT  DeviceObject;
+    ULONG           Index;
+} TEST_WRITER;
+
+static pthread_barrier_t test_barrier;
+
+static void *
+test_writer (
+    void *Context
+    )
+{
+    TEST_WRITER *writer = (TEST_WRITER *) Context;
+    UCHAR       data[512];
+    ULONG       block;
+
+    for (block = 0; block < TEST_BLOCKS; block++)
+    {
+        RtlFillMemory(data, sizeof(data), (UCHAR) (writer->Index + 1));
+
+        pthread_barrier_wait(&test_barrier);
+
+        TestReadWrite(writer->DeviceObject, IRP_MJ_WRITE,
+            test_block(writer->DeviceObject, block) + writer->Index * 512, sizeof(data), data);
+    }
+
+    return NULL;
+}
+
+static void
+test_concurrent_parts (void)
+{
+    PDEVICE_OBJECT  device_object;
+    PTEST_DISK      disk;
+    TEST_WRITER     writer[TEST_THREADS];
+    static UCHAR    data[TEST_BLOCKS * TEST_BLOCK];
+    UCHAR           read[TEST_BLOCK];
+    ULONG           block, n;
+    ULONG           wrong;
+
+    device_object = test_load(&disk);
+
+    RtlFillMemory(data, sizeof(data), 0xee);
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 0), sizeof(data), data);
+
+    RtlZeroMemory(data, sizeof(data));
+
+    TestReadWrite(device_object, IRP_MJ_WRITE, test_block(device_object, 0), sizeof(data), data);
+
+    TestDiskStartThreads(disk, TEST_THREADS);
+
+    pthread_barrier_init(&test_barrier, NULL, TEST_THREADS);
+
+    for (n = 0; n < TEST_THREADS; n++)
+    {
+        writer[n].DeviceObject = device_object;
+        writer[n].Index = n;
+        pthread_create(&writer[n].Thread, NULL, test_writer, &writer[n]);
+    }
+
+    for (n = 0; n < TEST_THREADS; n++)
+    {
+        pthread_join(writer[n].Thread, NULL);
+    }
+
+    pthread_barrier_destroy(&test_barrier);
+
+    for (wrong = 0, block = 0; block < TEST_BLOCKS; block++)
+    {
+        TestReadWrite(device_object, IRP_MJ_READ, test_block(device_object, block), sizeof(read), read);
+
+        for (n = 0; n < TEST_THREADS; n++)
+        {
+            if (read[n * 512] != n + 1 || memcmp(read + n * 512, read + n * 512 + 1, 511))
+            {
+                wrong++;
+            }
+        }
+
+        if (!test_all_zero(read + TEST_THREADS * 512, sizeof(read) - TEST_THREADS * 512))
+        {
+            wrong++;
+        }
+    }
+
+    CHECK(wrong == 0);
+}
+
+int
+main (void)
+{
+    TEST_RUN(test_is_zero);
+    TEST_RUN(test_elided);
+    TEST_RUN(test_partial_write);
+    TEST_RUN(test_concurrent_parts);
+
+    return TestFailures != 0;
+}